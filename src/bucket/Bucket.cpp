@@ -8,6 +8,7 @@
 #include "util/asio.h"
 #include "bucket/Bucket.h"
 #include "bucket/BucketApplicator.h"
+#include "bucket/BucketIndex.h"
 #include "bucket/BucketList.h"
 #include "bucket/BucketManager.h"
 #include "bucket/BucketOutputIterator.h"
@@ -40,6 +41,14 @@ Bucket::Bucket(std::string const& filename, Hash const& hash)
         CLOG(TRACE, "Bucket")
             << "Bucket::Bucket() created, file exists : " << mFilename;
         mSize = fs::size(filename);
+        mBlockCompressed = isBlockCompressedFile(filename);
+        mUncompressedSize = mSize;
+        if (mBlockCompressed)
+        {
+            XDRInputMappedStream in;
+            in.open(filename);
+            mUncompressedSize = in.size();
+        }
     }
 }
 
@@ -65,6 +74,18 @@ Bucket::getSize() const
     return mSize;
 }
 
+size_t
+Bucket::getUncompressedSize() const
+{
+    return mUncompressedSize;
+}
+
+bool
+Bucket::isBlockCompressed() const
+{
+    return mBlockCompressed;
+}
+
 bool
 Bucket::containsBucketIdentity(BucketEntry const& id) const
 {
@@ -81,6 +102,105 @@ Bucket::containsBucketIdentity(BucketEntry const& id) const
     return false;
 }
 
+std::shared_ptr<BucketIndex const>
+Bucket::getIndex() const
+{
+    std::lock_guard<std::mutex> lock(mIndexMutex);
+    if (!mIndex)
+    {
+        auto indexFilename = BucketIndex::indexFilename(mFilename);
+        std::shared_ptr<BucketIndex const> index =
+            BucketIndex::load(indexFilename);
+        if (!index)
+        {
+            CLOG(DEBUG, "Bucket") << "Building index of bucket " << mFilename;
+            auto built = BucketIndex::build(mFilename);
+            try
+            {
+                built->save(indexFilename);
+            }
+            catch (std::exception& e)
+            {
+                CLOG(WARNING, "Bucket") << "Failed to save index of bucket "
+                                        << mFilename << ": " << e.what();
+            }
+            index = std::move(built);
+        }
+        mIndex = index;
+    }
+    return mIndex;
+}
+
+template <typename Stream>
+static std::shared_ptr<BucketEntry>
+findBucketEntry(Stream& in, std::pair<uint64_t, uint64_t> const& range,
+                LedgerKey const& key)
+{
+    in.seek(range.first);
+    LedgerEntryIdCmp cmp;
+    auto entry = std::make_shared<BucketEntry>();
+    while (in.pos() < range.second && in.readOne(*entry))
+    {
+        if (entry->type() == METAENTRY)
+        {
+            continue;
+        }
+        bool before = entry->type() == DEADENTRY
+                          ? cmp(entry->deadEntry(), key)
+                          : cmp(entry->liveEntry().data, key);
+        if (before)
+        {
+            continue;
+        }
+        bool after = entry->type() == DEADENTRY
+                         ? cmp(key, entry->deadEntry())
+                         : cmp(key, entry->liveEntry().data);
+        if (!after)
+        {
+            return entry;
+        }
+        break;
+    }
+    return nullptr;
+}
+
+std::shared_ptr<BucketEntry>
+Bucket::getBucketEntry(LedgerKey const& key) const
+{
+    if (mFilename.empty())
+    {
+        return nullptr;
+    }
+    auto index = getIndex();
+    if (!index->mayContain(key))
+    {
+        return nullptr;
+    }
+    return getBucketEntry(key, *index);
+}
+
+std::shared_ptr<BucketEntry>
+Bucket::getBucketEntry(LedgerKey const& key, BucketIndex const& index) const
+{
+    auto range = index.getRange(key);
+    if (range.first == range.second)
+    {
+        return nullptr;
+    }
+
+    // Offsets are in the uncompressed file, only the mapped stream
+    // uncompresses the block holding them
+    if (mBlockCompressed)
+    {
+        XDRInputMappedStream in;
+        in.open(mFilename);
+        return findBucketEntry(in, range, key);
+    }
+    XDRInputFileStream in;
+    in.open(mFilename);
+    return findBucketEntry(in, range, key);
+}
+
 void
 Bucket::apply(Application& app) const
 {
@@ -146,17 +266,40 @@ Bucket::fresh(BucketManager& bucketManager, uint32_t protocolVersion,
     bool useInit =
         (protocolVersion >= FIRST_PROTOCOL_SUPPORTING_INITENTRY_AND_METAENTRY);
 
+    return fresh(
+        bucketManager, protocolVersion,
+        convertToBucketEntry(useInit, initEntries, liveEntries, deadEntries),
+        countMergeEvents, doFsync);
+}
+
+std::shared_ptr<Bucket>
+Bucket::fresh(BucketManager& bucketManager, uint32_t protocolVersion,
+              std::vector<BucketEntry>&& entries, bool countMergeEvents,
+              bool doFsync)
+{
+    bool useInit =
+        (protocolVersion >= FIRST_PROTOCOL_SUPPORTING_INITENTRY_AND_METAENTRY);
+    assert(std::adjacent_find(entries.begin(), entries.end(),
+                              [](BucketEntry const& lhs,
+                                 BucketEntry const& rhs) {
+                                  return !BucketEntryIdCmp{}(lhs, rhs);
+                              }) == entries.end());
+
     BucketMetadata meta;
     meta.ledgerVersion = protocolVersion;
-    auto entries =
-        convertToBucketEntry(useInit, initEntries, liveEntries, deadEntries);
 
     MergeCounters mc;
     BucketOutputIterator out(bucketManager.getTmpDir(), true, meta, mc,
-                             doFsync);
-    for (auto const& e : entries)
+                             doFsync, bucketManager.compressBucketFiles());
+    for (auto& e : entries)
     {
-        out.put(e);
+        if (!useInit && e.type() == INITENTRY)
+        {
+            auto le = std::move(e.liveEntry());
+            e.type(LIVEENTRY);
+            e.liveEntry() = std::move(le);
+        }
+        out.put(std::move(e));
     }
 
     if (countMergeEvents)
@@ -199,10 +342,27 @@ Bucket::checkProtocolLegality(BucketEntry const& entry,
     }
 }
 
+inline void
+putEntry(BucketOutputIterator& out, BucketEntry const& entry,
+         ByteSlice const* entryXdr)
+{
+    if (entryXdr)
+    {
+        out.put(entry, *entryXdr);
+    }
+    else
+    {
+        out.put(entry);
+    }
+}
+
+// entryXdr is the XDR of entry as it is in its input bucket, if entry comes
+// from one unchanged, so that it is copied rather than encoded again.
 inline void
 maybePut(BucketOutputIterator& out, BucketEntry const& entry,
          std::vector<BucketInputIterator>& shadowIterators,
-         bool keepShadowedLifecycleEntries, MergeCounters& mc)
+         bool keepShadowedLifecycleEntries, MergeCounters& mc,
+         ByteSlice const* entryXdr = nullptr)
 {
     // In ledgers before protocol 11, keepShadowedLifecycleEntries will be
     // `false` and we will drop all shadowed entries here.
@@ -246,7 +406,7 @@ maybePut(BucketOutputIterator& out, BucketEntry const& entry,
         (entry.type() == INITENTRY || entry.type() == DEADENTRY))
     {
         // Never shadow-out entries in this case; no point scanning shadows.
-        out.put(entry);
+        putEntry(out, entry, entryXdr);
         return;
     }
 
@@ -270,7 +430,7 @@ maybePut(BucketOutputIterator& out, BucketEntry const& entry,
         }
     }
     // Nothing shadowed.
-    out.put(entry);
+    putEntry(out, entry, entryXdr);
 }
 
 static void
@@ -432,7 +592,9 @@ mergeCasesWithDefaultAcceptance(
         ++mc.mOldEntriesDefaultAccepted;
         Bucket::checkProtocolLegality(*oi, protocolVersion);
         countOldEntryType(mc, *oi);
-        maybePut(out, *oi, shadowIterators, keepShadowedLifecycleEntries, mc);
+        auto xdr = oi.getEntryXdr();
+        maybePut(out, *oi, shadowIterators, keepShadowedLifecycleEntries, mc,
+                 &xdr);
         ++oi;
         return true;
     }
@@ -447,7 +609,9 @@ mergeCasesWithDefaultAcceptance(
         ++mc.mNewEntriesDefaultAccepted;
         Bucket::checkProtocolLegality(*ni, protocolVersion);
         countNewEntryType(mc, *ni);
-        maybePut(out, *ni, shadowIterators, keepShadowedLifecycleEntries, mc);
+        auto xdr = ni.getEntryXdr();
+        maybePut(out, *ni, shadowIterators, keepShadowedLifecycleEntries, mc,
+                 &xdr);
         ++ni;
         return true;
     }
@@ -577,19 +741,99 @@ mergeCasesWithEqualKeys(MergeCounters& mc, BucketInputIterator& oi,
     {
         // Neither is in INIT state, take the newer one.
         ++mc.mNewEntriesMergedWithOldNeitherInit;
+        auto xdr = ni.getEntryXdr();
         maybePut(out, newEntry, shadowIterators, keepShadowedLifecycleEntries,
-                 mc);
+                 mc, &xdr);
     }
     ++oi;
     ++ni;
 }
 
+static void
+mergeEntries(MergeCounters& mc, BucketInputIterator& oi,
+             BucketInputIterator& ni, BucketOutputIterator& out,
+             std::vector<BucketInputIterator>& shadowIterators,
+             uint32_t protocolVersion, bool keepShadowedLifecycleEntries)
+{
+    BucketEntryIdCmp cmp;
+    while (oi || ni)
+    {
+        if (!mergeCasesWithDefaultAcceptance(cmp, mc, oi, ni, out,
+                                             shadowIterators, protocolVersion,
+                                             keepShadowedLifecycleEntries))
+        {
+            mergeCasesWithEqualKeys(mc, oi, ni, out, shadowIterators,
+                                    protocolVersion,
+                                    keepShadowedLifecycleEntries);
+        }
+    }
+}
+
+// Merges the entries of every range of keys between splitKeys on its own
+// thread, the first one into out and the others into continuations of out,
+// which are then appended to it in order. Ranges partition the keys, so out
+// ends up with the same entries as in a sequential merge.
+static void
+mergeInRanges(BucketManager& bucketManager, MergeCounters& mc,
+              std::shared_ptr<Bucket> const& oldBucket,
+              std::shared_ptr<Bucket> const& newBucket,
+              BucketInputIterator& oi, BucketInputIterator& ni,
+              BucketOutputIterator& out,
+              std::vector<LedgerKey> const& splitKeys,
+              uint32_t protocolVersion, bool keepShadowedLifecycleEntries)
+{
+    size_t nRanges = splitKeys.size() + 1;
+    std::vector<MergeCounters> counters(nRanges - 1);
+    std::vector<std::unique_ptr<BucketOutputIterator>> continuations;
+    for (size_t i = 1; i < nRanges; ++i)
+    {
+        continuations.emplace_back(std::make_unique<BucketOutputIterator>(
+            bucketManager.getTmpDir(), out, counters[i - 1]));
+    }
+
+    // Declared last so that, should anything throw, pending merges are
+    // waited for before what they use goes away
+    std::vector<std::future<void>> merges;
+    for (size_t i = 1; i < nRanges; ++i)
+    {
+        merges.emplace_back(std::async(std::launch::async, [&, i]() {
+            BucketInputIterator rangeOi(oldBucket);
+            BucketInputIterator rangeNi(newBucket);
+            for (auto in : {&rangeOi, &rangeNi})
+            {
+                in->seek(splitKeys[i - 1]);
+                if (i < splitKeys.size())
+                {
+                    in->setEnd(splitKeys[i]);
+                }
+            }
+            std::vector<BucketInputIterator> noShadows;
+            mergeEntries(counters[i - 1], rangeOi, rangeNi,
+                         *continuations[i - 1], noShadows, protocolVersion,
+                         keepShadowedLifecycleEntries);
+        }));
+    }
+
+    oi.setEnd(splitKeys.front());
+    ni.setEnd(splitKeys.front());
+    std::vector<BucketInputIterator> noShadows;
+    mergeEntries(mc, oi, ni, out, noShadows, protocolVersion,
+                 keepShadowedLifecycleEntries);
+    for (size_t i = 1; i < nRanges; ++i)
+    {
+        merges[i - 1].get();
+        out.append(*continuations[i - 1]);
+        mc += counters[i - 1];
+    }
+}
+
 std::shared_ptr<Bucket>
 Bucket::merge(BucketManager& bucketManager, uint32_t maxProtocolVersion,
               std::shared_ptr<Bucket> const& oldBucket,
               std::shared_ptr<Bucket> const& newBucket,
               std::vector<std::shared_ptr<Bucket>> const& shadows,
-              bool keepDeadEntries, bool countMergeEvents, bool doFsync)
+              bool keepDeadEntries, bool countMergeEvents, bool doFsync,
+              uint32_t nThreads)
 {
     // This is the key operation in the scheme: merging two (read-only)
     // buckets together into a new 3rd bucket, while calculating its hash,
@@ -614,20 +858,33 @@ Bucket::merge(BucketManager& bucketManager, uint32_t maxProtocolVersion,
     BucketMetadata meta;
     meta.ledgerVersion = protocolVersion;
     BucketOutputIterator out(bucketManager.getTmpDir(), keepDeadEntries, meta,
-                             mc, doFsync);
+                             mc, doFsync, bucketManager.compressBucketFiles());
 
-    BucketEntryIdCmp cmp;
-    while (oi || ni)
+    // Ranges are split along the pages of the larger input. Shadows would
+    // have to be split as well, merges with shadows stay sequential.
+    std::vector<LedgerKey> splitKeys;
+    if (nThreads > 1 && shadows.empty())
     {
-        if (!mergeCasesWithDefaultAcceptance(cmp, mc, oi, ni, out,
-                                             shadowIterators, protocolVersion,
-                                             keepShadowedLifecycleEntries))
+        auto const& larger = oldBucket->getUncompressedSize() >=
+                                     newBucket->getUncompressedSize()
+                                 ? oldBucket
+                                 : newBucket;
+        if (!larger->getFilename().empty())
         {
-            mergeCasesWithEqualKeys(mc, oi, ni, out, shadowIterators,
-                                    protocolVersion,
-                                    keepShadowedLifecycleEntries);
+            splitKeys = larger->getIndex()->getSplitKeys(nThreads);
         }
     }
+    if (splitKeys.empty())
+    {
+        mergeEntries(mc, oi, ni, out, shadowIterators, protocolVersion,
+                     keepShadowedLifecycleEntries);
+    }
+    else
+    {
+        mergeInRanges(bucketManager, mc, oldBucket, newBucket, oi, ni, out,
+                      splitKeys, protocolVersion,
+                      keepShadowedLifecycleEntries);
+    }
     if (countMergeEvents)
     {
         bucketManager.incrMergeCounters(mc);
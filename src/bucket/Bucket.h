@@ -9,6 +9,8 @@
 #include "overlay/StellarXDR.h"
 #include "util/NonCopyable.h"
 #include "util/XDRStream.h"
+#include <memory>
+#include <mutex>
 #include <string>
 
 namespace stellar
@@ -26,6 +28,7 @@ namespace stellar
  */
 
 class Application;
+class BucketIndex;
 class BucketManager;
 class BucketList;
 class Database;
@@ -37,6 +40,13 @@ class Bucket : public std::enable_shared_from_this<Bucket>,
     std::string const mFilename;
     Hash const mHash;
     size_t mSize{0};
+    size_t mUncompressedSize{0};
+    bool mBlockCompressed{false};
+
+    // Derived from the bucket file and loaded or built on first use, which
+    // does not change the bucket itself.
+    mutable std::mutex mIndexMutex;
+    mutable std::shared_ptr<BucketIndex const> mIndex;
 
   public:
     // Create an empty bucket. The empty bucket has hash '000000...' and its
@@ -50,12 +60,36 @@ class Bucket : public std::enable_shared_from_this<Bucket>,
 
     Hash const& getHash() const;
     std::string const& getFilename() const;
+    // Size of the bucket file, compressed if it is block-compressed.
     size_t getSize() const;
 
+    // Size of the entries of the bucket as they would be in an uncompressed
+    // file, which is what merging or applying the bucket costs, and the range
+    // of the positions of its BucketInputIterators.
+    size_t getUncompressedSize() const;
+
+    // Whether the bucket file is block-compressed, in which case getSize is
+    // the size of the compressed file.
+    bool isBlockCompressed() const;
+
     // Returns true if a BucketEntry that is key-wise identical to the given
     // BucketEntry exists in the bucket. For testing.
     bool containsBucketIdentity(BucketEntry const& id) const;
 
+    // Returns the key index of the bucket, loading it from the file next to
+    // the bucket, or building it from the bucket if there is none.
+    std::shared_ptr<BucketIndex const> getIndex() const;
+
+    // Returns the entry of the bucket with the given key, which may be a
+    // DEADENTRY, or nullptr if the bucket has no such entry. Reads at most
+    // one page of the bucket file, and none if the filter rules the key out.
+    std::shared_ptr<BucketEntry> getBucketEntry(LedgerKey const& key) const;
+
+    // Same as getBucketEntry, for callers that already hold the index of the
+    // bucket and have checked that its filter lets the key through.
+    std::shared_ptr<BucketEntry> getBucketEntry(LedgerKey const& key,
+                                                BucketIndex const& index) const;
+
     // At version 11, we added support for INITENTRY and METAENTRY. Before this
     // we were only supporting LIVEENTRY and DEADENTRY.
     static constexpr uint32_t
@@ -87,6 +121,14 @@ class Bucket : public std::enable_shared_from_this<Bucket>,
           std::vector<LedgerKey> const& deadEntries, bool countMergeEvents,
           bool doFsync);
 
+    // Create a fresh bucket from entries, which must be sorted by key with no
+    // two entries for the same key, moving them into the bucket. INITENTRYs
+    // become LIVEENTRYs in protocols that do not support them.
+    static std::shared_ptr<Bucket>
+    fresh(BucketManager& bucketManager, uint32_t protocolVersion,
+          std::vector<BucketEntry>&& entries, bool countMergeEvents,
+          bool doFsync);
+
     // Merge two buckets together, producing a fresh one. Entries in `oldBucket`
     // are overridden in the fresh bucket by keywise-equal entries in
     // `newBucket`. Entries are inhibited from the fresh bucket by keywise-equal
@@ -98,12 +140,16 @@ class Bucket : public std::enable_shared_from_this<Bucket>,
     // `maxProtocolVersion` bounds this (for error checking) and should usually
     // be the protocol of the ledger header at which the merge is starting. An
     // exception will be thrown if any provided bucket versions exceed it.
+    //
+    // Merges without shadows may be split into up to `nThreads` ranges of
+    // keys merged concurrently; the fresh bucket is the same either way.
     static std::shared_ptr<Bucket>
     merge(BucketManager& bucketManager, uint32_t maxProtocolVersion,
           std::shared_ptr<Bucket> const& oldBucket,
           std::shared_ptr<Bucket> const& newBucket,
           std::vector<std::shared_ptr<Bucket>> const& shadows,
-          bool keepDeadEntries, bool countMergeEvents, bool doFsync);
+          bool keepDeadEntries, bool countMergeEvents, bool doFsync,
+          uint32_t nThreads = 1);
 
     static uint32_t getBucketVersion(std::shared_ptr<Bucket> const& bucket);
 };
@@ -18,7 +18,10 @@ namespace stellar
 BucketApplicator::BucketApplicator(Application& app,
                                    uint32_t maxProtocolVersion,
                                    std::shared_ptr<const Bucket> bucket)
-    : mApp(app), mMaxProtocolVersion(maxProtocolVersion), mBucketIter(bucket)
+    : mApp(app)
+    , mMaxProtocolVersion(maxProtocolVersion)
+    , mBucketIter(bucket)
+    , mThreads(app.getConfig().BUCKET_APPLY_THREADS)
 {
     auto protocolVersion = mBucketIter.getMetadata().ledgerVersion;
     if (protocolVersion > mMaxProtocolVersion)
@@ -49,6 +52,37 @@ BucketApplicator::size() const
 size_t
 BucketApplicator::advance(BucketApplicator::Counters& counters)
 {
+    if (mThreads > 1)
+    {
+        LedgerEntryWrites entries;
+        size_t const batchSize = LEDGER_ENTRY_BATCH_COMMIT_SIZE * mThreads;
+        entries.reserve(batchSize);
+        for (; mBucketIter && entries.size() < batchSize; ++mBucketIter)
+        {
+            BucketEntry const& e = *mBucketIter;
+            Bucket::checkProtocolLegality(e, mMaxProtocolVersion);
+            counters.mark(e);
+            if (e.type() == LIVEENTRY || e.type() == INITENTRY)
+            {
+                entries.emplace_back(
+                    LedgerEntryKey(e.liveEntry()),
+                    std::make_shared<LedgerEntry const>(e.liveEntry()));
+            }
+            else
+            {
+                if (e.type() != DEADENTRY)
+                {
+                    throw std::runtime_error("Malformed bucket: unexpected "
+                                             "non-INIT/LIVE/DEAD entry.");
+                }
+                entries.emplace_back(e.deadEntry(), nullptr);
+            }
+        }
+        mApp.getLedgerTxnRoot().writeInParallel(entries, mThreads);
+        mCount += entries.size();
+        return entries.size();
+    }
+
     size_t count = 0;
 
     LedgerTxn ltx(mApp.getLedgerTxnRoot(), false);
@@ -126,6 +160,16 @@ BucketApplicator::Counters::getRates(VirtualClock::time_point now,
     T_sec = (total * 1000000) / usecs;
 }
 
+uint64_t
+BucketApplicator::Counters::entriesPerSecond(VirtualClock::time_point now)
+{
+    uint64_t au_sec, ad_sec, tu_sec, td_sec, ou_sec, od_sec, du_sec, dd_sec,
+        T_sec, total;
+    getRates(now, au_sec, ad_sec, tu_sec, td_sec, ou_sec, od_sec, du_sec,
+             dd_sec, T_sec, total);
+    return T_sec;
+}
+
 void
 BucketApplicator::Counters::logInfo(std::string const& bucketName,
                                     uint32_t level,
@@ -25,6 +25,7 @@ class BucketApplicator
     uint32_t mMaxProtocolVersion;
     BucketInputIterator mBucketIter;
     size_t mCount{0};
+    uint32_t const mThreads;
 
   public:
     class Counters
@@ -51,12 +52,19 @@ class BucketApplicator
         Counters(VirtualClock::time_point now);
         void reset(VirtualClock::time_point now);
         void mark(BucketEntry const& e);
+        // Entries marked per second since the counters were reset
+        uint64_t entriesPerSecond(VirtualClock::time_point now);
         void logInfo(std::string const& bucketName, uint32_t level,
                      VirtualClock::time_point now);
         void logDebug(std::string const& bucketName, uint32_t level,
                       VirtualClock::time_point now);
     };
 
+    // With BUCKET_APPLY_THREADS above 1, every advance writes a batch of
+    // entries that many times larger, split among that many database
+    // connections. The entries of a bucket have unique keys, and advance
+    // returns once they are all written, so applying buckets one after the
+    // other, oldest first, still leaves the newest version of every entry.
     BucketApplicator(Application& app, uint32_t maxProtocolVersion,
                      std::shared_ptr<const Bucket> bucket);
     operator bool() const;
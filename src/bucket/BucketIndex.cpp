@@ -0,0 +1,266 @@
+// Copyright 2020 Stellar Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "bucket/BucketIndex.h"
+#include "bucket/LedgerCmp.h"
+#include "crypto/Random.h"
+#include "crypto/XDRHasher.h"
+#include "util/Fs.h"
+#include "util/Logging.h"
+#include "util/XDRStream.h"
+#include "util/siphash.h"
+#include "util/types.h"
+
+#include <algorithm>
+#include <cassert>
+#include <limits>
+
+namespace stellar
+{
+
+uint64_t const BucketIndex::PAGE_BYTES;
+
+namespace
+{
+struct KeyHasher : XDRHasher<KeyHasher>
+{
+    SipHash24 mState;
+
+    explicit KeyHasher(uint8_t const key[16]) : mState(key)
+    {
+    }
+
+    void
+    hashBytes(unsigned char const* bytes, size_t len)
+    {
+        mState.update(bytes, len);
+    }
+};
+}
+
+static LedgerKey
+bucketEntryKey(BucketEntry const& entry)
+{
+    return entry.type() == DEADENTRY ? entry.deadEntry()
+                                     : LedgerEntryKey(entry.liveEntry());
+}
+
+BucketIndex::BucketIndex()
+{
+    auto bytes = randomBytes(mHashKey.size());
+    std::copy(bytes.begin(), bytes.end(), mHashKey.begin());
+}
+
+BucketIndex::BucketIndex(std::array<uint8_t, 16> const& hashKey)
+    : mHashKey(hashKey)
+{
+}
+
+uint64_t
+BucketIndex::hashKey(LedgerKey const& key) const
+{
+    KeyHasher hasher(mHashKey.data());
+    xdr::archive(hasher, key);
+    hasher.flush();
+    return hasher.mState.digest();
+}
+
+void
+BucketIndex::add(BucketEntry const& entry, uint64_t offset)
+{
+    if (entry.type() == METAENTRY)
+    {
+        return;
+    }
+    auto key = bucketEntryKey(entry);
+    mKeyHashes.emplace_back(hashKey(key));
+    if (mOffsets.empty() || offset / PAGE_BYTES != mOffsets.back() / PAGE_BYTES)
+    {
+        mKeys.emplace_back(std::move(key));
+        mOffsets.emplace_back(offset);
+    }
+}
+
+void
+BucketIndex::append(BucketIndex& other, uint64_t offset)
+{
+    assert(mHashKey == other.mHashKey);
+    assert(!mFilter && !other.mFilter);
+    assert(mOffsets.empty() || mOffsets.back() < offset);
+    mKeys.insert(mKeys.end(), std::make_move_iterator(other.mKeys.begin()),
+                 std::make_move_iterator(other.mKeys.end()));
+    for (auto o : other.mOffsets)
+    {
+        mOffsets.emplace_back(o + offset);
+    }
+    mKeyHashes.insert(mKeyHashes.end(), other.mKeyHashes.begin(),
+                      other.mKeyHashes.end());
+    other.mKeys.clear();
+    other.mOffsets.clear();
+    other.mKeyHashes.clear();
+}
+
+void
+BucketIndex::finish()
+{
+    mFilter = std::make_unique<KeyFilter>(mKeyHashes.size());
+    for (auto h : mKeyHashes)
+    {
+        mFilter->add(h);
+    }
+    std::vector<uint64_t>().swap(mKeyHashes);
+}
+
+bool
+BucketIndex::mayContain(LedgerKey const& key) const
+{
+    return !mFilter || mFilter->mayContain(hashKey(key));
+}
+
+size_t
+BucketIndex::filterBytes() const
+{
+    return mFilter ? mFilter->bitCount() / 8 : 0;
+}
+
+double
+BucketIndex::filterFalsePositiveRate() const
+{
+    return mFilter ? mFilter->falsePositiveRate() : 1.0;
+}
+
+std::pair<uint64_t, uint64_t>
+BucketIndex::getRange(LedgerKey const& key) const
+{
+    // The last page starting with a key not greater than key
+    auto iter = std::upper_bound(mKeys.begin(), mKeys.end(), key,
+                                 LedgerEntryIdCmp{});
+    if (iter == mKeys.begin())
+    {
+        return {0, 0};
+    }
+    auto i = static_cast<size_t>(iter - mKeys.begin()) - 1;
+    auto end = i + 1 < mOffsets.size() ? mOffsets[i + 1]
+                                       : std::numeric_limits<uint64_t>::max();
+    return {mOffsets[i], end};
+}
+
+std::vector<LedgerKey>
+BucketIndex::getSplitKeys(size_t n) const
+{
+    std::vector<LedgerKey> res;
+    size_t last = 0;
+    for (size_t i = 1; i < n; ++i)
+    {
+        // Pages start with increasing keys, the first key of the bucket
+        // splits nothing
+        size_t page = i * mKeys.size() / n;
+        if (page > last)
+        {
+            res.emplace_back(mKeys[page]);
+            last = page;
+        }
+    }
+    return res;
+}
+
+std::string
+BucketIndex::indexFilename(std::string const& bucketFilename)
+{
+    return bucketFilename + ".index";
+}
+
+void
+BucketIndex::save(std::string const& filename) const
+{
+    assert(mFilter);
+
+    // The page size goes first, so that indexes built with another page size
+    // are rebuilt rather than misread
+    xdr::xvector<LedgerKey> keys(mKeys.begin(), mKeys.end());
+    xdr::xvector<uint64_t> offsets;
+    offsets.reserve(mOffsets.size() + 1);
+    offsets.emplace_back(PAGE_BYTES);
+    offsets.insert(offsets.end(), mOffsets.begin(), mOffsets.end());
+
+    // The filter as the hash key, the number of keys and the words
+    xdr::opaque_array<16> hashKey;
+    std::copy(mHashKey.begin(), mHashKey.end(), hashKey.begin());
+    xdr::xvector<uint64_t> filter;
+    filter.reserve(mFilter->words().size() + 1);
+    filter.emplace_back(mFilter->additions());
+    filter.insert(filter.end(), mFilter->words().begin(),
+                  mFilter->words().end());
+
+    XDROutputFileStream out(/*fsyncOnClose=*/false);
+    out.open(filename);
+    out.writeOne(keys);
+    out.writeOne(offsets);
+    out.writeOne(hashKey);
+    out.writeOne(filter);
+    out.close();
+}
+
+std::unique_ptr<BucketIndex>
+BucketIndex::load(std::string const& filename)
+{
+    if (!fs::exists(filename))
+    {
+        return nullptr;
+    }
+
+    xdr::xvector<LedgerKey> keys;
+    xdr::xvector<uint64_t> offsets;
+    xdr::opaque_array<16> hashKey;
+    xdr::xvector<uint64_t> filter;
+    try
+    {
+        XDRInputFileStream in;
+        in.open(filename);
+        if (!in.readOne(keys) || !in.readOne(offsets) ||
+            !in.readOne(hashKey) || !in.readOne(filter))
+        {
+            return nullptr;
+        }
+        if (offsets.empty() || offsets[0] != PAGE_BYTES ||
+            offsets.size() != keys.size() + 1 || filter.empty())
+        {
+            return nullptr;
+        }
+
+        auto index = std::make_unique<BucketIndex>();
+        index->mKeys.assign(std::make_move_iterator(keys.begin()),
+                            std::make_move_iterator(keys.end()));
+        index->mOffsets.assign(offsets.begin() + 1, offsets.end());
+        std::copy(hashKey.begin(), hashKey.end(), index->mHashKey.begin());
+        index->mFilter = std::make_unique<KeyFilter>(
+            std::vector<uint64_t>(filter.begin() + 1, filter.end()),
+            filter[0]);
+        return index;
+    }
+    catch (std::exception& e)
+    {
+        CLOG(WARNING, "Bucket")
+            << "Ignoring bucket index " << filename << ": " << e.what();
+        return nullptr;
+    }
+}
+
+std::unique_ptr<BucketIndex>
+BucketIndex::build(std::string const& bucketFilename)
+{
+    auto index = std::make_unique<BucketIndex>();
+    XDRInputMappedStream in;
+    in.open(bucketFilename);
+    BucketEntry entry;
+    uint64_t offset = 0;
+    while (in.readOne(entry))
+    {
+        index->add(entry, offset);
+        offset = in.pos();
+    }
+    index->finish();
+    return index;
+}
+}
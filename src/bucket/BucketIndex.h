@@ -0,0 +1,120 @@
+#pragma once
+
+// Copyright 2020 Stellar Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "util/BloomFilter.h"
+#include "util/NonCopyable.h"
+#include "xdr/Stellar-ledger.h"
+
+#include <array>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace stellar
+{
+
+// A sparse index of the keys of a bucket file: the key and offset of the
+// first entry starting in every page of PAGE_BYTES bytes of the file, in file
+// order. Looking a key up in the bucket then reads the entries of at most one
+// page.
+//
+// The index also holds a Bloom filter of all the keys of the bucket, so that
+// looking up a key that is not in the bucket rarely reads it at all. Keys are
+// hashed with SipHash under a random key of the index, which is stored with
+// it: unlike shortHash, this stays valid across restarts.
+//
+// Indexes are built while buckets are written, see BucketOutputIterator, and
+// stored next to their bucket in a file named by indexFilename; those of
+// buckets obtained otherwise are built from the bucket file when first needed.
+class BucketIndex : public NonMovableOrCopyable
+{
+    // Keys are hashed before being added to the filter
+    struct IdentityHash
+    {
+        size_t
+        operator()(uint64_t h) const
+        {
+            return static_cast<size_t>(h);
+        }
+    };
+    typedef BloomFilter<uint64_t, IdentityHash> KeyFilter;
+
+    std::vector<LedgerKey> mKeys;
+    std::vector<uint64_t> mOffsets;
+    std::array<uint8_t, 16> mHashKey;
+    std::unique_ptr<KeyFilter> mFilter;
+    // Hashes of the keys added until finish sizes the filter for them
+    std::vector<uint64_t> mKeyHashes;
+
+    uint64_t hashKey(LedgerKey const& key) const;
+
+  public:
+    static uint64_t const PAGE_BYTES = 16384;
+
+    BucketIndex();
+
+    // Creates an index whose keys are hashed like those of another, so that
+    // the two can be joined with append.
+    explicit BucketIndex(std::array<uint8_t, 16> const& hashKey);
+
+    std::array<uint8_t, 16> const&
+    getHashKey() const
+    {
+        return mHashKey;
+    }
+
+    // Called for every entry of the bucket, in order, with the offset of the
+    // entry in the bucket file.
+    void add(BucketEntry const& entry, uint64_t offset);
+
+    // Adds the entries of the index of a file that was appended to this
+    // bucket at offset, moving them out of other. Both must share their hash
+    // key and neither may be finished.
+    //
+    // other starts its pages at its own first entry rather than on a
+    // multiple of PAGE_BYTES in this bucket, so a joined index may have more
+    // pages, some shorter, than one built from the whole file: it is denser,
+    // but just as valid.
+    void append(BucketIndex& other, uint64_t offset);
+
+    // Called after the last add, builds the filter.
+    void finish();
+
+    // False if the bucket has no entry with key, true if it may have one.
+    bool mayContain(LedgerKey const& key) const;
+
+    // The range of offsets in the bucket file where an entry with key may be,
+    // as [begin, end). end is UINT64_MAX if the range extends to the end of
+    // the file, begin is equal to end if there can be no such entry.
+    std::pair<uint64_t, uint64_t> getRange(LedgerKey const& key) const;
+
+    // Returns up to n - 1 increasing keys that split the bucket into n ranges
+    // of about as many pages each, fewer if it has fewer pages.
+    std::vector<LedgerKey> getSplitKeys(size_t n) const;
+
+    size_t
+    size() const
+    {
+        return mKeys.size();
+    }
+
+    size_t filterBytes() const;
+
+    // Estimated probability that mayContain is true for a key that is not in
+    // the bucket.
+    double filterFalsePositiveRate() const;
+
+    static std::string indexFilename(std::string const& bucketFilename);
+
+    void save(std::string const& filename) const;
+
+    // Returns nullptr if filename does not hold a valid index
+    static std::unique_ptr<BucketIndex> load(std::string const& filename);
+
+    static std::unique_ptr<BucketIndex>
+    build(std::string const& bucketFilename);
+};
+}
@@ -4,9 +4,21 @@
 
 #include "bucket/BucketInputIterator.h"
 #include "bucket/Bucket.h"
+#include "bucket/BucketIndex.h"
+
+#include <cassert>
 
 namespace stellar
 {
+
+static bool
+keyLess(BucketEntry const& entry, LedgerKey const& key)
+{
+    LedgerEntryIdCmp cmp;
+    return entry.type() == DEADENTRY ? cmp(entry.deadEntry(), key)
+                                     : cmp(entry.liveEntry().data, key);
+}
+
 /**
  * Helper class that reads from the file underlying a bucket, keeping the bucket
  * alive for the duration of its existence.
@@ -14,8 +26,10 @@ namespace stellar
 void
 BucketInputIterator::loadEntry()
 {
-    if (mIn.readOne(mEntry))
+    if (mIn.readOneXdr(mEntryXdr, mEntryXdrSize))
     {
+        xdr::xdr_get g(mEntryXdr, mEntryXdr + mEntryXdrSize);
+        xdr::xdr_argpack_archive(g, mEntry);
         mEntryPtr = &mEntry;
         if (mEntry.type() == METAENTRY)
         {
@@ -42,6 +56,10 @@ BucketInputIterator::loadEntry()
             {
                 Bucket::checkProtocolLegality(mEntry, mMetadata.ledgerVersion);
             }
+            if (mEnd && !keyLess(mEntry, *mEnd))
+            {
+                mEntryPtr = nullptr;
+            }
         }
     }
     else
@@ -72,6 +90,13 @@ BucketEntry const& BucketInputIterator::operator*()
     return *mEntryPtr;
 }
 
+ByteSlice
+BucketInputIterator::getEntryXdr() const
+{
+    assert(mEntryPtr);
+    return ByteSlice(mEntryXdr, mEntryXdrSize);
+}
+
 bool
 BucketInputIterator::seenMetadata() const
 {
@@ -110,7 +135,7 @@ BucketInputIterator::~BucketInputIterator()
 
 BucketInputIterator& BucketInputIterator::operator++()
 {
-    if (mIn)
+    if (mIn && mEntryPtr)
     {
         loadEntry();
     }
@@ -120,4 +145,35 @@ BucketInputIterator& BucketInputIterator::operator++()
     }
     return *this;
 }
+
+void
+BucketInputIterator::seek(LedgerKey const& key)
+{
+    if (!mEntryPtr || !keyLess(*mEntryPtr, key))
+    {
+        return;
+    }
+    // The page that may hold key starts at an entry; if it is past the
+    // current one, jump to it
+    auto range = mBucket->getIndex()->getRange(key);
+    if (range.first != range.second && range.first >= mIn.pos())
+    {
+        mIn.seek(range.first);
+        loadEntry();
+    }
+    while (mEntryPtr && keyLess(*mEntryPtr, key))
+    {
+        ++(*this);
+    }
+}
+
+void
+BucketInputIterator::setEnd(LedgerKey const& key)
+{
+    mEnd = std::make_unique<LedgerKey>(key);
+    if (mEntryPtr && !keyLess(*mEntryPtr, key))
+    {
+        mEntryPtr = nullptr;
+    }
+}
 }
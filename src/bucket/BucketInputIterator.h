@@ -5,6 +5,7 @@
 // of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
 
 #include "bucket/LedgerCmp.h"
+#include "crypto/ByteSlice.h"
 #include "util/XDRStream.h"
 #include "xdr/Stellar-ledger.h"
 
@@ -24,11 +25,16 @@ class BucketInputIterator
     // pointer. If
     // non-null, it points to mEntry.
     BucketEntry const* mEntryPtr{nullptr};
-    XDRInputFileStream mIn;
+    XDRInputMappedStream mIn;
     BucketEntry mEntry;
+    uint8_t const* mEntryXdr{nullptr};
+    size_t mEntryXdrSize{0};
     bool mSeenMetadata{false};
     bool mSeenOtherEntries{false};
     BucketMetadata mMetadata;
+    // If set, the iterator ends before the first entry with a key not less
+    // than *mEnd
+    std::unique_ptr<LedgerKey> mEnd;
     void loadEntry();
 
   public:
@@ -46,12 +52,25 @@ class BucketInputIterator
 
     BucketEntry const& operator*();
 
+    // The XDR of the current entry as it is in the bucket file, for callers
+    // that copy or hash the entry as is. Valid until the iterator is
+    // advanced: the block of a block-compressed bucket holding it is then
+    // replaced by the next one, so callers must copy it before operator++.
+    ByteSlice getEntryXdr() const;
+
     BucketInputIterator(std::shared_ptr<Bucket const> bucket);
 
     ~BucketInputIterator();
 
     BucketInputIterator& operator++();
 
+    // Moves the iterator forward to the first entry with a key not less than
+    // key, using the index of the bucket to skip most of those before it.
+    void seek(LedgerKey const& key);
+
+    // Ends the iterator before the first entry with a key not less than key.
+    void setEnd(LedgerKey const& key);
+
     size_t pos();
     size_t size() const;
 };
@@ -9,7 +9,11 @@
 #include "crypto/Hex.h"
 #include "crypto/Random.h"
 #include "crypto/SHA.h"
+#include "bucket/BucketIndex.h"
 #include "main/Application.h"
+#include "medida/counter.h"
+#include "medida/meter.h"
+#include "medida/metrics_registry.h"
 #include "util/Logging.h"
 #include "util/XDRStream.h"
 #include "util/format.h"
@@ -70,12 +74,39 @@ BucketLevel::setCurr(std::shared_ptr<Bucket> b)
 {
     mNextCurr.clear();
     mCurr = b;
+    updateFilterBytes();
 }
 
 void
 BucketLevel::setSnap(std::shared_ptr<Bucket> b)
 {
     mSnap = b;
+    updateFilterBytes();
+}
+
+void
+BucketLevel::setFilterBytesCounter(medida::Counter* counter)
+{
+    mFilterBytes = counter;
+    updateFilterBytes();
+}
+
+void
+BucketLevel::updateFilterBytes()
+{
+    if (!mFilterBytes)
+    {
+        return;
+    }
+    size_t filterBytes = 0;
+    for (auto const& bucket : {mCurr, mSnap})
+    {
+        if (!bucket->getFilename().empty())
+        {
+            filterBytes += bucket->getIndex()->filterBytes();
+        }
+    }
+    mFilterBytes->set_count(filterBytes);
 }
 
 void
@@ -169,6 +200,7 @@ BucketLevel::snap()
 {
     mSnap = mCurr;
     mCurr = std::make_shared<Bucket>();
+    updateFilterBytes();
     // CLOG(DEBUG, "Bucket") << "level " << mLevel << " set mSnap to "
     //            << mSnap->getEntries().size() << " elements";
     // CLOG(DEBUG, "Bucket") << "level " << mLevel << " reset mCurr to "
@@ -364,6 +396,67 @@ BucketList::getHash() const
     return hsh->finish();
 }
 
+BucketLookupMetrics::BucketLookupMetrics(Application& app)
+{
+    for (uint32_t i = 0; i < BucketList::kNumLevels; ++i)
+    {
+        auto level = "level-" + std::to_string(i);
+        mFilterSkip.emplace_back(&app.getMetrics().NewMeter(
+            {"bucket", "filter-skip", level}, "lookup"));
+        mFilterFalsePositive.emplace_back(&app.getMetrics().NewMeter(
+            {"bucket", "filter-false-positive", level}, "lookup"));
+        mFilterBytes.emplace_back(
+            &app.getMetrics().NewCounter({"bucket", "filter-bytes", level}));
+    }
+}
+
+std::shared_ptr<LedgerEntry>
+BucketList::getLedgerEntry(LedgerKey const& key,
+                           BucketLookupMetrics* metrics) const
+{
+    for (uint32_t i = 0; i < mLevels.size(); ++i)
+    {
+        auto const& lev = mLevels[i];
+        bool measure = metrics && i < metrics->mFilterSkip.size();
+        std::shared_ptr<BucketEntry> entry;
+        for (auto const& bucket : {lev.getCurr(), lev.getSnap()})
+        {
+            if (bucket->getFilename().empty())
+            {
+                continue;
+            }
+            auto index = bucket->getIndex();
+            if (!index->mayContain(key))
+            {
+                if (measure)
+                {
+                    metrics->mFilterSkip[i]->Mark();
+                }
+                continue;
+            }
+            entry = bucket->getBucketEntry(key, *index);
+            if (entry)
+            {
+                break;
+            }
+            if (measure)
+            {
+                metrics->mFilterFalsePositive[i]->Mark();
+            }
+        }
+        if (!entry)
+        {
+            continue;
+        }
+        if (entry->type() == DEADENTRY)
+        {
+            return nullptr;
+        }
+        return std::make_shared<LedgerEntry>(entry->liveEntry());
+    }
+    return nullptr;
+}
+
 // levelShouldSpill is the set of boundaries at which each level should spill,
 // it's not-entirely obvious which numbers these are by inspection, so we list
 // the first 3 values it's true on each level here for reference:
@@ -414,6 +507,16 @@ BucketList::getLevel(uint32_t i)
     return mLevels.at(i);
 }
 
+void
+BucketList::setLookupMetrics(BucketLookupMetrics const& metrics)
+{
+    for (uint32_t i = 0; i < mLevels.size() && i < metrics.mFilterBytes.size();
+         ++i)
+    {
+        mLevels[i].setFilterBytesCounter(metrics.mFilterBytes[i]);
+    }
+}
+
 void
 BucketList::resolveAnyReadyFutures()
 {
@@ -461,6 +564,18 @@ BucketList::addBatch(Application& app, uint32_t currLedger,
                      std::vector<LedgerEntry> const& initEntries,
                      std::vector<LedgerEntry> const& liveEntries,
                      std::vector<LedgerKey> const& deadEntries)
+{
+    addBatch(app, currLedger, currLedgerProtocol,
+             Bucket::convertToBucketEntry(
+                 currLedgerProtocol >=
+                     Bucket::FIRST_PROTOCOL_SUPPORTING_INITENTRY_AND_METAENTRY,
+                 initEntries, liveEntries, deadEntries));
+}
+
+void
+BucketList::addBatch(Application& app, uint32_t currLedger,
+                     uint32_t currLedgerProtocol,
+                     std::vector<BucketEntry>&& entries)
 {
     assert(currLedger > 0);
 
@@ -565,8 +680,8 @@ BucketList::addBatch(Application& app, uint32_t currLedger,
     assert(shadows.size() == 0);
     mLevels[0].prepare(app, currLedger, currLedgerProtocol,
                        Bucket::fresh(app.getBucketManager(), currLedgerProtocol,
-                                     initEntries, liveEntries, deadEntries,
-                                     countMergeEvents, doFsync),
+                                     std::move(entries), countMergeEvents,
+                                     doFsync),
                        shadows, countMergeEvents);
     mLevels[0].commit();
 
@@ -9,6 +9,12 @@
 #include "xdrpp/message.h"
 #include <future>
 
+namespace medida
+{
+class Counter;
+class Meter;
+}
+
 namespace stellar
 {
 // This is the "bucket list", a set sets-of-hashed-objects, organized into
@@ -307,6 +313,9 @@ class BucketLevel
     FutureBucket mNextCurr;
     std::shared_ptr<Bucket> mCurr;
     std::shared_ptr<Bucket> mSnap;
+    medida::Counter* mFilterBytes{nullptr};
+
+    void updateFilterBytes();
 
   public:
     BucketLevel(uint32_t i);
@@ -324,6 +333,22 @@ class BucketLevel
                  std::vector<std::shared_ptr<Bucket>> const& shadows,
                  bool countMergeEvents);
     std::shared_ptr<Bucket> snap();
+
+    // Sets the counter of the memory of the filters of curr and snap, kept
+    // up to date as they change from then on.
+    void setFilterBytesCounter(medida::Counter* counter);
+};
+
+// Metrics of BucketList::getLedgerEntry, per level: lookups the filters of the
+// buckets of the level ruled out, lookups they let through but that found no
+// entry in the bucket, and the memory of the filters of the level, which the
+// levels of a BucketList update once given to BucketList::setLookupMetrics.
+struct BucketLookupMetrics
+{
+    explicit BucketLookupMetrics(Application& app);
+    std::vector<medida::Meter*> mFilterSkip;
+    std::vector<medida::Meter*> mFilterFalsePositive;
+    std::vector<medida::Counter*> mFilterBytes;
 };
 
 // NOTE: The access specifications for this class have been carefully chosen to
@@ -395,11 +420,23 @@ class BucketList
     // Return level `i` of the BucketList.
     BucketLevel& getLevel(uint32_t i);
 
+    // Has the levels update the filter memory counters of metrics.
+    void setLookupMetrics(BucketLookupMetrics const& metrics);
+
     // Return a cumulative hash of the entire bucketlist; this is the hash of
     // the concatenation of each level's hash, each of which in turn is the hash
     // of the concatenation of the hashes of the `curr` and `snap` buckets.
     Hash getHash() const;
 
+    // Returns the current state of the entry with the given key, or nullptr
+    // if there is none, by looking it up in the buckets from newest to oldest
+    // and stopping at the first that has an entry for it. Buckets whose
+    // filter rules the key out are not read. Accounts for the lookup in
+    // metrics if it is not null.
+    std::shared_ptr<LedgerEntry>
+    getLedgerEntry(LedgerKey const& key,
+                   BucketLookupMetrics* metrics = nullptr) const;
+
     // Restart any merges that might be running on background worker threads,
     // merging buckets between levels. This needs to be called after forcing a
     // BucketList to adopt a new state, either at application restart or when
@@ -440,5 +477,11 @@ class BucketList
                   std::vector<LedgerEntry> const& initEntries,
                   std::vector<LedgerEntry> const& liveEntries,
                   std::vector<LedgerKey> const& deadEntries);
+
+    // As above, with the batch given as BucketEntries sorted by key, which
+    // are moved into the fresh bucket of level 0.
+    void addBatch(Application& app, uint32_t currLedger,
+                  uint32_t currLedgerProtocol,
+                  std::vector<BucketEntry>&& entries);
 };
 }
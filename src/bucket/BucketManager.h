@@ -104,8 +104,16 @@ class BucketManager : NonMovableOrCopyable
     virtual std::string const& getBucketDir() const = 0;
     virtual BucketList& getBucketList() = 0;
 
+    // Looks key up in the BucketList, see BucketList::getLedgerEntry, and
+    // accounts for it in the bucket.filter-* metrics.
+    virtual std::shared_ptr<LedgerEntry>
+    getLedgerEntry(LedgerKey const& key) = 0;
+
     virtual medida::Timer& getMergeTimer() = 0;
 
+    // Whether new bucket files are written block-compressed
+    virtual bool compressBucketFiles() const = 0;
+
     // Reading and writing the merge counters is done in bulk, and takes a lock
     // briefly; this can be done from any thread.
     virtual MergeCounters readMergeCounters() = 0;
@@ -176,6 +184,13 @@ class BucketManager : NonMovableOrCopyable
                           std::vector<LedgerEntry> const& liveEntries,
                           std::vector<LedgerKey> const& deadEntries) = 0;
 
+    // As above, with the batch given as BucketEntries sorted by key, as
+    // AbstractLedgerTxn::getAllBucketEntries returns them. The entries are
+    // moved into the bucket list.
+    virtual void addBatch(Application& app, uint32_t currLedger,
+                          uint32_t currLedgerProtocol,
+                          std::vector<BucketEntry>&& entries) = 0;
+
     // Update the given LedgerHeader's bucketListHash to reflect the current
     // state of the bucket list.
     virtual void snapshotLedger(LedgerHeader& currentHeader) = 0;
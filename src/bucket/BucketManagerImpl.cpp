@@ -4,6 +4,7 @@
 
 #include "bucket/BucketManagerImpl.h"
 #include "bucket/Bucket.h"
+#include "bucket/BucketIndex.h"
 #include "bucket/BucketList.h"
 #include "crypto/Hex.h"
 #include "history/HistoryManager.h"
@@ -76,6 +77,7 @@ BucketManagerImpl::initialize()
     if (mApp.getConfig().MODE_ENABLES_BUCKETLIST)
     {
         mBucketList = std::make_unique<BucketList>();
+        mBucketList->setLookupMetrics(*mLookupMetrics);
     }
 }
 
@@ -112,7 +114,7 @@ BucketManagerImpl::BucketManagerImpl(Application& app)
     , mBucketSnapMerge(app.getMetrics().NewTimer({"bucket", "snap", "merge"}))
     , mSharedBucketsSize(
           app.getMetrics().NewCounter({"bucket", "memory", "shared"}))
-
+    , mLookupMetrics(std::make_unique<BucketLookupMetrics>(app))
 {
 }
 
@@ -129,7 +131,7 @@ bucketBasename(std::string const& bucketHexHash)
 bool
 isBucketFile(std::string const& name)
 {
-    static std::regex re("^bucket-[a-z0-9]{64}\\.xdr(\\.gz)?$");
+    static std::regex re("^bucket-[a-z0-9]{64}\\.xdr(\\.gz|\\.index)?$");
     return std::regex_match(name, re);
 };
 
@@ -198,12 +200,24 @@ BucketManagerImpl::getBucketList()
     return *mBucketList;
 }
 
+std::shared_ptr<LedgerEntry>
+BucketManagerImpl::getLedgerEntry(LedgerKey const& key)
+{
+    return getBucketList().getLedgerEntry(key, mLookupMetrics.get());
+}
+
 medida::Timer&
 BucketManagerImpl::getMergeTimer()
 {
     return mBucketSnapMerge;
 }
 
+bool
+BucketManagerImpl::compressBucketFiles() const
+{
+    return mApp.getConfig().COMPRESS_BUCKET_FILES;
+}
+
 MergeCounters
 BucketManagerImpl::readMergeCounters()
 {
@@ -339,6 +353,7 @@ BucketManagerImpl::adoptFileAsBucket(std::string const& filename,
 
     // Check to see if we have an existing bucket (either in-memory or on-disk)
     std::shared_ptr<Bucket> b = getBucketByHash(hash);
+    auto indexFilename = BucketIndex::indexFilename(filename);
     if (b)
     {
         CLOG(DEBUG, "Bucket") << "Deleting bucket file " << filename
@@ -346,6 +361,7 @@ BucketManagerImpl::adoptFileAsBucket(std::string const& filename,
         {
             auto timer = LogSlowExecution("Delete redundant bucket");
             std::remove(filename.c_str());
+            std::remove(indexFilename.c_str());
         }
     }
     else
@@ -366,6 +382,14 @@ BucketManagerImpl::adoptFileAsBucket(std::string const& filename,
                 throw std::runtime_error(err);
             }
         }
+        // Buckets build their index when missing, so failing to keep it
+        // is not an error
+        if (fs::exists(indexFilename) &&
+            !renameBucket(indexFilename,
+                          BucketIndex::indexFilename(canonicalName)))
+        {
+            std::remove(indexFilename.c_str());
+        }
 
         b = std::make_shared<Bucket>(canonicalName, hash);
         {
@@ -630,6 +654,8 @@ BucketManagerImpl::forgetUnreferencedBuckets()
                 std::remove(filename.c_str());
                 auto gzfilename = filename + ".gz";
                 std::remove(gzfilename.c_str());
+                auto indexFilename = BucketIndex::indexFilename(filename);
+                std::remove(indexFilename.c_str());
             }
 
             // Dropping this bucket means we'll no longer be able to
@@ -685,6 +711,24 @@ BucketManagerImpl::addBatch(Application& app, uint32_t currLedger,
                           liveEntries, deadEntries);
 }
 
+void
+BucketManagerImpl::addBatch(Application& app, uint32_t currLedger,
+                            uint32_t currLedgerProtocol,
+                            std::vector<BucketEntry>&& entries)
+{
+    releaseAssertOrThrow(app.getConfig().MODE_ENABLES_BUCKETLIST);
+#ifdef BUILD_TESTS
+    if (mUseFakeTestValuesForNextClose)
+    {
+        currLedgerProtocol = mFakeTestProtocolVersion;
+    }
+#endif
+    auto timer = mBucketAddBatch.TimeScope();
+    mBucketObjectInsertBatch.Mark(entries.size());
+    mBucketList->addBatch(app, currLedger, currLedgerProtocol,
+                          std::move(entries));
+}
+
 #ifdef BUILD_TESTS
 void
 BucketManagerImpl::setNextCloseVersionAndHashForTesting(uint32_t protocolVers,
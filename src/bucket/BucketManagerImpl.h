@@ -29,6 +29,7 @@ class TmpDir;
 class Application;
 class Bucket;
 class BucketList;
+struct BucketLookupMetrics;
 struct HistoryArchiveState;
 
 class BucketManagerImpl : public BucketManager
@@ -46,6 +47,7 @@ class BucketManagerImpl : public BucketManager
     medida::Timer& mBucketAddBatch;
     medida::Timer& mBucketSnapMerge;
     medida::Counter& mSharedBucketsSize;
+    std::unique_ptr<BucketLookupMetrics> mLookupMetrics;
     MergeCounters mMergeCounters;
 
     // Records bucket-merges that are currently _live_ in some FutureBucket, in
@@ -86,7 +88,10 @@ class BucketManagerImpl : public BucketManager
     std::string const& getTmpDir() override;
     std::string const& getBucketDir() const override;
     BucketList& getBucketList() override;
+    std::shared_ptr<LedgerEntry>
+    getLedgerEntry(LedgerKey const& key) override;
     medida::Timer& getMergeTimer() override;
+    bool compressBucketFiles() const override;
     MergeCounters readMergeCounters() override;
     void incrMergeCounters(MergeCounters const&) override;
     TmpDirManager& getTmpDirManager() override;
@@ -111,6 +116,9 @@ class BucketManagerImpl : public BucketManager
                   std::vector<LedgerEntry> const& initEntries,
                   std::vector<LedgerEntry> const& liveEntries,
                   std::vector<LedgerKey> const& deadEntries) override;
+    void addBatch(Application& app, uint32_t currLedger,
+                  uint32_t currLedgerProtocol,
+                  std::vector<BucketEntry>&& entries) override;
     void snapshotLedger(LedgerHeader& currentHeader) override;
 
 #ifdef BUILD_TESTS
@@ -6,6 +6,10 @@
 #include "bucket/Bucket.h"
 #include "bucket/BucketManager.h"
 #include "crypto/Random.h"
+#include "util/MappedFile.h"
+#include "xdrpp/marshal.h"
+
+#include <cassert>
 
 namespace stellar
 {
@@ -35,9 +39,10 @@ randomBucketName(std::string const& tmpDir)
 BucketOutputIterator::BucketOutputIterator(std::string const& tmpDir,
                                            bool keepDeadEntries,
                                            BucketMetadata const& meta,
-                                           MergeCounters& mc, bool doFsync)
+                                           MergeCounters& mc, bool doFsync,
+                                           bool compress)
     : mFilename(randomBucketName(tmpDir))
-    , mOut(doFsync)
+    , mOut(doFsync, compress)
     , mBuf(nullptr)
     , mHasher(SHA256::create())
     , mKeepDeadEntries(keepDeadEntries)
@@ -60,8 +65,57 @@ BucketOutputIterator::BucketOutputIterator(std::string const& tmpDir,
     }
 }
 
+BucketOutputIterator::BucketOutputIterator(std::string const& tmpDir,
+                                           BucketOutputIterator const& head,
+                                           MergeCounters& mc)
+    : mFilename(randomBucketName(tmpDir))
+    , mOut(/*fsyncOnClose=*/false, /*compressBlocks=*/false)
+    , mBuf(nullptr)
+    , mHasher(SHA256::create())
+    , mKeepDeadEntries(head.mKeepDeadEntries)
+    , mMeta(head.mMeta)
+    , mPutMeta(true)
+    , mMergeCounters(mc)
+    , mIndex(head.mIndex.getHashKey())
+{
+    CLOG(TRACE, "Bucket") << "BucketOutputIterator opening file to write: "
+                          << mFilename;
+    // This file only lives until it is appended to the head, no need to sync
+    // or compress it
+    mOut.open(mFilename);
+}
+
 void
-BucketOutputIterator::put(BucketEntry const& e)
+BucketOutputIterator::append(BucketOutputIterator& continuation)
+{
+    // Entries of the continuation follow the buffered one, which a
+    // sequential merge would have written when putting the first of them
+    if (mBuf && continuation.mBuf)
+    {
+        ++mMergeCounters.mOutputIteratorActualWrites;
+    }
+    for (auto out : {this, &continuation})
+    {
+        if (out->mBuf)
+        {
+            out->writeBuffered();
+            out->mBuf.reset();
+        }
+    }
+    continuation.mOut.close();
+
+    {
+        MappedFile frames(continuation.mFilename);
+        mIndex.append(continuation.mIndex, mBytesPut);
+        mOut.writeFrames(ByteSlice(frames.data(), frames.size()),
+                         mHasher.get(), &mBytesPut);
+    }
+    mObjectsPut += continuation.mObjectsPut;
+    std::remove(continuation.mFilename.c_str());
+}
+
+bool
+BucketOutputIterator::prepareToPut(BucketEntry const& e)
 {
     Bucket::checkProtocolLegality(e, mMeta.ledgerVersion);
     if (e.type() == METAENTRY)
@@ -76,7 +130,7 @@ BucketOutputIterator::put(BucketEntry const& e)
     if (!mKeepDeadEntries && e.type() == DEADENTRY)
     {
         ++mMergeCounters.mOutputIteratorTombstoneElisions;
-        return;
+        return false;
     }
 
     // Check to see if there's an existing buffered entry.
@@ -91,8 +145,7 @@ BucketOutputIterator::put(BucketEntry const& e)
         if (mCmp(*mBuf, e))
         {
             ++mMergeCounters.mOutputIteratorActualWrites;
-            mOut.writeOne(*mBuf, mHasher.get(), &mBytesPut);
-            mObjectsPut++;
+            writeBuffered();
         }
     }
     else
@@ -100,9 +153,57 @@ BucketOutputIterator::put(BucketEntry const& e)
         mBuf = std::make_unique<BucketEntry>();
     }
 
-    // In any case, replace *mBuf with e.
+    // In any case, the caller replaces *mBuf with e.
     ++mMergeCounters.mOutputIteratorBufferUpdates;
-    *mBuf = e;
+    return true;
+}
+
+void
+BucketOutputIterator::writeBuffered()
+{
+    mIndex.add(*mBuf, mBytesPut);
+    if (mBufHasXdr)
+    {
+        mOut.writeOneXdr(ByteSlice(mBufXdr), mHasher.get(), &mBytesPut);
+    }
+    else
+    {
+        mOut.writeOne(*mBuf, mHasher.get(), &mBytesPut);
+    }
+    mObjectsPut++;
+}
+
+void
+BucketOutputIterator::put(BucketEntry const& e)
+{
+    if (prepareToPut(e))
+    {
+        *mBuf = e;
+        mBufHasXdr = false;
+    }
+}
+
+void
+BucketOutputIterator::put(BucketEntry&& e)
+{
+    if (prepareToPut(e))
+    {
+        *mBuf = std::move(e);
+        mBufHasXdr = false;
+    }
+}
+
+void
+BucketOutputIterator::put(BucketEntry const& e, ByteSlice const& xdr)
+{
+    if (prepareToPut(e))
+    {
+        *mBuf = e;
+        mBufXdr.assign(xdr.begin(), xdr.end());
+        // Catches slices kept past the advance of their input iterator
+        assert(mBufXdr == xdr::xdr_to_opaque(e));
+        mBufHasXdr = true;
+    }
 }
 
 std::shared_ptr<Bucket>
@@ -111,8 +212,7 @@ BucketOutputIterator::getBucket(BucketManager& bucketManager,
 {
     if (mBuf)
     {
-        mOut.writeOne(*mBuf, mHasher.get(), &mBytesPut);
-        mObjectsPut++;
+        writeBuffered();
         mBuf.reset();
     }
 
@@ -129,6 +229,19 @@ BucketOutputIterator::getBucket(BucketManager& bucketManager,
         }
         return std::make_shared<Bucket>();
     }
+
+    // The index is only a cache, the bucket can do without it
+    mIndex.finish();
+    try
+    {
+        mIndex.save(BucketIndex::indexFilename(mFilename));
+    }
+    catch (std::exception& e)
+    {
+        CLOG(WARNING, "Bucket")
+            << "Failed to save index of bucket " << mFilename << ": "
+            << e.what();
+    }
     return bucketManager.adoptFileAsBucket(mFilename, mHasher->finish(),
                                            mObjectsPut, mBytesPut, mergeKey);
 }
@@ -4,6 +4,7 @@
 // under the Apache License, Version 2.0. See the COPYING file at the root
 // of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
 
+#include "bucket/BucketIndex.h"
 #include "bucket/BucketManager.h"
 #include "bucket/LedgerCmp.h"
 #include "util/XDRStream.h"
@@ -27,6 +28,9 @@ class BucketOutputIterator
     XDROutputFileStream mOut;
     BucketEntryIdCmp mCmp;
     std::unique_ptr<BucketEntry> mBuf;
+    // The XDR of *mBuf if mBufHasXdr, so that it need not be encoded again
+    std::vector<uint8_t> mBufXdr;
+    bool mBufHasXdr{false};
     std::unique_ptr<SHA256> mHasher;
     size_t mBytesPut{0};
     size_t mObjectsPut{0};
@@ -34,6 +38,13 @@ class BucketOutputIterator
     BucketMetadata mMeta;
     bool mPutMeta{false};
     MergeCounters& mMergeCounters;
+    BucketIndex mIndex;
+
+    void writeBuffered();
+
+    // Checks that e may be put, and writes out the buffered entry if e has a
+    // greater key. Returns false if e is to be dropped rather than buffered.
+    bool prepareToPut(BucketEntry const& e);
 
   public:
     // BucketOutputIterators must _always_ be constructed with BucketMetadata,
@@ -43,11 +54,30 @@ class BucketOutputIterator
     // version new enough that it should _write_ the metadata to the stream in
     // the form of a METAENTRY; but that's not a thing the caller gets to decide
     // (or forget to do), it's handled automatically.
+    //
+    // If compress is true, the bucket file is block-compressed; the hash of
+    // the bucket is the same either way.
     BucketOutputIterator(std::string const& tmpDir, bool keepDeadEntries,
                          BucketMetadata const& meta, MergeCounters& mc,
-                         bool doFsync);
+                         bool doFsync, bool compress = false);
+
+    // Creates an iterator for entries that follow those put in head, to be
+    // written concurrently and then appended to head with append. It shares
+    // the settings of head, but is not compressed, and does not start with a
+    // METAENTRY.
+    BucketOutputIterator(std::string const& tmpDir,
+                         BucketOutputIterator const& head, MergeCounters& mc);
 
     void put(BucketEntry const& e);
+    void put(BucketEntry&& e);
+
+    // Puts e given its XDR as well, as BucketInputIterator::getEntryXdr
+    // returns it, which is then written as is.
+    void put(BucketEntry const& e, ByteSlice const& xdr);
+
+    // Appends the entries put in an iterator created to continue this one,
+    // all of which must have greater keys than those put in this one so far.
+    void append(BucketOutputIterator& continuation);
 
     std::shared_ptr<Bucket> getBucket(BucketManager& bucketManager,
                                       MergeKey* mergeKey = nullptr);
@@ -26,6 +26,10 @@
 namespace stellar
 {
 
+// Smaller merges, in uncompressed bytes, are not worth splitting across
+// threads
+static size_t const PARALLEL_MERGE_MIN_BYTES = 64 * 1024 * 1024;
+
 FutureBucket::FutureBucket(Application& app,
                            std::shared_ptr<Bucket> const& curr,
                            std::shared_ptr<Bucket> const& snap,
@@ -340,10 +344,16 @@ FutureBucket::startMerge(Application& app, uint32_t maxProtocolVersion,
         checkState();
         return;
     }
+    uint32_t nThreads = 1;
+    if (curr->getUncompressedSize() + snap->getUncompressedSize() >=
+        PARALLEL_MERGE_MIN_BYTES)
+    {
+        nThreads = app.getConfig().BUCKET_MERGE_THREADS;
+    }
     using task_t = std::packaged_task<std::shared_ptr<Bucket>()>;
     std::shared_ptr<task_t> task = std::make_shared<task_t>(
         [curr, snap, &bm, shadows, maxProtocolVersion, countMergeEvents, level,
-         &timer, &app]() mutable {
+         nThreads, &timer, &app]() mutable {
             auto timeScope = timer.TimeScope();
             CLOG(TRACE, "Bucket")
                 << "Worker merging curr=" << hexAbbrev(curr->getHash())
@@ -354,7 +364,7 @@ FutureBucket::startMerge(Application& app, uint32_t maxProtocolVersion,
                 auto res = Bucket::merge(
                     bm, maxProtocolVersion, curr, snap, shadows,
                     BucketList::keepDeadEntries(level), countMergeEvents,
-                    !app.getConfig().DISABLE_XDR_FSYNC);
+                    !app.getConfig().DISABLE_XDR_FSYNC, nThreads);
 
                 CLOG(TRACE, "Bucket")
                     << "Worker finished merging curr="
@@ -11,21 +11,28 @@
 // else.
 #include "util/asio.h"
 #include "bucket/Bucket.h"
+#include "bucket/BucketIndex.h"
 #include "bucket/BucketInputIterator.h"
 #include "bucket/BucketList.h"
 #include "bucket/BucketManager.h"
 #include "bucket/BucketOutputIterator.h"
 #include "bucket/BucketTests.h"
+#include "bucket/LedgerCmp.h"
+#include "ledger/test/LedgerTestUtils.h"
 #include "lib/catch.hpp"
 #include "main/Application.h"
 #include "main/Config.h"
+#include "medida/counter.h"
+#include "medida/meter.h"
 #include "test/TestUtils.h"
 #include "test/test.h"
 #include "util/Math.h"
 #include "util/Timer.h"
 #include "xdrpp/autocheck.h"
 
+#include <chrono>
 #include <deque>
+#include <map>
 #include <sstream>
 
 using namespace stellar;
@@ -468,6 +475,126 @@ TEST_CASE("single entry bubbling up", "[bucket][bucketlist][bucketbubble]")
     }
 }
 
+TEST_CASE("bucket list point lookups", "[bucket][bucketlist][bucketindex]")
+{
+    VirtualClock clock;
+    Config const& cfg = getTestConfig();
+    for_versions_with_differing_bucket_logic(cfg, [&](Config const& cfg) {
+        Application::pointer app = createTestApplication(clock, cfg);
+        BucketList bl;
+        std::map<LedgerKey, LedgerEntry, LedgerEntryIdCmp> state;
+        std::vector<LedgerKey> liveKeys;
+        std::vector<LedgerKey> deletedKeys;
+        BucketLookupMetrics metrics(*app);
+        bl.setLookupMetrics(metrics);
+
+        auto check = [&]() {
+            for (auto const& kv : state)
+            {
+                auto e = bl.getLedgerEntry(kv.first, &metrics);
+                REQUIRE(e);
+                REQUIRE(*e == kv.second);
+            }
+            for (auto const& k : deletedKeys)
+            {
+                REQUIRE(!bl.getLedgerEntry(k, &metrics));
+            }
+        };
+
+        for (uint32_t i = 1;
+             !app->getClock().getIOContext().stopped() && i < 300; ++i)
+        {
+            app->getClock().crank(false);
+            std::map<LedgerKey, LedgerEntry, LedgerEntryIdCmp> live;
+            std::vector<LedgerKey> dead;
+            for (auto& e : LedgerTestUtils::generateValidLedgerEntries(8))
+            {
+                auto k = LedgerEntryKey(e);
+                if (state.find(k) == state.end())
+                {
+                    e.lastModifiedLedgerSeq = i;
+                    live.emplace(k, e);
+                }
+            }
+            // Update a couple of entries and delete a couple of others,
+            // so that their newest versions shadow older ones in deeper
+            // levels
+            for (size_t j = 0; j < 4 && liveKeys.size() > 8; ++j)
+            {
+                auto k = rand_element(liveKeys);
+                if (live.find(k) != live.end() ||
+                    std::find(dead.begin(), dead.end(), k) != dead.end())
+                {
+                    continue;
+                }
+                if (j % 2 == 0)
+                {
+                    auto e = state.at(k);
+                    e.lastModifiedLedgerSeq = i;
+                    live.emplace(k, e);
+                }
+                else
+                {
+                    dead.emplace_back(k);
+                }
+            }
+
+            std::vector<LedgerEntry> liveEntries;
+            for (auto const& kv : live)
+            {
+                if (state.find(kv.first) == state.end())
+                {
+                    liveKeys.emplace_back(kv.first);
+                }
+                state[kv.first] = kv.second;
+                liveEntries.emplace_back(kv.second);
+            }
+            for (auto const& k : dead)
+            {
+                state.erase(k);
+                liveKeys.erase(
+                    std::find(liveKeys.begin(), liveKeys.end(), k));
+                deletedKeys.emplace_back(k);
+            }
+            bl.addBatch(*app, i, getAppLedgerVersion(app), {}, liveEntries,
+                        dead);
+            if (i % 64 == 0)
+            {
+                check();
+            }
+        }
+        check();
+
+        // Most buckets that do not have a key are skipped thanks to their
+        // filter
+        int64_t skips = 0;
+        int64_t falsePositives = 0;
+        for (uint32_t j = 0; j < BucketList::kNumLevels; ++j)
+        {
+            skips += metrics.mFilterSkip[j]->count();
+            falsePositives += metrics.mFilterFalsePositive[j]->count();
+        }
+        REQUIRE(skips > 0);
+        REQUIRE(falsePositives < skips / 20);
+
+        // The filter memory of every level follows its buckets
+        for (uint32_t j = 0; j < BucketList::kNumLevels; ++j)
+        {
+            auto const& lev = bl.getLevel(j);
+            int64_t filterBytes = 0;
+            for (auto const& bucket : {lev.getCurr(), lev.getSnap()})
+            {
+                if (!bucket->getFilename().empty())
+                {
+                    filterBytes += bucket->getIndex()->filterBytes();
+                }
+            }
+            REQUIRE(metrics.mFilterBytes[j]->count() == filterBytes);
+        }
+        REQUIRE(metrics.mFilterBytes[0]->count() > 0);
+    });
+}
+
 TEST_CASE("BucketList sizeOf and oldestLedgerIn relations",
           "[bucket][bucketlist][count]")
 {
@@ -751,3 +878,74 @@ TEST_CASE("BucketList number dump", "[bucket][bucketlist][count][!hide]")
             << "[" << formatX32(snapOld) << ", " << formatX32(snapNew) << "]";
     }
 }
+
+TEST_CASE("bucket list point lookup bench", "[bucketbench][!hide]")
+{
+    VirtualClock clock;
+    Config const& cfg = getTestConfig();
+    Application::pointer app = createTestApplication(clock, cfg);
+    BucketList bl;
+    std::vector<LedgerKey> noDead;
+    for (uint32_t i = 1;
+         !app->getClock().getIOContext().stopped() && i < 0x1000; ++i)
+    {
+        app->getClock().crank(false);
+        bl.addBatch(*app, i, getAppLedgerVersion(app), {},
+                    LedgerTestUtils::generateValidLedgerEntries(100), noDead);
+    }
+
+    for (uint32_t j = 0; j < BucketList::kNumLevels; ++j)
+    {
+        auto const& lev = bl.getLevel(j);
+        for (auto const& bucket : {lev.getCurr(), lev.getSnap()})
+        {
+            std::vector<LedgerKey> keys;
+            for (BucketInputIterator in(bucket); in && keys.size() < 1000;
+                 ++in)
+            {
+                if ((*in).type() != DEADENTRY)
+                {
+                    keys.emplace_back(LedgerEntryKey((*in).liveEntry()));
+                }
+            }
+            if (keys.empty())
+            {
+                continue;
+            }
+            // Build or load the indexes first, those are not what we time
+            bl.getLedgerEntry(keys.front());
+
+            auto start = std::chrono::steady_clock::now();
+            for (auto const& k : keys)
+            {
+                REQUIRE(bl.getLedgerEntry(k));
+            }
+            auto elapsed =
+                std::chrono::duration_cast<std::chrono::microseconds>(
+                    std::chrono::steady_clock::now() - start);
+            auto which = bucket == lev.getCurr() ? "curr" : "snap";
+            CLOG(INFO, "Bucket")
+                << "level " << j << " " << which << " (" << bucket->getSize()
+                << " bytes): " << keys.size() << " lookups, "
+                << elapsed.count() / keys.size() << "us per lookup";
+        }
+    }
+
+    // Keys that are in no bucket, which every filter should rule out
+    BucketLookupMetrics metrics(*app);
+    bl.setLookupMetrics(metrics);
+    for (auto const& e : LedgerTestUtils::generateValidLedgerEntries(10000))
+    {
+        bl.getLedgerEntry(LedgerEntryKey(e), &metrics);
+    }
+    for (uint32_t j = 0; j < BucketList::kNumLevels; ++j)
+    {
+        auto skips = metrics.mFilterSkip[j]->count();
+        auto falsePositives = metrics.mFilterFalsePositive[j]->count();
+        auto probes = skips + falsePositives;
+        CLOG(INFO, "Bucket")
+            << "level " << j << ": " << metrics.mFilterBytes[j]->count()
+            << " filter bytes, " << falsePositives << " false positives in "
+            << probes << " lookups of missing keys";
+    }
+}
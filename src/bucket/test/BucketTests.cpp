@@ -13,11 +13,13 @@
 #include "util/asio.h"
 #include "bucket/BucketTests.h"
 #include "bucket/Bucket.h"
+#include "bucket/BucketIndex.h"
 #include "bucket/BucketInputIterator.h"
 #include "ledger/LedgerTxn.h"
 #include "ledger/test/LedgerTestUtils.h"
 #include "lib/catch.hpp"
 #include "main/Application.h"
+#include "test/AllocationCounter.h"
 #include "test/TestUtils.h"
 #include "test/test.h"
 #include "util/Fs.h"
@@ -931,11 +933,382 @@ TEST_CASE("bucket apply", "[bucket]")
     });
 }
 
+TEST_CASE("bucket apply in parallel", "[bucket]")
+{
+    auto runTest = [](Config::TestDbMode mode) {
+        VirtualClock clock;
+        Config cfg(getTestConfig(0, mode));
+        cfg.BUCKET_APPLY_THREADS = 4;
+        Application::pointer app = createTestApplication(clock, cfg);
+        app->start();
+        auto& bm = app->getBucketManager();
+        auto vers = getAppLedgerVersion(app);
+
+        std::vector<LedgerEntry> live(1000), newLive;
+        std::vector<LedgerKey> newDead, noDead;
+        for (auto& e : live)
+        {
+            e.data.type(ACCOUNT);
+            auto& a = e.data.account();
+            a = LedgerTestUtils::generateValidAccountEntry(5);
+            a.balance = 1000000000;
+        }
+        // The newer bucket updates a third of the entries and erases another
+        for (size_t i = 0; i < live.size(); ++i)
+        {
+            if (i % 3 == 0)
+            {
+                newLive.emplace_back(live[i]);
+                ++newLive.back().data.account().balance;
+            }
+            else if (i % 3 == 1)
+            {
+                newDead.emplace_back(LedgerEntryKey(live[i]));
+            }
+        }
+        auto older = Bucket::fresh(bm, vers, {}, live, noDead,
+                                   /*countMergeEvents=*/true,
+                                   /*doFsync=*/true);
+        auto newer = Bucket::fresh(bm, vers, {}, newLive, newDead,
+                                   /*countMergeEvents=*/true,
+                                   /*doFsync=*/true);
+
+        // Oldest first, as catchup applies them
+        older->apply(*app);
+        newer->apply(*app);
+        REQUIRE(app->getLedgerTxnRoot().countObjects(ACCOUNT) ==
+                live.size() - newDead.size() + 1 /* root account */);
+
+        LedgerTxn ltx(app->getLedgerTxnRoot());
+        for (size_t i = 0; i < live.size(); ++i)
+        {
+            auto loaded = ltx.loadWithoutRecord(LedgerEntryKey(live[i]));
+            if (i % 3 == 1)
+            {
+                REQUIRE(!loaded);
+            }
+            else
+            {
+                REQUIRE(loaded);
+                REQUIRE(loaded.current() ==
+                        (i % 3 == 0 ? newLive[i / 3] : live[i]));
+            }
+        }
+    };
+
+    SECTION("sqlite")
+    {
+        runTest(Config::TESTDB_ON_DISK_SQLITE);
+    }
+#ifdef USE_POSTGRES
+    SECTION("postgresql")
+    {
+        runTest(Config::TESTDB_POSTGRESQL);
+    }
+#endif
+}
+
+TEST_CASE("bucket point lookups", "[bucket][bucketindex]")
+{
+    VirtualClock clock;
+    Config cfg(getTestConfig());
+    for_versions_with_differing_bucket_logic(cfg, [&](Config const& cfg) {
+        Application::pointer app = createTestApplication(clock, cfg);
+
+        autocheck::generator<LedgerKey> deadGen;
+        std::vector<LedgerEntry> live(2000);
+        std::vector<LedgerKey> dead(500);
+        for (auto& e : live)
+            e = LedgerTestUtils::generateValidLedgerEntry(3);
+        for (auto& e : dead)
+            e = deadGen(3);
+        std::shared_ptr<Bucket> b = Bucket::fresh(
+            app->getBucketManager(), getAppLedgerVersion(app), {}, live, dead,
+            /*countMergeEvents=*/true, /*doFsync=*/true);
+
+        auto indexFilename = BucketIndex::indexFilename(b->getFilename());
+        REQUIRE(fs::exists(indexFilename));
+        // Several pages, so that lookups do not all start at the beginning
+        REQUIRE(b->getIndex()->size() > 1);
+
+        auto checkLookups = [&](std::shared_ptr<Bucket> const& bucket) {
+            for (auto const& e : live)
+            {
+                auto be = bucket->getBucketEntry(LedgerEntryKey(e));
+                REQUIRE(be);
+                REQUIRE(be->type() != DEADENTRY);
+                REQUIRE(be->liveEntry() == e);
+            }
+            for (auto const& k : dead)
+            {
+                auto be = bucket->getBucketEntry(k);
+                REQUIRE(be);
+                REQUIRE(be->type() == DEADENTRY);
+                REQUIRE(be->deadEntry() == k);
+            }
+            // Keys that are not in the bucket are mostly ruled out by the
+            // filter, without reading the bucket
+            auto index = bucket->getIndex();
+            REQUIRE(index->filterFalsePositiveRate() < 0.01);
+            size_t maybe = 0;
+            size_t absent = 0;
+            for (size_t i = 0; i < 1000; ++i)
+            {
+                auto k = deadGen(3);
+                if (std::find(dead.begin(), dead.end(), k) == dead.end())
+                {
+                    ++absent;
+                    REQUIRE(!bucket->getBucketEntry(k));
+                    if (index->mayContain(k))
+                    {
+                        ++maybe;
+                    }
+                }
+            }
+            REQUIRE(maybe < absent / 20);
+        };
+
+        SECTION("with the index written along the bucket")
+        {
+            checkLookups(b);
+        }
+        SECTION("with an index built from the bucket file")
+        {
+            std::remove(indexFilename.c_str());
+            auto rebuilt =
+                std::make_shared<Bucket>(b->getFilename(), b->getHash());
+            checkLookups(rebuilt);
+            REQUIRE(fs::exists(indexFilename));
+            REQUIRE(rebuilt->getIndex()->size() == b->getIndex()->size());
+        }
+        SECTION("the empty bucket has no entries")
+        {
+            REQUIRE(!std::make_shared<Bucket>()->getBucketEntry(dead.front()));
+        }
+    });
+}
+
+TEST_CASE("parallel merges match sequential ones", "[bucket][bucketindex]")
+{
+    VirtualClock clock;
+    Config cfg(getTestConfig());
+
+    autocheck::generator<LedgerKey> deadGen;
+    std::vector<LedgerEntry> oldInit(1000);
+    std::vector<LedgerEntry> oldLive(3000);
+    std::vector<LedgerKey> oldDead(500);
+    std::vector<LedgerEntry> newInit(500);
+    for (auto& e : oldInit)
+        e = LedgerTestUtils::generateValidLedgerEntry(3);
+    for (auto& e : oldLive)
+        e = LedgerTestUtils::generateValidLedgerEntry(3);
+    for (auto& k : oldDead)
+        k = deadGen(3);
+    for (auto& e : newInit)
+        e = LedgerTestUtils::generateValidLedgerEntry(3);
+
+    // The new bucket updates a third of the old entries and deletes another
+    std::vector<LedgerEntry> newLive;
+    std::vector<LedgerKey> newDead;
+    std::vector<LedgerEntry> old(oldInit);
+    old.insert(old.end(), oldLive.begin(), oldLive.end());
+    for (size_t i = 0; i < old.size(); ++i)
+    {
+        if (i % 3 == 0)
+        {
+            newLive.emplace_back(old[i]);
+            ++newLive.back().lastModifiedLedgerSeq;
+        }
+        else if (i % 3 == 1)
+        {
+            newDead.emplace_back(LedgerEntryKey(old[i]));
+        }
+    }
+
+    for_versions_with_differing_bucket_logic(cfg, [&](Config const& cfg) {
+        for (uint32_t nThreads : {2, 8})
+        {
+            for (bool keepDeadEntries : {true, false})
+            {
+                Application::pointer app = createTestApplication(clock, cfg);
+                auto& bm = app->getBucketManager();
+                auto vers = getAppLedgerVersion(app);
+                auto oldBucket =
+                    Bucket::fresh(bm, vers, oldInit, oldLive, oldDead,
+                                  /*countMergeEvents=*/true, /*doFsync=*/true);
+                auto newBucket =
+                    Bucket::fresh(bm, vers, newInit, newLive, newDead,
+                                  /*countMergeEvents=*/true, /*doFsync=*/true);
+                // Enough pages for every range to have some
+                REQUIRE(oldBucket->getIndex()->size() > nThreads);
+
+                // Merged in parallel first, so that the bucket keeps the
+                // index joined from those of the ranges
+                auto parallel = Bucket::merge(
+                    bm, cfg.LEDGER_PROTOCOL_VERSION, oldBucket, newBucket,
+                    /*shadows=*/{}, keepDeadEntries,
+                    /*countMergeEvents=*/true, /*doFsync=*/true, nThreads);
+                auto sequential = Bucket::merge(
+                    bm, cfg.LEDGER_PROTOCOL_VERSION, oldBucket, newBucket,
+                    /*shadows=*/{}, keepDeadEntries,
+                    /*countMergeEvents=*/true, /*doFsync=*/true);
+                REQUIRE(parallel->getHash() == sequential->getHash());
+                REQUIRE(parallel->getSize() == sequential->getSize());
+
+                // The joined index may have more pages than one built from
+                // the file, but finds every entry all the same
+                for (BucketInputIterator in(parallel); in; ++in)
+                {
+                    BucketEntry const& e = *in;
+                    auto found = parallel->getBucketEntry(
+                        e.type() == DEADENTRY ? e.deadEntry()
+                                              : LedgerEntryKey(e.liveEntry()));
+                    REQUIRE(found);
+                    REQUIRE(*found == e);
+                }
+            }
+        }
+    });
+}
+
+TEST_CASE("block-compressed buckets", "[bucket][blockcompression]")
+{
+    VirtualClock clock;
+    Config plainCfg(getTestConfig(0));
+    Config compressedCfg(getTestConfig(1));
+    compressedCfg.COMPRESS_BUCKET_FILES = true;
+    Application::pointer plainApp = createTestApplication(clock, plainCfg);
+    Application::pointer app = createTestApplication(clock, compressedCfg);
+    auto& plainBm = plainApp->getBucketManager();
+    auto& bm = app->getBucketManager();
+    auto vers = getAppLedgerVersion(app);
+
+    autocheck::generator<LedgerKey> deadGen;
+    std::vector<LedgerEntry> oldLive(3000);
+    std::vector<LedgerEntry> newLive(1000);
+    std::vector<LedgerKey> dead(500);
+    for (auto& e : oldLive)
+        e = LedgerTestUtils::generateValidLedgerEntry(3);
+    for (auto& e : newLive)
+        e = LedgerTestUtils::generateValidLedgerEntry(3);
+    for (auto& k : dead)
+        k = deadGen(3);
+
+    auto fresh = [&](BucketManager& manager,
+                     std::vector<LedgerEntry> const& liveEntries,
+                     std::vector<LedgerKey> const& deadEntries) {
+        return Bucket::fresh(manager, vers, {}, liveEntries, deadEntries,
+                             /*countMergeEvents=*/true, /*doFsync=*/false);
+    };
+    auto plainOld = fresh(plainBm, oldLive, {});
+    auto plainNew = fresh(plainBm, newLive, dead);
+    auto oldBucket = fresh(bm, oldLive, {});
+    auto newBucket = fresh(bm, newLive, dead);
+    REQUIRE(!plainOld->isBlockCompressed());
+    REQUIRE(oldBucket->isBlockCompressed());
+    REQUIRE(newBucket->isBlockCompressed());
+
+    // Buckets are named and hashed after their uncompressed contents
+    REQUIRE(oldBucket->getHash() == plainOld->getHash());
+    REQUIRE(newBucket->getHash() == plainNew->getHash());
+    REQUIRE(oldBucket->getSize() < plainOld->getSize());
+    REQUIRE(oldBucket->getUncompressedSize() == plainOld->getSize());
+    REQUIRE(plainOld->getUncompressedSize() == plainOld->getSize());
+    REQUIRE(BucketInputIterator(oldBucket).size() ==
+            oldBucket->getUncompressedSize());
+
+    auto checkLookups = [&](std::shared_ptr<Bucket> const& bucket) {
+        for (BucketInputIterator in(bucket); in; ++in)
+        {
+            BucketEntry const& e = *in;
+            auto found = bucket->getBucketEntry(
+                e.type() == DEADENTRY ? e.deadEntry()
+                                      : LedgerEntryKey(e.liveEntry()));
+            REQUIRE(found);
+            REQUIRE(*found == e);
+        }
+    };
+
+    for (uint32_t nThreads : {1, 4})
+    {
+        auto plainMerged = Bucket::merge(
+            plainBm, vers, plainOld, plainNew, /*shadows=*/{},
+            /*keepDeadEntries=*/true, /*countMergeEvents=*/true,
+            /*doFsync=*/false, nThreads);
+        auto merged = Bucket::merge(
+            bm, vers, oldBucket, newBucket, /*shadows=*/{},
+            /*keepDeadEntries=*/true, /*countMergeEvents=*/true,
+            /*doFsync=*/false, nThreads);
+        REQUIRE(merged->isBlockCompressed());
+        REQUIRE(merged->getHash() == plainMerged->getHash());
+        REQUIRE(merged->getIndex()->size() ==
+                plainMerged->getIndex()->size());
+        checkLookups(merged);
+    }
+
+    SECTION("with an index built from the bucket file")
+    {
+        std::remove(BucketIndex::indexFilename(newBucket->getFilename())
+                        .c_str());
+        auto rebuilt = std::make_shared<Bucket>(newBucket->getFilename(),
+                                                newBucket->getHash());
+        REQUIRE(rebuilt->isBlockCompressed());
+        checkLookups(rebuilt);
+        REQUIRE(rebuilt->getIndex()->size() ==
+                plainNew->getIndex()->size());
+    }
+}
+
+TEST_CASE("parallel merge bench", "[bucketbench][!hide]")
+{
+    VirtualClock clock;
+    Config cfg(getTestConfig());
+    Application::pointer app = createTestApplication(clock, cfg);
+    auto& bm = app->getBucketManager();
+    auto vers = getAppLedgerVersion(app);
+
+    std::vector<LedgerEntry> oldLive(200000);
+    std::vector<LedgerEntry> newLive(100000);
+    std::vector<LedgerKey> noDead;
+    for (auto& e : oldLive)
+        e = LedgerTestUtils::generateValidLedgerEntry(5);
+    for (auto& e : newLive)
+        e = LedgerTestUtils::generateValidLedgerEntry(5);
+    auto oldBucket =
+        Bucket::fresh(bm, vers, {}, oldLive, noDead,
+                      /*countMergeEvents=*/false, /*doFsync=*/false);
+    auto newBucket =
+        Bucket::fresh(bm, vers, {}, newLive, noDead,
+                      /*countMergeEvents=*/false, /*doFsync=*/false);
+
+    Hash expected;
+    for (uint32_t nThreads : {1, 2, 4, 8})
+    {
+        auto start = std::chrono::steady_clock::now();
+        auto merged = Bucket::merge(
+            bm, cfg.LEDGER_PROTOCOL_VERSION, oldBucket, newBucket,
+            /*shadows=*/{}, /*keepDeadEntries=*/true,
+            /*countMergeEvents=*/false, /*doFsync=*/false, nThreads);
+        auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(
+            std::chrono::steady_clock::now() - start);
+        CLOG(INFO, "Bucket")
+            << "Merged " << oldBucket->getSize() + newBucket->getSize()
+            << " bytes with " << nThreads << " threads in " << elapsed.count()
+            << "ms";
+        if (nThreads == 1)
+        {
+            expected = merged->getHash();
+        }
+        REQUIRE(merged->getHash() == expected);
+    }
+}
+
 TEST_CASE("bucket apply bench", "[bucketbench][!hide]")
 {
-    auto runtest = [](Config::TestDbMode mode) {
+    auto runtest = [](Config::TestDbMode mode, uint32_t nThreads) {
         VirtualClock clock;
         Config cfg(getTestConfig(0, mode));
+        cfg.BUCKET_APPLY_THREADS = nThreads;
         Application::pointer app = createTestApplication(clock, cfg);
         app->start();
 
@@ -962,12 +1335,72 @@ TEST_CASE("bucket apply bench", "[bucketbench][!hide]")
 
     SECTION("sqlite")
     {
-        runtest(Config::TESTDB_ON_DISK_SQLITE);
+        runtest(Config::TESTDB_ON_DISK_SQLITE, 1);
     }
 #ifdef USE_POSTGRES
     SECTION("postgresql")
     {
-        runtest(Config::TESTDB_POSTGRESQL);
+        runtest(Config::TESTDB_POSTGRESQL, 1);
+    }
+    SECTION("postgresql with 4 connections")
+    {
+        runtest(Config::TESTDB_POSTGRESQL, 4);
     }
 #endif
 }
+
+TEST_CASE("fresh bucket from ledger delta bench", "[freshbucketbench][!hide]")
+{
+    VirtualClock clock;
+    Config cfg(getTestConfig());
+    Application::pointer app = createTestApplication(clock, cfg);
+    app->start();
+    auto& bm = app->getBucketManager();
+    auto vers = getAppLedgerVersion(app);
+
+    // A ledger creating 10000 accounts, sealed up front so that both ways of
+    // building its level 0 bucket read the same entries
+    LedgerTxn ltx(app->getLedgerTxnRoot());
+    for (auto const& ae : LedgerTestUtils::generateValidAccountEntries(10000))
+    {
+        LedgerEntry le;
+        le.data.type(ACCOUNT);
+        le.data.account() = ae;
+        ltx.createOrUpdateWithoutLoading(le);
+    }
+    std::vector<BucketEntry> sealed;
+    ltx.getAllBucketEntries(sealed);
+
+    auto report = [](std::string const& name,
+                     std::chrono::steady_clock::time_point start,
+                     AllocationCounter const& counter) {
+        auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::steady_clock::now() - start);
+        CLOG(INFO, "Bucket")
+            << name << ": " << elapsed.count() << "us, " << counter.getCount()
+            << " allocations of " << counter.getBytes() << " bytes";
+    };
+
+    for (int i = 0; i < 5; ++i)
+    {
+        {
+            auto start = std::chrono::steady_clock::now();
+            AllocationCounter counter;
+            std::vector<LedgerEntry> init, live;
+            std::vector<LedgerKey> dead;
+            ltx.getAllEntries(init, live, dead);
+            Bucket::fresh(bm, vers, init, live, dead,
+                          /*countMergeEvents=*/false, /*doFsync=*/false);
+            report("entry vectors", start, counter);
+        }
+        {
+            auto start = std::chrono::steady_clock::now();
+            AllocationCounter counter;
+            std::vector<BucketEntry> entries;
+            ltx.getAllBucketEntries(entries);
+            Bucket::fresh(bm, vers, std::move(entries),
+                          /*countMergeEvents=*/false, /*doFsync=*/false);
+            report("bucket entries", start, counter);
+        }
+    }
+}
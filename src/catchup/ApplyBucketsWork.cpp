@@ -76,10 +76,11 @@ ApplyBucketsWork::onReset()
     if (!isAborting())
     {
         auto addBucket = [this](std::shared_ptr<Bucket const> const& bucket) {
+            // Applicators report uncompressed positions
             if (bucket->getSize() > 0)
             {
                 mTotalBuckets++;
-                mTotalSize += bucket->getSize();
+                mTotalSize += bucket->getUncompressedSize();
             }
         };
 
@@ -111,8 +112,7 @@ ApplyBucketsWork::startLevel()
     bool applySnap = (i.snap != binToHex(level.getSnap()->getHash()));
     bool applyCurr = (i.curr != binToHex(level.getCurr()->getHash()));
 
-    if (!mApplying && !mApp.getConfig().MODE_USES_IN_MEMORY_LEDGER &&
-        (applySnap || applyCurr))
+    if (!mApplying && (applySnap || applyCurr))
     {
         uint32_t oldestLedger = applySnap
                                     ? BucketList::oldestLedgerInSnap(
@@ -220,6 +220,7 @@ ApplyBucketsWork::advance(std::string const& bucketName,
     auto sz = applicator.advance(mCounters);
     mAppliedEntries += sz;
     mCounters.logDebug(bucketName, mLevel, mApp.getClock().now());
+    auto entriesPerSecond = mCounters.entriesPerSecond(mApp.getClock().now());
 
     auto log = false;
     if (applicator)
@@ -250,7 +251,8 @@ ApplyBucketsWork::advance(std::string const& bucketName,
             << "Bucket-apply: " << mAppliedEntries << " entries in "
             << formatSize(mAppliedSize) << "/" << formatSize(mTotalSize)
             << " in " << mAppliedBuckets << "/" << mTotalBuckets << " files ("
-            << (100 * mAppliedSize / mTotalSize) << "%)";
+            << (100 * mAppliedSize / mTotalSize) << "%) at "
+            << entriesPerSecond << " entries/s";
     }
 }
 
@@ -58,6 +58,12 @@ ApplyBufferedLedgersWork::onRun()
 
     cm.popBufferedLedger();
 
+    // Load what the following buffered ledger touches while this one closes
+    if (cm.hasBufferedLedger())
+    {
+        lm.prefetchAhead(cm.getBufferedLedger().getTxSet()->sortForApply());
+    }
+
     CLOG(INFO, "History") << "Scheduling buffered ledger-close: "
                           << "[seq=" << lcd.getLedgerSeq() << ", prev="
                           << hexAbbrev(lcd.getTxSet()->previousLedgerHash())
@@ -326,7 +326,10 @@ Database::getAppSchemaVersion()
 medida::TimerContext
 Database::getInsertTimer(std::string const& entityName)
 {
-    mEntityTypes.insert(entityName);
+    {
+        std::lock_guard<std::mutex> lock(mEntityTypesMutex);
+        mEntityTypes.insert(entityName);
+    }
     mQueryMeter.Mark();
     return mApp.getMetrics()
         .NewTimer({"database", "insert", entityName})
@@ -336,7 +339,10 @@ Database::getInsertTimer(std::string const& entityName)
 medida::TimerContext
 Database::getSelectTimer(std::string const& entityName)
 {
-    mEntityTypes.insert(entityName);
+    {
+        std::lock_guard<std::mutex> lock(mEntityTypesMutex);
+        mEntityTypes.insert(entityName);
+    }
     mQueryMeter.Mark();
     return mApp.getMetrics()
         .NewTimer({"database", "select", entityName})
@@ -346,7 +352,10 @@ Database::getSelectTimer(std::string const& entityName)
 medida::TimerContext
 Database::getDeleteTimer(std::string const& entityName)
 {
-    mEntityTypes.insert(entityName);
+    {
+        std::lock_guard<std::mutex> lock(mEntityTypesMutex);
+        mEntityTypes.insert(entityName);
+    }
     mQueryMeter.Mark();
     return mApp.getMetrics()
         .NewTimer({"database", "delete", entityName})
@@ -356,7 +365,10 @@ Database::getDeleteTimer(std::string const& entityName)
 medida::TimerContext
 Database::getUpdateTimer(std::string const& entityName)
 {
-    mEntityTypes.insert(entityName);
+    {
+        std::lock_guard<std::mutex> lock(mEntityTypesMutex);
+        mEntityTypes.insert(entityName);
+    }
     mQueryMeter.Mark();
     return mApp.getMetrics()
         .NewTimer({"database", "update", entityName})
@@ -366,7 +378,10 @@ Database::getUpdateTimer(std::string const& entityName)
 medida::TimerContext
 Database::getUpsertTimer(std::string const& entityName)
 {
-    mEntityTypes.insert(entityName);
+    {
+        std::lock_guard<std::mutex> lock(mEntityTypesMutex);
+        mEntityTypes.insert(entityName);
+    }
     mQueryMeter.Mark();
     return mApp.getMetrics()
         .NewTimer({"database", "upsert", entityName})
@@ -405,6 +420,12 @@ Database::getSimpleCollationClause() const
     }
 }
 
+bool
+Database::useBulkCopy(size_t rows) const
+{
+    return !isSqlite() && rows >= mApp.getConfig().BULK_UPSERT_COPY_THRESHOLD;
+}
+
 bool
 Database::canUsePool() const
 {
@@ -504,7 +525,7 @@ Database::getPool()
             soci::session& sess = mPool->at(i);
             sess.open(c.value);
             DatabaseConfigureSessionOp op(sess);
-            doDatabaseTypeSpecificOperation(op);
+            doDatabaseTypeSpecificOperation(op, sess);
         }
     }
     assert(mPool);
@@ -568,6 +589,21 @@ Database::getPreparedStatement(std::string const& query)
     return sc;
 }
 
+StatementContext
+Database::getPreparedStatement(std::string const& query,
+                               soci::session& session)
+{
+    if (&session == &mSession)
+    {
+        return getPreparedStatement(query);
+    }
+    auto p = std::make_shared<soci::statement>(session);
+    p->alloc();
+    p->prepare(query);
+    StatementContext sc(p);
+    return sc;
+}
+
 std::shared_ptr<SQLLogContext>
 Database::captureAndLogSQL(std::string contextName)
 {
@@ -584,10 +620,15 @@ std::chrono::nanoseconds
 Database::totalQueryTime() const
 {
     std::vector<std::string> qtypes = {"insert", "delete", "select", "update"};
+    std::set<std::string> entityTypes;
+    {
+        std::lock_guard<std::mutex> lock(mEntityTypesMutex);
+        entityTypes = mEntityTypes;
+    }
     std::chrono::nanoseconds nsq(0);
     for (auto const& q : qtypes)
     {
-        for (auto const& e : mEntityTypes)
+        for (auto const& e : entityTypes)
         {
             auto& timer = mApp.getMetrics().NewTimer({"database", q, e});
             uint64_t sumns = static_cast<uint64_t>(
@@ -9,6 +9,7 @@
 #include "overlay/StellarXDR.h"
 #include "util/NonCopyable.h"
 #include "util/Timer.h"
+#include <mutex>
 #include <set>
 #include <soci.h>
 #include <string>
@@ -92,7 +93,9 @@ class Database : NonMovableOrCopyable
     medida::Counter& mStatementsSize;
 
     // Helpers for maintaining the total query time and calculating
-    // idle percentage.
+    // idle percentage. Worker threads reading through the connection pool
+    // time their queries too, hence the mutex.
+    mutable std::mutex mEntityTypesMutex;
     std::set<std::string> mEntityTypes;
     std::chrono::nanoseconds mExcludedQueryTime;
     std::chrono::nanoseconds mExcludedTotalTime;
@@ -138,6 +141,13 @@ class Database : NonMovableOrCopyable
     // when the statement context is destroyed.
     StatementContext getPreparedStatement(std::string const& query);
 
+    // Like getPreparedStatement, but for a statement on `session`. When
+    // `session` is not the main connection, e.g. when a worker thread borrowed
+    // it from the connection pool, the statement is prepared afresh and not
+    // cached, so this may be called from any thread.
+    StatementContext getPreparedStatement(std::string const& query,
+                                          soci::session& session);
+
     // Purge all cached prepared statements, closing their handles with the
     // database.
     void clearPreparedStatementCache();
@@ -166,10 +176,20 @@ class Database : NonMovableOrCopyable
     // defaults are correct already).
     std::string getSimpleCollationClause() const;
 
+    // Return true if a bulk upsert of `rows` rows should stream them with COPY
+    // rather than bind them as arrays. Only Postgresql supports COPY.
+    bool useBulkCopy(size_t rows) const;
+
     // Call `op` back with the specific database backend subtype in use.
     template <typename T>
     T doDatabaseTypeSpecificOperation(DatabaseTypeSpecificOperation<T>& op);
 
+    // Call `op` back with the backend of `session`, which may be the main
+    // connection or one from the connection pool.
+    template <typename T>
+    T doDatabaseTypeSpecificOperation(DatabaseTypeSpecificOperation<T>& op,
+                                      soci::session& session);
+
     // Return true if a connection pool is available for worker threads
     // to read from the database through, otherwise false.
     bool canUsePool() const;
@@ -202,7 +222,15 @@ template <typename T>
 T
 Database::doDatabaseTypeSpecificOperation(DatabaseTypeSpecificOperation<T>& op)
 {
-    auto b = mSession.get_backend();
+    return doDatabaseTypeSpecificOperation(op, mSession);
+}
+
+template <typename T>
+T
+Database::doDatabaseTypeSpecificOperation(DatabaseTypeSpecificOperation<T>& op,
+                                          soci::session& session)
+{
+    auto b = session.get_backend();
     if (auto sq = dynamic_cast<soci::sqlite3_session_backend*>(b))
     {
         return op.doSqliteSpecificOperation(sq);
@@ -31,4 +31,48 @@ deleteOldEntriesHelper(soci::session& sess, uint32_t ledgerSeq, uint32_t count,
     }
 }
 }
-}
\ No newline at end of file
+
+#ifdef USE_POSTGRES
+std::string
+PGBinaryCopy::copyInto(soci::session& session, PGconn* conn,
+                       std::string const& table, std::string const& columns)
+{
+    std::string tmp = "upsert_" + table;
+    session << "CREATE TEMP TABLE IF NOT EXISTS " + tmp + " (LIKE " + table +
+                   ")";
+    session << "TRUNCATE " + tmp;
+
+    // Trailer
+    putInt(UINT16_MAX, 2);
+
+    std::string sql =
+        "COPY " + tmp + " (" + columns + ") FROM STDIN (FORMAT binary)";
+    PGresult* res = PQexec(conn, sql.c_str());
+    bool started = PQresultStatus(res) == PGRES_COPY_IN;
+    PQclear(res);
+    if (!started)
+    {
+        throw std::runtime_error(std::string("Could not start COPY in SQL: ") +
+                                 PQerrorMessage(conn));
+    }
+
+    bool sent = PQputCopyData(conn, mData.data(),
+                              static_cast<int>(mData.size())) == 1;
+    sent = PQputCopyEnd(conn, sent ? nullptr : "aborted") == 1 && sent;
+
+    // The results must all be read before the connection can be used again
+    bool copied = sent;
+    while ((res = PQgetResult(conn)) != nullptr)
+    {
+        copied = copied && PQresultStatus(res) == PGRES_COMMAND_OK;
+        PQclear(res);
+    }
+    if (!copied)
+    {
+        throw std::runtime_error(std::string("Could not COPY data in SQL: ") +
+                                 PQerrorMessage(conn));
+    }
+    return tmp;
+}
+#endif
+}
@@ -5,6 +5,13 @@
 // of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
 
 #include "Database.h"
+#ifdef USE_POSTGRES
+#include <cstring>
+#include <iomanip>
+#include <libpq-fe.h>
+#include <limits>
+#include <sstream>
+#endif
 
 namespace stellar
 {
@@ -14,4 +21,147 @@ void deleteOldEntriesHelper(soci::session& sess, uint32_t ledgerSeq,
                             uint32_t count, std::string const& tableName,
                             std::string const& ledgerSeqColumn);
 }
+
+#ifdef USE_POSTGRES
+template <typename T>
+inline void
+marshalToPGArrayItem(PGconn* conn, std::ostringstream& oss, const T& item)
+{
+    // NB: This setprecision is very important to ensuring that a double
+    // gets marshaled to enough decimal digits to reconstruct exactly the
+    // same double on the postgres side (that precision-level is exactly
+    // what max_digits10 is defined as). Do not remove it!
+    oss << std::setprecision(std::numeric_limits<T>::max_digits10) << item;
+}
+
+template <>
+inline void
+marshalToPGArrayItem<std::string>(PGconn* conn, std::ostringstream& oss,
+                                  const std::string& item)
+{
+    std::vector<char> buf(item.size() * 2 + 1, '\0');
+    int err = 0;
+    size_t len =
+        PQescapeStringConn(conn, buf.data(), item.c_str(), item.size(), &err);
+    if (err != 0)
+    {
+        throw std::runtime_error("Could not escape string in SQL");
+    }
+    oss << '"';
+    oss.write(buf.data(), len);
+    oss << '"';
+}
+
+template <typename T>
+inline void
+marshalToPGArray(PGconn* conn, std::string& out, const std::vector<T>& v,
+                 const std::vector<soci::indicator>* ind = nullptr)
+{
+    std::ostringstream oss;
+    oss << '{';
+    for (size_t i = 0; i < v.size(); ++i)
+    {
+        if (i > 0)
+        {
+            oss << ',';
+        }
+        if (ind && (*ind)[i] == soci::i_null)
+        {
+            oss << "NULL";
+        }
+        else
+        {
+            marshalToPGArrayItem(conn, oss, v[i]);
+        }
+    }
+    oss << '}';
+    out = oss.str();
+}
+
+// Accumulates rows in the binary format of the postgres COPY command, then
+// streams them into a temporary table that the bulk upserts merge from. This
+// skips the text formatting and parsing of marshalToPGArray.
+class PGBinaryCopy
+{
+    std::string mData;
+    uint16_t const mNumFields;
+
+    void
+    putInt(uint64_t v, size_t bytes)
+    {
+        for (size_t i = bytes; i-- > 0;)
+        {
+            mData.push_back(static_cast<char>((v >> (8 * i)) & 0xff));
+        }
+    }
+
+  public:
+    explicit PGBinaryCopy(uint16_t numFields) : mNumFields(numFields)
+    {
+        // Signature, flags and header extension length
+        static char const signature[] = "PGCOPY\n\377\r\n";
+        mData.append(signature, sizeof(signature));
+        putInt(0, 4);
+        putInt(0, 4);
+    }
+
+    void
+    beginRow()
+    {
+        putInt(mNumFields, 2);
+    }
+
+    void
+    put(std::string const& v)
+    {
+        putInt(v.size(), 4);
+        mData.append(v);
+    }
+
+    void
+    put(int32_t v)
+    {
+        putInt(4, 4);
+        putInt(static_cast<uint32_t>(v), 4);
+    }
+
+    void
+    put(int64_t v)
+    {
+        putInt(8, 4);
+        putInt(static_cast<uint64_t>(v), 8);
+    }
+
+    void
+    put(double v)
+    {
+        uint64_t bits;
+        static_assert(sizeof(bits) == sizeof(v), "double is not 64 bits");
+        std::memcpy(&bits, &v, sizeof(bits));
+        putInt(8, 4);
+        putInt(bits, 8);
+    }
+
+    template <typename T>
+    void
+    put(T const& v, soci::indicator ind)
+    {
+        if (ind == soci::i_null)
+        {
+            putInt(UINT32_MAX, 4);
+        }
+        else
+        {
+            put(v);
+        }
+    }
+
+    // Streams the rows into the temporary table upsert_<table> through conn,
+    // the connection of session, after creating that table with the columns
+    // of table if needed and emptying it. Returns the name of the temporary
+    // table. Throws if anything fails.
+    std::string copyInto(soci::session& session, PGconn* conn,
+                         std::string const& table, std::string const& columns);
+};
+#endif
 }
@@ -734,6 +734,13 @@ HerderSCPDriver::combineCandidates(uint64_t slotIndex,
             "HerderSCPDriver: combineCandidates posts recvTxSet");
     }
 
+    // The composite value is very likely to be externalized: start loading
+    // what it touches while balloting runs
+    if (mLedgerManager.isSynced())
+    {
+        mLedgerManager.prefetchAhead(bestTxSet->mTransactions);
+    }
+
     // Ballot Protocol uses BASIC values
     comp.ext.v(STELLAR_VALUE_BASIC);
     auto res = wrapStellarValue(comp);
@@ -152,7 +152,17 @@ StateSnapshot::differingHASFiles(HistoryArchiveState const& other)
     {
         auto b = mApp.getBucketManager().getBucketByHash(hexToBin256(hash));
         assert(b);
-        addIfExists(std::make_shared<FileTransferInfo>(*b));
+        if (b->isBlockCompressed())
+        {
+            auto f = std::make_shared<FileTransferInfo>(
+                mSnapDir, HISTORY_FILE_TYPE_BUCKET, hash);
+            mUncompressedBucketFiles[f->localPath_nogz()] = b;
+            files.push_back(f);
+        }
+        else
+        {
+            addIfExists(std::make_shared<FileTransferInfo>(*b));
+        }
     }
 
     return files;
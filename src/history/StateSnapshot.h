@@ -15,6 +15,7 @@
 namespace stellar
 {
 
+class Bucket;
 class FileTransferInfo;
 
 struct StateSnapshot : public std::enable_shared_from_this<StateSnapshot>
@@ -26,6 +27,9 @@ struct StateSnapshot : public std::enable_shared_from_this<StateSnapshot>
     std::shared_ptr<FileTransferInfo> mTransactionSnapFile;
     std::shared_ptr<FileTransferInfo> mTransactionResultSnapFile;
     std::shared_ptr<FileTransferInfo> mSCPHistorySnapFile;
+    // Block-compressed buckets among differingHASFiles, by the file in
+    // mSnapDir that they are published from once written uncompressed
+    std::map<std::string, std::shared_ptr<Bucket>> mUncompressedBucketFiles;
 
     StateSnapshot(Application& app, HistoryArchiveState const& state);
     bool writeHistoryBlocks() const;
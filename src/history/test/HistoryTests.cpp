@@ -389,6 +389,17 @@ TEST_CASE("History publish", "[history][publish]")
     catchupSimulation.ensureOfflineCatchupPossible(checkpointLedger);
 }
 
+TEST_CASE("History publish with block-compressed buckets", "[history]")
+{
+    // Buckets are published uncompressed, under the same hashes
+    auto configurator =
+        std::make_shared<BlockCompressedTmpDirHistoryConfigurator>();
+    CatchupSimulation catchupSimulation{VirtualClock::VIRTUAL_TIME,
+                                        configurator};
+    auto checkpointLedger = catchupSimulation.getLastCheckpointLedger(2);
+    catchupSimulation.ensureOfflineCatchupPossible(checkpointLedger);
+}
+
 TEST_CASE("History publish to multiple archives", "[history]")
 {
     Config cfg(getTestConfig());
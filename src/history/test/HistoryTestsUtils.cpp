@@ -124,6 +124,15 @@ RealGenesisTmpDirHistoryConfigurator::configure(Config& mCfg,
     return mCfg;
 }
 
+Config&
+BlockCompressedTmpDirHistoryConfigurator::configure(Config& mCfg,
+                                                    bool writable) const
+{
+    TmpDirHistoryConfigurator::configure(mCfg, writable);
+    mCfg.COMPRESS_BUCKET_FILES = true;
+    return mCfg;
+}
+
 BucketOutputIteratorForTesting::BucketOutputIteratorForTesting(
     std::string const& tmpDir, uint32_t protocolVersion, MergeCounters& mc)
     : BucketOutputIterator{tmpDir, true,
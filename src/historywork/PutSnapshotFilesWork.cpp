@@ -10,6 +10,7 @@
 #include "historywork/GzipFileWork.h"
 #include "historywork/PutFilesWork.h"
 #include "historywork/PutHistoryArchiveStateWork.h"
+#include "historywork/WriteUncompressedBucketWork.h"
 #include "main/Application.h"
 #include "work/WorkSequence.h"
 #include <util/format.h>
@@ -70,10 +71,23 @@ PutSnapshotFilesWork::doWork()
         auto status = WorkUtils::getWorkStatus(works);
         if (status == State::WORK_SUCCESS)
         {
-            // Step 2: Gzip all unique files
+            // Step 2: Gzip all unique files, block-compressed buckets from
+            // an uncompressed copy
             for (auto const& f : getFilesToZip())
             {
-                mGzipFilesWorks.emplace_back(addWork<GzipFileWork>(f, true));
+                auto bucket = mSnapshot->mUncompressedBucketFiles.find(f);
+                if (bucket == mSnapshot->mUncompressedBucketFiles.end())
+                {
+                    mGzipFilesWorks.emplace_back(
+                        addWork<GzipFileWork>(f, true));
+                    continue;
+                }
+                std::vector<std::shared_ptr<BasicWork>> seq{
+                    std::make_shared<WriteUncompressedBucketWork>(
+                        mApp, bucket->second, f),
+                    std::make_shared<GzipFileWork>(mApp, f, true)};
+                mGzipFilesWorks.emplace_back(addWork<WorkSequence>(
+                    "uncompress-and-gzip-" + f, seq, BasicWork::RETRY_NEVER));
             }
             return State::WORK_RUNNING;
         }
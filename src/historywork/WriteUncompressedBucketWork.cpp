@@ -0,0 +1,102 @@
+// Copyright 2020 Stellar Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "historywork/WriteUncompressedBucketWork.h"
+#include "bucket/Bucket.h"
+#include "crypto/Hex.h"
+#include "crypto/SHA.h"
+#include "main/Application.h"
+#include "util/Logging.h"
+#include "util/XDRStream.h"
+
+namespace stellar
+{
+
+WriteUncompressedBucketWork::WriteUncompressedBucketWork(
+    Application& app, std::shared_ptr<Bucket const> bucket,
+    std::string const& filename)
+    : BasicWork(app,
+                "write-uncompressed-bucket-" + hexAbbrev(bucket->getHash()),
+                BasicWork::RETRY_A_FEW)
+    , mBucket(bucket)
+    , mFilename(filename)
+{
+}
+
+void
+WriteUncompressedBucketWork::onReset()
+{
+    mDone = false;
+    mSuccess = true;
+    std::remove(mFilename.c_str());
+}
+
+BasicWork::State
+WriteUncompressedBucketWork::onRun()
+{
+    if (mDone)
+    {
+        return mSuccess ? State::WORK_SUCCESS : State::WORK_FAILURE;
+    }
+
+    std::weak_ptr<WriteUncompressedBucketWork> weak(
+        std::static_pointer_cast<WriteUncompressedBucketWork>(
+            shared_from_this()));
+
+    auto work = [weak, bucket = mBucket, filename = mFilename]() {
+        bool success = true;
+        try
+        {
+            XDRInputMappedStream in;
+            in.open(bucket->getFilename());
+            XDROutputFileStream out(/*fsyncOnClose=*/false);
+            out.open(filename);
+            auto hasher = SHA256::create();
+            uint8_t const* data;
+            size_t size;
+            while (in.readOneXdr(data, size))
+            {
+                out.writeOneXdr(ByteSlice(data, size), hasher.get());
+            }
+            out.close();
+            if (hasher->finish() != bucket->getHash())
+            {
+                CLOG(ERROR, "History")
+                    << "Uncompressed copy of bucket "
+                    << binToHex(bucket->getHash()) << " has another hash";
+                success = false;
+            }
+        }
+        catch (std::exception& e)
+        {
+            CLOG(WARNING, "History")
+                << "Failed to write uncompressed copy of bucket "
+                << binToHex(bucket->getHash()) << ": " << e.what();
+            success = false;
+        }
+
+        auto self = weak.lock();
+        if (!self)
+        {
+            return;
+        }
+        // BasicWork's state is only touched on the main thread, as in
+        // WriteSnapshotWork
+        self->mApp.postOnMainThread(
+            [weak, success]() {
+                auto self = weak.lock();
+                if (self)
+                {
+                    self->mDone = true;
+                    self->mSuccess = success;
+                    self->wakeUp();
+                }
+            },
+            "WriteUncompressedBucketWork: finish");
+    };
+
+    mApp.postOnBackgroundThread(work, "WriteUncompressedBucketWork: start");
+    return State::WORK_WAITING;
+}
+}
@@ -0,0 +1,39 @@
+// Copyright 2020 Stellar Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#pragma once
+
+#include "work/Work.h"
+
+namespace stellar
+{
+
+class Bucket;
+
+// Writes an uncompressed copy of a block-compressed bucket to a file, on a
+// worker thread, checking that it has the hash of the bucket. Buckets are
+// published from such copies, as history archives hold uncompressed buckets.
+class WriteUncompressedBucketWork : public BasicWork
+{
+    std::shared_ptr<Bucket const> mBucket;
+    std::string const mFilename;
+    bool mDone{false};
+    bool mSuccess{true};
+
+  public:
+    WriteUncompressedBucketWork(Application& app,
+                                std::shared_ptr<Bucket const> bucket,
+                                std::string const& filename);
+    ~WriteUncompressedBucketWork() = default;
+
+  protected:
+    State onRun() override;
+    void onReset() override;
+    bool
+    onAbort() override
+    {
+        return true;
+    };
+};
+}
@@ -43,6 +43,7 @@ InvariantManagerImpl::getJsonInfo()
 {
     Json::Value failures;
 
+    std::lock_guard<std::mutex> guard(mFailureInformationMutex);
     for (auto const& fi : mFailureInformation)
     {
         auto& fail = failures[fi.first];
@@ -207,7 +208,10 @@ InvariantManagerImpl::onInvariantFailure(std::shared_ptr<Invariant> invariant,
                                          uint32_t ledger)
 {
     mInvariantFailureCount.inc();
-    mFailureInformation[invariant->getName()] = {ledger, message};
+    {
+        std::lock_guard<std::mutex> guard(mFailureInformationMutex);
+        mFailureInformation[invariant->getName()] = {ledger, message};
+    }
     handleInvariantFailure(invariant, message);
 }
 
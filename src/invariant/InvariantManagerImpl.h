@@ -6,6 +6,7 @@
 
 #include "invariant/InvariantManager.h"
 #include <map>
+#include <mutex>
 #include <vector>
 
 namespace medida
@@ -28,6 +29,8 @@ class InvariantManagerImpl : public InvariantManager
         uint32_t lastFailedOnLedger;
         std::string lastFailedWithMessage;
     };
+    // checkOnOperationApply may run on parallel apply worker threads
+    std::mutex mFailureInformationMutex;
     std::map<std::string, InvariantFailureInformation> mFailureInformation;
 
   public:
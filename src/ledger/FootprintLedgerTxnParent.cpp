@@ -0,0 +1,220 @@
+// Copyright 2020 Stellar Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "ledger/FootprintLedgerTxnParent.h"
+#include "util/XDROperators.h"
+#include <stdexcept>
+
+namespace stellar
+{
+
+FootprintLedgerTxnParent::FootprintLedgerTxnParent(
+    Snapshot const& snapshot, std::unordered_set<LedgerKey> const& footprint,
+    LedgerHeader const& header)
+    : mSnapshot(snapshot)
+    , mFootprint(footprint)
+    , mHeader(header)
+    , mChild(nullptr)
+    , mEscaped(false)
+{
+}
+
+void
+FootprintLedgerTxnParent::escape(std::string const& what) const
+{
+    mEscaped = true;
+    throw std::runtime_error("transaction escaped its footprint: " + what);
+}
+
+FootprintLedgerTxnParent::Delta const&
+FootprintLedgerTxnParent::getDelta() const
+{
+    return mDelta;
+}
+
+void
+FootprintLedgerTxnParent::addChild(AbstractLedgerTxn& child)
+{
+    if (mChild)
+    {
+        throw std::runtime_error("FootprintLedgerTxnParent already has child");
+    }
+    mChild = &child;
+}
+
+void
+FootprintLedgerTxnParent::commitChild(EntryIterator iter,
+                                      LedgerTxnConsistency cons)
+{
+    if (!(mChild->getHeader() == mHeader))
+    {
+        escape("ledger header modified");
+    }
+
+    for (; (bool)iter; ++iter)
+    {
+        if (iter.entryExists())
+        {
+            mDelta.emplace_back(iter.key(),
+                                std::make_shared<LedgerEntry>(iter.entry()));
+        }
+        else
+        {
+            mDelta.emplace_back(iter.key(), nullptr);
+        }
+    }
+    mChild = nullptr;
+}
+
+void
+FootprintLedgerTxnParent::rollbackChild()
+{
+    mChild = nullptr;
+}
+
+std::unordered_map<LedgerKey, LedgerEntry>
+FootprintLedgerTxnParent::getAllOffers()
+{
+    escape("getAllOffers");
+    return {};
+}
+
+std::shared_ptr<LedgerEntry const>
+FootprintLedgerTxnParent::getBestOffer(Asset const& buying,
+                                       Asset const& selling)
+{
+    escape("getBestOffer");
+    return nullptr;
+}
+
+std::shared_ptr<LedgerEntry const>
+FootprintLedgerTxnParent::getBestOffer(Asset const& buying,
+                                       Asset const& selling,
+                                       OfferDescriptor const& worseThan)
+{
+    escape("getBestOffer");
+    return nullptr;
+}
+
+std::unordered_map<LedgerKey, LedgerEntry>
+FootprintLedgerTxnParent::getOffersByAccountAndAsset(AccountID const& account,
+                                                     Asset const& asset)
+{
+    escape("getOffersByAccountAndAsset");
+    return {};
+}
+
+LedgerHeader const&
+FootprintLedgerTxnParent::getHeader() const
+{
+    return mHeader;
+}
+
+std::vector<InflationWinner>
+FootprintLedgerTxnParent::getInflationWinners(size_t maxWinners,
+                                              int64_t minBalance)
+{
+    escape("getInflationWinners");
+    return {};
+}
+
+std::shared_ptr<LedgerEntry const>
+FootprintLedgerTxnParent::getNewestVersion(LedgerKey const& key) const
+{
+    if (mFootprint.find(key) == mFootprint.end())
+    {
+        escape("getNewestVersion");
+    }
+    auto iter = mSnapshot.find(key);
+    return iter != mSnapshot.end() ? iter->second : nullptr;
+}
+
+uint64_t
+FootprintLedgerTxnParent::countObjects(LedgerEntryType let) const
+{
+    throw std::runtime_error("called countObjects on FootprintLedgerTxnParent");
+}
+
+uint64_t
+FootprintLedgerTxnParent::countObjects(LedgerEntryType let,
+                                       LedgerRange const& ledgers) const
+{
+    throw std::runtime_error("called countObjects on FootprintLedgerTxnParent");
+}
+
+void
+FootprintLedgerTxnParent::deleteObjectsModifiedOnOrAfterLedger(
+    uint32_t ledger) const
+{
+    throw std::runtime_error(
+        "called deleteObjectsModifiedOnOrAfterLedger on "
+        "FootprintLedgerTxnParent");
+}
+
+void
+FootprintLedgerTxnParent::dropAccounts()
+{
+    throw std::runtime_error("called dropAccounts on FootprintLedgerTxnParent");
+}
+
+void
+FootprintLedgerTxnParent::dropData()
+{
+    throw std::runtime_error("called dropData on FootprintLedgerTxnParent");
+}
+
+void
+FootprintLedgerTxnParent::dropOffers()
+{
+    throw std::runtime_error("called dropOffers on FootprintLedgerTxnParent");
+}
+
+void
+FootprintLedgerTxnParent::dropTrustLines()
+{
+    throw std::runtime_error(
+        "called dropTrustLines on FootprintLedgerTxnParent");
+}
+
+void
+FootprintLedgerTxnParent::writeInParallel(LedgerEntryWrites const& entries,
+                                          size_t nThreads)
+{
+    throw std::runtime_error(
+        "called writeInParallel on FootprintLedgerTxnParent");
+}
+
+void
+FootprintLedgerTxnParent::loadInMemoryState()
+{
+    throw std::runtime_error(
+        "called loadInMemoryState on FootprintLedgerTxnParent");
+}
+
+double
+FootprintLedgerTxnParent::getPrefetchHitRate() const
+{
+    return 0.0;
+}
+
+EntryCacheCounters
+FootprintLedgerTxnParent::getEntryCacheCounters(LedgerEntryType let) const
+{
+    return {};
+}
+
+uint32_t
+FootprintLedgerTxnParent::prefetch(std::unordered_set<LedgerKey> const& keys)
+{
+    // Everything in the footprint is already in the snapshot
+    return 0;
+}
+
+bool
+FootprintLedgerTxnParent::prefetchAsync(
+    std::unordered_set<LedgerKey> const& keys)
+{
+    return false;
+}
+}
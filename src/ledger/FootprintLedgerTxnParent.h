@@ -0,0 +1,108 @@
+#pragma once
+
+// Copyright 2020 Stellar Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "ledger/LedgerHashUtils.h"
+#include "ledger/LedgerTxn.h"
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+// A read-only AbstractLedgerTxnParent that serves a fixed set of ledger entries
+// (the "footprint" of a transaction) out of a snapshot taken on the main
+// thread, so that a transaction can be applied on a worker thread without
+// touching the real LedgerTxn stack.
+//
+// Any access to an entry outside of the footprint, any offer or inflation
+// query, and any change to the ledger header marks the parent as escaped and
+// throws. A transaction applied against an escaped parent must be discarded
+// and applied again serially.
+//
+// Committing a child does not modify the snapshot; the committed entries are
+// recorded and can be retrieved with getDelta to be merged into the real
+// LedgerTxn afterwards. Each instance is only ever used from one thread at a
+// time, the snapshot is shared read-only between instances.
+
+namespace stellar
+{
+
+class FootprintLedgerTxnParent : public AbstractLedgerTxnParent
+{
+  public:
+    typedef std::unordered_map<LedgerKey, std::shared_ptr<LedgerEntry const>>
+        Snapshot;
+    typedef std::vector<std::pair<LedgerKey, std::shared_ptr<LedgerEntry const>>>
+        Delta;
+
+  private:
+    Snapshot const& mSnapshot;
+    std::unordered_set<LedgerKey> const& mFootprint;
+    LedgerHeader const& mHeader;
+    AbstractLedgerTxn* mChild;
+    Delta mDelta;
+    mutable bool mEscaped;
+
+    void escape(std::string const& what) const;
+
+  public:
+    FootprintLedgerTxnParent(Snapshot const& snapshot,
+                             std::unordered_set<LedgerKey> const& footprint,
+                             LedgerHeader const& header);
+
+    bool
+    hasEscaped() const
+    {
+        return mEscaped;
+    }
+
+    // Entries committed by children, in commit order. A null entry means
+    // the key was erased.
+    Delta const& getDelta() const;
+
+    void addChild(AbstractLedgerTxn& child) override;
+    void commitChild(EntryIterator iter, LedgerTxnConsistency cons) override;
+    void rollbackChild() override;
+
+    std::unordered_map<LedgerKey, LedgerEntry> getAllOffers() override;
+    std::shared_ptr<LedgerEntry const>
+    getBestOffer(Asset const& buying, Asset const& selling) override;
+    std::shared_ptr<LedgerEntry const>
+    getBestOffer(Asset const& buying, Asset const& selling,
+                 OfferDescriptor const& worseThan) override;
+    std::unordered_map<LedgerKey, LedgerEntry>
+    getOffersByAccountAndAsset(AccountID const& account,
+                               Asset const& asset) override;
+
+    LedgerHeader const& getHeader() const override;
+
+    std::vector<InflationWinner>
+    getInflationWinners(size_t maxWinners, int64_t minBalance) override;
+
+    std::shared_ptr<LedgerEntry const>
+    getNewestVersion(LedgerKey const& key) const override;
+
+    uint64_t countObjects(LedgerEntryType let) const override;
+    uint64_t countObjects(LedgerEntryType let,
+                          LedgerRange const& ledgers) const override;
+
+    void deleteObjectsModifiedOnOrAfterLedger(uint32_t ledger) const override;
+
+    void dropAccounts() override;
+    void dropData() override;
+    void dropOffers() override;
+    void dropTrustLines() override;
+    void writeInParallel(LedgerEntryWrites const& entries,
+                         size_t nThreads) override;
+    void loadInMemoryState() override;
+    double getPrefetchHitRate() const override;
+    EntryCacheCounters
+    getEntryCacheCounters(LedgerEntryType let) const override;
+    uint32_t prefetch(std::unordered_set<LedgerKey> const& keys) override;
+    bool prefetchAsync(std::unordered_set<LedgerKey> const& keys) override;
+};
+}
@@ -1,6 +1,8 @@
 #include "ledger/InMemoryLedgerTxnRoot.h"
+#include "crypto/KeyUtils.h"
 #include "ledger/LedgerRange.h"
 #include "ledger/LedgerTxn.h"
+#include "util/GlobalChecks.h"
 #include "util/XDROperators.h"
 #include "util/types.h"
 #include "xdr/Stellar-ledger-entries.h"
@@ -10,6 +12,14 @@
 namespace stellar
 {
 
+// Estimated like the entries of the entry cache of LedgerTxnRoot
+static uint64_t
+entryBytes(LedgerKey const& key, LedgerEntry const& entry)
+{
+    return sizeof(LedgerKey) + sizeof(LedgerEntry) + xdr::xdr_size(key) +
+           xdr::xdr_size(entry);
+}
+
 InMemoryLedgerTxnRoot::InMemoryLedgerTxnRoot()
     : mHeader(std::make_unique<LedgerHeader>())
 {
@@ -18,44 +28,222 @@ InMemoryLedgerTxnRoot::InMemoryLedgerTxnRoot()
 void
 InMemoryLedgerTxnRoot::addChild(AbstractLedgerTxn& child)
 {
+    if (mChild)
+    {
+        throw std::runtime_error("InMemoryLedgerTxnRoot already has child");
+    }
+    mChild = &child;
+}
+
+void
+InMemoryLedgerTxnRoot::throwIfChild() const
+{
+    if (mChild)
+    {
+        throw std::runtime_error("InMemoryLedgerTxnRoot has child");
+    }
 }
 
 void
 InMemoryLedgerTxnRoot::commitChild(EntryIterator iter,
                                    LedgerTxnConsistency cons)
 {
-    throw std::runtime_error("committing to stub InMemoryLedgerTxnRoot");
+    // Erasing a key that is not there is harmless, so cons does not matter
+    try
+    {
+        auto childHeader = std::make_unique<LedgerHeader>(mChild->getHeader());
+        for (; (bool)iter; ++iter)
+        {
+            putEntry(iter.key(),
+                     iter.entryExists()
+                         ? std::make_shared<LedgerEntry const>(iter.entry())
+                         : nullptr);
+        }
+        mHeader.swap(childHeader);
+    }
+    catch (std::exception& e)
+    {
+        printErrorAndAbort(
+            "fatal error during commit to InMemoryLedgerTxnRoot: ", e.what());
+    }
+    catch (...)
+    {
+        printErrorAndAbort(
+            "unknown fatal error during commit to InMemoryLedgerTxnRoot");
+    }
+    mChild = nullptr;
 }
 
 void
 InMemoryLedgerTxnRoot::rollbackChild()
 {
+    mChild = nullptr;
+}
+
+void
+InMemoryLedgerTxnRoot::putEntry(
+    LedgerKey const& key, std::shared_ptr<LedgerEntry const> const& entry) const
+{
+    auto& entries = mEntries[key.type()];
+    auto& footprint = mFootprints[key.type()];
+    auto iter = entries.find(key);
+    if (iter != entries.end())
+    {
+        footprint.mBytes -= entryBytes(key, *iter->second);
+        --footprint.mEntries;
+        if (key.type() == OFFER)
+        {
+            eraseFromOrderBook(*iter->second);
+        }
+        if (entry)
+        {
+            iter->second = entry;
+        }
+        else
+        {
+            entries.erase(key);
+        }
+    }
+    else if (entry)
+    {
+        entries.emplace(key, entry);
+    }
+
+    if (entry)
+    {
+        footprint.mBytes += entryBytes(key, *entry);
+        ++footprint.mEntries;
+        if (key.type() == OFFER)
+        {
+            insertInOrderBook(entry);
+        }
+    }
+}
+
+void
+InMemoryLedgerTxnRoot::insertInOrderBook(
+    std::shared_ptr<LedgerEntry const> const& offer) const
+{
+    auto const& oe = offer->data.offer();
+    mMultiOrderBook[{oe.buying, oe.selling}].emplace(
+        OfferDescriptor{oe.price, oe.offerID}, offer);
+    for (auto const& asset : {oe.selling, oe.buying})
+    {
+        if (asset.type() != ASSET_TYPE_NATIVE)
+        {
+            mOffersBySeller[oe.sellerID][asset].emplace(oe.offerID);
+        }
+    }
+}
+
+void
+InMemoryLedgerTxnRoot::eraseFromOrderBook(LedgerEntry const& offer) const
+{
+    auto const& oe = offer.data.offer();
+    auto mobIter = mMultiOrderBook.find({oe.buying, oe.selling});
+    if (mobIter != mMultiOrderBook.end())
+    {
+        mobIter->second.erase(OfferDescriptor{oe.price, oe.offerID});
+        if (mobIter->second.empty())
+        {
+            mMultiOrderBook.erase(mobIter);
+        }
+    }
+
+    auto sellerIter = mOffersBySeller.find(oe.sellerID);
+    if (sellerIter != mOffersBySeller.end())
+    {
+        auto& offersByAsset = sellerIter->second;
+        for (auto const& asset : {oe.selling, oe.buying})
+        {
+            auto assetIter = offersByAsset.find(asset);
+            if (assetIter != offersByAsset.end())
+            {
+                assetIter->second.erase(oe.offerID);
+                if (assetIter->second.empty())
+                {
+                    offersByAsset.erase(assetIter);
+                }
+            }
+        }
+        if (offersByAsset.empty())
+        {
+            mOffersBySeller.erase(sellerIter);
+        }
+    }
 }
 
 std::unordered_map<LedgerKey, LedgerEntry>
 InMemoryLedgerTxnRoot::getAllOffers()
 {
-    return std::unordered_map<LedgerKey, LedgerEntry>();
+    auto const& offers = getEntries(OFFER);
+    std::unordered_map<LedgerKey, LedgerEntry> res(offers.size());
+    for (auto const& kv : offers)
+    {
+        res.emplace(kv.first, *kv.second);
+    }
+    return res;
 }
 
 std::shared_ptr<LedgerEntry const>
 InMemoryLedgerTxnRoot::getBestOffer(Asset const& buying, Asset const& selling)
 {
-    return nullptr;
+    return getBestOffer(buying, selling, nullptr);
 }
 
 std::shared_ptr<LedgerEntry const>
 InMemoryLedgerTxnRoot::getBestOffer(Asset const& buying, Asset const& selling,
                                     OfferDescriptor const& worseThan)
 {
-    return nullptr;
+    return getBestOffer(buying, selling, &worseThan);
+}
+
+std::shared_ptr<LedgerEntry const>
+InMemoryLedgerTxnRoot::getBestOffer(Asset const& buying, Asset const& selling,
+                                    OfferDescriptor const* worseThan)
+{
+    auto mobIter = mMultiOrderBook.find({buying, selling});
+    if (mobIter == mMultiOrderBook.end())
+    {
+        return nullptr;
+    }
+
+    auto const& orderBook = mobIter->second;
+    auto iter = worseThan ? orderBook.upper_bound(*worseThan)
+                          : orderBook.cbegin();
+    return iter == orderBook.cend() ? nullptr : iter->second;
 }
 
 std::unordered_map<LedgerKey, LedgerEntry>
 InMemoryLedgerTxnRoot::getOffersByAccountAndAsset(AccountID const& account,
                                                   Asset const& asset)
 {
-    return std::unordered_map<LedgerKey, LedgerEntry>();
+    if (asset.type() == ASSET_TYPE_NATIVE)
+    {
+        throw std::runtime_error("Invalid asset type");
+    }
+
+    std::unordered_map<LedgerKey, LedgerEntry> res;
+    auto sellerIter = mOffersBySeller.find(account);
+    if (sellerIter == mOffersBySeller.end())
+    {
+        return res;
+    }
+    auto assetIter = sellerIter->second.find(asset);
+    if (assetIter == sellerIter->second.end())
+    {
+        return res;
+    }
+
+    auto const& offers = getEntries(OFFER);
+    LedgerKey key(OFFER);
+    key.offer().sellerID = account;
+    for (auto offerID : assetIter->second)
+    {
+        key.offer().offerID = offerID;
+        res.emplace(key, *offers.at(key));
+    }
+    return res;
 }
 
 LedgerHeader const&
@@ -68,52 +256,156 @@ std::vector<InflationWinner>
 InMemoryLedgerTxnRoot::getInflationWinners(size_t maxWinners,
                                            int64_t minBalance)
 {
-    return std::vector<InflationWinner>();
+    std::unordered_map<AccountID, int64_t> totals;
+    for (auto const& kv : getEntries(ACCOUNT))
+    {
+        auto const& ae = kv.second->data.account();
+        if (ae.inflationDest && ae.balance >= MIN_VOTES_TO_INCLUDE)
+        {
+            totals[*ae.inflationDest] += ae.balance;
+        }
+    }
+
+    // Ranked as by LedgerTxnRoot, by votes then by descending strkey
+    std::vector<std::pair<int64_t, std::string>> ranking;
+    for (auto const& kv : totals)
+    {
+        if (kv.second >= minBalance)
+        {
+            ranking.emplace_back(kv.second, KeyUtils::toStrKey(kv.first));
+        }
+    }
+    std::sort(ranking.begin(), ranking.end(),
+              std::greater<std::pair<int64_t, std::string>>());
+
+    std::vector<InflationWinner> winners;
+    for (size_t i = 0; i < ranking.size() && i < maxWinners; ++i)
+    {
+        winners.push_back({KeyUtils::fromStrKey<PublicKey>(ranking[i].second),
+                           ranking[i].first});
+    }
+    return winners;
+}
+
+InMemoryLedgerTxnRoot::EntryMap const&
+InMemoryLedgerTxnRoot::getEntries(LedgerEntryType let) const
+{
+    static EntryMap const empty;
+    auto iter = mEntries.find(let);
+    return iter == mEntries.end() ? empty : iter->second;
 }
 
 std::shared_ptr<LedgerEntry const>
 InMemoryLedgerTxnRoot::getNewestVersion(LedgerKey const& key) const
 {
-    return nullptr;
+    auto const& entries = getEntries(key.type());
+    auto iter = entries.find(key);
+    return iter == entries.end() ? nullptr : iter->second;
 }
 
 uint64_t
 InMemoryLedgerTxnRoot::countObjects(LedgerEntryType let) const
 {
-    return 0;
+    throwIfChild();
+    return getEntries(let).size();
 }
 
 uint64_t
 InMemoryLedgerTxnRoot::countObjects(LedgerEntryType let,
                                     LedgerRange const& ledgers) const
 {
-    return 0;
+    throwIfChild();
+    uint64_t count = 0;
+    for (auto const& kv : getEntries(let))
+    {
+        auto lastModified = kv.second->lastModifiedLedgerSeq;
+        if (lastModified >= ledgers.mFirst && lastModified <= ledgers.mLast)
+        {
+            ++count;
+        }
+    }
+    return count;
 }
 
 void
 InMemoryLedgerTxnRoot::deleteObjectsModifiedOnOrAfterLedger(
     uint32_t ledger) const
 {
+    throwIfChild();
+    for (auto let : {ACCOUNT, DATA, TRUSTLINE, OFFER})
+    {
+        std::vector<LedgerKey> toErase;
+        for (auto const& kv : getEntries(let))
+        {
+            if (kv.second->lastModifiedLedgerSeq >= ledger)
+            {
+                toErase.emplace_back(kv.first);
+            }
+        }
+        for (auto const& key : toErase)
+        {
+            putEntry(key, nullptr);
+        }
+    }
+}
+
+void
+InMemoryLedgerTxnRoot::dropEntries(LedgerEntryType let)
+{
+    mEntries.erase(let);
+    mFootprints.erase(let);
+    if (let == OFFER)
+    {
+        mMultiOrderBook.clear();
+        mOffersBySeller.clear();
+    }
 }
 
 void
 InMemoryLedgerTxnRoot::dropAccounts()
 {
+    throwIfChild();
+    dropEntries(ACCOUNT);
 }
 
 void
 InMemoryLedgerTxnRoot::dropData()
 {
+    throwIfChild();
+    dropEntries(DATA);
 }
 
 void
 InMemoryLedgerTxnRoot::dropOffers()
 {
+    throwIfChild();
+    dropEntries(OFFER);
 }
 
 void
 InMemoryLedgerTxnRoot::dropTrustLines()
 {
+    throwIfChild();
+    dropEntries(TRUSTLINE);
+}
+
+void
+InMemoryLedgerTxnRoot::writeInParallel(LedgerEntryWrites const& entries,
+                                       size_t nThreads)
+{
+    // There is no database to write in parallel to
+    throwIfChild();
+    for (auto const& item : entries)
+    {
+        putEntry(item.first, item.second);
+    }
+}
+
+void
+InMemoryLedgerTxnRoot::loadInMemoryState()
+{
+    // Everything is in memory already
+    throwIfChild();
 }
 
 double
@@ -122,9 +414,28 @@ InMemoryLedgerTxnRoot::getPrefetchHitRate() const
     return 0.0;
 }
 
+EntryCacheCounters
+InMemoryLedgerTxnRoot::getEntryCacheCounters(LedgerEntryType let) const
+{
+    return {};
+}
+
 uint32_t
 InMemoryLedgerTxnRoot::prefetch(std::unordered_set<LedgerKey> const& keys)
 {
     return 0;
 }
+
+bool
+InMemoryLedgerTxnRoot::prefetchAsync(std::unordered_set<LedgerKey> const& keys)
+{
+    return false;
+}
+
+InMemoryLedgerTxnRoot::Footprint
+InMemoryLedgerTxnRoot::getFootprint(LedgerEntryType let) const
+{
+    auto iter = mFootprints.find(let);
+    return iter == mFootprints.end() ? Footprint{} : iter->second;
+}
 }
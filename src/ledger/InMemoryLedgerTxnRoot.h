@@ -1,24 +1,82 @@
+#pragma once
+
 #include "ledger/LedgerTxn.h"
 #include "ledger/LedgerTxnImpl.h"
+#include "util/FlatHashMap.h"
 #include "xdr/Stellar-ledger-entries.h"
 #include <map>
 #include <set>
 #include <unordered_map>
 #include <vector>
 
-// This is a stub helper class that pretends to implements a "root"
-// AbstractLedgerTxnParent like LedgerTxnRoot but returns empty/null values for
-// any query made of it, and throws if anyone ever tries to commit to it.
+// This is a root AbstractLedgerTxnParent like LedgerTxnRoot that keeps the
+// whole ledger state in memory instead of in the database: every entry in a
+// hash map per type of entry, with the offers also indexed as an order book
+// and by seller and asset, so that no query made of it touches the database.
+// Commits replace the entries in place, and the drop functions and
+// deleteObjectsModifiedOnOrAfterLedger act on the maps as LedgerTxnRoot does
+// on the tables.
 //
-// This is used to anchor a live-but-never-committed LedgerTxn when doing
-// strictly-in-memory fast history replay.
+// This is used in MODE_USES_IN_MEMORY_LEDGER, both for strictly-in-memory
+// fast history replay and for nodes that rebuild the ledger state from the
+// bucket list when they start. It only works when the ledger fits in RAM.
 
 namespace stellar
 {
 
 class InMemoryLedgerTxnRoot : public AbstractLedgerTxnParent
 {
+  public:
+    // The number of entries of one type that an InMemoryLedgerTxnRoot holds,
+    // and an estimate of the memory that they and their keys take.
+    struct Footprint
+    {
+        uint64_t mEntries{0};
+        uint64_t mBytes{0};
+    };
+
+  private:
+    typedef FlatHashMap<LedgerKey, std::shared_ptr<LedgerEntry const>>
+        EntryMap;
+    typedef std::map<OfferDescriptor, std::shared_ptr<LedgerEntry const>,
+                     IsBetterOfferComparator>
+        OrderBook;
+    typedef std::unordered_map<AssetPair, OrderBook, AssetPairHash>
+        MultiOrderBook;
+    typedef std::unordered_map<Asset, std::set<int64_t>> OffersByAsset;
+
     std::unique_ptr<LedgerHeader> mHeader;
+    AbstractLedgerTxn* mChild{nullptr};
+
+    // The maps are mutable because deleteObjectsModifiedOnOrAfterLedger is
+    // const, as it is for LedgerTxnRoot
+    mutable std::unordered_map<LedgerEntryType, EntryMap> mEntries;
+    mutable std::unordered_map<LedgerEntryType, Footprint> mFootprints;
+    mutable MultiOrderBook mMultiOrderBook;
+    mutable std::unordered_map<AccountID, OffersByAsset> mOffersBySeller;
+
+    void throwIfChild() const;
+
+    // getEntries does not insert anything, so that concurrent readers are
+    // safe while there is no writer
+    EntryMap const& getEntries(LedgerEntryType let) const;
+
+    // putEntry replaces the entry of key, if any, by entry, or erases it if
+    // entry is null, keeping the order book and the footprint in step. It has
+    // the basic exception safety guarantee.
+    void putEntry(LedgerKey const& key,
+                  std::shared_ptr<LedgerEntry const> const& entry) const;
+
+    void
+    insertInOrderBook(std::shared_ptr<LedgerEntry const> const& offer) const;
+    void eraseFromOrderBook(LedgerEntry const& offer) const;
+
+    // dropEntries does not throw
+    void dropEntries(LedgerEntryType let);
+
+    std::shared_ptr<LedgerEntry const>
+    getBestOffer(Asset const& buying, Asset const& selling,
+                 OfferDescriptor const* worseThan);
 
   public:
     InMemoryLedgerTxnRoot();
@@ -54,7 +112,16 @@ class InMemoryLedgerTxnRoot : public AbstractLedgerTxnParent
     void dropData() override;
     void dropOffers() override;
     void dropTrustLines() override;
+    void writeInParallel(LedgerEntryWrites const& entries,
+                         size_t nThreads) override;
+    void loadInMemoryState() override;
     double getPrefetchHitRate() const override;
+    EntryCacheCounters
+    getEntryCacheCounters(LedgerEntryType let) const override;
     uint32_t prefetch(std::unordered_set<LedgerKey> const& keys) override;
+    bool prefetchAsync(std::unordered_set<LedgerKey> const& keys) override;
+
+    // Returns the footprint of the entries of type let.
+    Footprint getFootprint(LedgerEntryType let) const;
 };
 }
@@ -0,0 +1,224 @@
+// Copyright 2020 Stellar Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "ledger/LedgerCloseMetaStream.h"
+#include "main/Application.h"
+#include "main/Config.h"
+#include "util/GlobalChecks.h"
+#include "util/Logging.h"
+#include "util/TmpDir.h"
+
+#include "medida/counter.h"
+#include "medida/metrics_registry.h"
+#include "medida/timer.h"
+
+#include <cstdio>
+
+namespace stellar
+{
+
+static LedgerCloseMetaStream::Backpressure
+backpressureFromConfig(Config const& cfg)
+{
+    if (cfg.METADATA_OUTPUT_BACKPRESSURE == "DROP")
+    {
+        return LedgerCloseMetaStream::Backpressure::DROP;
+    }
+    if (cfg.METADATA_OUTPUT_BACKPRESSURE == "SPILL")
+    {
+        return LedgerCloseMetaStream::Backpressure::SPILL;
+    }
+    return LedgerCloseMetaStream::Backpressure::BLOCK;
+}
+
+LedgerCloseMetaStream::LedgerCloseMetaStream(
+    Application& app, std::unique_ptr<XDROutputFileStream> out)
+    : LedgerCloseMetaStream(app, std::move(out), nullptr)
+{
+}
+
+LedgerCloseMetaStream::LedgerCloseMetaStream(
+    Application& app, std::unique_ptr<ShmRingBufferWriter> shm)
+    : LedgerCloseMetaStream(app, nullptr, std::move(shm))
+{
+}
+
+LedgerCloseMetaStream::LedgerCloseMetaStream(
+    Application& app, std::unique_ptr<XDROutputFileStream> out,
+    std::unique_ptr<ShmRingBufferWriter> shm)
+    : mOut(std::move(out))
+    , mShm(std::move(shm))
+    , mBackpressure(backpressureFromConfig(app.getConfig()))
+    , mQueueSize(app.getConfig().METADATA_OUTPUT_QUEUE_SIZE)
+    , mQueueDepth(
+          app.getMetrics().NewCounter({"ledger", "metastream", "queue-depth"}))
+    , mWrite(app.getMetrics().NewTimer({"ledger", "metastream", "write"}))
+    , mBlocked(app.getMetrics().NewTimer({"ledger", "metastream", "blocked"}))
+    , mDropped(
+          app.getMetrics().NewCounter({"ledger", "metastream", "dropped"}))
+    , mSpilled(
+          app.getMetrics().NewCounter({"ledger", "metastream", "spilled"}))
+{
+    if (mBackpressure == Backpressure::BLOCK)
+    {
+        return;
+    }
+    if (mBackpressure == Backpressure::SPILL)
+    {
+        mSpillDir = std::make_unique<TmpDir>(
+            app.getTmpDirManager().tmpDir("metastream"));
+    }
+    mWriter = std::thread([this]() { runWriter(); });
+}
+
+LedgerCloseMetaStream::~LedgerCloseMetaStream()
+{
+    if (!mWriter.joinable())
+    {
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        mStopping = true;
+    }
+    mChanged.notify_all();
+    mWriter.join();
+}
+
+std::string
+LedgerCloseMetaStream::spillPath(uint64_t generation) const
+{
+    return mSpillDir->getName() + "/spill-" + std::to_string(generation) +
+           ".xdr";
+}
+
+void
+LedgerCloseMetaStream::write(LedgerCloseMeta&& lcm)
+{
+    if (mBackpressure == Backpressure::BLOCK)
+    {
+        auto timer = mBlocked.TimeScope();
+        writeOut(lcm);
+        return;
+    }
+
+    std::unique_lock<std::mutex> lock(mMutex);
+    // BLOCK returned above, so a full queue either drops or spills
+    if (mBackpressure == Backpressure::DROP && mQueue.size() >= mQueueSize)
+    {
+        mDropped.inc();
+        CLOG(WARNING, "Ledger")
+            << "Dropping metadata of ledger "
+            << lcm.v0().ledgerHeader.header.ledgerSeq << ", " << mQueue.size()
+            << " ledgers are waiting to be streamed";
+        return;
+    }
+
+    if (mSpillSize > 0 || mQueue.size() >= mQueueSize)
+    {
+        // Once a ledger is spilled, the following ones are spilled too until
+        // the writer takes the spill file, so that ledgers stay in order
+        if (!mSpill)
+        {
+            mSpill = std::make_unique<XDROutputFileStream>(
+                /*fsyncOnClose=*/false);
+            mSpill->open(spillPath(mSpillGeneration));
+        }
+        mSpill->writeOne(lcm);
+        ++mSpillSize;
+        mSpilled.inc();
+    }
+    else
+    {
+        mQueue.emplace_back(std::move(lcm));
+        mQueueDepth.set_count(mQueue.size());
+    }
+    lock.unlock();
+    mChanged.notify_all();
+}
+
+void
+LedgerCloseMetaStream::writeOut(LedgerCloseMeta const& lcm)
+{
+    auto timer = mWrite.TimeScope();
+    if (mShm)
+    {
+        mShm->writeOne(lcm);
+    }
+    else
+    {
+        mOut->writeOne(lcm);
+        mOut->flush();
+    }
+}
+
+void
+LedgerCloseMetaStream::writeOutSpill(std::string const& path, size_t size)
+{
+    XDRInputFileStream in;
+    in.open(path);
+    LedgerCloseMeta lcm;
+    size_t n = 0;
+    while (in.readOne(lcm))
+    {
+        writeOut(lcm);
+        ++n;
+    }
+    in.close();
+    if (n != size)
+    {
+        throw std::runtime_error("metadata spill file " + path + " holds " +
+                                 std::to_string(n) + " ledgers, expected " +
+                                 std::to_string(size));
+    }
+    std::remove(path.c_str());
+}
+
+void
+LedgerCloseMetaStream::runWriter()
+{
+    try
+    {
+        std::unique_lock<std::mutex> lock(mMutex);
+        while (true)
+        {
+            mChanged.wait(lock, [this]() {
+                return mStopping || !mQueue.empty() || mSpillSize > 0;
+            });
+
+            if (!mQueue.empty())
+            {
+                auto lcm = std::move(mQueue.front());
+                mQueue.pop_front();
+                mQueueDepth.set_count(mQueue.size());
+                lock.unlock();
+                mChanged.notify_all();
+                writeOut(lcm);
+                lock.lock();
+            }
+            else if (mSpillSize > 0)
+            {
+                // Everything queued was written before the first ledger
+                // spilled, take the spill file and let write queue again
+                auto path = spillPath(mSpillGeneration);
+                auto size = mSpillSize;
+                mSpill.reset();
+                mSpillSize = 0;
+                ++mSpillGeneration;
+                lock.unlock();
+                writeOutSpill(path, size);
+                lock.lock();
+            }
+            else
+            {
+                return;
+            }
+        }
+    }
+    catch (std::exception& e)
+    {
+        printErrorAndAbort("Exception while streaming metadata: ", e.what());
+    }
+}
+}
@@ -0,0 +1,105 @@
+#pragma once
+
+// Copyright 2020 Stellar Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "util/ShmRingBuffer.h"
+#include "util/TmpDir.h"
+#include "util/XDRStream.h"
+#include "xdr/Stellar-ledger.h"
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+namespace medida
+{
+class Counter;
+class Timer;
+}
+
+namespace stellar
+{
+
+class Application;
+
+// Streams the LedgerCloseMeta of every ledger closed to METADATA_OUTPUT_STREAM.
+// The stream is either a file (or pipe) or a shared memory ring buffer, which
+// never waits for its readers.
+//
+// With METADATA_OUTPUT_BACKPRESSURE set to BLOCK, write streams the ledger
+// before returning, so that it is streamed before the ledger is committed and
+// a crash can only lose metadata that is produced again when the ledger is
+// replayed. Otherwise a dedicated thread streams the ledgers, so that closing
+// a ledger does not wait for the reader, and up to METADATA_OUTPUT_QUEUE_SIZE
+// ledgers are queued in memory; once the queue is full,
+// - DROP discards the ledger, the reader sees the ledger sequence numbers of
+//   the headers streamed skip it,
+// - SPILL appends the ledger to a temporary file, and keeps appending there
+//   until the writer thread has drained the queue and taken the file, so that
+//   ledgers are streamed in order.
+// The ledgers queued or spilled when the process dies are lost, as they are
+// committed by then.
+//
+// No marker is streamed in place of a dropped ledger: LedgerCloseMeta has no
+// arm for one, adding one would break every existing reader, and a v0 value
+// holding only the header would read as a ledger without transactions. The
+// gap shows in the ledgerSeq and previousLedgerHash of the headers streamed.
+class LedgerCloseMetaStream
+{
+  public:
+    enum class Backpressure
+    {
+        BLOCK,
+        DROP,
+        SPILL
+    };
+
+  private:
+    std::unique_ptr<XDROutputFileStream> mOut;
+    std::unique_ptr<ShmRingBufferWriter> mShm;
+    Backpressure const mBackpressure;
+    size_t const mQueueSize;
+    std::unique_ptr<TmpDir> mSpillDir;
+
+    medida::Counter& mQueueDepth;
+    medida::Timer& mWrite;
+    medida::Timer& mBlocked;
+    medida::Counter& mDropped;
+    medida::Counter& mSpilled;
+
+    // Guards everything below, and is notified whenever the queue or the
+    // spill file changes
+    std::mutex mMutex;
+    std::condition_variable mChanged;
+    std::deque<LedgerCloseMeta> mQueue;
+    std::unique_ptr<XDROutputFileStream> mSpill;
+    size_t mSpillSize{0};
+    uint64_t mSpillGeneration{0};
+    bool mStopping{false};
+
+    std::thread mWriter;
+
+    std::string spillPath(uint64_t generation) const;
+    void writeOut(LedgerCloseMeta const& lcm);
+    void writeOutSpill(std::string const& path, size_t size);
+    void runWriter();
+
+    LedgerCloseMetaStream(Application& app,
+                          std::unique_ptr<XDROutputFileStream> out,
+                          std::unique_ptr<ShmRingBufferWriter> shm);
+
+  public:
+    LedgerCloseMetaStream(Application& app,
+                          std::unique_ptr<XDROutputFileStream> out);
+    LedgerCloseMetaStream(Application& app,
+                          std::unique_ptr<ShmRingBufferWriter> shm);
+
+    // Waits until everything queued or spilled has been streamed
+    ~LedgerCloseMetaStream();
+
+    void write(LedgerCloseMeta&& lcm);
+};
+}
@@ -162,6 +162,20 @@ deleteOldEntries(Database& db, uint32_t ledgerSeq, uint32_t count)
                                           "ledgerheaders", "ledgerseq");
 }
 
+uint32_t
+getOldestLedgerSeq(Database& db)
+{
+    uint32_t seq = 0;
+    soci::indicator gotSeq;
+    auto& sess = db.getSession();
+    soci::statement st =
+        (sess.prepare << "SELECT MIN(ledgerseq) FROM ledgerheaders",
+         soci::into(seq, gotSeq));
+    auto timer = db.getSelectTimer("ledger-header-oldest");
+    st.execute(true);
+    return (st.got_data() && gotSeq == soci::i_ok) ? seq : 0;
+}
+
 size_t
 copyToStream(Database& db, soci::session& sess, uint32_t ledgerSeq,
              uint32_t ledgerCount, XDROutputFileStream& headersOut)
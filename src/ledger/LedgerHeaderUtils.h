@@ -26,6 +26,9 @@ std::shared_ptr<LedgerHeader> loadBySequence(Database& db, soci::session& sess,
 
 void deleteOldEntries(Database& db, uint32_t ledgerSeq, uint32_t count);
 
+// Sequence number of the oldest ledger header stored, 0 if there is none
+uint32_t getOldestLedgerSeq(Database& db);
+
 size_t copyToStream(Database& db, soci::session& sess, uint32_t ledgerSeq,
                     uint32_t ledgerCount, XDROutputFileStream& headersOut);
 
@@ -13,6 +13,7 @@ namespace stellar
 
 class LedgerCloseData;
 class Database;
+class OperationProfiler;
 
 /**
  * LedgerManager maintains, in memory, a logical pair of ledgers:
@@ -151,6 +152,14 @@ class LedgerManager
     // permit testing.
     virtual void closeLedger(LedgerCloseData const& ledgerData) = 0;
 
+    // Start loading, off the main thread, the ledger entries that applying
+    // `txs` is expected to touch, so that a later closeLedger on them finds
+    // them in memory instead of waiting on the database. This is purely
+    // advisory: `txs` need not end up in the next ledger, and entries
+    // modified in the meantime are not used.
+    virtual void
+    prefetchAhead(std::vector<TransactionFramePtr> const& txs) = 0;
+
     // deletes old entries stored in the database
     virtual void deleteOldEntries(Database& db, uint32_t ledgerSeq,
                                   uint32_t count) = 0;
@@ -158,6 +167,10 @@ class LedgerManager
     virtual void
     setLastClosedLedger(LedgerHeaderHistoryEntry const& lastClosed) = 0;
 
+    // Returns the profiler that transactions report the cost of applying
+    // them to, or nullptr unless PROFILE_OPERATIONS is set.
+    virtual OperationProfiler* getOperationProfiler() = 0;
+
     virtual ~LedgerManager()
     {
     }
@@ -18,6 +18,7 @@
 #include "history/HistoryManager.h"
 #include "invariant/InvariantDoesNotHold.h"
 #include "invariant/InvariantManager.h"
+#include "ledger/InMemoryLedgerTxnRoot.h"
 #include "ledger/LedgerHeaderUtils.h"
 #include "ledger/LedgerRange.h"
 #include "ledger/LedgerTxn.h"
@@ -128,10 +129,16 @@ LedgerManagerImpl::LedgerManagerImpl(Application& app)
     , mLastClose(mApp.getClock().now())
     , mCatchupDuration(
           app.getMetrics().NewTimer({"ledger", "catchup", "duration"}))
+    , mParallelTxApplier(app)
     , mState(LM_BOOTING_STATE)
 
 {
     setupLedgerCloseMetaStream();
+    if (mApp.getConfig().PROFILE_OPERATIONS)
+    {
+        mOperationProfiler = std::make_unique<OperationProfiler>(
+            app.getMetrics(), mApp.getConfig().PROFILE_SLOWEST_TRANSACTIONS);
+    }
 }
 
 void
@@ -314,6 +321,12 @@ LedgerManagerImpl::loadLastKnownLedger(
                         }
                         advanceLedgerPointers(header.current());
                     }
+                    if (mApp.getConfig().MODE_USES_IN_MEMORY_LEDGER)
+                    {
+                        loadInMemoryLedgerEntries();
+                    }
+                    restoreUnwrittenLedgerEntries();
+                    mApp.getLedgerTxnRoot().loadInMemoryState();
                     handler(ec);
                 }
             };
@@ -344,6 +357,101 @@ LedgerManagerImpl::loadLastKnownLedger(
     }
 }
 
+void
+LedgerManagerImpl::loadInMemoryLedgerEntries()
+{
+    if (!mApp.getConfig().MODE_ENABLES_BUCKETLIST)
+    {
+        return;
+    }
+
+    CLOG(INFO, "Ledger") << "Loading ledger entries into memory from the "
+                            "bucket list for LCL "
+                         << getLastClosedLedgerNum();
+
+    // Applying every level oldest first leaves the newest version of each
+    // entry, as when catching up
+    auto& bl = mApp.getBucketManager().getBucketList();
+    for (uint32_t i = BucketList::kNumLevels; i-- > 0;)
+    {
+        bl.getLevel(i).getSnap()->apply(mApp);
+        bl.getLevel(i).getCurr()->apply(mApp);
+    }
+}
+
+void
+LedgerManagerImpl::restoreUnwrittenLedgerEntries()
+{
+    auto& ps = mApp.getPersistentState();
+    auto lastWritten = ps.getState(PersistentState::kLastWrittenLedger);
+    uint32_t lcl = getLastClosedLedgerNum();
+
+    if (!lastWritten.empty())
+    {
+        auto written = static_cast<uint32_t>(std::stoul(lastWritten));
+        if (written < lcl)
+        {
+            if (!mApp.getConfig().MODE_ENABLES_BUCKETLIST)
+            {
+                throw std::runtime_error(
+                    "Ledger entries are behind the last closed ledger");
+            }
+
+            CLOG(INFO, "Ledger")
+                << "Ledger entries were last written for ledger " << written
+                << ", restoring them up to LCL " << lcl;
+
+            // The levels up to the first one that holds ledger written + 1
+            // hold every change since, from its oldest ledger on. They may
+            // lack the tombstone of an entry erased since, as merges
+            // annihilate the INIT and DEAD entries of an entry created and
+            // erased within the ledgers of one bucket, but then the database
+            // can only hold a version of that entry modified on or after the
+            // oldest ledger of the bucket. So, as ApplyBucketsWork does,
+            // everything modified from the oldest ledger of these levels on
+            // is deleted, then the levels are applied oldest first, which
+            // leaves the newest version of each entry they hold.
+            auto& bl = mApp.getBucketManager().getBucketList();
+            uint32_t level = 0;
+            uint32_t oldest = 0;
+            for (; level < BucketList::kNumLevels; ++level)
+            {
+                oldest = std::min(BucketList::oldestLedgerInCurr(lcl, level),
+                                  BucketList::oldestLedgerInSnap(lcl, level));
+                if (oldest <= written + 1)
+                {
+                    break;
+                }
+            }
+            if (level == BucketList::kNumLevels)
+            {
+                // The whole bucket list is applied to empty tables
+                --level;
+                oldest = 0;
+            }
+            mApp.getLedgerTxnRoot().deleteObjectsModifiedOnOrAfterLedger(
+                oldest);
+            for (uint32_t i = level + 1; i-- > 0;)
+            {
+                bl.getLevel(i).getSnap()->apply(mApp);
+                bl.getLevel(i).getCurr()->apply(mApp);
+            }
+        }
+    }
+
+    // The writer advances the last written ledger from here on; without it,
+    // the ledger entries are always committed with their ledger
+    auto const& cfg = mApp.getConfig();
+    bool writeBehind = cfg.WRITE_BEHIND_LEDGER_ENTRIES &&
+                       !cfg.MODE_USES_IN_MEMORY_LEDGER &&
+                       !getDatabase().isSqlite();
+    auto nowWritten = writeBehind ? std::to_string(lcl) : std::string();
+    if (nowWritten != lastWritten)
+    {
+        ps.setState(PersistentState::kLastWrittenLedger, nowWritten);
+    }
+}
+
 Database&
 LedgerManagerImpl::getDatabase()
 {
@@ -512,6 +620,46 @@ void
 LedgerManagerImpl::syncMetrics()
 {
     mLedgerAge.set_count(secondsSinceLastLedgerClose());
+
+    auto& root = mApp.getLedgerTxnRoot();
+    for (auto const& type : {std::make_pair(ACCOUNT, "account"),
+                             std::make_pair(TRUSTLINE, "trust"),
+                             std::make_pair(OFFER, "offer"),
+                             std::make_pair(DATA, "data")})
+    {
+        auto counters = root.getEntryCacheCounters(type.first);
+        auto& metrics = mApp.getMetrics();
+        metrics.NewCounter({"ledger", "entry-cache-hit", type.second})
+            .set_count(counters.mHits);
+        metrics.NewCounter({"ledger", "entry-cache-miss", type.second})
+            .set_count(counters.mMisses);
+        metrics.NewCounter({"ledger", "entry-cache-evict", type.second})
+            .set_count(counters.mEvictions);
+        metrics.NewCounter({"ledger", "key-filter-skip", type.second})
+            .set_count(counters.mFilterSkips);
+        metrics.NewCounter({"ledger", "key-filter-false-positive", type.second})
+            .set_count(counters.mFilterFalsePositives);
+        metrics.NewCounter({"ledger", "key-filter-rebuild", type.second})
+            .set_count(counters.mFilterRebuilds);
+    }
+
+    // The in-memory ledger reports what it holds instead of cache counters
+    if (auto inMemoryRoot = dynamic_cast<InMemoryLedgerTxnRoot*>(&root))
+    {
+        for (auto const& type : {std::make_pair(ACCOUNT, "account"),
+                                 std::make_pair(TRUSTLINE, "trust"),
+                                 std::make_pair(OFFER, "offer"),
+                                 std::make_pair(DATA, "data")})
+        {
+            auto footprint = inMemoryRoot->getFootprint(type.first);
+            auto& metrics = mApp.getMetrics();
+            metrics.NewCounter({"ledger", "memory-entries", type.second})
+                .set_count(footprint.mEntries);
+            metrics.NewCounter({"ledger", "memory-bytes", type.second})
+                .set_count(footprint.mBytes);
+        }
+    }
+
     mApp.syncOwnMetrics();
 }
 
@@ -677,8 +825,7 @@ LedgerManagerImpl::closeLedger(LedgerCloseData const& ledgerData)
     {
         releaseAssert(ledgerCloseMeta);
         ledgerCloseMeta->v0().ledgerHeader = mLastClosedLedger;
-        mMetaStream->writeOne(*ledgerCloseMeta);
-        mMetaStream->flush();
+        mMetaStream->write(std::move(*ledgerCloseMeta));
     }
 
     // The next 4 steps happen in a relatively non-obvious, subtle order.
@@ -757,6 +904,15 @@ LedgerManagerImpl::setLastClosedLedger(
     ltx.commit();
 
     advanceLedgerPointers(lastClosed.header);
+
+    // The buckets just applied replaced whatever was loaded before
+    mApp.getLedgerTxnRoot().loadInMemoryState();
+}
+
+OperationProfiler*
+LedgerManagerImpl::getOperationProfiler()
+{
+    return mOperationProfiler.get();
 }
 
 void
@@ -767,11 +923,22 @@ LedgerManagerImpl::setupLedgerCloseMetaStream()
         throw std::runtime_error("LedgerManagerImpl already streaming");
     }
     auto& cfg = mApp.getConfig();
-    if (cfg.METADATA_OUTPUT_STREAM != "")
+    std::regex shmrx("^shm:(.+)$");
+    std::smatch shmsm;
+    if (std::regex_match(cfg.METADATA_OUTPUT_STREAM, shmsm, shmrx))
+    {
+        CLOG(INFO, "Ledger")
+            << "Streaming metadata to shared memory '" << shmsm[1] << "'";
+        auto shm = std::make_unique<ShmRingBufferWriter>(
+            shmsm[1], size_t(cfg.METADATA_OUTPUT_SHM_SIZE_MB) * 1024 * 1024);
+        mMetaStream =
+            std::make_unique<LedgerCloseMetaStream>(mApp, std::move(shm));
+    }
+    else if (cfg.METADATA_OUTPUT_STREAM != "")
     {
         // We can't be sure we're writing to a stream that supports fsync;
         // pipes typically error when you try. So we don't do it.
-        mMetaStream =
+        auto stream =
             std::make_unique<XDROutputFileStream>(/*fsyncOnClose=*/false);
         std::regex fdrx("^fd:([0-9]+)$");
         std::smatch sm;
@@ -780,14 +947,16 @@ LedgerManagerImpl::setupLedgerCloseMetaStream()
             int fd = std::stoi(sm[1]);
             CLOG(INFO, "Ledger")
                 << "Streaming metadata to file descriptor " << fd;
-            mMetaStream->fdopen(fd);
+            stream->fdopen(fd);
         }
         else
         {
             CLOG(INFO, "Ledger") << "Streaming metadata to '"
                                  << cfg.METADATA_OUTPUT_STREAM << "'";
-            mMetaStream->open(cfg.METADATA_OUTPUT_STREAM);
+            stream->open(cfg.METADATA_OUTPUT_STREAM);
         }
+        mMetaStream =
+            std::make_unique<LedgerCloseMetaStream>(mApp, std::move(stream));
     }
 }
 
@@ -815,6 +984,7 @@ LedgerManagerImpl::processFeesSeqNums(
     {
         LedgerTxn ltx(ltxOuter);
         auto ledgerSeq = ltx.loadHeader().current().ledgerSeq;
+        auto feeHistory = TransactionHistoryBatch::forTransactionFees();
         for (auto tx : txs)
         {
             LedgerTxn ltxTx(ltx);
@@ -835,11 +1005,11 @@ LedgerManagerImpl::processFeesSeqNums(
             ++index;
             if (mApp.getConfig().MODE_STORES_HISTORY)
             {
-                tx->storeTransactionFee(mApp.getDatabase(), ledgerSeq, changes,
-                                        index);
+                tx->storeTransactionFee(feeHistory, ledgerSeq, changes, index);
             }
             ltxTx.commit();
         }
+        feeHistory.flush(mApp.getDatabase());
         ltx.commit();
     }
     catch (std::exception& e)
@@ -874,18 +1044,108 @@ LedgerManagerImpl::prefetchTransactionData(
     {
         auto& root = mApp.getLedgerTxnRoot();
         std::unordered_set<LedgerKey> keysToPrefetch;
-        for (auto const& tx : txs)
+        insertTxDataKeysToPrefetch(txs, keysToPrefetch);
+        root.prefetch(keysToPrefetch);
+    }
+}
+
+void
+LedgerManagerImpl::insertTxDataKeysToPrefetch(
+    std::vector<TransactionFramePtr> const& txs,
+    std::unordered_set<LedgerKey>& keys)
+{
+    for (auto const& tx : txs)
+    {
+        for (auto const& op : tx->getOperations())
         {
-            for (auto const& op : tx->getOperations())
+            if (!(tx->getSourceID() == op->getSourceID()))
             {
-                if (!(tx->getSourceID() == op->getSourceID()))
-                {
-                    keysToPrefetch.emplace(accountKey(op->getSourceID()));
-                }
-                op->insertLedgerKeysToPrefetch(keysToPrefetch);
+                keys.emplace(accountKey(op->getSourceID()));
             }
+            op->insertLedgerKeysToPrefetch(keys);
         }
-        root.prefetch(keysToPrefetch);
+    }
+}
+
+void
+LedgerManagerImpl::prefetchAhead(std::vector<TransactionFramePtr> const& txs)
+{
+    if (mApp.getConfig().PREFETCH_BATCH_SIZE == 0 || txs.empty())
+    {
+        return;
+    }
+
+    std::unordered_set<LedgerKey> keys;
+    for (auto const& tx : txs)
+    {
+        keys.emplace(accountKey(tx->getSourceID()));
+    }
+    insertTxDataKeysToPrefetch(txs, keys);
+
+    mApp.getLedgerTxnRoot().prefetchAsync(keys);
+}
+
+void
+LedgerManagerImpl::applyTransaction(TransactionFramePtr const& tx, size_t index,
+                                    AbstractLedgerTxn& ltx,
+                                    TransactionMeta& tm,
+                                    ParallelTxApplier::TxApplyMode mode)
+{
+    typedef ParallelTxApplier::TxApplyMode TxApplyMode;
+    CLOG(DEBUG, "Tx") << " tx#" << index << " = "
+                      << hexAbbrev(tx->getFullHash())
+                      << " ops=" << tx->getNumOperations()
+                      << " txseq=" << tx->getSeqNum() << " (@ "
+                      << mApp.getConfig().toShortString(tx->getSourceID())
+                      << ")"
+                      << (mode == TxApplyMode::IN_STAGE ? " in parallel" : "")
+                      << (mode == TxApplyMode::DISCARDED ? " discarded" : "");
+    if (mode == TxApplyMode::IN_STAGE)
+    {
+        // The stage is applied again serially if this throws, and the
+        // failure reported then
+        tx->apply(mApp, ltx, tm);
+        return;
+    }
+
+    // Only the apply that is kept is counted, discarded ones are followed by
+    // a serial apply of the same transaction
+    bool const kept = mode == TxApplyMode::SERIAL;
+    auto start = std::chrono::steady_clock::now();
+    try
+    {
+        tx->apply(mApp, ltx, tm);
+    }
+    catch (InvariantDoesNotHold&)
+    {
+        CLOG(ERROR, "Ledger") << "Invariant failure during tx->apply for tx "
+                              << tx->getFullHash();
+        throw;
+    }
+    catch (std::runtime_error& e)
+    {
+        CLOG(ERROR, "Ledger") << "Exception during tx->apply for tx "
+                              << tx->getFullHash() << " : " << e.what();
+        if (kept)
+        {
+            mInternalErrorCount.inc();
+        }
+        tx->getResult().result.code(txINTERNAL_ERROR);
+    }
+    catch (...)
+    {
+        CLOG(ERROR, "Ledger")
+            << "Unknown exception during tx->apply for tx "
+            << tx->getFullHash();
+        if (kept)
+        {
+            mInternalErrorCount.inc();
+        }
+        tx->getResult().result.code(txINTERNAL_ERROR);
+    }
+    if (kept)
+    {
+        mTransactionApply.Update(std::chrono::steady_clock::now() - start);
     }
 }
 
@@ -915,41 +1175,38 @@ LedgerManagerImpl::applyTransactions(
 
     prefetchTransactionData(txs);
 
-    for (auto tx : txs)
+    auto const& cfg = mApp.getConfig();
+    std::vector<TransactionMeta> metas(
+        txs.size(), TransactionMeta(cfg.SUPPORTED_META_VERSION));
+    if (cfg.PARALLEL_TX_APPLY_THREADS > 0 && txs.size() > 1)
     {
-        auto txTime = mTransactionApply.TimeScope();
-        TransactionMeta tm(mApp.getConfig().SUPPORTED_META_VERSION);
-        try
-        {
-            CLOG(DEBUG, "Tx")
-                << " tx#" << index << " = " << hexAbbrev(tx->getFullHash())
-                << " ops=" << tx->getNumOperations()
-                << " txseq=" << tx->getSeqNum() << " (@ "
-                << mApp.getConfig().toShortString(tx->getSourceID()) << ")";
-            tx->apply(mApp, ltx, tm);
-        }
-        catch (InvariantDoesNotHold&)
+        auto applyTx = [&](size_t i, AbstractLedgerTxn& ltxTx,
+                           ParallelTxApplier::TxApplyMode mode) {
+            applyTransaction(txs[i], i, ltxTx, metas[i], mode);
+        };
+        if (cfg.PARALLEL_TX_APPLY_COMPARE_SERIAL)
         {
-            CLOG(ERROR, "Ledger")
-                << "Invariant failure during tx->apply for tx "
-                << tx->getFullHash();
-            throw;
+            mParallelTxApplier.applyAndCompareWithSerial(txs, ltx, metas,
+                                                         applyTx);
         }
-        catch (std::runtime_error& e)
+        else
         {
-            CLOG(ERROR, "Ledger") << "Exception during tx->apply for tx "
-                                  << tx->getFullHash() << " : " << e.what();
-            mInternalErrorCount.inc();
-            tx->getResult().result.code(txINTERNAL_ERROR);
+            mParallelTxApplier.apply(txs, ltx, metas, applyTx);
         }
-        catch (...)
+    }
+    else
+    {
+        for (size_t i = 0; i < txs.size(); ++i)
         {
-            CLOG(ERROR, "Ledger")
-                << "Unknown exception during tx->apply for tx "
-                << tx->getFullHash();
-            mInternalErrorCount.inc();
-            tx->getResult().result.code(txINTERNAL_ERROR);
+            applyTransaction(txs[i], i, ltx, metas[i]);
         }
+    }
+
+    auto ledgerSeq = ltx.loadHeader().current().ledgerSeq;
+    auto txHistory = TransactionHistoryBatch::forTransactions();
+    for (auto tx : txs)
+    {
+        auto const& tm = metas.at(index);
         TransactionResultPair results = tx->getResultPair();
 
         // First gather the TransactionResultPair into the TxResultSet for
@@ -967,7 +1224,8 @@ LedgerManagerImpl::applyTransactions(
         }
 
         // Then finally store the results and meta into the txhistory table.
-        // if we're running in a mode that has one.
+        // if we're running in a mode that has one. The rows of the whole
+        // ledger are inserted at once, below.
         //
         // Note to future: when we eliminate the txhistory and txfeehistory
         // tables, the following step can be removed.
@@ -978,12 +1236,15 @@ LedgerManagerImpl::applyTransactions(
         ++index;
         if (mApp.getConfig().MODE_STORES_HISTORY)
         {
-            auto ledgerSeq = ltx.loadHeader().current().ledgerSeq;
-            tx->storeTransaction(mApp.getDatabase(), ledgerSeq, tm, index,
-                                 txResultSet);
+            tx->storeTransaction(txHistory, ledgerSeq, tm, index, txResultSet);
         }
     }
+    txHistory.flush(mApp.getDatabase());
 
+    if (mOperationProfiler)
+    {
+        mOperationProfiler->ledgerClosed(ledgerSeq);
+    }
     logTxApplyMetrics(ltx, numTxs, numOps);
 }
 
@@ -1034,13 +1295,14 @@ LedgerManagerImpl::transferLedgerEntriesToBucketList(AbstractLedgerTxn& ltx,
                                                      uint32_t ledgerSeq,
                                                      uint32_t ledgerVers)
 {
-    std::vector<LedgerEntry> initEntries, liveEntries;
-    std::vector<LedgerKey> deadEntries;
-    ltx.getAllEntries(initEntries, liveEntries, deadEntries);
+    // The entries come out of ltx sorted, and are moved from there into the
+    // fresh bucket of level 0
+    std::vector<BucketEntry> entries;
+    ltx.getAllBucketEntries(entries);
     if (mApp.getConfig().MODE_ENABLES_BUCKETLIST)
     {
         mApp.getBucketManager().addBatch(mApp, ledgerSeq, ledgerVers,
-                                         initEntries, liveEntries, deadEntries);
+                                         std::move(entries));
     }
 }
 
@@ -6,8 +6,11 @@
 #include "util/asio.h"
 
 #include "history/HistoryManager.h"
+#include "ledger/LedgerCloseMetaStream.h"
 #include "ledger/LedgerManager.h"
+#include "ledger/ParallelTxApplier.h"
 #include "main/PersistentState.h"
+#include "transactions/OperationProfiler.h"
 #include "transactions/TransactionFrame.h"
 #include "util/XDRStream.h"
 #include "xdr/Stellar-ledger.h"
@@ -39,7 +42,7 @@ class LedgerManagerImpl : public LedgerManager
 
   protected:
     Application& mApp;
-    std::unique_ptr<XDROutputFileStream> mMetaStream;
+    std::unique_ptr<LedgerCloseMetaStream> mMetaStream;
 
   private:
     medida::Timer& mTransactionApply;
@@ -55,6 +58,9 @@ class LedgerManagerImpl : public LedgerManager
     std::unique_ptr<VirtualClock::time_point> mStartCatchup;
     medida::Timer& mCatchupDuration;
 
+    ParallelTxApplier mParallelTxApplier;
+    std::unique_ptr<OperationProfiler> mOperationProfiler;
+
     void
     processFeesSeqNums(std::vector<TransactionFramePtr>& txs,
                        AbstractLedgerTxn& ltxOuter, int64_t baseFee,
@@ -65,10 +71,32 @@ class LedgerManagerImpl : public LedgerManager
                       AbstractLedgerTxn& ltx, TransactionResultSet& txResultSet,
                       std::unique_ptr<LedgerCloseMeta> const& ledgerCloseMeta);
 
+    // Applies tx, timing it if mode is SERIAL. Unless mode is IN_STAGE,
+    // failures are logged and turn into txINTERNAL_ERROR results, counted
+    // if mode is SERIAL; see ParallelTxApplier.
+    void applyTransaction(TransactionFramePtr const& tx, size_t index,
+                          AbstractLedgerTxn& ltx, TransactionMeta& tm,
+                          ParallelTxApplier::TxApplyMode mode =
+                              ParallelTxApplier::TxApplyMode::SERIAL);
+
     void ledgerClosed(AbstractLedgerTxn& ltx);
 
     void storeCurrentLedger(LedgerHeader const& header);
+
+    // Brings the ledger entries in the database up to the last closed ledger
+    // if WRITE_BEHIND_LEDGER_ENTRIES left them behind it, by applying the
+    // buckets that hold the ledgers they miss. Requires the bucket list to be
+    // in the state of the last closed ledger.
+    void restoreUnwrittenLedgerEntries();
+
+    // Fills the InMemoryLedgerTxnRoot of MODE_USES_IN_MEMORY_LEDGER, which
+    // holds no ledger entries when the node starts, from the bucket list of
+    // the last closed ledger.
+    void loadInMemoryLedgerEntries();
     void prefetchTransactionData(std::vector<TransactionFramePtr>& txs);
+    static void
+    insertTxDataKeysToPrefetch(std::vector<TransactionFramePtr> const& txs,
+                               std::unordered_set<LedgerKey>& keys);
     void prefetchTxSourceIds(std::vector<TransactionFramePtr>& txs);
 
     enum class CloseLedgerIfResult
@@ -125,12 +153,15 @@ class LedgerManagerImpl : public LedgerManager
                       std::shared_ptr<HistoryArchive> archive) override;
 
     void closeLedger(LedgerCloseData const& ledgerData) override;
+    void prefetchAhead(std::vector<TransactionFramePtr> const& txs) override;
     void deleteOldEntries(Database& db, uint32_t ledgerSeq,
                           uint32_t count) override;
 
     void
     setLastClosedLedger(LedgerHeaderHistoryEntry const& lastClosed) override;
 
+    OperationProfiler* getOperationProfiler() override;
+
     void setupLedgerCloseMetaStream();
 };
 }
@@ -3,6 +3,7 @@
 // of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
 
 #include "ledger/LedgerTxn.h"
+#include "bucket/LedgerCmp.h"
 #include "crypto/Hex.h"
 #include "crypto/KeyUtils.h"
 #include "crypto/SecretKey.h"
@@ -11,8 +12,10 @@
 #include "ledger/LedgerTxnEntry.h"
 #include "ledger/LedgerTxnHeader.h"
 #include "ledger/LedgerTxnImpl.h"
+#include "main/PersistentState.h"
 #include "transactions/TransactionUtils.h"
 #include "util/GlobalChecks.h"
+#include "util/Logging.h"
 #include "util/XDROperators.h"
 #include "util/types.h"
 #include "xdr/Stellar-ledger-entries.h"
@@ -22,11 +25,12 @@
 namespace stellar
 {
 
-std::unordered_map<LedgerKey, std::shared_ptr<LedgerEntry const>>
+FlatHashMap<LedgerKey, std::shared_ptr<LedgerEntry const>>
 populateLoadedEntries(std::unordered_set<LedgerKey> const& keys,
                       std::vector<LedgerEntry> const& entries)
 {
-    std::unordered_map<LedgerKey, std::shared_ptr<LedgerEntry const>> res;
+    FlatHashMap<LedgerKey, std::shared_ptr<LedgerEntry const>> res;
+    res.reserve(keys.size());
 
     for (auto const& le : entries)
     {
@@ -43,12 +47,10 @@ populateLoadedEntries(std::unordered_set<LedgerKey> const& keys,
         res.emplace(key, std::make_shared<LedgerEntry const>(le));
     }
 
+    // emplace does nothing for keys that were loaded
     for (auto const& key : keys)
     {
-        if (res.find(key) == res.end())
-        {
-            res.emplace(key, nullptr);
-        }
+        res.emplace(key, nullptr);
     }
     return res;
 }
@@ -207,16 +209,32 @@ LedgerTxn::LedgerTxn(LedgerTxn& parent, bool shouldUpdateLastModified)
 {
 }
 
+// Transactions can be applied on several threads at once, see
+// ParallelTxApplier, so each thread counts its own work
+static thread_local LedgerTxnCounters gLedgerTxnCounters;
+
+LedgerTxnCounters const&
+getLedgerTxnCounters()
+{
+    return gLedgerTxnCounters;
+}
+
+size_t const LedgerTxn::Impl::MAX_ARENA_BYTES = 16 << 20;
+
 LedgerTxn::Impl::Impl(LedgerTxn& self, AbstractLedgerTxnParent& parent,
                       bool shouldUpdateLastModified)
     : mParent(parent)
     , mChild(nullptr)
     , mHeader(std::make_unique<LedgerHeader>(mParent.getHeader()))
+    , mArena(std::make_shared<Arena>())
+    , mEntry(EntryMap::allocator_type(mArena))
+    , mActive(ActiveMap::allocator_type(mArena))
     , mShouldUpdateLastModified(shouldUpdateLastModified)
     , mIsSealed(false)
     , mConsistency(LedgerTxnConsistency::EXACT)
 {
     mParent.addChild(self);
+    ++gLedgerTxnCounters.mLedgerTxns;
 }
 
 LedgerTxn::~LedgerTxn()
@@ -356,7 +374,7 @@ LedgerTxn::Impl::commitChild(EntryIterator iter, LedgerTxnConsistency cons)
 
             if (iter.entryExists())
             {
-                updateEntry(key, std::make_shared<LedgerEntry>(iter.entry()));
+                updateEntry(key, makeEntry(iter.entry()));
             }
             else
             {
@@ -475,7 +493,7 @@ LedgerTxn::Impl::create(LedgerTxn& self, LedgerEntry const& entry)
         throw std::runtime_error("Key already exists");
     }
 
-    auto current = std::make_shared<LedgerEntry>(entry);
+    auto current = makeEntry(entry);
     auto impl = LedgerTxnEntry::makeSharedImpl(self, *current);
 
     // Set the key to active before constructing the LedgerTxnEntry, as this
@@ -509,7 +527,7 @@ LedgerTxn::Impl::createOrUpdateWithoutLoading(LedgerTxn& self,
         throw std::runtime_error("Key is already active");
     }
 
-    updateEntry(key, std::make_shared<LedgerEntry>(entry));
+    updateEntry(key, makeEntry(entry));
 }
 
 void
@@ -534,6 +552,31 @@ LedgerTxn::Impl::deactivate(LedgerKey const& key)
     mActive.erase(iter);
 }
 
+LedgerEntry&
+LedgerTxn::copyOnWrite(LedgerKey const& key)
+{
+    return getImpl()->copyOnWrite(key);
+}
+
+LedgerEntry&
+LedgerTxn::Impl::copyOnWrite(LedgerKey const& key)
+{
+    if (mActive.find(key) == mActive.end())
+    {
+        throw std::runtime_error("Key is not active");
+    }
+
+    // An active key is always recorded, with an entry
+    auto iter = mEntry.find(key);
+    assert(iter != mEntry.end() && iter->second);
+    auto current = makeEntry(*iter->second);
+
+    // The order book refers to keys, so replacing the entry by an equal one
+    // needs no other update. std::shared_ptr<...>::operator= does not throw
+    iter->second = current;
+    return *current;
+}
+
 void
 LedgerTxn::deactivateHeader()
 {
@@ -667,7 +710,8 @@ LedgerTxn::Impl::getBestOffer(Asset const& buying, Asset const& selling)
             {
                 throw std::runtime_error("invalid order book state");
             }
-            selfBest = std::make_shared<LedgerEntry const>(*entryIter->second);
+            // Recorded entries are immutable, so they can be shared
+            selfBest = entryIter->second;
         }
     }
 
@@ -771,7 +815,7 @@ LedgerTxn::Impl::getBestOffer(Asset const& buying, Asset const& selling,
             {
                 throw std::runtime_error("invalid order book state");
             }
-            selfBest = std::make_shared<LedgerEntry const>(*entryIter->second);
+            selfBest = entryIter->second;
         }
     }
 
@@ -830,10 +874,12 @@ LedgerTxn::Impl::getChanges()
     LedgerEntryChanges changes;
     changes.reserve(mEntry.size() * 2);
     maybeUpdateLastModifiedThenInvokeThenSeal([&](EntryMap const& entries) {
-        for (auto const& kv : entries)
+        // The changes are listed in key order, so that the meta does not
+        // depend on the order in which the entries were recorded
+        for (auto kv : sortByKey(entries))
         {
-            auto const& key = kv.first;
-            auto const& entry = kv.second;
+            auto const& key = kv->first;
+            auto const& entry = kv->second;
 
             auto previous = mParent.getNewestVersion(key);
             if (previous)
@@ -902,6 +948,35 @@ LedgerTxn::Impl::getEntryIterator(EntryMap const& entries) const
     return EntryIterator(std::move(iterImpl));
 }
 
+std::vector<LedgerTxn::Impl::EntryMap::value_type const*>
+LedgerTxn::Impl::sortByKey(EntryMap const& entries)
+{
+    std::vector<EntryMap::value_type const*> sorted;
+    sorted.reserve(entries.size());
+    for (auto const& kv : entries)
+    {
+        sorted.emplace_back(&kv);
+    }
+    LedgerEntryIdCmp cmp;
+    std::sort(sorted.begin(), sorted.end(),
+              [&cmp](EntryMap::value_type const* lhs,
+                     EntryMap::value_type const* rhs) {
+                  return cmp(lhs->first, rhs->first);
+              });
+    return sorted;
+}
+
+std::shared_ptr<LedgerEntry>
+LedgerTxn::Impl::makeEntry(LedgerEntry const& entry) const
+{
+    if (mArena->getBytesReserved() >= MAX_ARENA_BYTES)
+    {
+        return std::make_shared<LedgerEntry>(entry);
+    }
+    return std::allocate_shared<LedgerEntry>(
+        ArenaAllocator<LedgerEntry>(mArena), entry);
+}
+
 LedgerHeader const&
 LedgerTxn::getHeader() const
 {
@@ -923,7 +998,6 @@ LedgerTxn::getInflationWinners(size_t maxWinners, int64_t minVotes)
 std::map<AccountID, int64_t>
 LedgerTxn::Impl::getDeltaVotes() const
 {
-    int64_t const MIN_VOTES_TO_INCLUDE = 1000000000;
     std::map<AccountID, int64_t> deltaVotes;
     for (auto const& kv : mEntry)
     {
@@ -1115,6 +1189,41 @@ LedgerTxn::Impl::getAllEntries(std::vector<LedgerEntry>& initEntries,
     deadEntries.swap(resDead);
 }
 
+void
+LedgerTxn::getAllBucketEntries(std::vector<BucketEntry>& entries)
+{
+    getImpl()->getAllBucketEntries(entries);
+}
+
+void
+LedgerTxn::Impl::getAllBucketEntries(std::vector<BucketEntry>& entries)
+{
+    std::vector<BucketEntry> res;
+    maybeUpdateLastModifiedThenInvokeThenSeal([&](EntryMap const& entryMap) {
+        // Each entry is copied exactly once, in order, into res
+        auto sorted = sortByKey(entryMap);
+        res.resize(sorted.size());
+        for (size_t i = 0; i < sorted.size(); ++i)
+        {
+            auto const& key = sorted[i]->first;
+            auto const& entry = sorted[i]->second;
+            auto& be = res[i];
+            if (entry)
+            {
+                be.type(mParent.getNewestVersion(key) ? LIVEENTRY
+                                                      : INITENTRY);
+                be.liveEntry() = *entry;
+            }
+            else
+            {
+                be.type(DEADENTRY);
+                be.deadEntry() = key;
+            }
+        }
+    });
+    entries.swap(res);
+}
+
 std::shared_ptr<LedgerEntry const>
 LedgerTxn::getNewestVersion(LedgerKey const& key) const
 {
@@ -1188,14 +1297,15 @@ LedgerTxn::Impl::load(LedgerTxn& self, LedgerKey const& key)
         throw std::runtime_error("Key is active");
     }
 
+    ++gLedgerTxnCounters.mLoads;
     auto newest = getNewestVersion(key);
     if (!newest)
     {
         return {};
     }
 
-    auto current = std::make_shared<LedgerEntry>(*newest);
-    auto impl = LedgerTxnEntry::makeSharedImpl(self, *current);
+    // The entry is shared with the parent until ltxe modifies it
+    auto impl = LedgerTxnEntry::makeSharedImplCopyOnWrite(self, *newest);
 
     // Set the key to active before constructing the LedgerTxnEntry, as this
     // can throw and the LedgerTxnEntry destructor requires that mActive
@@ -1207,7 +1317,7 @@ LedgerTxn::Impl::load(LedgerTxn& self, LedgerKey const& key)
     // If this throws, the order book will not be modified because of the strong
     // exception safety guarantee. Furthermore, ltxe will be destructed leading
     // to key being deactivated. This will leave LedgerTxn unmodified.
-    updateEntry(key, current);
+    updateEntry(key, newest);
     return ltxe;
 }
 
@@ -1410,13 +1520,14 @@ LedgerTxn::Impl::loadWithoutRecord(LedgerTxn& self, LedgerKey const& key)
         throw std::runtime_error("Key is active");
     }
 
+    ++gLedgerTxnCounters.mLoads;
     auto newest = getNewestVersion(key);
     if (!newest)
     {
         return {};
     }
 
-    auto impl = ConstLedgerTxnEntry::makeSharedImpl(self, *newest);
+    auto impl = ConstLedgerTxnEntry::makeSharedImpl(self, newest);
 
     // Set the key to active before constructing the ConstLedgerTxnEntry, as
     // this can throw and the LedgerTxnEntry destructor requires that mActive
@@ -1538,6 +1649,18 @@ LedgerTxn::dropTrustLines()
     throw std::runtime_error("called dropTrustLines on non-root LedgerTxn");
 }
 
+void
+LedgerTxn::writeInParallel(LedgerEntryWrites const& entries, size_t nThreads)
+{
+    throw std::runtime_error("called writeInParallel on non-root LedgerTxn");
+}
+
+void
+LedgerTxn::loadInMemoryState()
+{
+    throw std::runtime_error("called loadInMemoryState on non-root LedgerTxn");
+}
+
 double
 LedgerTxn::getPrefetchHitRate() const
 {
@@ -1550,6 +1673,18 @@ LedgerTxn::Impl::getPrefetchHitRate() const
     return mParent.getPrefetchHitRate();
 }
 
+EntryCacheCounters
+LedgerTxn::getEntryCacheCounters(LedgerEntryType let) const
+{
+    return getImpl()->getEntryCacheCounters(let);
+}
+
+EntryCacheCounters
+LedgerTxn::Impl::getEntryCacheCounters(LedgerEntryType let) const
+{
+    return mParent.getEntryCacheCounters(let);
+}
+
 uint32_t
 LedgerTxn::prefetch(std::unordered_set<LedgerKey> const& keys)
 {
@@ -1562,27 +1697,39 @@ LedgerTxn::Impl::prefetch(std::unordered_set<LedgerKey> const& keys)
     return mParent.prefetch(keys);
 }
 
+bool
+LedgerTxn::prefetchAsync(std::unordered_set<LedgerKey> const& keys)
+{
+    return getImpl()->prefetchAsync(keys);
+}
+
+bool
+LedgerTxn::Impl::prefetchAsync(std::unordered_set<LedgerKey> const& keys)
+{
+    return mParent.prefetchAsync(keys);
+}
+
 LedgerTxn::Impl::EntryMap
 LedgerTxn::Impl::maybeUpdateLastModified() const
 {
     throwIfSealed();
     throwIfChild();
 
-    // Note: We do a deep copy here since a shallow copy would not be exception
-    // safe.
-    EntryMap entries;
+    // Note: We copy the map here since updating mEntry in place would not be
+    // exception safe. The recorded entries are immutable, so only those whose
+    // lastModifiedLedgerSeq changes need to be copied.
+    EntryMap entries(mEntry.get_allocator());
     entries.reserve(mEntry.size());
     for (auto const& kv : mEntry)
     {
         auto const& key = kv.first;
-        std::shared_ptr<LedgerEntry> entry;
-        if (kv.second)
+        auto entry = kv.second;
+        if (entry && mShouldUpdateLastModified &&
+            entry->lastModifiedLedgerSeq != mHeader->ledgerSeq)
         {
-            entry = std::make_shared<LedgerEntry>(*kv.second);
-            if (mShouldUpdateLastModified)
-            {
-                entry->lastModifiedLedgerSeq = mHeader->ledgerSeq;
-            }
+            auto updated = makeEntry(*entry);
+            updated->lastModifiedLedgerSeq = mHeader->ledgerSeq;
+            entry = updated;
         }
         entries.emplace(key, entry);
     }
@@ -1649,7 +1796,7 @@ LedgerTxn::Impl::updateEntryIfRecorded(LedgerKey const& key,
 
 void
 LedgerTxn::Impl::updateEntry(LedgerKey const& key,
-                             std::shared_ptr<LedgerEntry> lePtr)
+                             std::shared_ptr<LedgerEntry const> lePtr)
 {
     bool effectiveActive = mActive.find(key) != mActive.end();
     updateEntry(key, lePtr, effectiveActive);
@@ -1657,7 +1804,7 @@ LedgerTxn::Impl::updateEntry(LedgerKey const& key,
 
 void
 LedgerTxn::Impl::updateEntry(LedgerKey const& key,
-                             std::shared_ptr<LedgerEntry> lePtr,
+                             std::shared_ptr<LedgerEntry const> lePtr,
                              bool effectiveActive)
 {
     bool eraseIfNull = !lePtr && !mParent.getNewestVersion(key);
@@ -1666,13 +1813,12 @@ LedgerTxn::Impl::updateEntry(LedgerKey const& key,
 
 void
 LedgerTxn::Impl::updateEntry(LedgerKey const& key,
-                             std::shared_ptr<LedgerEntry> lePtr,
+                             std::shared_ptr<LedgerEntry const> lePtr,
                              bool effectiveActive, bool eraseIfNull)
 {
     // recordEntry has the strong exception safety guarantee because
-    // - std::unordered_map<...>::erase has the strong exception safety
-    //   guarantee
-    // - std::unordered_map<...>::operator[] has the strong exception safety
+    // - FlatHashMap<...>::erase does not throw
+    // - FlatHashMap<...>::operator[] has the strong exception safety
     //   guarantee
     // - std::shared_ptr<...>::operator= does not throw
     auto recordEntry = [&]() {
@@ -1825,6 +1971,18 @@ LedgerTxn::Impl::getOrderBook()
 {
     return mMultiOrderBook;
 }
+
+size_t
+LedgerTxn::getArenaBytesReserved() const
+{
+    return getImpl()->getArenaBytesReserved();
+}
+
+size_t
+LedgerTxn::Impl::getArenaBytesReserved() const
+{
+    return mArena->getBytesReserved();
+}
 #endif
 
 // Implementation of LedgerTxn::Impl::EntryIteratorImpl ---------------------
@@ -1907,28 +2065,89 @@ LedgerTxn::Impl::WorstBestOfferIteratorImpl::clone() const
     return std::make_unique<WorstBestOfferIteratorImpl>(mIter, mEnd);
 }
 
+// Implementation of LedgerTxnRoot::Impl::WriteBatchIteratorImpl -----------
+LedgerTxnRoot::Impl::WriteBatchIteratorImpl::WriteBatchIteratorImpl(
+    IteratorType const& begin, IteratorType const& end)
+    : mIter(begin), mEnd(end)
+{
+}
+
+void
+LedgerTxnRoot::Impl::WriteBatchIteratorImpl::advance()
+{
+    ++mIter;
+}
+
+bool
+LedgerTxnRoot::Impl::WriteBatchIteratorImpl::atEnd() const
+{
+    return mIter == mEnd;
+}
+
+LedgerEntry const&
+LedgerTxnRoot::Impl::WriteBatchIteratorImpl::entry() const
+{
+    return *(mIter->second);
+}
+
+bool
+LedgerTxnRoot::Impl::WriteBatchIteratorImpl::entryExists() const
+{
+    return (bool)(mIter->second);
+}
+
+LedgerKey const&
+LedgerTxnRoot::Impl::WriteBatchIteratorImpl::key() const
+{
+    return mIter->first;
+}
+
+std::unique_ptr<EntryIterator::AbstractImpl>
+LedgerTxnRoot::Impl::WriteBatchIteratorImpl::clone() const
+{
+    return std::make_unique<WriteBatchIteratorImpl>(mIter, mEnd);
+}
+
 // Implementation of LedgerTxnRoot ------------------------------------------
 size_t const LedgerTxnRoot::Impl::MIN_BEST_OFFERS_BATCH_SIZE = 5;
 size_t const LedgerTxnRoot::Impl::MAX_BEST_OFFERS_BATCH_SIZE = 1024;
+size_t const LedgerTxnRoot::Impl::MAX_BATCHES_BEHIND = 4;
+double const LedgerTxnRoot::Impl::MAX_KEY_FILTER_FALSE_POSITIVE_RATE = 0.02;
 
 LedgerTxnRoot::LedgerTxnRoot(Database& db, size_t entryCacheSize,
-                             size_t bestOfferCacheSize,
-                             size_t prefetchBatchSize)
-    : mImpl(std::make_unique<Impl>(db, entryCacheSize, bestOfferCacheSize,
-                                   prefetchBatchSize))
+                             size_t entryCacheBytes, size_t bestOfferCacheSize,
+                             size_t prefetchBatchSize, bool inMemoryOrderBook,
+                             bool writeBehind, bool keyFilters)
+    : mImpl(std::make_unique<Impl>(db, entryCacheSize, entryCacheBytes,
+                                   bestOfferCacheSize, prefetchBatchSize,
+                                   inMemoryOrderBook, writeBehind, keyFilters))
 {
 }
 
 LedgerTxnRoot::Impl::Impl(Database& db, size_t entryCacheSize,
-                          size_t bestOfferCacheSize, size_t prefetchBatchSize)
+                          size_t entryCacheBytes, size_t bestOfferCacheSize,
+                          size_t prefetchBatchSize, bool inMemoryOrderBook,
+                          bool writeBehind, bool keyFilters)
     : mDatabase(db)
     , mHeader(std::make_unique<LedgerHeader>())
-    , mEntryCache(entryCacheSize)
+    , mEntryCache(entryCacheSize, entryCacheBytes,
+                  [this](LedgerKey const& key, CacheEntry const&) {
+                      ++mEntryCacheCounters[key.type()].mEvictions;
+                  })
     , mBestOffersCache(bestOfferCacheSize)
+    , mInMemoryOrderBook(inMemoryOrderBook)
+    , mUseKeyFilters(keyFilters)
+    , mWriteBehind(writeBehind)
     , mMaxCacheSize(entryCacheSize)
     , mBulkLoadBatchSize(prefetchBatchSize)
     , mChild(nullptr)
 {
+    // Every type has counters from the start, so that counting never
+    // allocates
+    for (auto let : {ACCOUNT, TRUSTLINE, OFFER, DATA})
+    {
+        mEntryCacheCounters[let] = {};
+    }
 }
 
 LedgerTxnRoot::~LedgerTxnRoot()
@@ -1941,14 +2160,22 @@ LedgerTxnRoot::Impl::~Impl()
     {
         mChild->rollback();
     }
+    stopLoader();
+    stopWriter();
+    discardLoadsAhead();
 }
 
 #ifdef FUZZING_BUILD_MODE_UNSAFE_FOR_PRODUCTION
 void
 LedgerTxnRoot::Impl::resetForFuzzer()
 {
+    flushWrites();
     mBestOffersCache.clear();
     mEntryCache.clear();
+    discardOrderBook();
+    discardKeyFilters();
+    discardInflationTally();
+    discardLoadsAhead();
 }
 
 void
@@ -2025,54 +2252,55 @@ BulkLedgerEntryChangeAccumulator::accumulate(EntryIterator const& iter)
 void
 LedgerTxnRoot::Impl::bulkApply(BulkLedgerEntryChangeAccumulator& bleca,
                                size_t bufferThreshold,
-                               LedgerTxnConsistency cons)
+                               LedgerTxnConsistency cons,
+                               soci::session& session)
 {
     auto& upsertAccounts = bleca.getAccountsToUpsert();
     if (upsertAccounts.size() > bufferThreshold)
     {
-        bulkUpsertAccounts(upsertAccounts);
+        bulkUpsertAccounts(upsertAccounts, session);
         upsertAccounts.clear();
     }
     auto& deleteAccounts = bleca.getAccountsToDelete();
     if (deleteAccounts.size() > bufferThreshold)
     {
-        bulkDeleteAccounts(deleteAccounts, cons);
+        bulkDeleteAccounts(deleteAccounts, cons, session);
         deleteAccounts.clear();
     }
     auto& upsertTrustLines = bleca.getTrustLinesToUpsert();
     if (upsertTrustLines.size() > bufferThreshold)
     {
-        bulkUpsertTrustLines(upsertTrustLines);
+        bulkUpsertTrustLines(upsertTrustLines, session);
         upsertTrustLines.clear();
     }
     auto& deleteTrustLines = bleca.getTrustLinesToDelete();
     if (deleteTrustLines.size() > bufferThreshold)
     {
-        bulkDeleteTrustLines(deleteTrustLines, cons);
+        bulkDeleteTrustLines(deleteTrustLines, cons, session);
         deleteTrustLines.clear();
     }
     auto& upsertOffers = bleca.getOffersToUpsert();
     if (upsertOffers.size() > bufferThreshold)
     {
-        bulkUpsertOffers(upsertOffers);
+        bulkUpsertOffers(upsertOffers, session);
         upsertOffers.clear();
     }
     auto& deleteOffers = bleca.getOffersToDelete();
     if (deleteOffers.size() > bufferThreshold)
     {
-        bulkDeleteOffers(deleteOffers, cons);
+        bulkDeleteOffers(deleteOffers, cons, session);
         deleteOffers.clear();
     }
     auto& upsertAccountData = bleca.getAccountDataToUpsert();
     if (upsertAccountData.size() > bufferThreshold)
     {
-        bulkUpsertAccountData(upsertAccountData);
+        bulkUpsertAccountData(upsertAccountData, session);
         upsertAccountData.clear();
     }
     auto& deleteAccountData = bleca.getAccountDataToDelete();
     if (deleteAccountData.size() > bufferThreshold)
     {
-        bulkDeleteAccountData(deleteAccountData, cons);
+        bulkDeleteAccountData(deleteAccountData, cons, session);
         deleteAccountData.clear();
     }
 }
@@ -2084,16 +2312,77 @@ LedgerTxnRoot::Impl::commitChild(EntryIterator iter, LedgerTxnConsistency cons)
     // guarantee, so use std::unique_ptr<...>::swap to achieve it
     auto childHeader = std::make_unique<LedgerHeader>(mChild->getHeader());
 
+    // Only the commits that close the next ledger are written behind, so
+    // that the last written ledger always covers every commit up to it. Any
+    // other commit, like loading the last closed ledger or applying buckets,
+    // writes after the batches still queued.
+    std::shared_ptr<WriteBatch> batch;
+    if (mWriteBehind && childHeader->ledgerSeq == mHeader->ledgerSeq + 1)
+    {
+        retireWrites();
+        batch = std::make_shared<WriteBatch>();
+        batch->mLedgerSeq = childHeader->ledgerSeq;
+        batch->mCons = cons;
+    }
+    else
+    {
+        flushWrites();
+    }
+
     auto bleca = BulkLedgerEntryChangeAccumulator();
+    std::vector<std::pair<int64_t, std::shared_ptr<LedgerEntry const>>>
+        offerChanges;
+    std::vector<std::pair<LedgerKey, std::shared_ptr<LedgerEntry const>>>
+        cacheUpdates;
+    std::vector<std::pair<AccountID, std::shared_ptr<LedgerEntry const>>>
+        voteChanges;
     try
     {
         while ((bool)iter)
         {
+            std::shared_ptr<LedgerEntry const> entry;
+            auto getEntry = [&]() {
+                if (!entry && iter.entryExists())
+                {
+                    entry = std::make_shared<LedgerEntry const>(iter.entry());
+                }
+                return entry;
+            };
+            if (mEntryCache.exists(iter.key(), false))
+            {
+                cacheUpdates.emplace_back(iter.key(), getEntry());
+            }
+            if (mOrderBookLoaded && iter.key().type() == OFFER)
+            {
+                offerChanges.emplace_back(iter.key().offer().offerID,
+                                          getEntry());
+            }
+            if (mInflationTallyLoaded && iter.key().type() == ACCOUNT)
+            {
+                voteChanges.emplace_back(iter.key().account().accountID,
+                                         getEntry());
+            }
+            for (auto& pending : mLoadsAhead)
+            {
+                pending.mModified.emplace(iter.key());
+            }
+            // Adding a key that the commit fails to write only makes the
+            // filter more permissive
+            if (iter.entryExists())
+            {
+                addToKeyFilter(iter.key());
+            }
+            if (batch)
+            {
+                batch->mEntries.emplace_back(iter.key(), getEntry());
+                ++iter;
+                continue;
+            }
             bleca.accumulate(iter);
             ++iter;
             size_t bufferThreshold =
                 (bool)iter ? LEDGER_ENTRY_BATCH_COMMIT_SIZE : 0;
-            bulkApply(bleca, bufferThreshold, cons);
+            bulkApply(bleca, bufferThreshold, cons, mDatabase.getSession());
         }
         // NB: we want to clear the prepared statement cache _before_
         // committing; on postgres this doesn't matter but on SQLite the passive
@@ -2101,6 +2390,30 @@ LedgerTxnRoot::Impl::commitChild(EntryIterator iter, LedgerTxnConsistency cons)
         // still prepared statements open at commit time.
         mDatabase.clearPreparedStatementCache();
         mTransaction->commit();
+
+        // The header is committed, so the batch must be written whatever
+        // happens from here on
+        if (batch)
+        {
+            batch->mID = ++mLastBatchID;
+            for (auto const& item : batch->mEntries)
+            {
+                mPendingWrites[item.first] = {item.second, batch->mID};
+            }
+            mBatchesInFlight.emplace_back(batch);
+            if (!mWriter.joinable())
+            {
+                startWriter();
+            }
+            {
+                std::unique_lock<std::mutex> lock(mWriteMutex);
+                mWriteCV.wait(lock, [this]() {
+                    return mWriteQueue.size() < MAX_BATCHES_BEHIND;
+                });
+                mWriteQueue.emplace_back(batch);
+            }
+            mWriteCV.notify_all();
+        }
     }
     catch (std::exception& e)
     {
@@ -2115,7 +2428,92 @@ LedgerTxnRoot::Impl::commitChild(EntryIterator iter, LedgerTxnConsistency cons)
 
     // Clearing the cache does not throw
     mBestOffersCache.clear();
-    mEntryCache.clear();
+
+    // The entry cache keeps the entries that were not committed, and must
+    // either reflect those that were or be cleared. putInEntryCache already
+    // clears it if it throws; clearing it again here does not throw.
+    try
+    {
+        for (auto const& update : cacheUpdates)
+        {
+            putInEntryCache(update.first, update.second, LoadType::IMMEDIATE);
+        }
+    }
+    catch (std::exception& e)
+    {
+        mEntryCache.clear();
+        CLOG(WARNING, "Ledger")
+            << "Clearing entry cache after failing to update it: " << e.what();
+    }
+    catch (...)
+    {
+        mEntryCache.clear();
+        CLOG(WARNING, "Ledger")
+            << "Clearing entry cache after failing to update it";
+    }
+
+    // The database now reflects offerChanges, so the order book must either
+    // reflect them too or be discarded
+    try
+    {
+        for (auto const& change : offerChanges)
+        {
+            eraseFromOrderBook(change.first);
+            if (change.second)
+            {
+                insertInOrderBook(change.second);
+            }
+        }
+    }
+    catch (...)
+    {
+        discardOrderBook();
+    }
+
+    // Likewise for the inflation tally and voteChanges
+    try
+    {
+        for (auto const& change : voteChanges)
+        {
+            updateInflationVote(change.first, change.second);
+        }
+    }
+    catch (...)
+    {
+        discardInflationTally();
+    }
+
+    // Filters that let through too many of the keys that are not in the
+    // database are rebuilt on mLoader, sized for what they now hold, and
+    // stay in use until then. Without a pool they are loaded again on next
+    // use instead.
+    finishKeyFilterRebuilds();
+    for (auto& filter : mKeyFilters)
+    {
+        if (!filter.second || filter.second->falsePositiveRate() <=
+                                  MAX_KEY_FILTER_FALSE_POSITIVE_RATE)
+        {
+            continue;
+        }
+        if (!mDatabase.canUsePool())
+        {
+            filter.second.reset();
+            continue;
+        }
+        if (mKeyFilterRebuilds.find(filter.first) == mKeyFilterRebuilds.end())
+        {
+            // A rebuild that fails to start is tried again on next commit
+            try
+            {
+                startKeyFilterRebuild(filter.first);
+            }
+            catch (std::exception& e)
+            {
+                CLOG(WARNING, "Ledger")
+                    << "Failed to start rebuilding key filter: " << e.what();
+            }
+        }
+    }
 
     // std::unique_ptr<...>::reset does not throw
     mTransaction.reset();
@@ -2126,58 +2524,350 @@ LedgerTxnRoot::Impl::commitChild(EntryIterator iter, LedgerTxnConsistency cons)
 
     mPrefetchHits = 0;
     mPrefetchMisses = 0;
+    mPrefetchedEntries = 0;
+    mPrefetchedBytes = 0;
 }
 
-std::string
-LedgerTxnRoot::Impl::tableFromLedgerEntryType(LedgerEntryType let)
+void
+LedgerTxnRoot::Impl::writeEntries(LedgerEntryWrites const& entries,
+                                  LedgerTxnConsistency cons,
+                                  soci::session& session)
 {
-    switch (let)
+    auto bleca = BulkLedgerEntryChangeAccumulator();
+    EntryIterator iter(std::make_unique<WriteBatchIteratorImpl>(
+        entries.cbegin(), entries.cend()));
+    while ((bool)iter)
     {
-    case ACCOUNT:
-        return "accounts";
-    case DATA:
-        return "accountdata";
-    case OFFER:
-        return "offers";
-    case TRUSTLINE:
-        return "trustlines";
-    default:
-        throw std::runtime_error("Unknown ledger entry type");
+        bleca.accumulate(iter);
+        ++iter;
+        size_t bufferThreshold =
+            (bool)iter ? LEDGER_ENTRY_BATCH_COMMIT_SIZE : 0;
+        bulkApply(bleca, bufferThreshold, cons, session);
     }
 }
 
-uint64_t
-LedgerTxnRoot::countObjects(LedgerEntryType let) const
+void
+LedgerTxnRoot::Impl::writeBatch(WriteBatch const& batch,
+                                soci::connection_pool& pool)
 {
-    return mImpl->countObjects(let);
+    try
+    {
+        soci::session session(pool);
+        soci::transaction tx(session);
+        writeEntries(batch.mEntries, batch.mCons, session);
+        PersistentState::setState(mDatabase, session,
+                                  PersistentState::kLastWrittenLedger,
+                                  std::to_string(batch.mLedgerSeq));
+        tx.commit();
+    }
+    catch (std::exception& e)
+    {
+        printErrorAndAbort("fatal error during write behind LedgerTxnRoot: ",
+                           e.what());
+    }
+    catch (...)
+    {
+        printErrorAndAbort(
+            "unknown fatal error during write behind LedgerTxnRoot");
+    }
 }
 
-uint64_t
-LedgerTxnRoot::Impl::countObjects(LedgerEntryType let) const
+void
+LedgerTxnRoot::Impl::runWriter(soci::connection_pool& pool)
 {
-    using namespace soci;
-    throwIfChild();
+    while (true)
+    {
+        WriteBatchPtr batch;
+        {
+            std::unique_lock<std::mutex> lock(mWriteMutex);
+            mWriteCV.wait(lock, [this]() {
+                return mStopWriter || !mWriteQueue.empty();
+            });
+            if (mWriteQueue.empty())
+            {
+                return;
+            }
+            batch = mWriteQueue.front();
+        }
 
-    std::string query =
-        "SELECT COUNT(*) FROM " + tableFromLedgerEntryType(let) + ";";
-    uint64_t count = 0;
-    mDatabase.getSession() << query, into(count);
-    return count;
-}
+        writeBatch(*batch, pool);
 
-uint64_t
-LedgerTxnRoot::countObjects(LedgerEntryType let,
-                            LedgerRange const& ledgers) const
-{
-    return mImpl->countObjects(let, ledgers);
+        {
+            std::lock_guard<std::mutex> lock(mWriteMutex);
+            mWriteQueue.pop_front();
+            mLastBatchWritten = batch->mID;
+        }
+        mWriteCV.notify_all();
+    }
 }
 
-uint64_t
+void
+LedgerTxnRoot::Impl::writeInParallel(LedgerEntryWrites const& entries,
+                                     size_t nThreads)
+{
+    throwIfChild();
+    flushWrites();
+    discardLoadsAhead();
+    mEntryCache.clear();
+    mBestOffersCache.clear();
+    for (auto const& item : entries)
+    {
+        if (item.first.type() == OFFER)
+        {
+            discardOrderBook();
+        }
+        else if (item.first.type() == ACCOUNT)
+        {
+            discardInflationTally();
+        }
+        // Adding a key that fails to be written only makes the filter more
+        // permissive
+        if (item.second)
+        {
+            addToKeyFilter(item.first);
+        }
+    }
+
+    // On SQLite, connections would only wait for each other to write
+    if (nThreads <= 1 || mDatabase.isSqlite() || !mDatabase.canUsePool())
+    {
+        auto& session = mDatabase.getSession();
+        soci::transaction tx(session);
+        writeEntries(entries, LedgerTxnConsistency::EXTRA_DELETES, session);
+        tx.commit();
+        return;
+    }
+
+    // Every key goes to a single connection, so that they never wait for
+    // each other's rows
+    std::vector<LedgerEntryWrites> shards(nThreads);
+    for (auto const& item : entries)
+    {
+        shards[KeyFilterHash{}(item.first) % nThreads].emplace_back(item);
+    }
+
+    // The pool is created on first use, which must happen on this thread
+    auto& pool = mDatabase.getPool();
+    auto writeShard = [this, &pool](LedgerEntryWrites const& shard) {
+        if (shard.empty())
+        {
+            return;
+        }
+        soci::session session(pool);
+        soci::transaction tx(session);
+        writeEntries(shard, LedgerTxnConsistency::EXTRA_DELETES, session);
+        tx.commit();
+    };
+
+    // Declared last so that, should anything throw, pending writes are
+    // waited for before the shards go away
+    std::vector<std::future<void>> writes;
+    for (size_t i = 1; i < nThreads; ++i)
+    {
+        writes.emplace_back(std::async(std::launch::async, writeShard,
+                                       std::cref(shards[i])));
+    }
+    writeShard(shards[0]);
+    for (auto& write : writes)
+    {
+        write.get();
+    }
+}
+
+void
+LedgerTxnRoot::Impl::startWriter()
+{
+    // The pool is created on first use, which must happen on this thread
+    auto& pool = mDatabase.getPool();
+    mWriter = std::thread([this, &pool]() { runWriter(pool); });
+}
+
+void
+LedgerTxnRoot::Impl::postToLoader(LoaderJob job)
+{
+    if (!mLoader.joinable())
+    {
+        // The pool is created on first use, which must happen on this thread
+        auto& pool = mDatabase.getPool();
+        mLoader = std::thread([this, &pool]() { runLoader(pool); });
+    }
+    {
+        std::lock_guard<std::mutex> lock(mLoaderMutex);
+        mLoaderJobs.emplace_back(std::move(job));
+    }
+    mLoaderCV.notify_all();
+}
+
+void
+LedgerTxnRoot::Impl::runLoader(soci::connection_pool& pool)
+{
+    while (true)
+    {
+        LoaderJob job;
+        {
+            std::unique_lock<std::mutex> lock(mLoaderMutex);
+            mLoaderCV.wait(lock, [this]() {
+                return mStopLoader || !mLoaderJobs.empty();
+            });
+            if (mStopLoader)
+            {
+                return;
+            }
+            job = std::move(mLoaderJobs.front());
+            mLoaderJobs.pop_front();
+        }
+
+        // A connection is only held while a job runs, so that the loader
+        // never keeps the writer from getting one. A job dropped for lack of
+        // a connection breaks its promise, which its owner treats as failed.
+        try
+        {
+            soci::session session(pool);
+            job(session);
+        }
+        catch (std::exception& e)
+        {
+            CLOG(WARNING, "Ledger")
+                << "Dropping load for lack of a connection: " << e.what();
+        }
+    }
+}
+
+void
+LedgerTxnRoot::Impl::stopLoader()
+{
+    if (!mLoader.joinable())
+    {
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(mLoaderMutex);
+        mStopLoader = true;
+        mLoaderJobs.clear();
+    }
+    mLoaderCV.notify_all();
+    mLoader.join();
+}
+
+void
+LedgerTxnRoot::Impl::stopWriter()
+{
+    if (!mWriter.joinable())
+    {
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(mWriteMutex);
+        mStopWriter = true;
+    }
+    mWriteCV.notify_all();
+    mWriter.join();
+}
+
+void
+LedgerTxnRoot::Impl::retireWrites() const
+{
+    uint64_t lastWritten;
+    {
+        std::lock_guard<std::mutex> lock(mWriteMutex);
+        lastWritten = mLastBatchWritten;
+    }
+
+    while (!mBatchesInFlight.empty() &&
+           mBatchesInFlight.front()->mID <= lastWritten)
+    {
+        auto const& batch = *mBatchesInFlight.front();
+        for (auto const& item : batch.mEntries)
+        {
+            // A load ahead may have read the entry before it was written
+            for (auto& pending : mLoadsAhead)
+            {
+                pending.mModified.emplace(item.first);
+            }
+            auto iter = mPendingWrites.find(item.first);
+            if (iter != mPendingWrites.end() &&
+                iter->second.mBatchID == batch.mID)
+            {
+                mPendingWrites.erase(iter);
+            }
+        }
+        mBatchesInFlight.pop_front();
+    }
+}
+
+void
+LedgerTxnRoot::Impl::flushWrites() const
+{
+    if (mBatchesInFlight.empty())
+    {
+        return;
+    }
+    {
+        std::unique_lock<std::mutex> lock(mWriteMutex);
+        mWriteCV.wait(lock, [this]() { return mWriteQueue.empty(); });
+    }
+    retireWrites();
+}
+
+LedgerTxnRoot::Impl::PendingWrite const*
+LedgerTxnRoot::Impl::getPendingWrite(LedgerKey const& key) const
+{
+    auto iter = mPendingWrites.find(key);
+    return iter == mPendingWrites.end() ? nullptr : &iter->second;
+}
+
+std::string
+LedgerTxnRoot::Impl::tableFromLedgerEntryType(LedgerEntryType let)
+{
+    switch (let)
+    {
+    case ACCOUNT:
+        return "accounts";
+    case DATA:
+        return "accountdata";
+    case OFFER:
+        return "offers";
+    case TRUSTLINE:
+        return "trustlines";
+    default:
+        throw std::runtime_error("Unknown ledger entry type");
+    }
+}
+
+uint64_t
+LedgerTxnRoot::countObjects(LedgerEntryType let) const
+{
+    return mImpl->countObjects(let);
+}
+
+uint64_t
+LedgerTxnRoot::Impl::countObjects(LedgerEntryType let) const
+{
+    using namespace soci;
+    throwIfChild();
+    flushWrites();
+
+    std::string query =
+        "SELECT COUNT(*) FROM " + tableFromLedgerEntryType(let) + ";";
+    uint64_t count = 0;
+    mDatabase.getSession() << query, into(count);
+    return count;
+}
+
+uint64_t
+LedgerTxnRoot::countObjects(LedgerEntryType let,
+                            LedgerRange const& ledgers) const
+{
+    return mImpl->countObjects(let, ledgers);
+}
+
+uint64_t
 LedgerTxnRoot::Impl::countObjects(LedgerEntryType let,
                                   LedgerRange const& ledgers) const
 {
     using namespace soci;
     throwIfChild();
+    flushWrites();
 
     std::string query = "SELECT COUNT(*) FROM " +
                         tableFromLedgerEntryType(let) +
@@ -2200,8 +2890,12 @@ LedgerTxnRoot::Impl::deleteObjectsModifiedOnOrAfterLedger(uint32_t ledger) const
 {
     using namespace soci;
     throwIfChild();
+    flushWrites();
     mEntryCache.clear();
     mBestOffersCache.clear();
+    discardOrderBook();
+    discardInflationTally();
+    discardLoadsAhead();
 
     for (auto let : {ACCOUNT, DATA, TRUSTLINE, OFFER})
     {
@@ -2235,6 +2929,35 @@ LedgerTxnRoot::dropTrustLines()
     mImpl->dropTrustLines();
 }
 
+void
+LedgerTxnRoot::writeInParallel(LedgerEntryWrites const& entries,
+                               size_t nThreads)
+{
+    mImpl->writeInParallel(entries, nThreads);
+}
+
+void
+LedgerTxnRoot::loadInMemoryState()
+{
+    mImpl->loadInMemoryState();
+}
+
+void
+LedgerTxnRoot::Impl::loadInMemoryState()
+{
+    throwIfChild();
+    if (mInMemoryOrderBook)
+    {
+        loadOrderBook();
+    }
+    // Loaded now rather than on the first lookup, which would likely be
+    // while closing a ledger
+    for (auto let : {ACCOUNT, TRUSTLINE, OFFER, DATA})
+    {
+        getKeyFilter(let);
+    }
+}
+
 uint32_t
 LedgerTxnRoot::prefetch(std::unordered_set<LedgerKey> const& keys)
 {
@@ -2244,7 +2967,11 @@ LedgerTxnRoot::prefetch(std::unordered_set<LedgerKey> const& keys)
 uint32_t
 LedgerTxnRoot::Impl::prefetch(std::unordered_set<LedgerKey> const& keys)
 {
+    retireWrites();
+    mergeLoadsAhead();
+
     uint32_t total = 0;
+    auto& session = mDatabase.getSession();
 
     std::unordered_set<LedgerKey> accounts;
     std::unordered_set<LedgerKey> offers;
@@ -2252,8 +2979,8 @@ LedgerTxnRoot::Impl::prefetch(std::unordered_set<LedgerKey> const& keys)
     std::unordered_set<LedgerKey> data;
 
     auto cacheResult =
-        [&](std::unordered_map<LedgerKey,
-                               std::shared_ptr<LedgerEntry const>> const& res) {
+        [&](FlatHashMap<LedgerKey, std::shared_ptr<LedgerEntry const>> const&
+                res) {
             for (auto const& item : res)
             {
                 putInEntryCache(item.first, item.second, LoadType::PREFETCH);
@@ -2261,9 +2988,17 @@ LedgerTxnRoot::Impl::prefetch(std::unordered_set<LedgerKey> const& keys)
             }
         };
 
+    // Entries that are still to be written are read from mPendingWrites, as
+    // the database does not have them yet, and keys that their key filter
+    // rules out are not in the database
     auto insertIfNotLoaded = [&](std::unordered_set<LedgerKey>& keys,
                                  LedgerKey const& key) {
-        if (!mEntryCache.exists(key, false))
+        if (mEntryCache.exists(key, false) || getPendingWrite(key))
+        {
+            return;
+        }
+        auto filter = getKeyFilter(key.type());
+        if (!filter || filter->mayContain(key))
         {
             keys.insert(key);
         }
@@ -2271,8 +3006,7 @@ LedgerTxnRoot::Impl::prefetch(std::unordered_set<LedgerKey> const& keys)
 
     for (auto const& key : keys)
     {
-        if ((static_cast<double>(mEntryCache.size()) / mMaxCacheSize) >=
-            ENTRY_CACHE_FILL_RATIO)
+        if (prefetchBudgetExhausted())
         {
             return total;
         }
@@ -2283,15 +3017,21 @@ LedgerTxnRoot::Impl::prefetch(std::unordered_set<LedgerKey> const& keys)
             insertIfNotLoaded(accounts, key);
             if (accounts.size() == mBulkLoadBatchSize)
             {
-                cacheResult(bulkLoadAccounts(accounts));
+                cacheResult(bulkLoadAccounts(accounts, session));
                 accounts.clear();
             }
             break;
         case OFFER:
+            // Offers are never loaded from the database when the in-memory
+            // order book is used
+            if (mInMemoryOrderBook)
+            {
+                break;
+            }
             insertIfNotLoaded(offers, key);
             if (offers.size() == mBulkLoadBatchSize)
             {
-                cacheResult(bulkLoadOffers(offers));
+                cacheResult(bulkLoadOffers(offers, session));
                 offers.clear();
             }
             break;
@@ -2299,7 +3039,7 @@ LedgerTxnRoot::Impl::prefetch(std::unordered_set<LedgerKey> const& keys)
             insertIfNotLoaded(trustlines, key);
             if (trustlines.size() == mBulkLoadBatchSize)
             {
-                cacheResult(bulkLoadTrustLines(trustlines));
+                cacheResult(bulkLoadTrustLines(trustlines, session));
                 trustlines.clear();
             }
             break;
@@ -2307,7 +3047,7 @@ LedgerTxnRoot::Impl::prefetch(std::unordered_set<LedgerKey> const& keys)
             insertIfNotLoaded(data, key);
             if (data.size() == mBulkLoadBatchSize)
             {
-                cacheResult(bulkLoadData(data));
+                cacheResult(bulkLoadData(data, session));
                 data.clear();
             }
             break;
@@ -2315,14 +3055,238 @@ LedgerTxnRoot::Impl::prefetch(std::unordered_set<LedgerKey> const& keys)
     }
 
     //  Prefetch whatever is remaining
-    cacheResult(bulkLoadAccounts(accounts));
-    cacheResult(bulkLoadOffers(offers));
-    cacheResult(bulkLoadTrustLines(trustlines));
-    cacheResult(bulkLoadData(data));
+    cacheResult(bulkLoadAccounts(accounts, session));
+    cacheResult(bulkLoadOffers(offers, session));
+    cacheResult(bulkLoadTrustLines(trustlines, session));
+    cacheResult(bulkLoadData(data, session));
 
     return total;
 }
 
+bool
+LedgerTxnRoot::prefetchAsync(std::unordered_set<LedgerKey> const& keys)
+{
+    return mImpl->prefetchAsync(keys);
+}
+
+bool
+LedgerTxnRoot::Impl::prefetchAsync(std::unordered_set<LedgerKey> const& keys)
+{
+    if (!mDatabase.canUsePool())
+    {
+        return false;
+    }
+
+    // Callers ask for mostly the same keys again as the candidate values of
+    // a ledger grow, so only what is not cached or on its way is loaded
+    LoadAhead pending;
+    for (auto const& key : keys)
+    {
+        if (!mEntryCache.exists(key, false) && !getPendingWrite(key) &&
+            !isLoadingAhead(key))
+        {
+            pending.mKeys.emplace(key);
+        }
+    }
+    if (pending.mKeys.empty())
+    {
+        return true;
+    }
+
+    auto cancelled = std::make_shared<std::atomic<bool>>(false);
+    using task_t = std::packaged_task<LoadedEntries(soci::session&)>;
+    auto task = std::make_shared<task_t>(
+        [this, keys = pending.mKeys, cancelled](soci::session& session) {
+            return loadAhead(keys, *cancelled, session);
+        });
+    pending.mLoaded = task->get_future();
+    pending.mCancelled = cancelled;
+
+    mLoadsAhead.emplace_back(std::move(pending));
+    try
+    {
+        postToLoader([task](soci::session& session) { (*task)(session); });
+    }
+    catch (...)
+    {
+        mLoadsAhead.pop_back();
+        throw;
+    }
+    return true;
+}
+
+bool
+LedgerTxnRoot::Impl::isLoadingAhead(LedgerKey const& key) const
+{
+    for (auto const& pending : mLoadsAhead)
+    {
+        if (pending.mKeys.find(key) != pending.mKeys.end() &&
+            pending.mModified.find(key) == pending.mModified.end())
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+LedgerTxnRoot::Impl::LoadedEntries
+LedgerTxnRoot::Impl::loadAhead(std::unordered_set<LedgerKey> const& keys,
+                               std::atomic<bool> const& cancelled,
+                               soci::session& session) const
+{
+    LoadedEntries res;
+    res.reserve(keys.size());
+    auto addResult = [&](LoadedEntries&& loaded) {
+        for (auto& item : loaded)
+        {
+            res.emplace(item.first, std::move(item.second));
+        }
+    };
+
+    std::unordered_set<LedgerKey> accounts;
+    std::unordered_set<LedgerKey> offers;
+    std::unordered_set<LedgerKey> trustlines;
+    std::unordered_set<LedgerKey> data;
+
+    for (auto const& key : keys)
+    {
+        // What was read so far is dropped anyway
+        if (cancelled)
+        {
+            return {};
+        }
+        switch (key.type())
+        {
+        case ACCOUNT:
+            accounts.insert(key);
+            if (accounts.size() == mBulkLoadBatchSize)
+            {
+                addResult(bulkLoadAccounts(accounts, session));
+                accounts.clear();
+            }
+            break;
+        case OFFER:
+            if (mInMemoryOrderBook)
+            {
+                break;
+            }
+            offers.insert(key);
+            if (offers.size() == mBulkLoadBatchSize)
+            {
+                addResult(bulkLoadOffers(offers, session));
+                offers.clear();
+            }
+            break;
+        case TRUSTLINE:
+            trustlines.insert(key);
+            if (trustlines.size() == mBulkLoadBatchSize)
+            {
+                addResult(bulkLoadTrustLines(trustlines, session));
+                trustlines.clear();
+            }
+            break;
+        case DATA:
+            data.insert(key);
+            if (data.size() == mBulkLoadBatchSize)
+            {
+                addResult(bulkLoadData(data, session));
+                data.clear();
+            }
+            break;
+        }
+    }
+
+    if (cancelled)
+    {
+        return {};
+    }
+    addResult(bulkLoadAccounts(accounts, session));
+    addResult(bulkLoadOffers(offers, session));
+    addResult(bulkLoadTrustLines(trustlines, session));
+    addResult(bulkLoadData(data, session));
+    return res;
+}
+
+void
+LedgerTxnRoot::Impl::mergeLoadsAhead()
+{
+    // Loads ahead that are still running are left for a later call, so that
+    // they never hold up the caller
+    std::vector<LoadAhead> finished;
+    for (auto iter = mLoadsAhead.begin(); iter != mLoadsAhead.end();)
+    {
+        if (iter->mLoaded.wait_for(std::chrono::seconds(0)) ==
+            std::future_status::ready)
+        {
+            finished.emplace_back(std::move(*iter));
+            iter = mLoadsAhead.erase(iter);
+        }
+        else
+        {
+            ++iter;
+        }
+    }
+
+    for (auto& done : finished)
+    {
+        LoadedEntries loaded;
+        try
+        {
+            loaded = done.mLoaded.get();
+        }
+        catch (std::exception& e)
+        {
+            CLOG(WARNING, "Ledger")
+                << "Dropping ledger entries loaded ahead: " << e.what();
+            continue;
+        }
+
+        for (auto const& item : loaded)
+        {
+            if (prefetchBudgetExhausted())
+            {
+                return;
+            }
+            if (done.mModified.find(item.first) == done.mModified.end() &&
+                !mEntryCache.exists(item.first, false) &&
+                !getPendingWrite(item.first))
+            {
+                putInEntryCache(item.first, item.second, LoadType::PREFETCH);
+            }
+        }
+    }
+}
+
+void
+LedgerTxnRoot::Impl::discardLoadsAhead() const
+{
+    // mLoader skips the loads that are cancelled before they start, and the
+    // result of the one running, if any, is dropped with its future
+    for (auto const& pending : mLoadsAhead)
+    {
+        *pending.mCancelled = true;
+    }
+    mLoadsAhead.clear();
+}
+
+#ifdef BUILD_TESTS
+size_t
+LedgerTxnRoot::waitForLoadsAhead()
+{
+    return mImpl->waitForLoadsAhead();
+}
+
+size_t
+LedgerTxnRoot::Impl::waitForLoadsAhead()
+{
+    for (auto const& pending : mLoadsAhead)
+    {
+        pending.mLoaded.wait();
+    }
+    return mLoadsAhead.size();
+}
+#endif
+
 double
 LedgerTxnRoot::getPrefetchHitRate() const
 {
@@ -2340,6 +3304,18 @@ LedgerTxnRoot::Impl::getPrefetchHitRate() const
            (mPrefetchMisses + mPrefetchHits);
 }
 
+EntryCacheCounters
+LedgerTxnRoot::getEntryCacheCounters(LedgerEntryType let) const
+{
+    return mImpl->getEntryCacheCounters(let);
+}
+
+EntryCacheCounters
+LedgerTxnRoot::Impl::getEntryCacheCounters(LedgerEntryType let) const
+{
+    return mEntryCacheCounters[let];
+}
+
 std::unordered_map<LedgerKey, LedgerEntry>
 LedgerTxnRoot::getAllOffers()
 {
@@ -2349,6 +3325,33 @@ LedgerTxnRoot::getAllOffers()
 std::unordered_map<LedgerKey, LedgerEntry>
 LedgerTxnRoot::Impl::getAllOffers()
 {
+    if (mInMemoryOrderBook)
+    {
+        try
+        {
+            loadOrderBook();
+        }
+        catch (std::exception& e)
+        {
+            printErrorAndAbort(
+                "fatal error when getting all offers from LedgerTxnRoot: ",
+                e.what());
+        }
+        catch (...)
+        {
+            printErrorAndAbort("unknown fatal error when getting all offers "
+                               "from LedgerTxnRoot");
+        }
+
+        std::unordered_map<LedgerKey, LedgerEntry> offersByKey(
+            mOffersByID.size());
+        for (auto const& kv : mOffersByID)
+        {
+            offersByKey.emplace(LedgerEntryKey(*kv.second), *kv.second);
+        }
+        return offersByKey;
+    }
+
     std::vector<LedgerEntry> offers;
     try
     {
@@ -2383,6 +3386,11 @@ LedgerTxnRoot::getBestOffer(Asset const& buying, Asset const& selling)
 std::shared_ptr<LedgerEntry const>
 LedgerTxnRoot::Impl::getBestOffer(Asset const& buying, Asset const& selling)
 {
+    if (mInMemoryOrderBook)
+    {
+        return getBestOfferFromOrderBook(buying, selling, nullptr);
+    }
+
     // Note: Elements of mBestOffersCache are properly sorted lists of the best
     // offers for a certain asset pair. This function maintaints the invariant
     // that the lists of best offers remain properly sorted. The sort order is
@@ -2432,6 +3440,11 @@ std::shared_ptr<LedgerEntry const>
 LedgerTxnRoot::Impl::getBestOffer(Asset const& buying, Asset const& selling,
                                   OfferDescriptor const& worseThan)
 {
+    if (mInMemoryOrderBook)
+    {
+        return getBestOfferFromOrderBook(buying, selling, &worseThan);
+    }
+
     // Note: Elements of mBestOffersCache are properly sorted lists of the best
     // offers for a certain asset pair. This function maintaints the invariant
     // that the lists of best offers remain properly sorted. The sort order is
@@ -2491,8 +3504,76 @@ LedgerTxnRoot::Impl::getBestOffer(Asset const& buying, Asset const& selling,
             BATCH_SIZE;
         res = findIncludedOffer(newOfferIter, offers.cend(), worseThan);
     }
-
-    return res;
+
+    return res;
+}
+
+std::shared_ptr<LedgerEntry const>
+LedgerTxnRoot::Impl::getBestOfferFromOrderBook(Asset const& buying,
+                                               Asset const& selling,
+                                               OfferDescriptor const* worseThan)
+{
+    try
+    {
+        loadOrderBook();
+    }
+    catch (std::exception& e)
+    {
+        printErrorAndAbort(
+            "fatal error when getting best offer from LedgerTxnRoot: ",
+            e.what());
+    }
+    catch (...)
+    {
+        printErrorAndAbort("unknown fatal error when getting best offer "
+                           "from LedgerTxnRoot");
+    }
+
+    auto mobIter = mMultiOrderBook.find({buying, selling});
+    if (mobIter == mMultiOrderBook.end())
+    {
+        return nullptr;
+    }
+
+    auto const& orderBook = mobIter->second;
+    auto iter = worseThan ? orderBook.upper_bound(*worseThan)
+                          : orderBook.cbegin();
+    if (iter == orderBook.cend())
+    {
+        return nullptr;
+    }
+    prefetchOfferSellers(iter, orderBook.cend());
+    return iter->second;
+}
+
+void
+LedgerTxnRoot::Impl::prefetchOfferSellers(OrderBook::const_iterator begin,
+                                          OrderBook::const_iterator const& end)
+{
+    // Sellers are prefetched for a batch of offers the first time one of them
+    // is needed, rather than for every offer when the order book is loaded
+    auto const& sellerID = begin->second->data.offer().sellerID;
+    if (mEntryCache.exists(accountKey(sellerID), false))
+    {
+        return;
+    }
+
+    std::unordered_set<LedgerKey> toPrefetch;
+    for (size_t n = 0; begin != end && n < MIN_BEST_OFFERS_BATCH_SIZE;
+         ++begin, ++n)
+    {
+        auto const& oe = begin->second->data.offer();
+        toPrefetch.emplace(accountKey(oe.sellerID));
+        if (oe.buying.type() != ASSET_TYPE_NATIVE)
+        {
+            toPrefetch.emplace(trustlineKey(oe.sellerID, oe.buying));
+        }
+        if (oe.selling.type() != ASSET_TYPE_NATIVE)
+        {
+            toPrefetch.emplace(trustlineKey(oe.sellerID, oe.selling));
+        }
+    }
+    prefetch(toPrefetch);
 }
 
 std::unordered_map<LedgerKey, LedgerEntry>
@@ -2509,7 +3590,14 @@ LedgerTxnRoot::Impl::getOffersByAccountAndAsset(AccountID const& account,
     std::vector<LedgerEntry> offers;
     try
     {
-        offers = loadOffersByAccountAndAsset(account, asset);
+        if (mInMemoryOrderBook)
+        {
+            offers = getOffersByAccountAndAssetFromOrderBook(account, asset);
+        }
+        else
+        {
+            offers = loadOffersByAccountAndAsset(account, asset);
+        }
     }
     catch (std::exception& e)
     {
@@ -2531,6 +3619,35 @@ LedgerTxnRoot::Impl::getOffersByAccountAndAsset(AccountID const& account,
     return res;
 }
 
+std::vector<LedgerEntry>
+LedgerTxnRoot::Impl::getOffersByAccountAndAssetFromOrderBook(
+    AccountID const& account, Asset const& asset) const
+{
+    if (asset.type() == ASSET_TYPE_NATIVE)
+    {
+        throw std::runtime_error("Invalid asset type");
+    }
+    loadOrderBook();
+
+    std::vector<LedgerEntry> offers;
+    auto sellerIter = mOffersBySeller.find(account);
+    if (sellerIter == mOffersBySeller.end())
+    {
+        return offers;
+    }
+    auto assetIter = sellerIter->second.find(asset);
+    if (assetIter == sellerIter->second.end())
+    {
+        return offers;
+    }
+    offers.reserve(assetIter->second.size());
+    for (auto offerID : assetIter->second)
+    {
+        offers.emplace_back(*mOffersByID.at(offerID));
+    }
+    return offers;
+}
+
 LedgerHeader const&
 LedgerTxnRoot::getHeader() const
 {
@@ -2552,9 +3669,23 @@ LedgerTxnRoot::getInflationWinners(size_t maxWinners, int64_t minVotes)
 std::vector<InflationWinner>
 LedgerTxnRoot::Impl::getInflationWinners(size_t maxWinners, int64_t minVotes)
 {
+    std::vector<InflationWinner> winners;
     try
     {
-        return loadInflationWinners(maxWinners, minVotes);
+        loadInflationTally();
+
+        // The ranking is in ascending order of votes, then strkey
+        for (auto iter = mInflationRanking.crbegin();
+             iter != mInflationRanking.crend() && winners.size() < maxWinners;
+             ++iter)
+        {
+            if (iter->first < minVotes)
+            {
+                break;
+            }
+            winners.push_back(
+                {KeyUtils::fromStrKey<PublicKey>(iter->second), iter->first});
+        }
     }
     catch (std::exception& e)
     {
@@ -2567,6 +3698,7 @@ LedgerTxnRoot::Impl::getInflationWinners(size_t maxWinners, int64_t minVotes)
         printErrorAndAbort("unknown fatal error when getting inflation winners "
                            "from LedgerTxnRoot");
     }
+    return winners;
 }
 
 std::shared_ptr<LedgerEntry const>
@@ -2578,34 +3710,87 @@ LedgerTxnRoot::getNewestVersion(LedgerKey const& key) const
 std::shared_ptr<LedgerEntry const>
 LedgerTxnRoot::Impl::getNewestVersion(LedgerKey const& key) const
 {
+    if (mInMemoryOrderBook && key.type() == OFFER)
+    {
+        try
+        {
+            loadOrderBook();
+        }
+        catch (std::exception& e)
+        {
+            printErrorAndAbort(
+                "fatal error when loading ledger entry from LedgerTxnRoot: ",
+                e.what());
+        }
+        catch (...)
+        {
+            printErrorAndAbort("unknown fatal error when loading ledger entry "
+                               "from LedgerTxnRoot");
+        }
+
+        auto iter = mOffersByID.find(key.offer().offerID);
+        if (iter != mOffersByID.end() &&
+            iter->second->data.offer().sellerID == key.offer().sellerID)
+        {
+            return iter->second;
+        }
+        return nullptr;
+    }
+
+    auto& counters = mEntryCacheCounters[key.type()];
     if (mEntryCache.exists(key))
     {
+        ++counters.mHits;
         return getFromEntryCache(key);
     }
     else
     {
+        ++counters.mMisses;
         ++mPrefetchMisses;
     }
 
+    // The database does not have the committed entries that are still to be
+    // written yet
+    if (auto pending = getPendingWrite(key))
+    {
+        putInEntryCache(key, pending->mEntry, LoadType::IMMEDIATE);
+        return pending->mEntry;
+    }
+
     std::shared_ptr<LedgerEntry const> entry;
     try
     {
-        switch (key.type())
+        // Keys that the key filter rules out are not in the database
+        auto filter = getKeyFilter(key.type());
+        if (filter && !filter->mayContain(key))
         {
-        case ACCOUNT:
-            entry = loadAccount(key);
-            break;
-        case DATA:
-            entry = loadData(key);
-            break;
-        case OFFER:
-            entry = loadOffer(key);
-            break;
-        case TRUSTLINE:
-            entry = loadTrustLine(key);
-            break;
-        default:
-            throw std::runtime_error("Unknown key type");
+            ++counters.mFilterSkips;
+        }
+        else
+        {
+            ++gLedgerTxnCounters.mDatabaseLoads;
+            switch (key.type())
+            {
+            case ACCOUNT:
+                entry = loadAccount(key);
+                break;
+            case DATA:
+                entry = loadData(key);
+                break;
+            case OFFER:
+                entry = loadOffer(key);
+                break;
+            case TRUSTLINE:
+                entry = loadTrustLine(key);
+                break;
+            default:
+                throw std::runtime_error("Unknown key type");
+            }
+
+            if (filter && !entry)
+            {
+                ++counters.mFilterFalsePositives;
+            }
         }
     }
     catch (std::exception& e)
@@ -2652,6 +3837,8 @@ LedgerTxnRoot::Impl::rollbackChild()
     mChild = nullptr;
     mPrefetchHits = 0;
     mPrefetchMisses = 0;
+    mPrefetchedEntries = 0;
+    mPrefetchedBytes = 0;
 }
 
 std::shared_ptr<LedgerEntry const>
@@ -2678,15 +3865,37 @@ LedgerTxnRoot::Impl::putInEntryCache(
     LedgerKey const& key, std::shared_ptr<LedgerEntry const> const& entry,
     LoadType type) const
 {
+    // The objects themselves, plus their serialized size as an estimate of
+    // the memory they own
+    size_t bytes = sizeof(LedgerKey) + sizeof(CacheEntry) + xdr::xdr_size(key);
+    if (entry)
+    {
+        bytes += sizeof(LedgerEntry) + xdr::xdr_size(*entry);
+    }
+
     try
     {
-        mEntryCache.put(key, {entry, type});
+        mEntryCache.put(key, {entry, type}, bytes);
     }
     catch (...)
     {
         mEntryCache.clear();
         throw;
     }
+
+    if (type == LoadType::PREFETCH)
+    {
+        ++mPrefetchedEntries;
+        mPrefetchedBytes += bytes;
+    }
+}
+
+bool
+LedgerTxnRoot::Impl::prefetchBudgetExhausted() const
+{
+    return mPrefetchedEntries >= ENTRY_CACHE_FILL_RATIO * mMaxCacheSize ||
+           mPrefetchedBytes >=
+               ENTRY_CACHE_FILL_RATIO * mEntryCache.maxBytes();
 }
 
 LedgerTxnRoot::Impl::BestOffersCacheEntryPtr
@@ -2712,4 +3921,367 @@ LedgerTxnRoot::Impl::getFromBestOffersCache(Asset const& buying,
         throw;
     }
 }
+
+// Indexes offer under each non-native asset it buys or sells
+static void
+insertInOffersBySeller(
+    std::unordered_map<AccountID, std::unordered_map<Asset, std::set<int64_t>>>&
+        offersBySeller,
+    OfferEntry const& oe)
+{
+    for (auto const& asset : {oe.selling, oe.buying})
+    {
+        if (asset.type() != ASSET_TYPE_NATIVE)
+        {
+            offersBySeller[oe.sellerID][asset].emplace(oe.offerID);
+        }
+    }
+}
+
+void
+LedgerTxnRoot::Impl::loadOrderBook() const
+{
+    if (mOrderBookLoaded)
+    {
+        return;
+    }
+
+    auto offers = loadAllOffers();
+    MultiOrderBook multiOrderBook;
+    std::unordered_map<int64_t, std::shared_ptr<LedgerEntry const>> offersByID(
+        offers.size());
+    std::unordered_map<AccountID, OffersByAsset> offersBySeller;
+    for (auto const& le : offers)
+    {
+        auto offer = std::make_shared<LedgerEntry const>(le);
+        auto const& oe = offer->data.offer();
+        multiOrderBook[{oe.buying, oe.selling}].emplace(
+            OfferDescriptor{oe.price, oe.offerID}, offer);
+        offersByID.emplace(oe.offerID, offer);
+        insertInOffersBySeller(offersBySeller, oe);
+    }
+
+    // std::unordered_map<...>::swap does not throw
+    mMultiOrderBook.swap(multiOrderBook);
+    mOffersByID.swap(offersByID);
+    mOffersBySeller.swap(offersBySeller);
+    mOrderBookLoaded = true;
+}
+
+void
+LedgerTxnRoot::Impl::insertInOrderBook(
+    std::shared_ptr<LedgerEntry const> const& offer)
+{
+    auto const& oe = offer->data.offer();
+    mMultiOrderBook[{oe.buying, oe.selling}].emplace(
+        OfferDescriptor{oe.price, oe.offerID}, offer);
+    mOffersByID[oe.offerID] = offer;
+    insertInOffersBySeller(mOffersBySeller, oe);
+}
+
+void
+LedgerTxnRoot::Impl::eraseFromOrderBook(int64_t offerID)
+{
+    auto iter = mOffersByID.find(offerID);
+    if (iter == mOffersByID.end())
+    {
+        return;
+    }
+
+    // oe stays valid until iter is erased
+    auto const& oe = iter->second->data.offer();
+    auto mobIter = mMultiOrderBook.find({oe.buying, oe.selling});
+    if (mobIter != mMultiOrderBook.end())
+    {
+        mobIter->second.erase(OfferDescriptor{oe.price, oe.offerID});
+        if (mobIter->second.empty())
+        {
+            mMultiOrderBook.erase(mobIter);
+        }
+    }
+    auto sellerIter = mOffersBySeller.find(oe.sellerID);
+    if (sellerIter != mOffersBySeller.end())
+    {
+        auto& offersByAsset = sellerIter->second;
+        for (auto const& asset : {oe.selling, oe.buying})
+        {
+            auto assetIter = offersByAsset.find(asset);
+            if (assetIter != offersByAsset.end())
+            {
+                assetIter->second.erase(oe.offerID);
+                if (assetIter->second.empty())
+                {
+                    offersByAsset.erase(assetIter);
+                }
+            }
+        }
+        if (offersByAsset.empty())
+        {
+            mOffersBySeller.erase(sellerIter);
+        }
+    }
+    mOffersByID.erase(iter);
+}
+
+void
+LedgerTxnRoot::Impl::discardOrderBook() const
+{
+    // std::unordered_map<...>::clear does not throw
+    mMultiOrderBook.clear();
+    mOffersByID.clear();
+    mOffersBySeller.clear();
+    mOrderBookLoaded = false;
+}
+
+LedgerTxnRoot::Impl::KeyFilter const*
+LedgerTxnRoot::Impl::getKeyFilter(LedgerEntryType let) const
+{
+    // Offers are never loaded from the database when the in-memory order
+    // book is used
+    if (!mUseKeyFilters || (let == OFFER && mInMemoryOrderBook))
+    {
+        return nullptr;
+    }
+
+    auto iter = mKeyFilters.find(let);
+    if (iter != mKeyFilters.end() && iter->second)
+    {
+        return iter->second.get();
+    }
+
+    // The database must have every committed key
+    flushWrites();
+    auto filter = buildKeyFilter(let, mDatabase.getSession());
+
+    // std::unique_ptr<...>::swap does not throw
+    auto& res = mKeyFilters[let];
+    res.swap(filter);
+    return res.get();
+}
+
+std::unique_ptr<LedgerTxnRoot::Impl::KeyFilter>
+LedgerTxnRoot::Impl::buildKeyFilter(LedgerEntryType let,
+                                    soci::session& session) const
+{
+    // Twice as many keys as there are now fit before the filter has to be
+    // rebuilt
+    uint64_t count = 0;
+    session << "SELECT COUNT(*) FROM " + tableFromLedgerEntryType(let),
+        soci::into(count);
+    auto filter = std::make_unique<KeyFilter>(2 * count);
+    switch (let)
+    {
+    case ACCOUNT:
+        loadAccountKeys(*filter, session);
+        break;
+    case DATA:
+        loadDataKeys(*filter, session);
+        break;
+    case OFFER:
+        loadOfferKeys(*filter, session);
+        break;
+    case TRUSTLINE:
+        loadTrustLineKeys(*filter, session);
+        break;
+    default:
+        throw std::runtime_error("Unknown key type");
+    }
+    return filter;
+}
+
+void
+LedgerTxnRoot::Impl::addToKeyFilter(LedgerKey const& key)
+{
+    auto filter = mKeyFilters.find(key.type());
+    if (filter == mKeyFilters.end() || !filter->second)
+    {
+        return;
+    }
+    filter->second->add(key);
+
+    auto rebuild = mKeyFilterRebuilds.find(key.type());
+    if (rebuild != mKeyFilterRebuilds.end())
+    {
+        try
+        {
+            rebuild->second.mAdded.emplace_back(key);
+        }
+        catch (...)
+        {
+            *rebuild->second.mCancelled = true;
+            mKeyFilterRebuilds.erase(rebuild);
+        }
+    }
+}
+
+void
+LedgerTxnRoot::Impl::startKeyFilterRebuild(LedgerEntryType let)
+{
+    // The rebuild only sees what is in the database, and misses the keys
+    // that are committed but not written yet
+    KeyFilterRebuild rebuild;
+    for (auto const& kv : mPendingWrites)
+    {
+        if (kv.first.type() == let && kv.second.mEntry)
+        {
+            rebuild.mAdded.emplace_back(kv.first);
+        }
+    }
+
+    auto cancelled = std::make_shared<std::atomic<bool>>(false);
+    auto task = std::make_shared<
+        std::packaged_task<std::unique_ptr<KeyFilter>(soci::session&)>>(
+        [this, let, cancelled](
+            soci::session& session) -> std::unique_ptr<KeyFilter> {
+            if (*cancelled)
+            {
+                return nullptr;
+            }
+            return buildKeyFilter(let, session);
+        });
+    rebuild.mFilter = task->get_future();
+    rebuild.mCancelled = cancelled;
+
+    auto res = mKeyFilterRebuilds.emplace(let, std::move(rebuild));
+    try
+    {
+        postToLoader([task](soci::session& session) { (*task)(session); });
+    }
+    catch (...)
+    {
+        mKeyFilterRebuilds.erase(res.first);
+        throw;
+    }
+}
+
+void
+LedgerTxnRoot::Impl::finishKeyFilterRebuilds()
+{
+    for (auto iter = mKeyFilterRebuilds.begin();
+         iter != mKeyFilterRebuilds.end();)
+    {
+        auto& rebuild = iter->second;
+        if (rebuild.mFilter.wait_for(std::chrono::seconds(0)) !=
+            std::future_status::ready)
+        {
+            ++iter;
+            continue;
+        }
+        try
+        {
+            auto filter = rebuild.mFilter.get();
+            auto current = mKeyFilters.find(iter->first);
+            if (filter && current != mKeyFilters.end())
+            {
+                for (auto const& key : rebuild.mAdded)
+                {
+                    filter->add(key);
+                }
+                // std::unique_ptr<...>::swap does not throw
+                current->second.swap(filter);
+                ++mEntryCacheCounters[iter->first].mFilterRebuilds;
+            }
+        }
+        catch (std::exception& e)
+        {
+            CLOG(WARNING, "Ledger")
+                << "Failed to rebuild key filter: " << e.what();
+        }
+        iter = mKeyFilterRebuilds.erase(iter);
+    }
+}
+
+void
+LedgerTxnRoot::Impl::discardKeyFilters() const
+{
+    // The loader skips the rebuilds that are cancelled before they start,
+    // and the result of those already running is dropped with their futures
+    for (auto& rebuild : mKeyFilterRebuilds)
+    {
+        *rebuild.second.mCancelled = true;
+    }
+
+    // std::unordered_map<...>::clear does not throw
+    mKeyFilterRebuilds.clear();
+    mKeyFilters.clear();
+}
+
+void
+LedgerTxnRoot::Impl::loadInflationTally() const
+{
+    if (mInflationTallyLoaded)
+    {
+        return;
+    }
+
+    auto votes = loadInflationVotes();
+    std::unordered_map<AccountID, int64_t> totals;
+    for (auto const& kv : votes)
+    {
+        totals[kv.second.mDest] += kv.second.mBalance;
+    }
+    std::set<std::pair<int64_t, std::string>> ranking;
+    for (auto const& kv : totals)
+    {
+        ranking.emplace(kv.second, KeyUtils::toStrKey(kv.first));
+    }
+
+    // swap does not throw
+    mInflationVotes.swap(votes);
+    mInflationTotals.swap(totals);
+    mInflationRanking.swap(ranking);
+    mInflationTallyLoaded = true;
+}
+
+void
+LedgerTxnRoot::Impl::updateInflationVote(
+    AccountID const& accountID, std::shared_ptr<LedgerEntry const> const& entry)
+{
+    auto iter = mInflationVotes.find(accountID);
+    if (iter != mInflationVotes.end())
+    {
+        auto previous = iter->second;
+        mInflationVotes.erase(iter);
+        addInflationVotes(previous.mDest, -previous.mBalance);
+    }
+
+    if (entry)
+    {
+        auto const& acc = entry->data.account();
+        if (acc.inflationDest && acc.balance >= MIN_VOTES_TO_INCLUDE)
+        {
+            mInflationVotes.emplace(
+                accountID, InflationVote{*acc.inflationDest, acc.balance});
+            addInflationVotes(*acc.inflationDest, acc.balance);
+        }
+    }
+}
+
+void
+LedgerTxnRoot::Impl::addInflationVotes(AccountID const& dest, int64_t votes)
+{
+    auto destStr = KeyUtils::toStrKey(dest);
+    auto& total = mInflationTotals[dest];
+    mInflationRanking.erase({total, destStr});
+    total += votes;
+    assert(total >= 0);
+    if (total > 0)
+    {
+        mInflationRanking.emplace(total, destStr);
+    }
+    else
+    {
+        mInflationTotals.erase(dest);
+    }
+}
+
+void
+LedgerTxnRoot::Impl::discardInflationTally() const
+{
+    // clear does not throw
+    mInflationVotes.clear();
+    mInflationTotals.clear();
+    mInflationRanking.clear();
+    mInflationTallyLoaded = false;
+}
 }
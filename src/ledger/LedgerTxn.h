@@ -215,6 +215,11 @@ struct LedgerEntry;
 struct LedgerKey;
 struct LedgerRange;
 
+// Entries to write to the database, in order, with null entries for erased
+// keys.
+typedef std::vector<std::pair<LedgerKey, std::shared_ptr<LedgerEntry const>>>
+    LedgerEntryWrites;
+
 struct OfferDescriptor
 {
     Price price;
@@ -250,6 +255,38 @@ struct InflationWinner
     int64_t votes;
 };
 
+// Lookups of one type of ledger entry in the entry cache of a LedgerTxnRoot,
+// and evictions of that type of entry from it, since the LedgerTxnRoot was
+// created.
+struct EntryCacheCounters
+{
+    uint64_t mHits{0};
+    uint64_t mMisses{0};
+    uint64_t mEvictions{0};
+    // Misses that the key filter of the type answered without querying the
+    // database, and misses that it let through for keys that turned out not
+    // to be in the database.
+    uint64_t mFilterSkips{0};
+    uint64_t mFilterFalsePositives{0};
+    // Times the key filter of the type was replaced by one rebuilt in the
+    // background.
+    uint64_t mFilterRebuilds{0};
+};
+
+// The work done by the LedgerTxns of one thread since it started: entries
+// loaded by any LedgerTxn, entries that a LedgerTxnRoot had to query from the
+// database, and LedgerTxns created. These are always counted, as that only
+// costs an increment, so that profiling can compare them before and after
+// some work done on the same thread.
+struct LedgerTxnCounters
+{
+    uint64_t mLoads{0};
+    uint64_t mDatabaseLoads{0};
+    uint64_t mLedgerTxns{0};
+};
+
+LedgerTxnCounters const& getLedgerTxnCounters();
+
 class AbstractLedgerTxn;
 
 // LedgerTxnDelta represents the difference between a LedgerTxn and its
@@ -423,16 +460,47 @@ class AbstractLedgerTxnParent
     // other than a (real or stub) root LedgerTxn.
     virtual void dropTrustLines() = 0;
 
+    // Write entries, with null entries for erased keys, outside of any
+    // AbstractLedgerTxn and without loading them. The entries are split by
+    // key among up to nThreads database connections that write them in bulk
+    // and in parallel, each in its own transaction, so keys must be unique.
+    // Erasing a key that does not exist is not an error. Will throw when
+    // called on anything other than a (real or stub) root LedgerTxn.
+    virtual void writeInParallel(LedgerEntryWrites const& entries,
+                                 size_t nThreads) = 0;
+
+    // Load whatever is kept in memory across ledgers, such as the in-memory
+    // order book, instead of waiting for the first ledger close to need it.
+    // Will throw when called on anything other than a (real or stub) root
+    // LedgerTxn.
+    virtual void loadInMemoryState() = 0;
+
     // Return the current cache hit rate for prefetched ledger entries, as a
     // fraction from 0.0 to 1.0. Will throw when called on anything other than a
     // (real or stub) root LedgerTxn.
     virtual double getPrefetchHitRate() const = 0;
 
+    // Return the entry cache counters for ledger entries of type let. Will
+    // throw when called on anything other than a (real or stub) root
+    // LedgerTxn.
+    virtual EntryCacheCounters
+    getEntryCacheCounters(LedgerEntryType let) const = 0;
+
     // Prefetch a set of ledger entries into memory, anticipating their use.
     // This is purely advisory and can be a no-op, or do any level of actual
     // work, while still being correct. Will throw when called on anything other
     // than a (real or stub) root LedgerTxn.
     virtual uint32_t prefetch(std::unordered_set<LedgerKey> const& keys) = 0;
+
+    // Start loading a set of ledger entries ahead of their use, typically by
+    // a later ledger, on a thread of the root's own. Returns false if loading
+    // ahead is not supported. Keys that are cached, or that an earlier load
+    // is still bringing in, are not loaded again. The entries loaded are made
+    // available to the next call to prefetch. Like prefetch, this is purely
+    // advisory. Will throw when called on anything other than a (real or
+    // stub) root LedgerTxn.
+    virtual bool
+    prefetchAsync(std::unordered_set<LedgerKey> const& keys) = 0;
 };
 
 // An abstraction for an object that is an AbstractLedgerTxnParent and has
@@ -446,6 +514,11 @@ class AbstractLedgerTxn : public AbstractLedgerTxnParent
     friend class ConstLedgerTxnEntry::Impl;
     virtual void deactivate(LedgerKey const& key) = 0;
 
+    // copyOnWrite is used by the LedgerTxnEntry associated with the given key
+    // when it is first modified, to replace the entry it shares with a copy
+    // that it can modify, which is returned.
+    virtual LedgerEntry& copyOnWrite(LedgerKey const& key) = 0;
+
     // deactivateHeader is used to deactivate the LedgerTxnHeader.
     friend class LedgerTxnHeader::Impl;
     virtual void deactivateHeader() = 0;
@@ -508,14 +581,14 @@ class AbstractLedgerTxn : public AbstractLedgerTxnParent
     virtual void createOrUpdateWithoutLoading(LedgerEntry const& entry) = 0;
     virtual void eraseWithoutLoading(LedgerKey const& key) = 0;
 
-    // getChanges, getDelta, and getAllEntries are used to
+    // getChanges, getDelta, getAllEntries and getAllBucketEntries are used to
     // extract information about changes contained in the AbstractLedgerTxn
     // in different formats. These functions also cause the AbstractLedgerTxn
     // to enter the sealed state, simultaneously updating last modified if
     // necessary.
     // - getChanges
-    //     Extract all changes from this AbstractLedgerTxn in XDR format. To
-    //     be stored as meta.
+    //     Extract all changes from this AbstractLedgerTxn in XDR format,
+    //     sorted by key (see LedgerEntryIdCmp). To be stored as meta.
     // - getDelta
     //     Extract all changes from this AbstractLedgerTxn (including changes
     //     to the LedgerHeader) in a format convenient for answering queries
@@ -525,6 +598,10 @@ class AbstractLedgerTxn : public AbstractLedgerTxnParent
     //     extracts a list of keys that were created (init), updated (live) or
     //     deleted (dead) in this AbstractLedgerTxn. All these are to be
     //     inserted into the BucketList.
+    // - getAllBucketEntries
+    //     extracts the same changes as INITENTRY, LIVEENTRY and DEADENTRY
+    //     BucketEntries, sorted by key, so that they can be moved into a
+    //     fresh bucket without being copied or sorted again.
     //
     // All of these functions throw if the AbstractLedgerTxn has a child.
     virtual LedgerEntryChanges getChanges() = 0;
@@ -532,6 +609,7 @@ class AbstractLedgerTxn : public AbstractLedgerTxnParent
     virtual void getAllEntries(std::vector<LedgerEntry>& initEntries,
                                std::vector<LedgerEntry>& liveEntries,
                                std::vector<LedgerKey>& deadEntries) = 0;
+    virtual void getAllBucketEntries(std::vector<BucketEntry>& entries) = 0;
 
     // getWorstBestOfferIterator allows a parent AbstractLedgerTxn to get the
     // worst best offers (an offer is a worst best offer if every better offer
@@ -580,6 +658,8 @@ class LedgerTxn final : public AbstractLedgerTxn
 
     void deactivate(LedgerKey const& key) override;
 
+    LedgerEntry& copyOnWrite(LedgerKey const& key) override;
+
     void deactivateHeader() override;
 
     std::unique_ptr<Impl> const& getImpl() const;
@@ -630,6 +710,7 @@ class LedgerTxn final : public AbstractLedgerTxn
     void getAllEntries(std::vector<LedgerEntry>& initEntries,
                        std::vector<LedgerEntry>& liveEntries,
                        std::vector<LedgerKey>& deadEntries) override;
+    void getAllBucketEntries(std::vector<BucketEntry>& entries) override;
 
     std::shared_ptr<LedgerEntry const>
     getNewestVersion(LedgerKey const& key) const override;
@@ -666,8 +747,14 @@ class LedgerTxn final : public AbstractLedgerTxn
     void dropData() override;
     void dropOffers() override;
     void dropTrustLines() override;
+    void writeInParallel(LedgerEntryWrites const& entries,
+                         size_t nThreads) override;
+    void loadInMemoryState() override;
     double getPrefetchHitRate() const override;
+    EntryCacheCounters
+    getEntryCacheCounters(LedgerEntryType let) const override;
     uint32_t prefetch(std::unordered_set<LedgerKey> const& keys) override;
+    bool prefetchAsync(std::unordered_set<LedgerKey> const& keys) override;
 
 #ifdef BUILD_TESTS
     std::unordered_map<
@@ -675,6 +762,9 @@ class LedgerTxn final : public AbstractLedgerTxn
         std::multimap<OfferDescriptor, LedgerKey, IsBetterOfferComparator>,
         AssetPairHash> const&
     getOrderBook();
+
+    // Size of the memory that this LedgerTxn has reserved for its entries.
+    size_t getArenaBytesReserved() const;
 #endif
 };
 
@@ -684,8 +774,15 @@ class LedgerTxnRoot : public AbstractLedgerTxnParent
     std::unique_ptr<Impl> const mImpl;
 
   public:
+    // If writeBehind is set, the entries of each ledger that commitChild
+    // closes are written to the database on a connection of its pool after
+    // commitChild returns, rather than as part of its transaction. If
+    // keyFilters is set, a filter of the keys in the database for each type
+    // of entry saves looking up most of the keys that are not there.
     explicit LedgerTxnRoot(Database& db, size_t entryCacheSize,
-                           size_t bestOfferCacheSize, size_t prefetchBatchSize);
+                           size_t entryCacheBytes, size_t bestOfferCacheSize,
+                           size_t prefetchBatchSize, bool inMemoryOrderBook,
+                           bool writeBehind = false, bool keyFilters = false);
 
     virtual ~LedgerTxnRoot();
 
@@ -704,6 +801,10 @@ class LedgerTxnRoot : public AbstractLedgerTxnParent
     void dropOffers() override;
     void dropTrustLines() override;
 
+    void writeInParallel(LedgerEntryWrites const& entries,
+                         size_t nThreads) override;
+    void loadInMemoryState() override;
+
 #ifdef FUZZING_BUILD_MODE_UNSAFE_FOR_PRODUCTION
     void resetForFuzzer();
 #endif // FUZZING_BUILD_MODE_UNSAFE_FOR_PRODUCTION
@@ -731,6 +832,15 @@ class LedgerTxnRoot : public AbstractLedgerTxnParent
     void rollbackChild() override;
 
     uint32_t prefetch(std::unordered_set<LedgerKey> const& keys) override;
+    bool prefetchAsync(std::unordered_set<LedgerKey> const& keys) override;
     double getPrefetchHitRate() const override;
+    EntryCacheCounters
+    getEntryCacheCounters(LedgerEntryType let) const override;
+
+#ifdef BUILD_TESTS
+    // Waits for the loads ahead that are still running to finish, and
+    // returns how many there are that prefetch has yet to merge.
+    size_t waitForLoadsAhead();
+#endif
 };
 }
@@ -95,42 +95,69 @@ LedgerTxnRoot::Impl::loadAccount(LedgerKey const& key) const
     return std::make_shared<LedgerEntry const>(std::move(le));
 }
 
-std::vector<InflationWinner>
-LedgerTxnRoot::Impl::loadInflationWinners(size_t maxWinners,
-                                          int64_t minBalance) const
+FlatHashMap<AccountID, LedgerTxnRoot::Impl::InflationVote>
+LedgerTxnRoot::Impl::loadInflationVotes() const
 {
-    InflationWinner w;
-    std::string inflationDest;
+    flushWrites();
+    std::string accountID, inflationDest;
+    int64_t balance;
+    int64_t minBalance = MIN_VOTES_TO_INCLUDE;
 
     auto prep = mDatabase.getPreparedStatement(
-        "SELECT sum(balance) AS votes, inflationdest"
-        " FROM accounts WHERE inflationdest IS NOT NULL"
-        " AND balance >= 1000000000 GROUP BY inflationdest"
-        " ORDER BY votes DESC, inflationdest DESC LIMIT :lim");
+        "SELECT accountid, inflationdest, balance FROM accounts"
+        " WHERE inflationdest IS NOT NULL AND balance >= :min");
     auto& st = prep.statement();
-    st.exchange(soci::into(w.votes));
+    st.exchange(soci::into(accountID));
     st.exchange(soci::into(inflationDest));
-    st.exchange(soci::use(maxWinners));
+    st.exchange(soci::into(balance));
+    st.exchange(soci::use(minBalance));
     st.define_and_bind();
-    st.execute(true);
+    {
+        auto timer = mDatabase.getSelectTimer("inflation-votes");
+        st.execute(true);
+    }
 
-    std::vector<InflationWinner> winners;
+    FlatHashMap<AccountID, InflationVote> votes;
     while (st.got_data())
     {
-        w.accountID = KeyUtils::fromStrKey<PublicKey>(inflationDest);
-        if (w.votes < minBalance)
-        {
-            break;
-        }
-        winners.push_back(w);
+        votes.emplace(KeyUtils::fromStrKey<PublicKey>(accountID),
+                      InflationVote{
+                          KeyUtils::fromStrKey<PublicKey>(inflationDest),
+                          balance});
+        st.fetch();
+    }
+    return votes;
+}
+
+void
+LedgerTxnRoot::Impl::loadAccountKeys(KeyFilter& filter,
+                                     soci::session& session) const
+{
+    std::string accountID;
+
+    auto prep = mDatabase.getPreparedStatement(
+        "SELECT accountid FROM accounts", session);
+    auto& st = prep.statement();
+    st.exchange(soci::into(accountID));
+    st.define_and_bind();
+    {
+        auto timer = mDatabase.getSelectTimer("account-keys");
+        st.execute(true);
+    }
+
+    LedgerKey key(ACCOUNT);
+    while (st.got_data())
+    {
+        key.account().accountID = KeyUtils::fromStrKey<PublicKey>(accountID);
+        filter.add(key);
         st.fetch();
     }
-    return winners;
 }
 
 class BulkUpsertAccountsOperation : public DatabaseTypeSpecificOperation<void>
 {
     Database& mDB;
+    soci::session& mSession;
     std::vector<std::string> mAccountIDs;
     std::vector<int64_t> mBalances;
     std::vector<int64_t> mSeqNums;
@@ -148,9 +175,9 @@ class BulkUpsertAccountsOperation : public DatabaseTypeSpecificOperation<void>
     std::vector<soci::indicator> mLiabilitiesInds;
 
   public:
-    BulkUpsertAccountsOperation(Database& DB,
+    BulkUpsertAccountsOperation(Database& DB, soci::session& session,
                                 std::vector<EntryIterator> const& entries)
-        : mDB(DB)
+        : mDB(DB), mSession(session)
     {
         mAccountIDs.reserve(entries.size());
         mBalances.reserve(entries.size());
@@ -245,7 +272,7 @@ class BulkUpsertAccountsOperation : public DatabaseTypeSpecificOperation<void>
             "lastmodified = excluded.lastmodified, "
             "buyingliabilities = excluded.buyingliabilities, "
             "sellingliabilities = excluded.sellingliabilities";
-        auto prep = mDB.getPreparedStatement(sql);
+        auto prep = mDB.getPreparedStatement(sql, mSession);
         soci::statement& st = prep.statement();
         st.exchange(soci::use(mAccountIDs));
         st.exchange(soci::use(mBalances));
@@ -277,9 +304,66 @@ class BulkUpsertAccountsOperation : public DatabaseTypeSpecificOperation<void>
     }
 
 #ifdef USE_POSTGRES
+    void
+    doPostgresCopyOperation(PGconn* conn)
+    {
+        std::string const columns =
+            "accountid, balance, seqnum, numsubentries, inflationdest, "
+            "homedomain, thresholds, signers, flags, lastmodified, "
+            "buyingliabilities, sellingliabilities";
+        PGBinaryCopy copy(12);
+        for (size_t i = 0; i < mAccountIDs.size(); ++i)
+        {
+            copy.beginRow();
+            copy.put(mAccountIDs[i]);
+            copy.put(mBalances[i]);
+            copy.put(mSeqNums[i]);
+            copy.put(mSubEntryNums[i]);
+            copy.put(mInflationDests[i], mInflationDestInds[i]);
+            copy.put(mHomeDomains[i]);
+            copy.put(mThresholds[i]);
+            copy.put(mSigners[i], mSignerInds[i]);
+            copy.put(mFlags[i]);
+            copy.put(mLastModifieds[i]);
+            copy.put(mBuyingLiabilities[i], mLiabilitiesInds[i]);
+            copy.put(mSellingLiabilities[i], mLiabilitiesInds[i]);
+        }
+
+        auto timer = mDB.getUpsertTimer("account");
+        auto tmp = copy.copyInto(mSession, conn, "accounts", columns);
+        std::string sql = "INSERT INTO accounts (" + columns + ") SELECT " +
+                          columns + " FROM " + tmp +
+                          " ON CONFLICT (accountid) DO UPDATE SET "
+                          "balance = excluded.balance, "
+                          "seqnum = excluded.seqnum, "
+                          "numsubentries = excluded.numsubentries, "
+                          "inflationdest = excluded.inflationdest, "
+                          "homedomain = excluded.homedomain, "
+                          "thresholds = excluded.thresholds, "
+                          "signers = excluded.signers, "
+                          "flags = excluded.flags, "
+                          "lastmodified = excluded.lastmodified, "
+                          "buyingliabilities = excluded.buyingliabilities, "
+                          "sellingliabilities = excluded.sellingliabilities";
+        auto prep = mDB.getPreparedStatement(sql, mSession);
+        soci::statement& st = prep.statement();
+        st.define_and_bind();
+        st.execute(true);
+        if (static_cast<size_t>(st.get_affected_rows()) != mAccountIDs.size())
+        {
+            throw std::runtime_error("Could not update data in SQL");
+        }
+    }
+
     void
     doPostgresSpecificOperation(soci::postgresql_session_backend* pg) override
     {
+        if (mDB.useBulkCopy(mAccountIDs.size()))
+        {
+            doPostgresCopyOperation(pg->conn_);
+            return;
+        }
+
         std::string strAccountIDs, strBalances, strSeqNums, strSubEntryNums,
             strInflationDests, strFlags, strHomeDomains, strThresholds,
             strSigners, strLastModifieds, strBuyingLiabilities,
@@ -334,7 +418,7 @@ class BulkUpsertAccountsOperation : public DatabaseTypeSpecificOperation<void>
             "lastmodified = excluded.lastmodified, "
             "buyingliabilities = excluded.buyingliabilities, "
             "sellingliabilities = excluded.sellingliabilities";
-        auto prep = mDB.getPreparedStatement(sql);
+        auto prep = mDB.getPreparedStatement(sql, mSession);
         soci::statement& st = prep.statement();
         st.exchange(soci::use(strAccountIDs));
         st.exchange(soci::use(strBalances));
@@ -364,13 +448,15 @@ class BulkUpsertAccountsOperation : public DatabaseTypeSpecificOperation<void>
 class BulkDeleteAccountsOperation : public DatabaseTypeSpecificOperation<void>
 {
     Database& mDB;
+    soci::session& mSession;
     LedgerTxnConsistency mCons;
     std::vector<std::string> mAccountIDs;
 
   public:
-    BulkDeleteAccountsOperation(Database& DB, LedgerTxnConsistency cons,
+    BulkDeleteAccountsOperation(Database& DB, soci::session& session,
+                                LedgerTxnConsistency cons,
                                 std::vector<EntryIterator> const& entries)
-        : mDB(DB), mCons(cons)
+        : mDB(DB), mSession(session), mCons(cons)
     {
         for (auto const& e : entries)
         {
@@ -385,7 +471,7 @@ class BulkDeleteAccountsOperation : public DatabaseTypeSpecificOperation<void>
     doSociGenericOperation()
     {
         std::string sql = "DELETE FROM accounts WHERE accountid = :id";
-        auto prep = mDB.getPreparedStatement(sql);
+        auto prep = mDB.getPreparedStatement(sql, mSession);
         soci::statement& st = prep.statement();
         st.exchange(soci::use(mAccountIDs));
         st.define_and_bind();
@@ -416,7 +502,7 @@ class BulkDeleteAccountsOperation : public DatabaseTypeSpecificOperation<void>
         std::string sql =
             "WITH r AS (SELECT unnest(:ids::TEXT[])) "
             "DELETE FROM accounts WHERE accountid IN (SELECT * FROM r)";
-        auto prep = mDB.getPreparedStatement(sql);
+        auto prep = mDB.getPreparedStatement(sql, mSession);
         soci::statement& st = prep.statement();
         st.exchange(soci::use(strAccountIDs));
         st.define_and_bind();
@@ -435,26 +521,31 @@ class BulkDeleteAccountsOperation : public DatabaseTypeSpecificOperation<void>
 
 void
 LedgerTxnRoot::Impl::bulkUpsertAccounts(
-    std::vector<EntryIterator> const& entries)
+    std::vector<EntryIterator> const& entries, soci::session& session)
 {
-    BulkUpsertAccountsOperation op(mDatabase, entries);
-    mDatabase.doDatabaseTypeSpecificOperation(op);
+    BulkUpsertAccountsOperation op(mDatabase, session, entries);
+    mDatabase.doDatabaseTypeSpecificOperation(op, session);
 }
 
 void
 LedgerTxnRoot::Impl::bulkDeleteAccounts(
-    std::vector<EntryIterator> const& entries, LedgerTxnConsistency cons)
+    std::vector<EntryIterator> const& entries, LedgerTxnConsistency cons,
+    soci::session& session)
 {
-    BulkDeleteAccountsOperation op(mDatabase, cons, entries);
-    mDatabase.doDatabaseTypeSpecificOperation(op);
+    BulkDeleteAccountsOperation op(mDatabase, session, cons, entries);
+    mDatabase.doDatabaseTypeSpecificOperation(op, session);
 }
 
 void
 LedgerTxnRoot::Impl::dropAccounts()
 {
     throwIfChild();
+    flushWrites();
     mEntryCache.clear();
     mBestOffersCache.clear();
+    discardKeyFilters();
+    discardInflationTally();
+    discardLoadsAhead();
 
     mDatabase.getSession() << "DROP TABLE IF EXISTS accounts;";
     mDatabase.getSession() << "DROP TABLE IF EXISTS signers;";
@@ -484,6 +575,7 @@ class BulkLoadAccountsOperation
     : public DatabaseTypeSpecificOperation<std::vector<LedgerEntry>>
 {
     Database& mDb;
+    soci::session& mSession;
     std::vector<std::string> mAccountIDs;
 
     std::vector<LedgerEntry>
@@ -573,9 +665,9 @@ class BulkLoadAccountsOperation
     }
 
   public:
-    BulkLoadAccountsOperation(Database& db,
+    BulkLoadAccountsOperation(Database& db, soci::session& session,
                               std::unordered_set<LedgerKey> const& keys)
-        : mDb(db)
+        : mDb(db), mSession(session)
     {
         mAccountIDs.reserve(keys.size());
         for (auto const& k : keys)
@@ -601,7 +693,7 @@ class BulkLoadAccountsOperation
             "buyingliabilities, sellingliabilities, signers FROM accounts "
             "WHERE accountid IN carray(?, ?, 'char*')";
 
-        auto prep = mDb.getPreparedStatement(sql);
+        auto prep = mDb.getPreparedStatement(sql, mSession);
         auto be = prep.statement().get_backend();
         if (be == nullptr)
         {
@@ -632,7 +724,7 @@ class BulkLoadAccountsOperation
             "buyingliabilities, sellingliabilities, signers FROM accounts "
             "WHERE accountid IN (SELECT * FROM r)";
 
-        auto prep = mDb.getPreparedStatement(sql);
+        auto prep = mDb.getPreparedStatement(sql, mSession);
         auto& st = prep.statement();
         st.exchange(soci::use(strAccountIDs));
         return executeAndFetch(st);
@@ -640,15 +732,15 @@ class BulkLoadAccountsOperation
 #endif
 };
 
-std::unordered_map<LedgerKey, std::shared_ptr<LedgerEntry const>>
+FlatHashMap<LedgerKey, std::shared_ptr<LedgerEntry const>>
 LedgerTxnRoot::Impl::bulkLoadAccounts(
-    std::unordered_set<LedgerKey> const& keys) const
+    std::unordered_set<LedgerKey> const& keys, soci::session& session) const
 {
     if (!keys.empty())
     {
-        BulkLoadAccountsOperation op(mDatabase, keys);
+        BulkLoadAccountsOperation op(mDatabase, session, keys);
         return populateLoadedEntries(
-            keys, mDatabase.doDatabaseTypeSpecificOperation(op));
+            keys, mDatabase.doDatabaseTypeSpecificOperation(op, session));
     }
     else
     {
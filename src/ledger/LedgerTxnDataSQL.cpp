@@ -55,9 +55,37 @@ LedgerTxnRoot::Impl::loadData(LedgerKey const& key) const
     return std::make_shared<LedgerEntry const>(std::move(le));
 }
 
+void
+LedgerTxnRoot::Impl::loadDataKeys(KeyFilter& filter,
+                                  soci::session& session) const
+{
+    std::string accountID, dataName;
+
+    auto prep = mDatabase.getPreparedStatement(
+        "SELECT accountid, dataname FROM accountdata", session);
+    auto& st = prep.statement();
+    st.exchange(soci::into(accountID));
+    st.exchange(soci::into(dataName));
+    st.define_and_bind();
+    {
+        auto timer = mDatabase.getSelectTimer("data-keys");
+        st.execute(true);
+    }
+
+    LedgerKey key(DATA);
+    while (st.got_data())
+    {
+        key.data().accountID = KeyUtils::fromStrKey<PublicKey>(accountID);
+        decoder::decode_b64(dataName, key.data().dataName);
+        filter.add(key);
+        st.fetch();
+    }
+}
+
 class BulkUpsertDataOperation : public DatabaseTypeSpecificOperation<void>
 {
     Database& mDB;
+    soci::session& mSession;
     std::vector<std::string> mAccountIDs;
     std::vector<std::string> mDataNames;
     std::vector<std::string> mDataValues;
@@ -76,9 +104,9 @@ class BulkUpsertDataOperation : public DatabaseTypeSpecificOperation<void>
     }
 
   public:
-    BulkUpsertDataOperation(Database& DB,
+    BulkUpsertDataOperation(Database& DB, soci::session& session,
                             std::vector<LedgerEntry> const& entries)
-        : mDB(DB)
+        : mDB(DB), mSession(session)
     {
         for (auto const& e : entries)
         {
@@ -86,9 +114,9 @@ class BulkUpsertDataOperation : public DatabaseTypeSpecificOperation<void>
         }
     }
 
-    BulkUpsertDataOperation(Database& DB,
+    BulkUpsertDataOperation(Database& DB, soci::session& session,
                             std::vector<EntryIterator> const& entryIter)
-        : mDB(DB)
+        : mDB(DB), mSession(session)
     {
         for (auto const& e : entryIter)
         {
@@ -107,7 +135,7 @@ class BulkUpsertDataOperation : public DatabaseTypeSpecificOperation<void>
                           ") ON CONFLICT (accountid, dataname) DO UPDATE SET "
                           "datavalue = excluded.datavalue, "
                           "lastmodified = excluded.lastmodified ";
-        auto prep = mDB.getPreparedStatement(sql);
+        auto prep = mDB.getPreparedStatement(sql, mSession);
         soci::statement& st = prep.statement();
         st.exchange(soci::use(mAccountIDs));
         st.exchange(soci::use(mDataNames));
@@ -130,9 +158,47 @@ class BulkUpsertDataOperation : public DatabaseTypeSpecificOperation<void>
         doSociGenericOperation();
     }
 #ifdef USE_POSTGRES
+    void
+    doPostgresCopyOperation(PGconn* conn)
+    {
+        std::string const columns =
+            "accountid, dataname, datavalue, lastmodified";
+        PGBinaryCopy copy(4);
+        for (size_t i = 0; i < mAccountIDs.size(); ++i)
+        {
+            copy.beginRow();
+            copy.put(mAccountIDs[i]);
+            copy.put(mDataNames[i]);
+            copy.put(mDataValues[i]);
+            copy.put(mLastModifieds[i]);
+        }
+
+        auto timer = mDB.getUpsertTimer("data");
+        auto tmp = copy.copyInto(mSession, conn, "accountdata", columns);
+        std::string sql = "INSERT INTO accountdata (" + columns +
+                          ") SELECT " + columns + " FROM " + tmp +
+                          " ON CONFLICT (accountid, dataname) DO UPDATE SET "
+                          "datavalue = excluded.datavalue, "
+                          "lastmodified = excluded.lastmodified ";
+        auto prep = mDB.getPreparedStatement(sql, mSession);
+        soci::statement& st = prep.statement();
+        st.define_and_bind();
+        st.execute(true);
+        if (static_cast<size_t>(st.get_affected_rows()) != mAccountIDs.size())
+        {
+            throw std::runtime_error("Could not update data in SQL");
+        }
+    }
+
     void
     doPostgresSpecificOperation(soci::postgresql_session_backend* pg) override
     {
+        if (mDB.useBulkCopy(mAccountIDs.size()))
+        {
+            doPostgresCopyOperation(pg->conn_);
+            return;
+        }
+
         std::string strAccountIDs, strDataNames, strDataValues,
             strLastModifieds;
 
@@ -153,7 +219,7 @@ class BulkUpsertDataOperation : public DatabaseTypeSpecificOperation<void>
                           "ON CONFLICT (accountid, dataname) DO UPDATE SET "
                           "datavalue = excluded.datavalue, "
                           "lastmodified = excluded.lastmodified ";
-        auto prep = mDB.getPreparedStatement(sql);
+        auto prep = mDB.getPreparedStatement(sql, mSession);
         soci::statement& st = prep.statement();
         st.exchange(soci::use(strAccountIDs));
         st.exchange(soci::use(strDataNames));
@@ -175,14 +241,16 @@ class BulkUpsertDataOperation : public DatabaseTypeSpecificOperation<void>
 class BulkDeleteDataOperation : public DatabaseTypeSpecificOperation<void>
 {
     Database& mDB;
+    soci::session& mSession;
     LedgerTxnConsistency mCons;
     std::vector<std::string> mAccountIDs;
     std::vector<std::string> mDataNames;
 
   public:
-    BulkDeleteDataOperation(Database& DB, LedgerTxnConsistency cons,
+    BulkDeleteDataOperation(Database& DB, soci::session& session,
+                            LedgerTxnConsistency cons,
                             std::vector<EntryIterator> const& entries)
-        : mDB(DB), mCons(cons)
+        : mDB(DB), mSession(session), mCons(cons)
     {
         for (auto const& e : entries)
         {
@@ -199,7 +267,7 @@ class BulkDeleteDataOperation : public DatabaseTypeSpecificOperation<void>
     {
         std::string sql = "DELETE FROM accountdata WHERE accountid = :id AND "
                           " dataname = :v1 ";
-        auto prep = mDB.getPreparedStatement(sql);
+        auto prep = mDB.getPreparedStatement(sql, mSession);
         soci::statement& st = prep.statement();
         st.exchange(soci::use(mAccountIDs));
         st.exchange(soci::use(mDataNames));
@@ -237,7 +305,7 @@ class BulkDeleteDataOperation : public DatabaseTypeSpecificOperation<void>
             " ) "
             "DELETE FROM accountdata WHERE (accountid, dataname) IN "
             "(SELECT * FROM r)";
-        auto prep = mDB.getPreparedStatement(sql);
+        auto prep = mDB.getPreparedStatement(sql, mSession);
         soci::statement& st = prep.statement();
         st.exchange(soci::use(strAccountIDs));
         st.exchange(soci::use(strDataNames));
@@ -257,26 +325,30 @@ class BulkDeleteDataOperation : public DatabaseTypeSpecificOperation<void>
 
 void
 LedgerTxnRoot::Impl::bulkUpsertAccountData(
-    std::vector<EntryIterator> const& entries)
+    std::vector<EntryIterator> const& entries, soci::session& session)
 {
-    BulkUpsertDataOperation op(mDatabase, entries);
-    mDatabase.doDatabaseTypeSpecificOperation(op);
+    BulkUpsertDataOperation op(mDatabase, session, entries);
+    mDatabase.doDatabaseTypeSpecificOperation(op, session);
 }
 
 void
 LedgerTxnRoot::Impl::bulkDeleteAccountData(
-    std::vector<EntryIterator> const& entries, LedgerTxnConsistency cons)
+    std::vector<EntryIterator> const& entries, LedgerTxnConsistency cons,
+    soci::session& session)
 {
-    BulkDeleteDataOperation op(mDatabase, cons, entries);
-    mDatabase.doDatabaseTypeSpecificOperation(op);
+    BulkDeleteDataOperation op(mDatabase, session, cons, entries);
+    mDatabase.doDatabaseTypeSpecificOperation(op, session);
 }
 
 void
 LedgerTxnRoot::Impl::dropData()
 {
     throwIfChild();
+    flushWrites();
     mEntryCache.clear();
     mBestOffersCache.clear();
+    discardKeyFilters();
+    discardLoadsAhead();
 
     std::string coll = mDatabase.getSimpleCollationClause();
 
@@ -297,6 +369,7 @@ class BulkLoadDataOperation
     : public DatabaseTypeSpecificOperation<std::vector<LedgerEntry>>
 {
     Database& mDb;
+    soci::session& mSession;
     std::vector<std::string> mAccountIDs;
     std::vector<std::string> mDataNames;
 
@@ -335,9 +408,9 @@ class BulkLoadDataOperation
     }
 
   public:
-    BulkLoadDataOperation(Database& db,
+    BulkLoadDataOperation(Database& db, soci::session& session,
                           std::unordered_set<LedgerKey> const& keys)
-        : mDb(db)
+        : mDb(db), mSession(session)
     {
         mAccountIDs.reserve(keys.size());
         mDataNames.reserve(keys.size());
@@ -375,7 +448,7 @@ class BulkLoadDataOperation
             ") SELECT accountid, dataname, datavalue, lastmodified "
             "FROM accountdata WHERE (accountid, dataname) IN r";
 
-        auto prep = mDb.getPreparedStatement(sql);
+        auto prep = mDb.getPreparedStatement(sql, mSession);
         auto be = prep.statement().get_backend();
         if (be == nullptr)
         {
@@ -409,7 +482,7 @@ class BulkLoadDataOperation
             "SELECT accountid, dataname, datavalue, lastmodified "
             "FROM accountdata WHERE (accountid, dataname) IN (SELECT * FROM r)";
 
-        auto prep = mDb.getPreparedStatement(sql);
+        auto prep = mDb.getPreparedStatement(sql, mSession);
         auto& st = prep.statement();
         st.exchange(soci::use(strAccountIDs));
         st.exchange(soci::use(strDataNames));
@@ -418,15 +491,15 @@ class BulkLoadDataOperation
 #endif
 };
 
-std::unordered_map<LedgerKey, std::shared_ptr<LedgerEntry const>>
+FlatHashMap<LedgerKey, std::shared_ptr<LedgerEntry const>>
 LedgerTxnRoot::Impl::bulkLoadData(
-    std::unordered_set<LedgerKey> const& keys) const
+    std::unordered_set<LedgerKey> const& keys, soci::session& session) const
 {
     if (!keys.empty())
     {
-        BulkLoadDataOperation op(mDatabase, keys);
+        BulkLoadDataOperation op(mDatabase, session, keys);
         return populateLoadedEntries(
-            keys, mDatabase.doDatabaseTypeSpecificOperation(op));
+            keys, mDatabase.doDatabaseTypeSpecificOperation(op, session));
     }
     else
     {
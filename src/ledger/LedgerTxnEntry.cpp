@@ -15,10 +15,14 @@ namespace stellar
 class LedgerTxnEntry::Impl : public EntryImplBase
 {
     AbstractLedgerTxn& mLedgerTxn;
-    LedgerEntry& mCurrent;
+    LedgerEntry const* mCurrent;
+
+    // mWritable is null until mCurrent may be modified, see copyOnWrite
+    LedgerEntry* mWritable;
 
   public:
     explicit Impl(AbstractLedgerTxn& ltx, LedgerEntry& current);
+    explicit Impl(AbstractLedgerTxn& ltx, LedgerEntry const& current);
 
     ~Impl() override;
 
@@ -44,6 +48,13 @@ LedgerTxnEntry::makeSharedImpl(AbstractLedgerTxn& ltx, LedgerEntry& current)
     return std::make_shared<Impl>(ltx, current);
 }
 
+std::shared_ptr<LedgerTxnEntry::Impl>
+LedgerTxnEntry::makeSharedImplCopyOnWrite(AbstractLedgerTxn& ltx,
+                                          LedgerEntry const& current)
+{
+    return std::make_shared<Impl>(ltx, current);
+}
+
 std::shared_ptr<EntryImplBase>
 toEntryImplBase(std::shared_ptr<LedgerTxnEntry::Impl> const& impl)
 {
@@ -60,7 +71,12 @@ LedgerTxnEntry::LedgerTxnEntry(std::shared_ptr<Impl> const& impl)
 }
 
 LedgerTxnEntry::Impl::Impl(AbstractLedgerTxn& ltx, LedgerEntry& current)
-    : mLedgerTxn(ltx), mCurrent(current)
+    : mLedgerTxn(ltx), mCurrent(&current), mWritable(&current)
+{
+}
+
+LedgerTxnEntry::Impl::Impl(AbstractLedgerTxn& ltx, LedgerEntry const& current)
+    : mLedgerTxn(ltx), mCurrent(&current), mWritable(nullptr)
 {
 }
 
@@ -119,13 +135,20 @@ LedgerTxnEntry::current() const
 LedgerEntry&
 LedgerTxnEntry::Impl::current()
 {
-    return mCurrent;
+    if (!mWritable)
+    {
+        // The caller may modify the entry from now on, so it can no longer
+        // be shared with the parent of mLedgerTxn
+        mWritable = &mLedgerTxn.copyOnWrite(LedgerEntryKey(*mCurrent));
+        mCurrent = mWritable;
+    }
+    return *mWritable;
 }
 
 LedgerEntry const&
 LedgerTxnEntry::Impl::current() const
 {
-    return mCurrent;
+    return *mCurrent;
 }
 
 void
@@ -137,7 +160,7 @@ LedgerTxnEntry::deactivate()
 void
 LedgerTxnEntry::Impl::deactivate()
 {
-    auto key = LedgerEntryKey(mCurrent);
+    auto key = LedgerEntryKey(*mCurrent);
     mLedgerTxn.deactivate(key);
 }
 
@@ -150,7 +173,7 @@ LedgerTxnEntry::erase()
 void
 LedgerTxnEntry::Impl::erase()
 {
-    auto key = LedgerEntryKey(mCurrent);
+    auto key = LedgerEntryKey(*mCurrent);
     mLedgerTxn.erase(key);
 }
 
@@ -186,10 +209,11 @@ LedgerTxnEntry::swap(LedgerTxnEntry& other)
 class ConstLedgerTxnEntry::Impl : public EntryImplBase
 {
     AbstractLedgerTxn& mLedgerTxn;
-    LedgerEntry const mCurrent;
+    std::shared_ptr<LedgerEntry const> const mCurrent;
 
   public:
-    explicit Impl(AbstractLedgerTxn& ltx, LedgerEntry const& current);
+    explicit Impl(AbstractLedgerTxn& ltx,
+                  std::shared_ptr<LedgerEntry const> const& current);
 
     ~Impl() override;
 
@@ -207,8 +231,8 @@ class ConstLedgerTxnEntry::Impl : public EntryImplBase
 };
 
 std::shared_ptr<ConstLedgerTxnEntry::Impl>
-ConstLedgerTxnEntry::makeSharedImpl(AbstractLedgerTxn& ltx,
-                                    LedgerEntry const& current)
+ConstLedgerTxnEntry::makeSharedImpl(
+    AbstractLedgerTxn& ltx, std::shared_ptr<LedgerEntry const> const& current)
 {
     return std::make_shared<Impl>(ltx, current);
 }
@@ -228,8 +252,8 @@ ConstLedgerTxnEntry::ConstLedgerTxnEntry(std::shared_ptr<Impl> const& impl)
 {
 }
 
-ConstLedgerTxnEntry::Impl::Impl(AbstractLedgerTxn& ltx,
-                                LedgerEntry const& current)
+ConstLedgerTxnEntry::Impl::Impl(
+    AbstractLedgerTxn& ltx, std::shared_ptr<LedgerEntry const> const& current)
     : mLedgerTxn(ltx), mCurrent(current)
 {
 }
@@ -283,7 +307,7 @@ ConstLedgerTxnEntry::current() const
 LedgerEntry const&
 ConstLedgerTxnEntry::Impl::current() const
 {
-    return mCurrent;
+    return *mCurrent;
 }
 
 std::shared_ptr<ConstLedgerTxnEntry::Impl>
@@ -317,7 +341,7 @@ ConstLedgerTxnEntry::deactivate()
 void
 ConstLedgerTxnEntry::Impl::deactivate()
 {
-    auto key = LedgerEntryKey(mCurrent);
+    auto key = LedgerEntryKey(*mCurrent);
     mLedgerTxn.deactivate(key);
 }
 
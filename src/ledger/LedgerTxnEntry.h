@@ -59,6 +59,13 @@ class LedgerTxnEntry
 
     static std::shared_ptr<Impl> makeSharedImpl(AbstractLedgerTxn& ltx,
                                                 LedgerEntry& current);
+
+    // The Impl made by makeSharedImplCopyOnWrite shares current, which must
+    // not be modified, until current() is first called on a non-const
+    // LedgerTxnEntry: ltx then replaces it by a copy that can be modified.
+    static std::shared_ptr<Impl>
+    makeSharedImplCopyOnWrite(AbstractLedgerTxn& ltx,
+                              LedgerEntry const& current);
 };
 
 class ConstLedgerTxnEntry
@@ -95,8 +102,9 @@ class ConstLedgerTxnEntry
 
     void swap(ConstLedgerTxnEntry& other);
 
-    static std::shared_ptr<Impl> makeSharedImpl(AbstractLedgerTxn& ltx,
-                                                LedgerEntry const& current);
+    static std::shared_ptr<Impl>
+    makeSharedImpl(AbstractLedgerTxn& ltx,
+                   std::shared_ptr<LedgerEntry const> const& current);
 };
 
 std::shared_ptr<EntryImplBase>
@@ -2,23 +2,29 @@
 // under the Apache License, Version 2.0. See the COPYING file at the root
 // of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
 
+#include "crypto/ShortHash.h"
 #include "database/Database.h"
+#include "database/DatabaseUtils.h"
 #include "ledger/LedgerTxn.h"
+#include "util/Arena.h"
+#include "util/BloomFilter.h"
+#include "util/FlatHashMap.h"
 #include "util/RandomEvictionCache.h"
+#include "util/TinyLFUCache.h"
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <future>
 #include <list>
-#ifdef USE_POSTGRES
-#include <iomanip>
-#include <libpq-fe.h>
-#include <limits>
-#include <sstream>
-#endif
+#include <mutex>
+#include <thread>
 
 namespace stellar
 {
 
 // Precondition: The keys associated with entries are unique and constitute a
 // subset of keys
-std::unordered_map<LedgerKey, std::shared_ptr<LedgerEntry const>>
+FlatHashMap<LedgerKey, std::shared_ptr<LedgerEntry const>>
 populateLoadedEntries(std::unordered_set<LedgerKey> const& keys,
                       std::vector<LedgerEntry> const& entries);
 
@@ -26,6 +32,10 @@ populateLoadedEntries(std::unordered_set<LedgerKey> const& keys,
 // up.
 static const double ENTRY_CACHE_FILL_RATIO = 0.5;
 
+// An account only votes for its inflation destination if its balance is at
+// least this much.
+static const int64_t MIN_VOTES_TO_INCLUDE = 1000000000;
+
 class EntryIterator::AbstractImpl
 {
   public:
@@ -152,15 +162,40 @@ class LedgerTxn::Impl
     class EntryIteratorImpl;
     class WorstBestOfferIteratorImpl;
 
-    typedef std::unordered_map<LedgerKey, std::shared_ptr<LedgerEntry>>
+    // mEntry, mActive and every LedgerEntry recorded in this LedgerTxn are
+    // allocated from mArena, which is released in bulk once this LedgerTxn is
+    // committed or rolled back and no entry handed out to a child (through
+    // getNewestVersion) or to a LedgerTxnDelta is still referenced. The nodes
+    // of mEntry and mActive are reused once freed, but an entry may be
+    // released on another thread, so its block never is: once mArena holds
+    // MAX_ARENA_BYTES, entries are allocated on the heap instead. This bounds
+    // what a long-lived LedgerTxn that replaces its entries over and over
+    // leaves behind, and what an escaped entry keeps alive.
+    //
+    // The entries recorded by load are those of the parent, shared rather
+    // than copied, and every recorded entry is immutable: a LedgerTxnEntry
+    // only gets a copy of its own, through copyOnWrite, once it is modified.
+    typedef FlatHashMap<LedgerKey, std::shared_ptr<LedgerEntry const>,
+                        std::hash<LedgerKey>, std::equal_to<LedgerKey>,
+                        ArenaNodeAllocator<std::pair<
+                            LedgerKey, std::shared_ptr<LedgerEntry const>>>>
         EntryMap;
+    typedef FlatHashMap<
+        LedgerKey, std::shared_ptr<EntryImplBase>, std::hash<LedgerKey>,
+        std::equal_to<LedgerKey>,
+        ArenaNodeAllocator<
+            std::pair<LedgerKey, std::shared_ptr<EntryImplBase>>>>
+        ActiveMap;
+
+    static size_t const MAX_ARENA_BYTES;
 
     AbstractLedgerTxnParent& mParent;
     AbstractLedgerTxn* mChild;
     std::unique_ptr<LedgerHeader> mHeader;
     std::shared_ptr<LedgerTxnHeader::Impl> mActiveHeader;
+    std::shared_ptr<Arena> mArena;
     EntryMap mEntry;
-    std::unordered_map<LedgerKey, std::shared_ptr<EntryImplBase>> mActive;
+    ActiveMap mActive;
     bool const mShouldUpdateLastModified;
     bool mIsSealed;
     LedgerTxnConsistency mConsistency;
@@ -365,6 +400,15 @@ class LedgerTxn::Impl
     // getEntryIterator has the strong exception safety guarantee
     EntryIterator getEntryIterator(EntryMap const& entries) const;
 
+    // makeEntry has the strong exception safety guarantee
+    std::shared_ptr<LedgerEntry> makeEntry(LedgerEntry const& entry) const;
+
+    // sortByKey returns pointers to the elements of entries in key order (see
+    // LedgerEntryIdCmp), which is much cheaper than sorting copies of them.
+    // sortByKey has the strong exception safety guarantee
+    static std::vector<EntryMap::value_type const*>
+    sortByKey(EntryMap const& entries);
+
     // maybeUpdateLastModified has the strong exception safety guarantee
     EntryMap maybeUpdateLastModified() const;
 
@@ -380,10 +424,13 @@ class LedgerTxn::Impl
     // updateEntryIfRecorded and updateEntry have the strong exception safety
     // guarantee
     void updateEntryIfRecorded(LedgerKey const& key, bool effectiveActive);
-    void updateEntry(LedgerKey const& key, std::shared_ptr<LedgerEntry> lePtr);
-    void updateEntry(LedgerKey const& key, std::shared_ptr<LedgerEntry> lePtr,
+    void updateEntry(LedgerKey const& key,
+                     std::shared_ptr<LedgerEntry const> lePtr);
+    void updateEntry(LedgerKey const& key,
+                     std::shared_ptr<LedgerEntry const> lePtr,
                      bool effectiveActive);
-    void updateEntry(LedgerKey const& key, std::shared_ptr<LedgerEntry> lePtr,
+    void updateEntry(LedgerKey const& key,
+                     std::shared_ptr<LedgerEntry const> lePtr,
                      bool effectiveActive, bool eraseIfNull);
 
     // updateWorstBestOffer has the strong exception safety guarantee
@@ -414,6 +461,9 @@ class LedgerTxn::Impl
     // deactivate has the strong exception safety guarantee
     void deactivate(LedgerKey const& key);
 
+    // copyOnWrite has the strong exception safety guarantee
+    LedgerEntry& copyOnWrite(LedgerKey const& key);
+
     // deactivateHeader has the strong exception safety guarantee
     void deactivateHeader();
 
@@ -490,6 +540,9 @@ class LedgerTxn::Impl
                        std::vector<LedgerEntry>& liveEntries,
                        std::vector<LedgerKey>& deadEntries);
 
+    // getAllBucketEntries has the strong exception safety guarantee
+    void getAllBucketEntries(std::vector<BucketEntry>& entries);
+
     // getNewestVersion has the basic exception safety guarantee. If it throws
     // an exception, then
     // - the prepared statement cache may be, but is not guaranteed to be,
@@ -564,10 +617,16 @@ class LedgerTxn::Impl
 
     uint32_t prefetch(std::unordered_set<LedgerKey> const& keys);
 
+    bool prefetchAsync(std::unordered_set<LedgerKey> const& keys);
+
     double getPrefetchHitRate() const;
 
+    EntryCacheCounters getEntryCacheCounters(LedgerEntryType let) const;
+
 #ifdef BUILD_TESTS
     MultiOrderBook const& getOrderBook();
+
+    size_t getArenaBytesReserved() const;
 #endif
 };
 
@@ -641,7 +700,7 @@ class LedgerTxnRoot::Impl
         LoadType type;
     };
 
-    typedef RandomEvictionCache<LedgerKey, CacheEntry> EntryCache;
+    typedef TinyLFUCache<LedgerKey, CacheEntry> EntryCache;
 
     typedef AssetPair BestOffersCacheKey;
 
@@ -656,8 +715,74 @@ class LedgerTxnRoot::Impl
                                 AssetPairHash>
         BestOffersCache;
 
+    // The in-memory order book holds every offer in the database, grouped by
+    // asset pair and sorted by the better offer relation within each asset
+    // pair, and indexes the same offers by offerID and by seller and
+    // non-native asset, bought or sold. It is loaded from the
+    // database the first time it is needed, then kept in exact correspondence
+    // with the database by commitChild. Anything else that modifies the
+    // offers table discards it, so that it is loaded again on next use.
+    typedef std::map<OfferDescriptor, std::shared_ptr<LedgerEntry const>,
+                     IsBetterOfferComparator>
+        OrderBook;
+    typedef std::unordered_map<AssetPair, OrderBook, AssetPairHash>
+        MultiOrderBook;
+    typedef std::unordered_map<Asset, std::set<int64_t>> OffersByAsset;
+
+    typedef FlatHashMap<LedgerKey, std::shared_ptr<LedgerEntry const>>
+        LoadedEntries;
+
+    // The entries that commitChild committed for one ledger in write-behind
+    // mode, in commit order, with null entries for erased keys.
+    struct WriteBatch
+    {
+        uint64_t mID;
+        uint32_t mLedgerSeq;
+        LedgerTxnConsistency mCons;
+        LedgerEntryWrites mEntries;
+    };
+    typedef std::shared_ptr<WriteBatch const> WriteBatchPtr;
+
+    // The newest committed version of an entry that the writer has yet to
+    // write, and the batch that will write it.
+    struct PendingWrite
+    {
+        std::shared_ptr<LedgerEntry const> mEntry;
+        uint64_t mBatchID;
+    };
+
+    class WriteBatchIteratorImpl;
+
+    // Hashes all of a key. std::hash<LedgerKey> only looks at part of some
+    // keys, which would make a filter of them nearly useless.
+    struct KeyFilterHash
+    {
+        size_t
+        operator()(LedgerKey const& key) const
+        {
+            return static_cast<size_t>(shortHash::xdrComputeHash(key));
+        }
+    };
+    typedef BloomFilter<LedgerKey, KeyFilterHash> KeyFilter;
+
+    // A load of the entries with keys mKeys that prefetchAsync queued on
+    // mLoader. Its connection may read an entry before or after any commit
+    // that happens while it runs, so the entries that commitChild modifies
+    // from the moment the load is started are recorded in mModified and never
+    // cached. Setting mCancelled makes the load skip what it has not read
+    // yet.
+    struct LoadAhead
+    {
+        std::future<LoadedEntries> mLoaded;
+        std::shared_ptr<std::atomic<bool>> mCancelled;
+        std::unordered_set<LedgerKey> mKeys;
+        std::unordered_set<LedgerKey> mModified;
+    };
+
     static size_t const MIN_BEST_OFFERS_BATCH_SIZE;
     static size_t const MAX_BEST_OFFERS_BATCH_SIZE;
+    static size_t const MAX_BATCHES_BEHIND;
+    static double const MAX_KEY_FILTER_FALSE_POSITIVE_RATE;
 
     Database& mDatabase;
     std::unique_ptr<LedgerHeader> mHeader;
@@ -665,6 +790,87 @@ class LedgerTxnRoot::Impl
     mutable BestOffersCache mBestOffersCache;
     mutable uint64_t mPrefetchHits{0};
     mutable uint64_t mPrefetchMisses{0};
+    mutable size_t mPrefetchedEntries{0};
+    mutable size_t mPrefetchedBytes{0};
+    mutable std::unordered_map<LedgerEntryType, EntryCacheCounters>
+        mEntryCacheCounters;
+
+    bool const mInMemoryOrderBook;
+    mutable bool mOrderBookLoaded{false};
+    mutable MultiOrderBook mMultiOrderBook;
+    mutable std::unordered_map<int64_t, std::shared_ptr<LedgerEntry const>>
+        mOffersByID;
+    mutable std::unordered_map<AccountID, OffersByAsset> mOffersBySeller;
+
+    mutable std::vector<LoadAhead> mLoadsAhead;
+
+    // The inflation tally holds the vote of every account in the database
+    // that votes for an inflation destination, the total votes for each
+    // destination, and the destinations ranked by total votes then by
+    // descending strkey, as the winners are. Like the in-memory order book,
+    // it is loaded from the database the first time it is needed, kept in
+    // exact correspondence with the database by commitChild, and discarded
+    // by anything else that modifies the accounts table.
+    struct InflationVote
+    {
+        AccountID mDest;
+        int64_t mBalance;
+    };
+    mutable bool mInflationTallyLoaded{false};
+    mutable FlatHashMap<AccountID, InflationVote> mInflationVotes;
+    mutable std::unordered_map<AccountID, int64_t> mInflationTotals;
+    mutable std::set<std::pair<int64_t, std::string>> mInflationRanking;
+
+    // The key filter of a type of entry rules out most of the keys of that
+    // type that are not in the database, so that getNewestVersion and
+    // prefetch need not look for them there. It is loaded from the database
+    // by loadInMemoryState, or else the first time it is needed, then
+    // commitChild adds every key that it creates or updates. Erased keys are
+    // never removed, so the filter only gets more permissive; once its
+    // estimated false positive rate exceeds MAX_KEY_FILTER_FALSE_POSITIVE_RATE
+    // mLoader builds a new one with room to grow, and the degraded one stays
+    // in use until it is replaced. The keys added from the moment a rebuild
+    // is started are recorded in its mAdded, as the rebuild may miss them.
+    struct KeyFilterRebuild
+    {
+        std::future<std::unique_ptr<KeyFilter>> mFilter;
+        std::shared_ptr<std::atomic<bool>> mCancelled;
+        std::vector<LedgerKey> mAdded;
+    };
+    bool const mUseKeyFilters;
+    mutable std::unordered_map<LedgerEntryType, std::unique_ptr<KeyFilter>>
+        mKeyFilters;
+    mutable std::unordered_map<LedgerEntryType, KeyFilterRebuild>
+        mKeyFilterRebuilds;
+
+    // In write-behind mode, commitChild commits the header of each ledger it
+    // closes on the main connection but leaves the entries to mWriter, which
+    // writes them in order on a connection of the pool and records the last
+    // ledger written in the storestate table. Until a batch is written, its
+    // entries are served from mPendingWrites, which only the main thread
+    // touches. The fields from mWriteMutex down are guarded by it.
+    bool const mWriteBehind;
+    uint64_t mLastBatchID{0};
+    mutable std::deque<WriteBatchPtr> mBatchesInFlight;
+    mutable std::unordered_map<LedgerKey, PendingWrite> mPendingWrites;
+    std::thread mWriter;
+    mutable std::mutex mWriteMutex;
+    mutable std::condition_variable mWriteCV;
+    std::deque<WriteBatchPtr> mWriteQueue;
+    uint64_t mLastBatchWritten{0};
+    bool mStopWriter{false};
+
+    // mLoader runs the loads ahead and key filter rebuilds off the main
+    // thread, in order, each on a connection of the pool, so that they never
+    // queue behind the work of the application's background threads and
+    // none is left running once the LedgerTxnRoot is destroyed. A job must not
+    // throw. The fields from mLoaderMutex down are guarded by it.
+    typedef std::function<void(soci::session&)> LoaderJob;
+    std::thread mLoader;
+    std::mutex mLoaderMutex;
+    std::condition_variable mLoaderCV;
+    std::deque<LoaderJob> mLoaderJobs;
+    bool mStopLoader{false};
 
     size_t mMaxCacheSize;
     size_t mBulkLoadBatchSize;
@@ -673,6 +879,107 @@ class LedgerTxnRoot::Impl
 
     void throwIfChild() const;
 
+    // loadOrderBook has the strong exception safety guarantee. It does
+    // nothing if the order book is already loaded.
+    void loadOrderBook() const;
+
+    // insertInOrderBook and eraseFromOrderBook have the basic exception
+    // safety guarantee; callers discard the order book if they throw.
+    void insertInOrderBook(std::shared_ptr<LedgerEntry const> const& offer);
+    void eraseFromOrderBook(int64_t offerID);
+
+    // discardOrderBook does not throw
+    void discardOrderBook() const;
+
+    // getOffersByAccountAndAssetFromOrderBook has the strong exception safety
+    // guarantee. It returns the same offers as loadOffersByAccountAndAsset,
+    // loading the order book if needed.
+    std::vector<LedgerEntry>
+    getOffersByAccountAndAssetFromOrderBook(AccountID const& account,
+                                            Asset const& asset) const;
+
+    // getKeyFilter returns the key filter for let, loading it if needed, or
+    // nullptr if entries of type let are not filtered. It has the same
+    // exception safety guarantee as flushWrites.
+    KeyFilter const* getKeyFilter(LedgerEntryType let) const;
+
+    // buildKeyFilter loads the keys of type let through session into a new
+    // filter with room for twice as many. It only reads mDatabase, so it may
+    // run on mLoader.
+    std::unique_ptr<KeyFilter> buildKeyFilter(LedgerEntryType let,
+                                              soci::session& session) const;
+
+    // addToKeyFilter adds key, which is in the database or about to be, to
+    // the key filter of its type and to the rebuild of that filter, if any.
+    // It does not throw; a rebuild that fails to record key is dropped.
+    void addToKeyFilter(LedgerKey const& key);
+
+    // startKeyFilterRebuild has the strong exception safety guarantee. It
+    // must be called from the main thread.
+    void startKeyFilterRebuild(LedgerEntryType let);
+
+    // finishKeyFilterRebuilds replaces the key filters whose rebuild is done.
+    // A rebuild that failed is dropped, and started again by the next commit
+    // that finds the filter degraded. It does not throw.
+    void finishKeyFilterRebuilds();
+
+    // discardKeyFilters cancels the rebuilds without waiting for them. It
+    // does not throw.
+    void discardKeyFilters() const;
+
+    // loadInflationTally has the strong exception safety guarantee. It does
+    // nothing if the tally is already loaded.
+    void loadInflationTally() const;
+
+    // updateInflationVote replaces the vote of accountID, if any, with that
+    // of entry, its newest version or nullptr if it was erased.
+    // updateInflationVote and addInflationVotes have the basic exception
+    // safety guarantee; callers discard the tally if they throw.
+    void updateInflationVote(AccountID const& accountID,
+                             std::shared_ptr<LedgerEntry const> const& entry);
+    void addInflationVotes(AccountID const& dest, int64_t votes);
+
+    // discardInflationTally does not throw
+    void discardInflationTally() const;
+
+    // Add the key of every entry of one type in the database to filter,
+    // reading through session.
+    void loadAccountKeys(KeyFilter& filter, soci::session& session) const;
+    void loadDataKeys(KeyFilter& filter, soci::session& session) const;
+    void loadOfferKeys(KeyFilter& filter, soci::session& session) const;
+    void loadTrustLineKeys(KeyFilter& filter, soci::session& session) const;
+
+    // Prefetches the accounts and trust lines needed to cross the offers in
+    // [begin, end).
+    void prefetchOfferSellers(OrderBook::const_iterator begin,
+                              OrderBook::const_iterator const& end);
+
+    // Loads the entries with the given keys through session, in batches,
+    // until cancelled is set. It only reads mDatabase, so it may run on
+    // mLoader.
+    LoadedEntries loadAhead(std::unordered_set<LedgerKey> const& keys,
+                            std::atomic<bool> const& cancelled,
+                            soci::session& session) const;
+
+    // Whether a load ahead that was started since key was last modified
+    // holds or will hold key.
+    bool isLoadingAhead(LedgerKey const& key) const;
+
+    // Moves the entries of the finished loads ahead into the entry cache. A
+    // load ahead that failed is dropped, as is anything beyond the entry
+    // cache fill ratio.
+    void mergeLoadsAhead();
+
+    // discardLoadsAhead cancels and drops the loads ahead without waiting
+    // for those still running. It does not throw.
+    void discardLoadsAhead() const;
+
+    // Best offer in the in-memory order book that is worse than worseThan,
+    // or the best offer if worseThan is null.
+    std::shared_ptr<LedgerEntry const>
+    getBestOfferFromOrderBook(Asset const& buying, Asset const& selling,
+                              OfferDescriptor const* worseThan);
+
     std::shared_ptr<LedgerEntry const> loadAccount(LedgerKey const& key) const;
     std::shared_ptr<LedgerEntry const> loadData(LedgerKey const& key) const;
     std::shared_ptr<LedgerEntry const> loadOffer(LedgerKey const& key) const;
@@ -690,37 +997,100 @@ class LedgerTxnRoot::Impl
     loadOffersByAccountAndAsset(AccountID const& accountID,
                                 Asset const& asset) const;
     std::vector<LedgerEntry> loadOffers(StatementContext& prep) const;
-    std::vector<InflationWinner> loadInflationWinners(size_t maxWinners,
-                                                      int64_t minBalance) const;
+    FlatHashMap<AccountID, InflationVote> loadInflationVotes() const;
     std::shared_ptr<LedgerEntry const>
     loadTrustLine(LedgerKey const& key) const;
 
+    // bulkApply and the bulk operations below write through session and only
+    // read mDatabase, so that the writer thread can use them too.
     void bulkApply(BulkLedgerEntryChangeAccumulator& bleca,
-                   size_t bufferThreshold, LedgerTxnConsistency cons);
-    void bulkUpsertAccounts(std::vector<EntryIterator> const& entries);
+                   size_t bufferThreshold, LedgerTxnConsistency cons,
+                   soci::session& session);
+    void bulkUpsertAccounts(std::vector<EntryIterator> const& entries,
+                            soci::session& session);
     void bulkDeleteAccounts(std::vector<EntryIterator> const& entries,
-                            LedgerTxnConsistency cons);
-    void bulkUpsertTrustLines(std::vector<EntryIterator> const& entries);
+                            LedgerTxnConsistency cons, soci::session& session);
+    void bulkUpsertTrustLines(std::vector<EntryIterator> const& entries,
+                              soci::session& session);
     void bulkDeleteTrustLines(std::vector<EntryIterator> const& entries,
-                              LedgerTxnConsistency cons);
-    void bulkUpsertOffers(std::vector<EntryIterator> const& entries);
+                              LedgerTxnConsistency cons,
+                              soci::session& session);
+    void bulkUpsertOffers(std::vector<EntryIterator> const& entries,
+                          soci::session& session);
     void bulkDeleteOffers(std::vector<EntryIterator> const& entries,
-                          LedgerTxnConsistency cons);
-    void bulkUpsertAccountData(std::vector<EntryIterator> const& entries);
+                          LedgerTxnConsistency cons, soci::session& session);
+    void bulkUpsertAccountData(std::vector<EntryIterator> const& entries,
+                               soci::session& session);
     void bulkDeleteAccountData(std::vector<EntryIterator> const& entries,
-                               LedgerTxnConsistency cons);
+                               LedgerTxnConsistency cons,
+                               soci::session& session);
+
+    // Writes entries through session, in bulk.
+    void writeEntries(LedgerEntryWrites const& entries,
+                      LedgerTxnConsistency cons, soci::session& session);
+
+    // Writes batch through a connection of pool, in a single transaction
+    // that also records the ledger of batch as the last written ledger.
+    // Aborts if that fails, as commitChild does.
+    void writeBatch(WriteBatch const& batch, soci::connection_pool& pool);
+
+    // Body of mWriter: writes the batches of mWriteQueue in order until it is
+    // empty and mStopWriter is set.
+    void runWriter(soci::connection_pool& pool);
+
+    // startWriter and stopWriter must be called from the main thread.
+    // stopWriter waits for the queued batches to be written. Neither throws
+    // except on failure to start a thread.
+    void startWriter();
+    void stopWriter();
+
+    // postToLoader queues job for mLoader, starting it if needed, and must be
+    // called from the main thread. It has the strong exception safety
+    // guarantee.
+    void postToLoader(LoaderJob job);
+
+    // Body of mLoader: runs the jobs of mLoaderJobs in order until
+    // mStopLoader is set.
+    void runLoader(soci::connection_pool& pool);
+
+    // stopLoader drops the queued jobs and waits for the running one, if any.
+    // It does not throw.
+    void stopLoader();
+
+    // Forgets the pending writes of the batches that the writer has written,
+    // and marks their keys modified for the loads ahead, which may have read
+    // them before they were written. It has the basic exception safety
+    // guarantee; what it fails to retire is retired by a later call.
+    void retireWrites() const;
+
+    // flushWrites waits for the writer to write every queued batch, so that
+    // the database holds every committed entry, then retires them. Anything
+    // that reads the entry tables without going through getNewestVersion, or
+    // modifies them outside of commitChild, calls it first. It has the same
+    // exception safety guarantee as retireWrites.
+    void flushWrites() const;
+
+    // The pending write for key, or nullptr if there is none.
+    PendingWrite const* getPendingWrite(LedgerKey const& key) const;
 
     static std::string tableFromLedgerEntryType(LedgerEntryType let);
 
     // The entry cache maintains relatively strong invariants:
     //
-    //  - It is only ever populated during a database operation, at root.
+    //  - It is only ever populated during a database operation, at root,
+    //    from a load ahead, minus the entries committed or written since
+    //    that load was started, from mPendingWrites, which holds what
+    //    the database will hold once the writer catches up, or with the
+    //    absence of a key that its key filter rules out.
     //
     //  - Until the (bulk) LedgerTxnRoot::commitChild operation, the only
     //    database operations are SELECTs, which only populate the cache
     //    with fresh data from the DB.
     //
-    //  - On LedgerTxnRoot::commitChild, the cache is cleared.
+    //  - On LedgerTxnRoot::commitChild, once the database transaction is
+    //    committed, every committed key that has an entry in the cache gets
+    //    the committed version of the entry (or none, if it was erased).
+    //    The cache is cleared if that fails.
     //
     //  - It is therefore always kept in exact correspondence with the
     //    database for the keyset that it has entries for. It's a precise
@@ -731,22 +1101,29 @@ class LedgerTxnRoot::Impl
                          std::shared_ptr<LedgerEntry const> const& entry,
                          LoadType type) const;
 
+    // Prefetching stops, until the next commit or rollback, once the entries
+    // prefetched since the last one fill ENTRY_CACHE_FILL_RATIO of the entry
+    // cache by count or by size, so that prefetching for one ledger does not
+    // evict everything else.
+    bool prefetchBudgetExhausted() const;
+
     BestOffersCacheEntryPtr getFromBestOffersCache(Asset const& buying,
                                                    Asset const& selling) const;
 
-    std::unordered_map<LedgerKey, std::shared_ptr<LedgerEntry const>>
-    bulkLoadAccounts(std::unordered_set<LedgerKey> const& keys) const;
-    std::unordered_map<LedgerKey, std::shared_ptr<LedgerEntry const>>
-    bulkLoadTrustLines(std::unordered_set<LedgerKey> const& keys) const;
-    std::unordered_map<LedgerKey, std::shared_ptr<LedgerEntry const>>
-    bulkLoadOffers(std::unordered_set<LedgerKey> const& keys) const;
-    std::unordered_map<LedgerKey, std::shared_ptr<LedgerEntry const>>
-    bulkLoadData(std::unordered_set<LedgerKey> const& keys) const;
+    LoadedEntries bulkLoadAccounts(std::unordered_set<LedgerKey> const& keys,
+                                   soci::session& session) const;
+    LoadedEntries bulkLoadTrustLines(std::unordered_set<LedgerKey> const& keys,
+                                     soci::session& session) const;
+    LoadedEntries bulkLoadOffers(std::unordered_set<LedgerKey> const& keys,
+                                 soci::session& session) const;
+    LoadedEntries bulkLoadData(std::unordered_set<LedgerKey> const& keys,
+                               soci::session& session) const;
 
   public:
     // Constructor has the strong exception safety guarantee
-    Impl(Database& db, size_t entryCacheSize, size_t bestOfferCacheSize,
-         size_t prefetchBatchSize);
+    Impl(Database& db, size_t entryCacheSize, size_t entryCacheBytes,
+         size_t bestOfferCacheSize, size_t prefetchBatchSize,
+         bool inMemoryOrderBook, bool writeBehind, bool keyFilters);
 
     ~Impl();
 
@@ -771,6 +1148,16 @@ class LedgerTxnRoot::Impl
     void dropOffers();
     void dropTrustLines();
 
+    // writeInParallel has the basic exception safety guarantee. If it throws
+    // an exception, then any of the entries may have been written. It
+    // discards whatever it caches of the entries before writing them.
+    void writeInParallel(LedgerEntryWrites const& entries, size_t nThreads);
+
+    // loadInMemoryState has the basic exception safety guarantee. If it
+    // throws an exception, then the in-memory order book is left unloaded,
+    // to be loaded when next needed.
+    void loadInMemoryState();
+
 #ifdef FUZZING_BUILD_MODE_UNSAFE_FOR_PRODUCTION
     void resetForFuzzer();
 #endif // FUZZING_BUILD_MODE_UNSAFE_FOR_PRODUCTION
@@ -789,6 +1176,7 @@ class LedgerTxnRoot::Impl
     //   cleared
     // - the best offers cache may be, but is not guaranteed to be, modified or
     //   even cleared
+    // - the in-memory order book may be, but is not guaranteed to be, loaded
     std::shared_ptr<LedgerEntry const> getBestOffer(Asset const& buying,
                                                     Asset const& selling);
     std::shared_ptr<LedgerEntry const>
@@ -823,68 +1211,45 @@ class LedgerTxnRoot::Impl
     // rollbackChild has the strong exception safety guarantee.
     void rollbackChild();
 
-    // Prefetch some or all of given keys in batches. Note that no prefetching
+    // Prefetch some or all of given keys in batches, after moving the entries
+    // of the finished loads ahead into the cache. Note that no prefetching
     // could occur if the cache is at its fill ratio. Returns number of keys
     // prefetched.
     uint32_t prefetch(std::unordered_set<LedgerKey> const& keys);
 
+    // prefetchAsync has the strong exception safety guarantee. A failed load
+    // ahead is dropped by the next call to prefetch.
+    bool prefetchAsync(std::unordered_set<LedgerKey> const& keys);
+
     double getPrefetchHitRate() const;
+
+    EntryCacheCounters getEntryCacheCounters(LedgerEntryType let) const;
+
+#ifdef BUILD_TESTS
+    size_t waitForLoadsAhead();
+#endif
 };
 
-#ifdef USE_POSTGRES
-template <typename T>
-inline void
-marshalToPGArrayItem(PGconn* conn, std::ostringstream& oss, const T& item)
+class LedgerTxnRoot::Impl::WriteBatchIteratorImpl
+    : public EntryIterator::AbstractImpl
 {
-    // NB: This setprecision is very important to ensuring that a double
-    // gets marshaled to enough decimal digits to reconstruct exactly the
-    // same double on the postgres side (that precision-level is exactly
-    // what max_digits10 is defined as). Do not remove it!
-    oss << std::setprecision(std::numeric_limits<T>::max_digits10) << item;
-}
+    typedef decltype(WriteBatch::mEntries)::const_iterator IteratorType;
+    IteratorType mIter;
+    IteratorType const mEnd;
 
-template <>
-inline void
-marshalToPGArrayItem<std::string>(PGconn* conn, std::ostringstream& oss,
-                                  const std::string& item)
-{
-    std::vector<char> buf(item.size() * 2 + 1, '\0');
-    int err = 0;
-    size_t len =
-        PQescapeStringConn(conn, buf.data(), item.c_str(), item.size(), &err);
-    if (err != 0)
-    {
-        throw std::runtime_error("Could not escape string in SQL");
-    }
-    oss << '"';
-    oss.write(buf.data(), len);
-    oss << '"';
-}
+  public:
+    WriteBatchIteratorImpl(IteratorType const& begin, IteratorType const& end);
 
-template <typename T>
-inline void
-marshalToPGArray(PGconn* conn, std::string& out, const std::vector<T>& v,
-                 const std::vector<soci::indicator>* ind = nullptr)
-{
-    std::ostringstream oss;
-    oss << '{';
-    for (size_t i = 0; i < v.size(); ++i)
-    {
-        if (i > 0)
-        {
-            oss << ',';
-        }
-        if (ind && (*ind)[i] == soci::i_null)
-        {
-            oss << "NULL";
-        }
-        else
-        {
-            marshalToPGArrayItem(conn, oss, v[i]);
-        }
-    }
-    oss << '}';
-    out = oss.str();
-}
-#endif
+    void advance() override;
+
+    bool atEnd() const override;
+
+    LedgerEntry const& entry() const override;
+
+    bool entryExists() const override;
+
+    LedgerKey const& key() const override;
+
+    std::unique_ptr<EntryIterator::AbstractImpl> clone() const override;
+};
 }
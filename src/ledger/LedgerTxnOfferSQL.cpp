@@ -49,6 +49,7 @@ LedgerTxnRoot::Impl::loadOffer(LedgerKey const& key) const
 std::vector<LedgerEntry>
 LedgerTxnRoot::Impl::loadAllOffers() const
 {
+    flushWrites();
     std::string sql = "SELECT sellerid, offerid, sellingasset, buyingasset, "
                       "amount, pricen, priced, flags, lastmodified "
                       "FROM offers";
@@ -67,6 +68,7 @@ LedgerTxnRoot::Impl::loadBestOffers(std::deque<LedgerEntry>& offers,
                                     Asset const& buying, Asset const& selling,
                                     size_t numOffers) const
 {
+    flushWrites();
     // price is an approximation of the actual n/d (truncated math, 15 digits)
     // ordering by offerid gives precendence to older offers for fairness
     std::string sql = "SELECT sellerid, offerid, sellingasset, buyingasset, "
@@ -97,6 +99,7 @@ LedgerTxnRoot::Impl::loadBestOffers(std::deque<LedgerEntry>& offers,
                                     OfferDescriptor const& worseThan,
                                     size_t numOffers) const
 {
+    flushWrites();
     // ManageOffer and related operations won't work correctly with an offerID
     // equal to or exceeding INT64_MAX, so there is no reason to support it
     // here. We are far from this limit anyway.
@@ -197,6 +200,7 @@ std::vector<LedgerEntry>
 LedgerTxnRoot::Impl::loadOffersByAccountAndAsset(AccountID const& accountID,
                                                  Asset const& asset) const
 {
+    flushWrites();
     std::string sql = "SELECT sellerid, offerid, sellingasset, buyingasset, "
                       "amount, pricen, priced, flags, lastmodified "
                       "FROM offers WHERE sellerid = :v1 AND "
@@ -312,9 +316,36 @@ LedgerTxnRoot::Impl::loadOffers(StatementContext& prep) const
     return offers;
 }
 
+void
+LedgerTxnRoot::Impl::loadOfferKeys(KeyFilter& filter,
+                                   soci::session& session) const
+{
+    std::string sellerID;
+
+    LedgerKey key(OFFER);
+    auto prep = mDatabase.getPreparedStatement(
+        "SELECT sellerid, offerid FROM offers", session);
+    auto& st = prep.statement();
+    st.exchange(soci::into(sellerID));
+    st.exchange(soci::into(key.offer().offerID));
+    st.define_and_bind();
+    {
+        auto timer = mDatabase.getSelectTimer("offer-keys");
+        st.execute(true);
+    }
+
+    while (st.got_data())
+    {
+        key.offer().sellerID = KeyUtils::fromStrKey<PublicKey>(sellerID);
+        filter.add(key);
+        st.fetch();
+    }
+}
+
 class BulkUpsertOffersOperation : public DatabaseTypeSpecificOperation<void>
 {
     Database& mDB;
+    soci::session& mSession;
     std::vector<std::string> mSellerIDs;
     std::vector<int64_t> mOfferIDs;
     std::vector<std::string> mSellingAssets;
@@ -352,9 +383,9 @@ class BulkUpsertOffersOperation : public DatabaseTypeSpecificOperation<void>
     }
 
   public:
-    BulkUpsertOffersOperation(Database& DB,
+    BulkUpsertOffersOperation(Database& DB, soci::session& session,
                               std::vector<LedgerEntry> const& entries)
-        : mDB(DB)
+        : mDB(DB), mSession(session)
     {
         mSellerIDs.reserve(entries.size());
         mOfferIDs.reserve(entries.size());
@@ -373,9 +404,9 @@ class BulkUpsertOffersOperation : public DatabaseTypeSpecificOperation<void>
         }
     }
 
-    BulkUpsertOffersOperation(Database& DB,
+    BulkUpsertOffersOperation(Database& DB, soci::session& session,
                               std::vector<EntryIterator> const& entries)
-        : mDB(DB)
+        : mDB(DB), mSession(session)
     {
         mSellerIDs.reserve(entries.size());
         mOfferIDs.reserve(entries.size());
@@ -413,7 +444,7 @@ class BulkUpsertOffersOperation : public DatabaseTypeSpecificOperation<void>
                           "price = excluded.price, "
                           "flags = excluded.flags, "
                           "lastmodified = excluded.lastmodified ";
-        auto prep = mDB.getPreparedStatement(sql);
+        auto prep = mDB.getPreparedStatement(sql, mSession);
         soci::statement& st = prep.statement();
         st.exchange(soci::use(mSellerIDs));
         st.exchange(soci::use(mOfferIDs));
@@ -443,9 +474,60 @@ class BulkUpsertOffersOperation : public DatabaseTypeSpecificOperation<void>
     }
 
 #ifdef USE_POSTGRES
+    void
+    doPostgresCopyOperation(PGconn* conn)
+    {
+        std::string const columns =
+            "sellerid, offerid, sellingasset, buyingasset, amount, pricen, "
+            "priced, price, flags, lastmodified";
+        PGBinaryCopy copy(10);
+        for (size_t i = 0; i < mOfferIDs.size(); ++i)
+        {
+            copy.beginRow();
+            copy.put(mSellerIDs[i]);
+            copy.put(mOfferIDs[i]);
+            copy.put(mSellingAssets[i]);
+            copy.put(mBuyingAssets[i]);
+            copy.put(mAmounts[i]);
+            copy.put(mPriceNs[i]);
+            copy.put(mPriceDs[i]);
+            copy.put(mPrices[i]);
+            copy.put(mFlags[i]);
+            copy.put(mLastModifieds[i]);
+        }
+
+        auto timer = mDB.getUpsertTimer("offer");
+        auto tmp = copy.copyInto(mSession, conn, "offers", columns);
+        std::string sql = "INSERT INTO offers (" + columns + ") SELECT " +
+                          columns + " FROM " + tmp +
+                          " ON CONFLICT (offerid) DO UPDATE SET "
+                          "sellerid = excluded.sellerid, "
+                          "sellingasset = excluded.sellingasset, "
+                          "buyingasset = excluded.buyingasset, "
+                          "amount = excluded.amount, "
+                          "pricen = excluded.pricen, "
+                          "priced = excluded.priced, "
+                          "price = excluded.price, "
+                          "flags = excluded.flags, "
+                          "lastmodified = excluded.lastmodified ";
+        auto prep = mDB.getPreparedStatement(sql, mSession);
+        soci::statement& st = prep.statement();
+        st.define_and_bind();
+        st.execute(true);
+        if (static_cast<size_t>(st.get_affected_rows()) != mOfferIDs.size())
+        {
+            throw std::runtime_error("Could not update data in SQL");
+        }
+    }
+
     void
     doPostgresSpecificOperation(soci::postgresql_session_backend* pg) override
     {
+        if (mDB.useBulkCopy(mOfferIDs.size()))
+        {
+            doPostgresCopyOperation(pg->conn_);
+            return;
+        }
 
         std::string strSellerIDs, strOfferIDs, strSellingAssets,
             strBuyingAssets, strAmounts, strPriceNs, strPriceDs, strPrices,
@@ -491,7 +573,7 @@ class BulkUpsertOffersOperation : public DatabaseTypeSpecificOperation<void>
                           "price = excluded.price, "
                           "flags = excluded.flags, "
                           "lastmodified = excluded.lastmodified ";
-        auto prep = mDB.getPreparedStatement(sql);
+        auto prep = mDB.getPreparedStatement(sql, mSession);
         soci::statement& st = prep.statement();
         st.exchange(soci::use(strSellerIDs));
         st.exchange(soci::use(strOfferIDs));
@@ -519,13 +601,15 @@ class BulkUpsertOffersOperation : public DatabaseTypeSpecificOperation<void>
 class BulkDeleteOffersOperation : public DatabaseTypeSpecificOperation<void>
 {
     Database& mDB;
+    soci::session& mSession;
     LedgerTxnConsistency mCons;
     std::vector<int64_t> mOfferIDs;
 
   public:
-    BulkDeleteOffersOperation(Database& DB, LedgerTxnConsistency cons,
+    BulkDeleteOffersOperation(Database& DB, soci::session& session,
+                              LedgerTxnConsistency cons,
                               std::vector<EntryIterator> const& entries)
-        : mDB(DB), mCons(cons)
+        : mDB(DB), mSession(session), mCons(cons)
     {
         for (auto const& e : entries)
         {
@@ -540,7 +624,7 @@ class BulkDeleteOffersOperation : public DatabaseTypeSpecificOperation<void>
     doSociGenericOperation()
     {
         std::string sql = "DELETE FROM offers WHERE offerid = :id";
-        auto prep = mDB.getPreparedStatement(sql);
+        auto prep = mDB.getPreparedStatement(sql, mSession);
         soci::statement& st = prep.statement();
         st.exchange(soci::use(mOfferIDs));
         st.define_and_bind();
@@ -573,7 +657,7 @@ class BulkDeleteOffersOperation : public DatabaseTypeSpecificOperation<void>
                           ") "
                           "DELETE FROM offers WHERE "
                           "offerid IN (SELECT * FROM r)";
-        auto prep = mDB.getPreparedStatement(sql);
+        auto prep = mDB.getPreparedStatement(sql, mSession);
         soci::statement& st = prep.statement();
         st.exchange(soci::use(strOfferIDs));
         st.define_and_bind();
@@ -591,26 +675,32 @@ class BulkDeleteOffersOperation : public DatabaseTypeSpecificOperation<void>
 };
 
 void
-LedgerTxnRoot::Impl::bulkUpsertOffers(std::vector<EntryIterator> const& entries)
+LedgerTxnRoot::Impl::bulkUpsertOffers(std::vector<EntryIterator> const& entries,
+                                      soci::session& session)
 {
-    BulkUpsertOffersOperation op(mDatabase, entries);
-    mDatabase.doDatabaseTypeSpecificOperation(op);
+    BulkUpsertOffersOperation op(mDatabase, session, entries);
+    mDatabase.doDatabaseTypeSpecificOperation(op, session);
 }
 
 void
 LedgerTxnRoot::Impl::bulkDeleteOffers(std::vector<EntryIterator> const& entries,
-                                      LedgerTxnConsistency cons)
+                                      LedgerTxnConsistency cons,
+                                      soci::session& session)
 {
-    BulkDeleteOffersOperation op(mDatabase, cons, entries);
-    mDatabase.doDatabaseTypeSpecificOperation(op);
+    BulkDeleteOffersOperation op(mDatabase, session, cons, entries);
+    mDatabase.doDatabaseTypeSpecificOperation(op, session);
 }
 
 void
 LedgerTxnRoot::Impl::dropOffers()
 {
     throwIfChild();
+    flushWrites();
     mEntryCache.clear();
     mBestOffersCache.clear();
+    discardKeyFilters();
+    discardLoadsAhead();
+    discardOrderBook();
 
     std::string coll = mDatabase.getSimpleCollationClause();
 
@@ -638,6 +728,7 @@ class BulkLoadOffersOperation
     : public DatabaseTypeSpecificOperation<std::vector<LedgerEntry>>
 {
     Database& mDb;
+    soci::session& mSession;
     std::vector<int64_t> mOfferIDs;
     std::unordered_map<int64_t, AccountID> mSellerIDsByOfferID;
 
@@ -697,9 +788,9 @@ class BulkLoadOffersOperation
     }
 
   public:
-    BulkLoadOffersOperation(Database& db,
+    BulkLoadOffersOperation(Database& db, soci::session& session,
                             std::unordered_set<LedgerKey> const& keys)
-        : mDb(db)
+        : mDb(db), mSession(session)
     {
         mOfferIDs.reserve(keys.size());
         for (auto const& k : keys)
@@ -721,7 +812,7 @@ class BulkLoadOffersOperation
             "amount, pricen, priced, flags, lastmodified "
             "FROM offers WHERE offerid IN carray(?, ?, 'int64')";
 
-        auto prep = mDb.getPreparedStatement(sql);
+        auto prep = mDb.getPreparedStatement(sql, mSession);
         auto be = prep.statement().get_backend();
         if (be == nullptr)
         {
@@ -749,7 +840,7 @@ class BulkLoadOffersOperation
             "SELECT sellerid, offerid, sellingasset, buyingasset, "
             "amount, pricen, priced, flags, lastmodified "
             "FROM offers WHERE offerid IN (SELECT * FROM r)";
-        auto prep = mDb.getPreparedStatement(sql);
+        auto prep = mDb.getPreparedStatement(sql, mSession);
         auto& st = prep.statement();
         st.exchange(soci::use(strOfferIDs));
         return executeAndFetch(st);
@@ -757,15 +848,15 @@ class BulkLoadOffersOperation
 #endif
 };
 
-std::unordered_map<LedgerKey, std::shared_ptr<LedgerEntry const>>
+FlatHashMap<LedgerKey, std::shared_ptr<LedgerEntry const>>
 LedgerTxnRoot::Impl::bulkLoadOffers(
-    std::unordered_set<LedgerKey> const& keys) const
+    std::unordered_set<LedgerKey> const& keys, soci::session& session) const
 {
     if (!keys.empty())
     {
-        BulkLoadOffersOperation op(mDatabase, keys);
+        BulkLoadOffersOperation op(mDatabase, session, keys);
         return populateLoadedEntries(
-            keys, mDatabase.doDatabaseTypeSpecificOperation(op));
+            keys, mDatabase.doDatabaseTypeSpecificOperation(op, session));
     }
     else
     {
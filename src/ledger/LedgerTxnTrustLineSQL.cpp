@@ -95,9 +95,55 @@ LedgerTxnRoot::Impl::loadTrustLine(LedgerKey const& key) const
     return std::make_shared<LedgerEntry>(std::move(le));
 }
 
+void
+LedgerTxnRoot::Impl::loadTrustLineKeys(KeyFilter& filter,
+                                       soci::session& session) const
+{
+    std::string accountID, issuer, assetCode;
+    uint32_t assetType;
+
+    auto prep = mDatabase.getPreparedStatement(
+        "SELECT accountid, assettype, issuer, assetcode FROM trustlines",
+        session);
+    auto& st = prep.statement();
+    st.exchange(soci::into(accountID));
+    st.exchange(soci::into(assetType));
+    st.exchange(soci::into(issuer));
+    st.exchange(soci::into(assetCode));
+    st.define_and_bind();
+    {
+        auto timer = mDatabase.getSelectTimer("trust-keys");
+        st.execute(true);
+    }
+
+    LedgerKey key(TRUSTLINE);
+    auto& tl = key.trustLine();
+    while (st.got_data())
+    {
+        tl.accountID = KeyUtils::fromStrKey<PublicKey>(accountID);
+        assert(assetType != ASSET_TYPE_NATIVE);
+        tl.asset.type(static_cast<AssetType>(assetType));
+        if (assetType == ASSET_TYPE_CREDIT_ALPHANUM4)
+        {
+            tl.asset.alphaNum4().issuer =
+                KeyUtils::fromStrKey<PublicKey>(issuer);
+            strToAssetCode(tl.asset.alphaNum4().assetCode, assetCode);
+        }
+        else
+        {
+            tl.asset.alphaNum12().issuer =
+                KeyUtils::fromStrKey<PublicKey>(issuer);
+            strToAssetCode(tl.asset.alphaNum12().assetCode, assetCode);
+        }
+        filter.add(key);
+        st.fetch();
+    }
+}
+
 class BulkUpsertTrustLinesOperation : public DatabaseTypeSpecificOperation<void>
 {
     Database& mDB;
+    soci::session& mSession;
     std::vector<std::string> mAccountIDs;
     std::vector<int32_t> mAssetTypes;
     std::vector<std::string> mIssuers;
@@ -111,9 +157,9 @@ class BulkUpsertTrustLinesOperation : public DatabaseTypeSpecificOperation<void>
     std::vector<soci::indicator> mLiabilitiesInds;
 
   public:
-    BulkUpsertTrustLinesOperation(Database& DB,
+    BulkUpsertTrustLinesOperation(Database& DB, soci::session& session,
                                   std::vector<EntryIterator> const& entries)
-        : mDB(DB)
+        : mDB(DB), mSession(session)
     {
         mAccountIDs.reserve(entries.size());
         mAssetTypes.reserve(entries.size());
@@ -181,7 +227,7 @@ class BulkUpsertTrustLinesOperation : public DatabaseTypeSpecificOperation<void>
             "lastmodified = excluded.lastmodified, "
             "buyingliabilities = excluded.buyingliabilities, "
             "sellingliabilities = excluded.sellingliabilities ";
-        auto prep = mDB.getPreparedStatement(sql);
+        auto prep = mDB.getPreparedStatement(sql, mSession);
         soci::statement& st = prep.statement();
         st.exchange(soci::use(mAccountIDs));
         st.exchange(soci::use(mAssetTypes));
@@ -211,9 +257,60 @@ class BulkUpsertTrustLinesOperation : public DatabaseTypeSpecificOperation<void>
     }
 
 #ifdef USE_POSTGRES
+    void
+    doPostgresCopyOperation(PGconn* conn)
+    {
+        std::string const columns =
+            "accountid, assettype, issuer, assetcode, tlimit, balance, flags, "
+            "lastmodified, buyingliabilities, sellingliabilities";
+        PGBinaryCopy copy(10);
+        for (size_t i = 0; i < mAccountIDs.size(); ++i)
+        {
+            copy.beginRow();
+            copy.put(mAccountIDs[i]);
+            copy.put(mAssetTypes[i]);
+            copy.put(mIssuers[i]);
+            copy.put(mAssetCodes[i]);
+            copy.put(mTlimits[i]);
+            copy.put(mBalances[i]);
+            copy.put(mFlags[i]);
+            copy.put(mLastModifieds[i]);
+            copy.put(mBuyingLiabilities[i], mLiabilitiesInds[i]);
+            copy.put(mSellingLiabilities[i], mLiabilitiesInds[i]);
+        }
+
+        auto timer = mDB.getUpsertTimer("trustline");
+        auto tmp = copy.copyInto(mSession, conn, "trustlines", columns);
+        std::string sql =
+            "INSERT INTO trustlines (" + columns + ") SELECT " + columns +
+            " FROM " + tmp +
+            " ON CONFLICT (accountid, issuer, assetcode) DO UPDATE SET "
+            "assettype = excluded.assettype, "
+            "tlimit = excluded.tlimit, "
+            "balance = excluded.balance, "
+            "flags = excluded.flags, "
+            "lastmodified = excluded.lastmodified, "
+            "buyingliabilities = excluded.buyingliabilities, "
+            "sellingliabilities = excluded.sellingliabilities ";
+        auto prep = mDB.getPreparedStatement(sql, mSession);
+        soci::statement& st = prep.statement();
+        st.define_and_bind();
+        st.execute(true);
+        if (static_cast<size_t>(st.get_affected_rows()) != mAccountIDs.size())
+        {
+            throw std::runtime_error("Could not update data in SQL");
+        }
+    }
+
     void
     doPostgresSpecificOperation(soci::postgresql_session_backend* pg) override
     {
+        if (mDB.useBulkCopy(mAccountIDs.size()))
+        {
+            doPostgresCopyOperation(pg->conn_);
+            return;
+        }
+
         PGconn* conn = pg->conn_;
 
         std::string strAccountIDs, strAssetTypes, strIssuers, strAssetCodes,
@@ -259,7 +356,7 @@ class BulkUpsertTrustLinesOperation : public DatabaseTypeSpecificOperation<void>
             "lastmodified = excluded.lastmodified, "
             "buyingliabilities = excluded.buyingliabilities, "
             "sellingliabilities = excluded.sellingliabilities ";
-        auto prep = mDB.getPreparedStatement(sql);
+        auto prep = mDB.getPreparedStatement(sql, mSession);
         soci::statement& st = prep.statement();
         st.exchange(soci::use(strAccountIDs));
         st.exchange(soci::use(strAssetTypes));
@@ -287,15 +384,17 @@ class BulkUpsertTrustLinesOperation : public DatabaseTypeSpecificOperation<void>
 class BulkDeleteTrustLinesOperation : public DatabaseTypeSpecificOperation<void>
 {
     Database& mDB;
+    soci::session& mSession;
     LedgerTxnConsistency mCons;
     std::vector<std::string> mAccountIDs;
     std::vector<std::string> mIssuers;
     std::vector<std::string> mAssetCodes;
 
   public:
-    BulkDeleteTrustLinesOperation(Database& DB, LedgerTxnConsistency cons,
+    BulkDeleteTrustLinesOperation(Database& DB, soci::session& session,
+                                  LedgerTxnConsistency cons,
                                   std::vector<EntryIterator> const& entries)
-        : mDB(DB), mCons(cons)
+        : mDB(DB), mSession(session), mCons(cons)
     {
         mAccountIDs.reserve(entries.size());
         mIssuers.reserve(entries.size());
@@ -319,7 +418,7 @@ class BulkDeleteTrustLinesOperation : public DatabaseTypeSpecificOperation<void>
     {
         std::string sql = "DELETE FROM trustlines WHERE accountid = :id "
                           "AND issuer = :v1 AND assetcode = :v2";
-        auto prep = mDB.getPreparedStatement(sql);
+        auto prep = mDB.getPreparedStatement(sql, mSession);
         soci::statement& st = prep.statement();
         st.exchange(soci::use(mAccountIDs));
         st.exchange(soci::use(mIssuers));
@@ -358,7 +457,7 @@ class BulkDeleteTrustLinesOperation : public DatabaseTypeSpecificOperation<void>
                           ") "
                           "DELETE FROM trustlines WHERE "
                           "(accountid, issuer, assetcode) IN (SELECT * FROM r)";
-        auto prep = mDB.getPreparedStatement(sql);
+        auto prep = mDB.getPreparedStatement(sql, mSession);
         soci::statement& st = prep.statement();
         st.exchange(soci::use(strAccountIDs));
         st.exchange(soci::use(strIssuers));
@@ -379,26 +478,30 @@ class BulkDeleteTrustLinesOperation : public DatabaseTypeSpecificOperation<void>
 
 void
 LedgerTxnRoot::Impl::bulkUpsertTrustLines(
-    std::vector<EntryIterator> const& entries)
+    std::vector<EntryIterator> const& entries, soci::session& session)
 {
-    BulkUpsertTrustLinesOperation op(mDatabase, entries);
-    mDatabase.doDatabaseTypeSpecificOperation(op);
+    BulkUpsertTrustLinesOperation op(mDatabase, session, entries);
+    mDatabase.doDatabaseTypeSpecificOperation(op, session);
 }
 
 void
 LedgerTxnRoot::Impl::bulkDeleteTrustLines(
-    std::vector<EntryIterator> const& entries, LedgerTxnConsistency cons)
+    std::vector<EntryIterator> const& entries, LedgerTxnConsistency cons,
+    soci::session& session)
 {
-    BulkDeleteTrustLinesOperation op(mDatabase, cons, entries);
-    mDatabase.doDatabaseTypeSpecificOperation(op);
+    BulkDeleteTrustLinesOperation op(mDatabase, session, cons, entries);
+    mDatabase.doDatabaseTypeSpecificOperation(op, session);
 }
 
 void
 LedgerTxnRoot::Impl::dropTrustLines()
 {
     throwIfChild();
+    flushWrites();
     mEntryCache.clear();
     mBestOffersCache.clear();
+    discardKeyFilters();
+    discardLoadsAhead();
 
     std::string coll = mDatabase.getSimpleCollationClause();
 
@@ -424,6 +527,7 @@ class BulkLoadTrustLinesOperation
     : public DatabaseTypeSpecificOperation<std::vector<LedgerEntry>>
 {
     Database& mDb;
+    soci::session& mSession;
     std::vector<std::string> mAccountIDs;
     std::vector<std::string> mIssuers;
     std::vector<std::string> mAssetCodes;
@@ -496,9 +600,9 @@ class BulkLoadTrustLinesOperation
     }
 
   public:
-    BulkLoadTrustLinesOperation(Database& db,
+    BulkLoadTrustLinesOperation(Database& db, soci::session& session,
                                 std::unordered_set<LedgerKey> const& keys)
-        : mDb(db)
+        : mDb(db), mSession(session)
     {
         mAccountIDs.reserve(keys.size());
         mIssuers.reserve(keys.size());
@@ -562,7 +666,7 @@ class BulkLoadTrustLinesOperation
             "sellingliabilities "
             "FROM trustlines WHERE (accountid, issuer, assetcode) IN r";
 
-        auto prep = mDb.getPreparedStatement(sql);
+        auto prep = mDb.getPreparedStatement(sql, mSession);
         auto be = prep.statement().get_backend();
         if (be == nullptr)
         {
@@ -596,12 +700,13 @@ class BulkLoadTrustLinesOperation
         marshalToPGArray(pg->conn_, strIssuers, mIssuers);
         marshalToPGArray(pg->conn_, strAssetCodes, mAssetCodes);
 
-        auto prep = mDb.getPreparedStatement(
+        std::string sql =
             "WITH r AS (SELECT unnest(:v1::TEXT[]), unnest(:v2::TEXT[]), "
             "unnest(:v3::TEXT[])) SELECT accountid, assettype, assetcode, "
             "issuer, tlimit, balance, flags, lastmodified, buyingliabilities, "
             "sellingliabilities FROM trustlines "
-            "WHERE (accountid, issuer, assetcode) IN (SELECT * FROM r)");
+            "WHERE (accountid, issuer, assetcode) IN (SELECT * FROM r)";
+        auto prep = mDb.getPreparedStatement(sql, mSession);
         auto& st = prep.statement();
         st.exchange(soci::use(strAccountIDs));
         st.exchange(soci::use(strIssuers));
@@ -611,15 +716,15 @@ class BulkLoadTrustLinesOperation
 #endif
 };
 
-std::unordered_map<LedgerKey, std::shared_ptr<LedgerEntry const>>
+FlatHashMap<LedgerKey, std::shared_ptr<LedgerEntry const>>
 LedgerTxnRoot::Impl::bulkLoadTrustLines(
-    std::unordered_set<LedgerKey> const& keys) const
+    std::unordered_set<LedgerKey> const& keys, soci::session& session) const
 {
     if (!keys.empty())
     {
-        BulkLoadTrustLinesOperation op(mDatabase, keys);
+        BulkLoadTrustLinesOperation op(mDatabase, session, keys);
         return populateLoadedEntries(
-            keys, mDatabase.doDatabaseTypeSpecificOperation(op));
+            keys, mDatabase.doDatabaseTypeSpecificOperation(op, session));
     }
     else
     {
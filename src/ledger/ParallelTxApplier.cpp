@@ -0,0 +1,402 @@
+// Copyright 2020 Stellar Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "ledger/ParallelTxApplier.h"
+#include "crypto/Hex.h"
+#include "ledger/FootprintLedgerTxnParent.h"
+#include "ledger/LedgerTxn.h"
+#include "ledger/LedgerTxnEntry.h"
+#include "main/Application.h"
+#include "main/Config.h"
+#include "util/Logging.h"
+#include "util/XDROperators.h"
+
+#include "medida/counter.h"
+#include "medida/histogram.h"
+#include "medida/metrics_registry.h"
+#include "medida/timer.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <unordered_map>
+
+namespace stellar
+{
+
+ParallelTxApplier::ParallelTxApplier(Application& app)
+    : mApp(app)
+    , mTransactionApply(
+          app.getMetrics().NewTimer({"ledger", "transaction", "apply"}))
+    , mStageApply(
+          app.getMetrics().NewTimer({"ledger", "parallel-apply", "stage"}))
+    , mStageSize(app.getMetrics().NewHistogram(
+          {"ledger", "parallel-apply", "stage-size"}))
+    , mStageFallbackCount(app.getMetrics().NewCounter(
+          {"ledger", "parallel-apply", "stage-fallback"}))
+    , mSerialMismatchCount(app.getMetrics().NewCounter(
+          {"ledger", "parallel-apply", "serial-mismatch"}))
+{
+}
+
+ParallelTxApplier::~ParallelTxApplier()
+{
+    {
+        std::lock_guard<std::mutex> lock(mWorkersMutex);
+        mStopWorkers = true;
+    }
+    mWorkersCV.notify_all();
+    for (auto& worker : mWorkers)
+    {
+        worker.join();
+    }
+}
+
+void
+ParallelTxApplier::runWorker()
+{
+    std::unique_lock<std::mutex> lock(mWorkersMutex);
+    while (true)
+    {
+        mWorkersCV.wait(lock,
+                        [&]() { return mStopWorkers || mWorkersToStart > 0; });
+        if (mStopWorkers)
+        {
+            return;
+        }
+        --mWorkersToStart;
+        ++mWorkersRunning;
+        auto work = mStageWork;
+        lock.unlock();
+        (*work)();
+        lock.lock();
+        if (--mWorkersRunning == 0 && mWorkersToStart == 0)
+        {
+            mStageDoneCV.notify_one();
+        }
+    }
+}
+
+void
+ParallelTxApplier::runOnWorkers(std::function<void()> const& work,
+                                size_t numWorkers)
+{
+    if (mWorkers.empty())
+    {
+        auto numThreads = mApp.getConfig().PARALLEL_TX_APPLY_THREADS;
+        mWorkers.reserve(numThreads);
+        for (size_t t = 0; t < numThreads; ++t)
+        {
+            mWorkers.emplace_back([this]() { runWorker(); });
+        }
+    }
+    numWorkers = std::min(numWorkers, mWorkers.size());
+
+    std::unique_lock<std::mutex> lock(mWorkersMutex);
+    mStageWork = &work;
+    mWorkersToStart = numWorkers;
+    mWorkersCV.notify_all();
+    mStageDoneCV.wait(lock, [&]() {
+        return mWorkersToStart == 0 && mWorkersRunning == 0;
+    });
+    mStageWork = nullptr;
+}
+
+std::vector<TxApplyStage>
+ParallelTxApplier::schedule(
+    std::vector<TransactionFramePtr> const& txs,
+    std::vector<std::unordered_set<LedgerKey>>& footprints)
+{
+    std::vector<TxApplyStage> stages;
+    footprints.clear();
+    footprints.resize(txs.size());
+
+    // Stage of the last transaction that touched each key, and the first stage
+    // that may still receive transactions (everything before the most recent
+    // barrier is closed)
+    std::unordered_map<LedgerKey, size_t> lastStage;
+    size_t firstOpenStage = 0;
+
+    for (size_t i = 0; i < txs.size(); ++i)
+    {
+        auto& footprint = footprints[i];
+        if (!txs[i]->insertLedgerKeysToFootprint(footprint))
+        {
+            footprint.clear();
+            stages.emplace_back();
+            stages.back().mTxIndexes.emplace_back(i);
+            stages.back().mIsBarrier = true;
+            firstOpenStage = stages.size();
+            continue;
+        }
+
+        size_t stage = firstOpenStage;
+        for (auto const& key : footprint)
+        {
+            auto iter = lastStage.find(key);
+            if (iter != lastStage.end())
+            {
+                stage = std::max(stage, iter->second + 1);
+            }
+        }
+
+        if (stage == stages.size())
+        {
+            stages.emplace_back();
+        }
+        stages[stage].mTxIndexes.emplace_back(i);
+        for (auto const& key : footprint)
+        {
+            lastStage[key] = stage;
+        }
+    }
+    return stages;
+}
+
+static void
+mergeEntry(AbstractLedgerTxn& ltx, LedgerKey const& key,
+           std::shared_ptr<LedgerEntry const> const& entry)
+{
+    bool exists = static_cast<bool>(ltx.getNewestVersion(key));
+    if (entry)
+    {
+        if (exists)
+        {
+            ltx.load(key).current() = *entry;
+        }
+        else
+        {
+            ltx.create(*entry);
+        }
+    }
+    else if (exists)
+    {
+        ltx.erase(key);
+    }
+}
+
+bool
+ParallelTxApplier::applyStageInParallel(
+    TxApplyStage const& stage, std::vector<TransactionFramePtr> const& txs,
+    std::vector<std::unordered_set<LedgerKey>> const& footprints,
+    AbstractLedgerTxn& ltx, std::vector<TransactionMeta>& metas,
+    TxApplyFn const& applyTx, bool discarded)
+{
+    auto timer = mStageApply.TimeScope();
+    auto const& indexes = stage.mTxIndexes;
+    mStageSize.Update(static_cast<int64_t>(indexes.size()));
+
+    // Everything the workers may read is materialized up front, on this
+    // thread, so that the LedgerTxn stack is never accessed concurrently
+    LedgerHeader const header = ltx.getHeader();
+    FootprintLedgerTxnParent::Snapshot snapshot;
+    for (auto i : indexes)
+    {
+        for (auto const& key : footprints[i])
+        {
+            snapshot.emplace(key, ltx.getNewestVersion(key));
+        }
+    }
+
+    std::vector<TransactionResult> initialResults;
+    std::vector<std::unique_ptr<FootprintLedgerTxnParent>> parents;
+    initialResults.reserve(indexes.size());
+    parents.reserve(indexes.size());
+    for (auto i : indexes)
+    {
+        initialResults.emplace_back(txs[i]->getResult());
+        parents.emplace_back(std::make_unique<FootprintLedgerTxnParent>(
+            snapshot, footprints[i], header));
+    }
+
+    std::vector<char> failed(indexes.size(), 0);
+    std::vector<std::chrono::nanoseconds> applyTimes(indexes.size());
+    std::atomic<size_t> next{0};
+    std::function<void()> worker = [&]() {
+        for (size_t k = next++; k < indexes.size(); k = next++)
+        {
+            auto i = indexes[k];
+            try
+            {
+                auto start = std::chrono::steady_clock::now();
+                LedgerTxn ltxTx(*parents[k]);
+                applyTx(i, ltxTx, TxApplyMode::IN_STAGE);
+                ltxTx.commit();
+                applyTimes[k] = std::chrono::steady_clock::now() - start;
+            }
+            catch (...)
+            {
+                // The serial fallback reports (or rethrows) whatever
+                // happened here
+                failed[k] = 1;
+            }
+        }
+    };
+
+    runOnWorkers(worker, indexes.size());
+
+    for (size_t k = 0; k < indexes.size(); ++k)
+    {
+        if (failed[k] || parents[k]->hasEscaped())
+        {
+            CLOG(DEBUG, "Ledger")
+                << "Parallel apply of tx "
+                << hexAbbrev(txs[indexes[k]]->getFullHash())
+                << " failed, applying stage of " << indexes.size()
+                << " txs serially";
+            for (size_t j = 0; j < indexes.size(); ++j)
+            {
+                auto i = indexes[j];
+                txs[i]->restoreResult(initialResults[j]);
+                metas[i] = TransactionMeta(metas[i].v());
+            }
+            return false;
+        }
+    }
+
+    for (auto const& parent : parents)
+    {
+        for (auto const& kv : parent->getDelta())
+        {
+            mergeEntry(ltx, kv.first, kv.second);
+        }
+    }
+    if (!discarded)
+    {
+        for (auto const& applyTime : applyTimes)
+        {
+            mTransactionApply.Update(applyTime);
+        }
+    }
+    return true;
+}
+
+void
+ParallelTxApplier::apply(std::vector<TransactionFramePtr> const& txs,
+                         AbstractLedgerTxn& ltx,
+                         std::vector<TransactionMeta>& metas,
+                         TxApplyFn const& applyTx)
+{
+    applyStages(txs, ltx, metas, applyTx, false);
+}
+
+void
+ParallelTxApplier::applyStages(std::vector<TransactionFramePtr> const& txs,
+                               AbstractLedgerTxn& ltx,
+                               std::vector<TransactionMeta>& metas,
+                               TxApplyFn const& applyTx, bool discarded)
+{
+    std::vector<std::unordered_set<LedgerKey>> footprints;
+    auto stages = schedule(txs, footprints);
+
+    for (auto const& stage : stages)
+    {
+        if (stage.mIsBarrier || stage.mTxIndexes.size() == 1 ||
+            !applyStageInParallel(stage, txs, footprints, ltx, metas,
+                                  applyTx, discarded))
+        {
+            if (!stage.mIsBarrier && stage.mTxIndexes.size() > 1)
+            {
+                mStageFallbackCount.inc();
+            }
+            for (auto i : stage.mTxIndexes)
+            {
+                applyTx(i, ltx,
+                        discarded ? TxApplyMode::DISCARDED
+                                  : TxApplyMode::SERIAL);
+            }
+        }
+    }
+}
+
+static bool
+deltaEntriesMatch(LedgerTxnDelta const& lhs, LedgerTxnDelta const& rhs)
+{
+    if (lhs.entry.size() != rhs.entry.size())
+    {
+        return false;
+    }
+    for (auto const& kv : lhs.entry)
+    {
+        auto iter = rhs.entry.find(kv.first);
+        if (iter == rhs.entry.end())
+        {
+            return false;
+        }
+        auto const& a = kv.second.current;
+        auto const& b = iter->second.current;
+        if (static_cast<bool>(a) != static_cast<bool>(b) || (a && !(*a == *b)))
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+void
+ParallelTxApplier::applyAndCompareWithSerial(
+    std::vector<TransactionFramePtr> const& txs, AbstractLedgerTxn& ltx,
+    std::vector<TransactionMeta>& metas, TxApplyFn const& applyTx)
+{
+    std::vector<TransactionResult> initialResults;
+    initialResults.reserve(txs.size());
+    for (auto const& tx : txs)
+    {
+        initialResults.emplace_back(tx->getResult());
+    }
+
+    std::vector<TransactionResultPair> parallelResults;
+    std::vector<TransactionMeta> parallelMetas;
+    LedgerTxnDelta parallelDelta;
+    {
+        LedgerTxn ltxParallel(ltx);
+        applyStages(txs, ltxParallel, metas, applyTx, true);
+        parallelDelta = ltxParallel.getDelta();
+    }
+    parallelResults.reserve(txs.size());
+    parallelMetas.reserve(txs.size());
+    for (size_t i = 0; i < txs.size(); ++i)
+    {
+        parallelResults.emplace_back(txs[i]->getResultPair());
+        parallelMetas.emplace_back(metas[i]);
+        txs[i]->restoreResult(initialResults[i]);
+        metas[i] = TransactionMeta(metas[i].v());
+    }
+
+    LedgerTxnDelta serialDelta;
+    {
+        LedgerTxn ltxSerial(ltx);
+        for (size_t i = 0; i < txs.size(); ++i)
+        {
+            applyTx(i, ltxSerial, TxApplyMode::SERIAL);
+        }
+        serialDelta = ltxSerial.getDelta();
+        ltxSerial.commit();
+    }
+
+    bool match = deltaEntriesMatch(parallelDelta, serialDelta);
+    if (!match)
+    {
+        CLOG(ERROR, "Ledger") << "Parallel apply of ledger "
+                              << ltx.getHeader().ledgerSeq
+                              << " produced different ledger changes";
+    }
+    for (size_t i = 0; i < txs.size(); ++i)
+    {
+        if (!(parallelResults[i] == txs[i]->getResultPair()) ||
+            !(parallelMetas[i] == metas[i]))
+        {
+            CLOG(ERROR, "Ledger")
+                << "Parallel apply of tx " << hexAbbrev(txs[i]->getFullHash())
+                << " produced a different result or meta";
+            match = false;
+        }
+    }
+    if (!match)
+    {
+        mSerialMismatchCount.inc();
+    }
+}
+}
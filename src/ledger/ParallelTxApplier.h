@@ -0,0 +1,146 @@
+#pragma once
+
+// Copyright 2020 Stellar Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "ledger/LedgerHashUtils.h"
+#include "transactions/TransactionFrame.h"
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <unordered_set>
+#include <vector>
+
+namespace medida
+{
+class Counter;
+class Histogram;
+class Timer;
+}
+
+namespace stellar
+{
+class AbstractLedgerTxn;
+class Application;
+
+// A group of transactions, identified by their index in apply order, that can
+// be applied concurrently. A barrier stage holds a single transaction whose
+// footprint is unknown and which must be applied on its own.
+struct TxApplyStage
+{
+    std::vector<size_t> mTxIndexes;
+    bool mIsBarrier{false};
+};
+
+// Applies the transactions of a ledger on several threads, while producing
+// exactly the same results, meta and ledger changes as applying them one after
+// the other.
+//
+// Transactions are scheduled into stages using the ledger keys they can touch
+// (see TransactionFrame::insertLedgerKeysToFootprint): two transactions in the
+// same stage never share a key, and a transaction is always in a later stage
+// than every earlier transaction it shares a key with. A transaction without a
+// known footprint is a barrier and is applied alone, after everything before
+// it and before everything after it.
+//
+// Each transaction of a stage is applied on a worker thread against a
+// FootprintLedgerTxnParent holding a snapshot of its footprint, and the
+// resulting entries are merged into the LedgerTxn in transaction order once
+// the whole stage is done. If any transaction of a stage escapes its footprint
+// or throws, the stage is discarded and applied serially instead.
+//
+// The PARALLEL_TX_APPLY_THREADS worker threads are started on the first
+// parallel stage and kept until the applier is destroyed, so that a ledger of
+// many small stages does not pay for starting and joining threads each time.
+class ParallelTxApplier
+{
+  public:
+    // How a transaction is applied:
+    //  - SERIAL on the calling thread, with the outcome kept;
+    //  - IN_STAGE on a worker thread, as part of a parallel stage that is
+    //    discarded and applied serially if any of its transactions fails, so
+    //    failures must be let through for the serial apply to report them;
+    //  - DISCARDED on the calling thread, as part of an apply that is rolled
+    //    back once compared with serial apply.
+    // Only SERIAL applies may be counted in per-transaction metrics, since
+    // every transaction is applied SERIAL once more whenever its other
+    // applies are discarded. The time of IN_STAGE applies is recorded here,
+    // once their stage is kept.
+    enum class TxApplyMode
+    {
+        SERIAL,
+        IN_STAGE,
+        DISCARDED
+    };
+
+    // Applies the transaction with the given index on top of the given
+    // LedgerTxn, recording its meta.
+    typedef std::function<void(size_t index, AbstractLedgerTxn& ltx,
+                               TxApplyMode mode)>
+        TxApplyFn;
+
+  private:
+    Application& mApp;
+    medida::Timer& mTransactionApply;
+    medida::Timer& mStageApply;
+    medida::Histogram& mStageSize;
+    medida::Counter& mStageFallbackCount;
+    medida::Counter& mSerialMismatchCount;
+
+    // mStageWork is run once by each of mWorkersToStart workers, and the
+    // stage is done once no worker is left to start or still running it
+    std::vector<std::thread> mWorkers;
+    std::mutex mWorkersMutex;
+    std::condition_variable mWorkersCV;
+    std::condition_variable mStageDoneCV;
+    std::function<void()> const* mStageWork{nullptr};
+    size_t mWorkersToStart{0};
+    size_t mWorkersRunning{0};
+    bool mStopWorkers{false};
+
+    void runWorker();
+
+    // Runs work on numWorkers workers at once and waits for all of them to
+    // return; work must not throw
+    void runOnWorkers(std::function<void()> const& work, size_t numWorkers);
+
+    bool applyStageInParallel(
+        TxApplyStage const& stage, std::vector<TransactionFramePtr> const& txs,
+        std::vector<std::unordered_set<LedgerKey>> const& footprints,
+        AbstractLedgerTxn& ltx, std::vector<TransactionMeta>& metas,
+        TxApplyFn const& applyTx, bool discarded);
+
+    void applyStages(std::vector<TransactionFramePtr> const& txs,
+                     AbstractLedgerTxn& ltx,
+                     std::vector<TransactionMeta>& metas,
+                     TxApplyFn const& applyTx, bool discarded);
+
+  public:
+    ParallelTxApplier(Application& app);
+    ~ParallelTxApplier();
+
+    // Computes the footprint of every transaction and partitions the
+    // transactions into stages as described above. Stages are returned in the
+    // order they must be applied, and each stage lists its transactions in
+    // increasing index order.
+    static std::vector<TxApplyStage>
+    schedule(std::vector<TransactionFramePtr> const& txs,
+             std::vector<std::unordered_set<LedgerKey>>& footprints);
+
+    // Applies txs to ltx with applyTx; metas must hold one freshly
+    // constructed TransactionMeta per transaction, which applyTx fills.
+    void apply(std::vector<TransactionFramePtr> const& txs,
+               AbstractLedgerTxn& ltx, std::vector<TransactionMeta>& metas,
+               TxApplyFn const& applyTx);
+
+    // Applies txs in parallel on a nested LedgerTxn that is then rolled back,
+    // followed by serially on ltx, and logs any difference in results, meta
+    // or ledger changes between the two. Only the serial apply is kept.
+    void applyAndCompareWithSerial(std::vector<TransactionFramePtr> const& txs,
+                                   AbstractLedgerTxn& ltx,
+                                   std::vector<TransactionMeta>& metas,
+                                   TxApplyFn const& applyTx);
+};
+}
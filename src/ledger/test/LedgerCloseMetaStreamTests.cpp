@@ -6,6 +6,7 @@
 #include "crypto/Random.h"
 #include "history/HistoryArchiveManager.h"
 #include "history/test/HistoryTestsUtils.h"
+#include "ledger/LedgerCloseMetaStream.h"
 #include "lib/catch.hpp"
 #include "main/Application.h"
 #include "main/ApplicationUtils.h"
@@ -15,8 +16,12 @@
 #include "util/Logging.h"
 #include "util/format.h"
 #include "xdr/Stellar-ledger.h"
+#include <algorithm>
 #include <fstream>
 
+#include "medida/counter.h"
+#include "medida/metrics_registry.h"
+
 using namespace stellar;
 
 TEST_CASE("LedgerCloseMetaStream file descriptor - LIVE_NODE",
@@ -192,3 +197,92 @@ TEST_CASE("LedgerCloseMetaStream file descriptor - REPLAY_IN_MEMORY",
     REQUIRE(nLcm == 0x13f);
     REQUIRE(lcm.v0().ledgerHeader.hash == hash);
 }
+
+TEST_CASE("LedgerCloseMetaStream backpressure", "[ledgerclosemetastream]")
+{
+    VirtualClock clock;
+    auto cfg = getTestConfig();
+    cfg.METADATA_OUTPUT_QUEUE_SIZE = 1;
+
+    TmpDirManager tdm(std::string("streamtmp-") + binToHex(randomBytes(8)));
+    TmpDir td = tdm.tmpDir("streams");
+    std::string path = td.getName() + "/stream.xdr";
+
+    uint32_t const nLedgers = 100;
+    auto streamLedgers = [&](Application& app) {
+        auto out =
+            std::make_unique<XDROutputFileStream>(/*fsyncOnClose=*/false);
+        out->open(path);
+        LedgerCloseMetaStream metaStream(app, std::move(out));
+        for (uint32_t seq = 1; seq <= nLedgers; ++seq)
+        {
+            LedgerCloseMeta lcm;
+            lcm.v0().ledgerHeader.header.ledgerSeq = seq;
+            metaStream.write(std::move(lcm));
+        }
+    };
+    auto readLedgers = [&]() {
+        std::vector<uint32_t> res;
+        XDRInputFileStream stream;
+        stream.open(path);
+        LedgerCloseMeta lcm;
+        while (stream && stream.readOne(lcm))
+        {
+            res.emplace_back(lcm.v0().ledgerHeader.header.ledgerSeq);
+        }
+        return res;
+    };
+    auto allLedgers = [&]() {
+        std::vector<uint32_t> res;
+        for (uint32_t seq = 1; seq <= nLedgers; ++seq)
+        {
+            res.emplace_back(seq);
+        }
+        return res;
+    };
+
+    SECTION("block")
+    {
+        cfg.METADATA_OUTPUT_BACKPRESSURE = "BLOCK";
+        auto app = createTestApplication(clock, cfg);
+        streamLedgers(*app);
+        REQUIRE(readLedgers() == allLedgers());
+    }
+
+    SECTION("block streams each ledger before returning")
+    {
+        cfg.METADATA_OUTPUT_BACKPRESSURE = "BLOCK";
+        auto app = createTestApplication(clock, cfg);
+        auto out =
+            std::make_unique<XDROutputFileStream>(/*fsyncOnClose=*/false);
+        out->open(path);
+        LedgerCloseMetaStream metaStream(*app, std::move(out));
+        for (uint32_t seq = 1; seq <= 10; ++seq)
+        {
+            LedgerCloseMeta lcm;
+            lcm.v0().ledgerHeader.header.ledgerSeq = seq;
+            metaStream.write(std::move(lcm));
+            REQUIRE(readLedgers().size() == seq);
+        }
+    }
+
+    SECTION("drop")
+    {
+        cfg.METADATA_OUTPUT_BACKPRESSURE = "DROP";
+        auto app = createTestApplication(clock, cfg);
+        streamLedgers(*app);
+        auto ledgers = readLedgers();
+        REQUIRE(std::is_sorted(ledgers.begin(), ledgers.end()));
+        auto& dropped = app->getMetrics().NewCounter(
+            {"ledger", "metastream", "dropped"});
+        REQUIRE(ledgers.size() + dropped.count() == nLedgers);
+    }
+
+    SECTION("spill")
+    {
+        cfg.METADATA_OUTPUT_BACKPRESSURE = "SPILL";
+        auto app = createTestApplication(clock, cfg);
+        streamLedgers(*app);
+        REQUIRE(readLedgers() == allLedgers());
+    }
+}
@@ -4,9 +4,17 @@
 
 #include "ledger/LedgerManager.h"
 #include "ledger/LedgerTxn.h"
+#include "ledger/LedgerTxnEntry.h"
 #include "main/Application.h"
+#include "main/PersistentState.h"
+#include "test/TestAccount.h"
+#include "test/TestUtils.h"
+#include "test/TxTests.h"
 #include "test/test.h"
+#include "transactions/TransactionUtils.h"
 
+#include "medida/metrics_registry.h"
+#include "medida/timer.h"
 #include <lib/catch.hpp>
 
 using namespace stellar;
@@ -43,3 +51,87 @@ TEST_CASE("cannot close ledger with unsupported ledger version", "[ledger]")
     }
     REQUIRE_THROWS_AS(applyEmptyLedger(), std::runtime_error);
 }
+
+TEST_CASE("transaction history is inserted once per ledger", "[ledger]")
+{
+    VirtualClock clock;
+    auto app = createTestApplication(clock, getTestConfig(0));
+    app->start();
+
+    auto root = txtest::TestAccount::createRoot(*app);
+    auto balance = app->getLedgerManager().getLastMinBalance(0) * 100;
+    std::vector<TransactionFramePtr> txs;
+    for (auto name : {"a", "b", "c"})
+    {
+        txs.emplace_back(root.tx({txtest::createAccount(
+            txtest::getAccount(name).getPublicKey(), balance)}));
+    }
+
+    auto& metrics = app->getMetrics();
+    auto& txInserts = metrics.NewTimer({"database", "insert", "txhistory"});
+    auto& feeInserts = metrics.NewTimer({"database", "insert", "txfeehistory"});
+    auto txInsertsBefore = txInserts.count();
+    auto feeInsertsBefore = feeInserts.count();
+
+    auto results = txtest::closeLedgerOn(*app, 2, 1, 1, 2020, txs);
+    REQUIRE(results.size() == txs.size());
+    for (auto const& result : results)
+    {
+        REQUIRE(result.first.result.result.code() == txSUCCESS);
+        REQUIRE(!result.second.empty());
+    }
+    REQUIRE(txInserts.count() == txInsertsBefore + 1);
+    REQUIRE(feeInserts.count() == feeInsertsBefore + 1);
+}
+
+TEST_CASE("ledger entries left unwritten by a crash are restored", "[ledger]")
+{
+    // On-disk, so that the database survives the restart
+    auto cfg = getTestConfig(0, Config::TESTDB_ON_DISK_SQLITE);
+    auto x = txtest::getAccount("x");
+    PublicKey rootKey;
+    {
+        VirtualClock clock;
+        auto app = createTestApplication(clock, cfg);
+        app->start();
+        auto root = TestAccount::createRoot(*app);
+        rootKey = root.getPublicKey();
+
+        auto balance = app->getLedgerManager().getLastMinBalance(0) * 10;
+        txtest::closeLedgerOn(
+            *app, 2, 1, 1, 2020,
+            {root.tx({txtest::createAccount(x.getPublicKey(), balance)})});
+        LedgerEntry created;
+        {
+            LedgerTxn ltx(app->getLedgerTxnRoot());
+            created = ltx.load(accountKey(x.getPublicKey())).current();
+        }
+        TestAccount acc(*app, x);
+        txtest::closeLedgerOn(*app, 3, 2, 1, 2020,
+                              {acc.tx({txtest::accountMerge(root)})});
+
+        // Merging the levels annihilates the INIT entry of x with its DEAD
+        // entry, so that no tombstone of x is left in the bucket list
+        for (uint32_t seq = 4; seq <= 30; ++seq)
+        {
+            txtest::closeLedgerOn(*app, seq, seq - 1, 1, 2020);
+        }
+
+        // Stop as if the writer had crashed after writing the entries of
+        // ledger 2, when x was created, and before erasing x
+        {
+            LedgerTxn ltx(app->getLedgerTxnRoot(), false);
+            ltx.createOrUpdateWithoutLoading(created);
+            ltx.commit();
+        }
+        app->getPersistentState().setState(
+            PersistentState::kLastWrittenLedger, "2");
+    }
+
+    VirtualClock clock;
+    auto app = createTestApplication(clock, cfg, /*newDB=*/false);
+    app->start();
+    LedgerTxn ltx(app->getLedgerTxnRoot());
+    REQUIRE(!ltx.load(accountKey(x.getPublicKey())));
+    REQUIRE(ltx.load(accountKey(rootKey)));
+}
@@ -2,23 +2,32 @@
 // under the Apache License, Version 2.0. See the COPYING file at the root
 // of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
 
+#include "bucket/LedgerCmp.h"
+#include "ledger/InMemoryLedgerTxnRoot.h"
 #include "ledger/LedgerTxn.h"
 #include "ledger/LedgerTxnEntry.h"
 #include "ledger/LedgerTxnHeader.h"
 #include "ledger/test/LedgerTestUtils.h"
 #include "lib/catch.hpp"
 #include "main/Application.h"
+#include "main/PersistentState.h"
+#include "medida/metrics_registry.h"
+#include "medida/timer.h"
+#include "test/AllocationCounter.h"
 #include "test/TestUtils.h"
 #include "test/test.h"
 #include "transactions/TransactionUtils.h"
 #include "util/Math.h"
 #include "util/XDROperators.h"
 #include <algorithm>
+#include <chrono>
 #include <functional>
 #include <map>
 #include <memory>
+#include <numeric>
 #include <queue>
 #include <set>
+#include <thread>
 #include <xdrpp/autocheck.h>
 
 using namespace stellar;
@@ -410,6 +419,18 @@ TEST_CASE("LedgerTxn round trip", "[ledgertxn]")
             auto cfg = getTestConfig();
             cfg.ENTRY_CACHE_SIZE = 0;
             cfg.BEST_OFFERS_CACHE_SIZE = 0;
+            cfg.IN_MEMORY_ORDER_BOOK = false;
+            auto app = createTestApplication(clock, cfg);
+            app->start();
+
+            runTest(app->getLedgerTxnRoot());
+        }
+
+        SECTION("with the in-memory order book")
+        {
+            VirtualClock clock;
+            auto cfg = getTestConfig();
+            cfg.IN_MEMORY_ORDER_BOOK = true;
             auto app = createTestApplication(clock, cfg);
             app->start();
 
@@ -827,6 +848,18 @@ testInflationWinners(
         auto cfg = getTestConfig();
         cfg.ENTRY_CACHE_SIZE = 0;
         cfg.BEST_OFFERS_CACHE_SIZE = 0;
+        cfg.IN_MEMORY_ORDER_BOOK = false;
+        auto app = createTestApplication(clock, cfg);
+        app->start();
+        testAtRoot(*app);
+    }
+
+    // first changes are in LedgerTxnRoot with the in-memory order book
+    if (updates.size() > 1)
+    {
+        VirtualClock clock;
+        auto cfg = getTestConfig();
+        cfg.IN_MEMORY_ORDER_BOOK = true;
         auto app = createTestApplication(clock, cfg);
         app->start();
         testAtRoot(*app);
@@ -1125,6 +1158,95 @@ TEST_CASE("LedgerTxn queryInflationWinners", "[ledgertxn]")
     }
 }
 
+TEST_CASE("LedgerTxnRoot inflation tally follows commits", "[ledgertxn]")
+{
+    int64_t const QUERY_VOTE_MINIMUM = 1000000000;
+
+    VirtualClock clock;
+    auto app = createTestApplication(clock, getTestConfig());
+    app->start();
+    auto& root = app->getLedgerTxnRoot();
+
+    std::vector<AccountID> voters, dests;
+    for (size_t i = 0; i < 20; ++i)
+    {
+        voters.emplace_back(
+            LedgerTestUtils::generateValidAccountEntry().accountID);
+    }
+    for (size_t i = 0; i < 4; ++i)
+    {
+        dests.emplace_back(
+            LedgerTestUtils::generateValidAccountEntry().accountID);
+    }
+
+    // The first query loads the tally, which every later commit updates
+    std::map<AccountID, std::pair<AccountID, int64_t>> state;
+    for (size_t round = 0; round < 10; ++round)
+    {
+        std::map<AccountID, std::pair<AccountID, int64_t>> updates;
+        for (auto const& voter : voters)
+        {
+            if (rand_flip())
+            {
+                continue;
+            }
+            // Erase some existing voters, and give others balances on
+            // either side of the minimum to vote
+            int64_t balance =
+                (state.count(voter) && rand_uniform(0, 3) == 0)
+                    ? 0
+                    : rand_uniform<int64_t>(QUERY_VOTE_MINIMUM / 2,
+                                            3 * QUERY_VOTE_MINIMUM);
+            updates[voter] = {rand_element(dests), balance};
+        }
+        {
+            LedgerTxn ltx(root);
+            applyLedgerTxnUpdates(ltx, updates);
+            ltx.commit();
+        }
+        for (auto const& kv : updates)
+        {
+            if (kv.second.second > 0)
+            {
+                state[kv.first] = kv.second;
+            }
+            else
+            {
+                state.erase(kv.first);
+            }
+        }
+
+        std::map<AccountID, int64_t> totals;
+        for (auto const& kv : state)
+        {
+            if (kv.second.second >= QUERY_VOTE_MINIMUM)
+            {
+                totals[kv.second.first] += kv.second.second;
+            }
+        }
+        std::vector<std::tuple<AccountID, int64_t>> expected(totals.begin(),
+                                                             totals.end());
+        std::sort(expected.begin(), expected.end(),
+                  [](auto const& lhs, auto const& rhs) {
+                      if (std::get<1>(lhs) == std::get<1>(rhs))
+                      {
+                          return KeyUtils::toStrKey(std::get<0>(lhs)) >
+                                 KeyUtils::toStrKey(std::get<0>(rhs));
+                      }
+                      return std::get<1>(lhs) > std::get<1>(rhs);
+                  });
+
+        LedgerTxn ltx(root);
+        auto winners = ltx.queryInflationWinners(dests.size(), 1);
+        REQUIRE(winners.size() == expected.size());
+        for (size_t i = 0; i < winners.size(); ++i)
+        {
+            REQUIRE(std::make_tuple(winners[i].accountID, winners[i].votes) ==
+                    expected[i]);
+        }
+    }
+}
+
 TEST_CASE("LedgerTxn loadHeader", "[ledgertxn]")
 {
     VirtualClock clock;
@@ -1222,6 +1344,75 @@ TEST_CASE("LedgerTxn load", "[ledgertxn]")
         REQUIRE(!ltx3.load(key));
         validate(ltx3, {});
     }
+
+    SECTION("shares the entry of the parent until it is modified")
+    {
+        LedgerTxn ltx1(app->getLedgerTxnRoot());
+        REQUIRE(ltx1.create(le));
+        auto parentEntry = ltx1.getNewestVersion(key);
+        auto le2 = generateLedgerEntryWithSameKey(le);
+
+        SECTION("rollback")
+        {
+            LedgerTxn ltx2(ltx1);
+            auto const ltxe = ltx2.load(key);
+            REQUIRE(&ltxe.current() == parentEntry.get());
+        }
+
+        SECTION("modify then rollback")
+        {
+            LedgerTxn ltx2(ltx1);
+            auto ltxe = ltx2.load(key);
+            ltxe.current() = le2;
+            REQUIRE(&ltxe.current() != parentEntry.get());
+            REQUIRE(*ltx2.getNewestVersion(key) == le2);
+        }
+
+        SECTION("modify then commit")
+        {
+            LedgerTxn ltx2(ltx1);
+            auto ltxe = ltx2.load(key);
+            ltxe.current() = le2;
+            ltxe.deactivate();
+            ltx2.commit();
+            REQUIRE(*ltx1.getNewestVersion(key) == le2);
+        }
+
+        REQUIRE(*parentEntry == le);
+    }
+
+    SECTION("allocates a copy of the entry only once it is modified")
+    {
+        // The name and value of this data entry live on the heap, so copying
+        // it allocates even when the copy itself is allocated from an arena
+        LedgerEntry data;
+        data.lastModifiedLedgerSeq = 1;
+        data.data.type(DATA);
+        data.data.data() = LedgerTestUtils::generateValidDataEntry();
+        data.data.data().dataName = std::string(64, 'a');
+        data.data.data().dataValue.assign(64, 1);
+        auto dataKey = LedgerEntryKey(data);
+
+        LedgerTxn ltx1(app->getLedgerTxnRoot());
+        REQUIRE(ltx1.create(data));
+        auto countAccess = [&](bool modify) {
+            LedgerTxn ltx2(ltx1);
+            auto ltxe = ltx2.load(dataKey);
+            auto const& readOnly = ltxe;
+            AllocationCounter counter;
+            if (modify)
+            {
+                ++ltxe.current().lastModifiedLedgerSeq;
+            }
+            else
+            {
+                readOnly.current();
+            }
+            return counter.getCount();
+        };
+        REQUIRE(countAccess(false) == 0);
+        REQUIRE(countAccess(true) > 0);
+    }
 }
 
 TEST_CASE("LedgerTxn loadWithoutRecord", "[ledgertxn]")
@@ -1403,6 +1594,18 @@ testAllOffers(
         auto cfg = getTestConfig();
         cfg.ENTRY_CACHE_SIZE = 0;
         cfg.BEST_OFFERS_CACHE_SIZE = 0;
+        cfg.IN_MEMORY_ORDER_BOOK = false;
+        auto app = createTestApplication(clock, cfg);
+        app->start();
+        testAtRoot(*app);
+    }
+
+    // first changes are in LedgerTxnRoot with the in-memory order book
+    if (updates.size() > 1)
+    {
+        VirtualClock clock;
+        auto cfg = getTestConfig();
+        cfg.IN_MEMORY_ORDER_BOOK = true;
         auto app = createTestApplication(clock, cfg);
         app->start();
         testAtRoot(*app);
@@ -1655,6 +1858,18 @@ testBestOffer(
         auto cfg = getTestConfig();
         cfg.ENTRY_CACHE_SIZE = 0;
         cfg.BEST_OFFERS_CACHE_SIZE = 0;
+        cfg.IN_MEMORY_ORDER_BOOK = false;
+        auto app = createTestApplication(clock, cfg);
+        app->start();
+        testAtRoot(*app);
+    }
+
+    // first changes are in LedgerTxnRoot with the in-memory order book
+    if (updates.size() > 1)
+    {
+        VirtualClock clock;
+        auto cfg = getTestConfig();
+        cfg.IN_MEMORY_ORDER_BOOK = true;
         auto app = createTestApplication(clock, cfg);
         app->start();
         testAtRoot(*app);
@@ -1838,6 +2053,137 @@ TEST_CASE("LedgerTxn loadBestOffer", "[ledgertxn]")
     }
 }
 
+TEST_CASE("LedgerTxnRoot in-memory order book follows commits",
+          "[ledgertxn]")
+{
+    VirtualClock clock;
+    auto cfg = getTestConfig();
+    cfg.IN_MEMORY_ORDER_BOOK = true;
+    auto app = createTestApplication(clock, cfg);
+    app->start();
+
+    // Both roots share the database, only one of them keeps an order book
+    auto& root = app->getLedgerTxnRoot();
+    LedgerTxnRoot sqlRoot(app->getDatabase(), 0, 0, 0, 1, false);
+
+    Asset buying = LedgerTestUtils::generateValidOfferEntry().buying;
+    Asset selling = LedgerTestUtils::generateValidOfferEntry().selling;
+    REQUIRE(!(buying == selling));
+    REQUIRE(buying.type() != ASSET_TYPE_NATIVE);
+    REQUIRE(selling.type() != ASSET_TYPE_NATIVE);
+
+    std::vector<AccountID> sellers;
+    for (size_t i = 0; i < 3; ++i)
+    {
+        sellers.emplace_back(
+            LedgerTestUtils::generateValidAccountEntry().accountID);
+    }
+
+    auto check = [&]() {
+        REQUIRE(root.getAllOffers() == sqlRoot.getAllOffers());
+
+        for (auto const& seller : sellers)
+        {
+            for (auto const& asset : {buying, selling})
+            {
+                REQUIRE(root.getOffersByAccountAndAsset(seller, asset) ==
+                        sqlRoot.getOffersByAccountAndAsset(seller, asset));
+            }
+        }
+
+        auto expected = sqlRoot.getBestOffer(buying, selling);
+        auto actual = root.getBestOffer(buying, selling);
+        while (expected)
+        {
+            REQUIRE(actual);
+            REQUIRE(*actual == *expected);
+            auto const& oe = expected->data.offer();
+            OfferDescriptor worseThan{oe.price, oe.offerID};
+            expected = sqlRoot.getBestOffer(buying, selling, worseThan);
+            actual = root.getBestOffer(buying, selling, worseThan);
+        }
+        REQUIRE(!actual);
+    };
+
+    // Loads the (empty) order book before anything is committed
+    check();
+
+    std::vector<LedgerKey> keys;
+    {
+        LedgerTxn ltx(root);
+        for (int64_t i = 1; i <= 20; ++i)
+        {
+            LedgerEntry le;
+            le.lastModifiedLedgerSeq = 1;
+            le.data.type(OFFER);
+            auto& oe = le.data.offer();
+            oe = LedgerTestUtils::generateValidOfferEntry();
+            oe.offerID = i;
+            oe.sellerID = sellers[i % sellers.size()];
+            oe.buying = buying;
+            oe.selling = selling;
+            oe.price = Price{static_cast<int32_t>(i % 7 + 1), 3};
+            keys.emplace_back(LedgerEntryKey(le));
+            ltx.create(le);
+        }
+        ltx.commit();
+    }
+    check();
+
+    {
+        LedgerTxn ltx(root);
+        for (size_t i = 0; i < keys.size(); i += 3)
+        {
+            ltx.erase(keys[i]);
+        }
+        for (size_t i = 1; i < keys.size(); i += 3)
+        {
+            auto offer = ltx.load(keys[i]);
+            offer.current().data.offer().price = Price{1, 5};
+        }
+        for (size_t i = 2; i < keys.size(); i += 6)
+        {
+            auto offer = ltx.load(keys[i]);
+            std::swap(offer.current().data.offer().buying,
+                      offer.current().data.offer().selling);
+        }
+        for (size_t i = 4; i < keys.size(); i += 6)
+        {
+            auto offer = ltx.load(keys[i]);
+            offer.current().data.offer().selling = Asset(ASSET_TYPE_NATIVE);
+        }
+        ltx.commit();
+    }
+    check();
+
+    {
+        LedgerTxn ltx(root);
+        ltx.erase(keys[1]);
+    }
+    check();
+
+    SECTION("discarded when offers are dropped")
+    {
+        root.dropOffers();
+        check();
+    }
+
+    SECTION("loaded ahead of use")
+    {
+        LedgerTxnRoot freshRoot(app->getDatabase(), 0, 0, 0, 1, true);
+        freshRoot.loadInMemoryState();
+        auto& selects =
+            app->getMetrics().NewTimer({"database", "select", "offer"});
+        auto before = selects.count();
+        REQUIRE(freshRoot.getAllOffers() == sqlRoot.getAllOffers());
+        auto after = selects.count();
+        REQUIRE(freshRoot.getBestOffer(buying, selling));
+        REQUIRE(selects.count() == after);
+        // Only sqlRoot went to the database
+        REQUIRE(after == before + 1);
+    }
+}
+
 static void
 testOffersByAccountAndAsset(
     AbstractLedgerTxnParent& ltxParent, AccountID const& accountID,
@@ -1914,6 +2260,18 @@ testOffersByAccountAndAsset(
         auto cfg = getTestConfig();
         cfg.ENTRY_CACHE_SIZE = 0;
         cfg.BEST_OFFERS_CACHE_SIZE = 0;
+        cfg.IN_MEMORY_ORDER_BOOK = false;
+        auto app = createTestApplication(clock, cfg);
+        app->start();
+        testAtRoot(*app);
+    }
+
+    // first changes are in LedgerTxnRoot with the in-memory order book
+    if (updates.size() > 1)
+    {
+        VirtualClock clock;
+        auto cfg = getTestConfig();
+        cfg.IN_MEMORY_ORDER_BOOK = true;
         auto app = createTestApplication(clock, cfg);
         app->start();
         testAtRoot(*app);
@@ -2221,80 +2579,895 @@ TEST_CASE("LedgerTxnRoot prefetch", "[ledgertxn]")
     }
 }
 
-TEST_CASE("Create performance benchmark", "[!hide][createbench]")
+TEST_CASE("LedgerTxn getAllBucketEntries", "[ledgertxn]")
 {
-    auto runTest = [&](Config::TestDbMode mode, bool loading) {
-        VirtualClock clock;
-        Config cfg(getTestConfig(0, mode));
-        Application::pointer app = createTestApplication(clock, cfg);
-        app->start();
-        size_t n = 0xffff, batch = 0xfff;
+    VirtualClock clock;
+    auto app = createTestApplication(clock, getTestConfig());
+    app->start();
+    auto& root = app->getLedgerTxnRoot();
 
-        std::vector<LedgerEntry> entries;
-        for (auto i = 0; i < 10; ++i)
+    std::vector<LedgerEntry> entries;
+    for (auto const& ae : LedgerTestUtils::generateValidAccountEntries(30))
+    {
+        LedgerEntry le;
+        le.data.type(ACCOUNT);
+        le.data.account() = ae;
+        entries.emplace_back(le);
+    }
+    {
+        LedgerTxn ltx(root);
+        for (size_t i = 0; i < 20; ++i)
         {
-            // First add some bulking entries so we're not using a
-            // totally empty database.
-            entries = LedgerTestUtils::generateValidLedgerEntries(n);
-            LedgerTxn ltx(app->getLedgerTxnRoot());
-            for (auto e : entries)
-            {
-                ltx.createOrUpdateWithoutLoading(e);
-            }
-            ltx.commit();
+            ltx.createOrUpdateWithoutLoading(entries[i]);
         }
+        ltx.commit();
+    }
 
-        // Then do some precise timed creates.
-        entries = LedgerTestUtils::generateValidLedgerEntries(n);
-        auto& m =
-            app->getMetrics().NewMeter({"ledger", "create", "commit"}, "entry");
-        while (!entries.empty())
+    // Update the first 10 entries, erase the next 10 and create the last 10
+    std::map<LedgerKey, BucketEntryType, LedgerEntryIdCmp> expected;
+    LedgerTxn ltx(root);
+    for (size_t i = 0; i < entries.size(); ++i)
+    {
+        auto key = LedgerEntryKey(entries[i]);
+        if (i < 10)
         {
-            LedgerTxn ltx(app->getLedgerTxnRoot());
-            for (size_t i = 0; !entries.empty() && i < batch; ++i)
-            {
-                if (loading)
-                {
-                    ltx.create(entries.back());
-                }
-                else
-                {
-                    ltx.createOrUpdateWithoutLoading(entries.back());
-                }
-                entries.pop_back();
-            }
-            ltx.commit();
-            m.Mark(batch);
-            CLOG(INFO, "Ledger")
-                << "benchmark create rate: " << m.mean_rate() << " entries/sec "
-                << (loading ? "(loading)" : "(non-loading)");
+            auto entry = ltx.load(key);
+            auto& ae = entry.current().data.account();
+            ae.balance = ae.balance > 0 ? ae.balance - 1 : 1;
+            expected[key] = LIVEENTRY;
+        }
+        else if (i < 20)
+        {
+            ltx.erase(key);
+            expected[key] = DEADENTRY;
+        }
+        else
+        {
+            REQUIRE(ltx.create(entries[i]));
+            expected[key] = INITENTRY;
         }
-    };
-
-    SECTION("sqlite")
-    {
-        runTest(Config::TESTDB_ON_DISK_SQLITE, true);
-        runTest(Config::TESTDB_ON_DISK_SQLITE, false);
     }
 
-#ifdef USE_POSTGRES
-    SECTION("postgresql")
+    std::vector<BucketEntry> bucketEntries;
+    ltx.getAllBucketEntries(bucketEntries);
+    REQUIRE(bucketEntries.size() == expected.size());
+    REQUIRE(std::is_sorted(bucketEntries.begin(), bucketEntries.end(),
+                           BucketEntryIdCmp{}));
+    for (auto const& be : bucketEntries)
     {
-        runTest(Config::TESTDB_POSTGRESQL, true);
-        runTest(Config::TESTDB_POSTGRESQL, false);
+        if (be.type() == DEADENTRY)
+        {
+            REQUIRE(expected.at(be.deadEntry()) == DEADENTRY);
+        }
+        else
+        {
+            auto key = LedgerEntryKey(be.liveEntry());
+            REQUIRE(expected.at(key) == be.type());
+            REQUIRE(be.liveEntry() == *ltx.getNewestVersion(key));
+        }
     }
-#endif
 }
 
-TEST_CASE("Erase performance benchmark", "[!hide][erasebench]")
+TEST_CASE("LedgerTxn getChanges lists entries by key", "[ledgertxn]")
 {
-    auto runTest = [&](Config::TestDbMode mode, bool loading) {
-        VirtualClock clock;
-        Config cfg(getTestConfig(0, mode));
-        Application::pointer app = createTestApplication(clock, cfg);
-        app->start();
-        size_t n = 0xffff, batch = 0xfff;
-
+    VirtualClock clock;
+    auto app = createTestApplication(clock, getTestConfig());
+    app->start();
+    auto& root = app->getLedgerTxnRoot();
+
+    std::vector<LedgerEntry> entries;
+    for (auto const& ae : LedgerTestUtils::generateValidAccountEntries(30))
+    {
+        LedgerEntry le;
+        le.data.type(ACCOUNT);
+        le.data.account() = ae;
+        entries.emplace_back(le);
+    }
+    {
+        LedgerTxn ltx(root);
+        for (size_t i = 0; i < 20; ++i)
+        {
+            ltx.createOrUpdateWithoutLoading(entries[i]);
+        }
+        ltx.commit();
+    }
+
+    // Updates the first 10 entries, erases the next 10 and creates the last
+    // 10, recording them in the given order
+    auto getChanges = [&](std::vector<size_t> const& order) {
+        LedgerTxn ltx(root);
+        for (auto i : order)
+        {
+            auto key = LedgerEntryKey(entries[i]);
+            if (i < 10)
+            {
+                auto entry = ltx.load(key);
+                auto& ae = entry.current().data.account();
+                ae.balance = ae.balance > 0 ? ae.balance - 1 : 1;
+            }
+            else if (i < 20)
+            {
+                ltx.erase(key);
+            }
+            else
+            {
+                REQUIRE(ltx.create(entries[i]));
+            }
+        }
+        return ltx.getChanges();
+    };
+
+    std::vector<size_t> order(entries.size());
+    std::iota(order.begin(), order.end(), size_t(0));
+    auto changes = getChanges(order);
+    std::reverse(order.begin(), order.end());
+    REQUIRE(getChanges(order) == changes);
+
+    // One CREATED, or one STATE followed by one UPDATED or REMOVED, per key
+    std::vector<LedgerKey> keys;
+    for (auto const& change : changes)
+    {
+        switch (change.type())
+        {
+        case LEDGER_ENTRY_CREATED:
+            keys.emplace_back(LedgerEntryKey(change.created()));
+            break;
+        case LEDGER_ENTRY_STATE:
+            keys.emplace_back(LedgerEntryKey(change.state()));
+            break;
+        default:
+            break;
+        }
+    }
+    REQUIRE(keys.size() == entries.size());
+    REQUIRE(std::is_sorted(keys.begin(), keys.end(), LedgerEntryIdCmp{}));
+}
+
+TEST_CASE("LedgerTxnRoot entry cache is kept across commits", "[ledgertxn]")
+{
+    VirtualClock clock;
+    auto cfg = getTestConfig();
+    cfg.ENTRY_CACHE_SIZE = 1000;
+    auto app = createTestApplication(clock, cfg);
+    app->start();
+    auto& root = app->getLedgerTxnRoot();
+
+    std::vector<LedgerEntry> entries;
+    {
+        LedgerTxn ltx(root);
+        for (auto const& ae : LedgerTestUtils::generateValidAccountEntries(10))
+        {
+            LedgerEntry le;
+            le.data.type(ACCOUNT);
+            le.data.account() = ae;
+            ltx.createOrUpdateWithoutLoading(le);
+            entries.emplace_back(le);
+        }
+        ltx.commit();
+    }
+
+    auto before = root.getEntryCacheCounters(ACCOUNT);
+    {
+        LedgerTxn ltx(root);
+        for (auto const& le : entries)
+        {
+            REQUIRE(ltx.load(LedgerEntryKey(le)));
+        }
+        auto& modified = entries[0].data.account();
+        modified.balance = modified.balance > 0 ? modified.balance - 1 : 1;
+        ltx.load(LedgerEntryKey(entries[0])).current().data.account() =
+            modified;
+        ltx.erase(LedgerEntryKey(entries[1]));
+        ltx.commit();
+    }
+    auto loaded = root.getEntryCacheCounters(ACCOUNT);
+    REQUIRE(loaded.mMisses == before.mMisses + entries.size());
+    REQUIRE(loaded.mHits == before.mHits);
+
+    // Every load is served by the cache, which reflects the last commit
+    LedgerTxn ltx(root);
+    for (size_t i = 0; i < entries.size(); ++i)
+    {
+        auto entry = ltx.loadWithoutRecord(LedgerEntryKey(entries[i]));
+        if (i == 1)
+        {
+            REQUIRE(!entry);
+        }
+        else
+        {
+            REQUIRE(entry);
+            REQUIRE(entry.current().data.account().balance ==
+                    entries[i].data.account().balance);
+        }
+    }
+    auto reloaded = root.getEntryCacheCounters(ACCOUNT);
+    REQUIRE(reloaded.mMisses == loaded.mMisses);
+    REQUIRE(reloaded.mHits == loaded.mHits + entries.size());
+    REQUIRE(reloaded.mEvictions == 0);
+}
+
+TEST_CASE("LedgerTxnRoot key filters skip missing keys", "[ledgertxn]")
+{
+    VirtualClock clock;
+    auto cfg = getTestConfig();
+    cfg.LEDGER_KEY_FILTERS = true;
+    auto app = createTestApplication(clock, cfg);
+    app->start();
+    auto& root = app->getLedgerTxnRoot();
+
+    std::vector<LedgerEntry> entries;
+    for (auto const& ae : LedgerTestUtils::generateValidAccountEntries(30))
+    {
+        LedgerEntry le;
+        le.data.type(ACCOUNT);
+        le.data.account() = ae;
+        entries.emplace_back(le);
+    }
+    auto create = [&](size_t begin, size_t end) {
+        LedgerTxn ltx(root);
+        for (size_t i = begin; i < end; ++i)
+        {
+            ltx.createOrUpdateWithoutLoading(entries[i]);
+        }
+        ltx.commit();
+    };
+    auto loadAll = [&](size_t begin, size_t end, bool exist) {
+        LedgerTxn ltx(root);
+        for (size_t i = begin; i < end; ++i)
+        {
+            auto entry = ltx.loadWithoutRecord(LedgerEntryKey(entries[i]));
+            REQUIRE(bool(entry) == exist);
+        }
+    };
+
+    // The filter is loaded from the database at startup
+    create(0, 10);
+    auto before = root.getEntryCacheCounters(ACCOUNT);
+    loadAll(0, 10, true);
+
+    // then keeps up with commits
+    create(10, 20);
+    loadAll(10, 20, true);
+    auto loaded = root.getEntryCacheCounters(ACCOUNT);
+    REQUIRE(loaded.mMisses == before.mMisses + 20);
+    REQUIRE(loaded.mFilterSkips == before.mFilterSkips);
+
+    loadAll(20, 30, false);
+    auto skipped = root.getEntryCacheCounters(ACCOUNT);
+    REQUIRE(skipped.mMisses == loaded.mMisses + 10);
+    REQUIRE(skipped.mFilterSkips == loaded.mFilterSkips + 10);
+    REQUIRE(skipped.mFilterFalsePositives == loaded.mFilterFalsePositives);
+}
+
+TEST_CASE("LedgerTxnRoot rebuilds degraded key filters in the background",
+          "[ledgertxn]")
+{
+    VirtualClock clock;
+    auto cfg = getTestConfig(0, Config::TESTDB_ON_DISK_SQLITE);
+    cfg.LEDGER_KEY_FILTERS = true;
+    auto app = createTestApplication(clock, cfg);
+    app->start();
+    auto& root = app->getLedgerTxnRoot();
+
+    std::vector<LedgerEntry> entries;
+    for (auto const& ae : LedgerTestUtils::generateValidAccountEntries(400))
+    {
+        LedgerEntry le;
+        le.data.type(ACCOUNT);
+        le.data.account() = ae;
+        entries.emplace_back(le);
+    }
+    auto create = [&](size_t begin, size_t end) {
+        LedgerTxn ltx(root);
+        for (size_t i = begin; i < end; ++i)
+        {
+            ltx.createOrUpdateWithoutLoading(entries[i]);
+        }
+        ltx.commit();
+    };
+    auto rebuilds = [&]() {
+        return root.getEntryCacheCounters(ACCOUNT).mFilterRebuilds;
+    };
+
+    // The filter loaded at startup has room for a handful of accounts, so
+    // this degrades it and starts a rebuild, and the accounts created while
+    // the rebuild runs must make it into the new filter
+    create(0, 300);
+    create(300, 350);
+    for (size_t i = 0; i < 1000 && rebuilds() == 0; ++i)
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        LedgerTxn ltx(root);
+        ltx.commit();
+    }
+    REQUIRE(rebuilds() == 1);
+
+    auto before = root.getEntryCacheCounters(ACCOUNT);
+    {
+        LedgerTxn ltx(root);
+        for (size_t i = 0; i < entries.size(); ++i)
+        {
+            auto entry = ltx.loadWithoutRecord(LedgerEntryKey(entries[i]));
+            REQUIRE(bool(entry) == (i < 350));
+        }
+    }
+    auto after = root.getEntryCacheCounters(ACCOUNT);
+    REQUIRE(after.mFilterSkips + after.mFilterFalsePositives ==
+            before.mFilterSkips + before.mFilterFalsePositives + 50);
+    REQUIRE(after.mFilterFalsePositives - before.mFilterFalsePositives < 5);
+
+    // The new filter is sized for what there is now
+    create(350, 400);
+    {
+        LedgerTxn ltx(root);
+        ltx.commit();
+    }
+    REQUIRE(rebuilds() == 1);
+}
+
+#ifdef USE_POSTGRES
+TEST_CASE("LedgerTxnRoot writes ledger entries behind", "[ledgertxn]")
+{
+    VirtualClock clock;
+    auto cfg = getTestConfig(0, Config::TESTDB_POSTGRESQL);
+    cfg.WRITE_BEHIND_LEDGER_ENTRIES = true;
+    auto app = createTestApplication(clock, cfg);
+    app->start();
+    auto& root = app->getLedgerTxnRoot();
+    auto lastWritten = [&]() {
+        return app->getPersistentState().getState(
+            PersistentState::kLastWrittenLedger);
+    };
+
+    std::vector<LedgerEntry> entries;
+    auto accounts = root.countObjects(ACCOUNT);
+    uint32_t ledgerSeq;
+    {
+        LedgerTxn ltx(root);
+        ledgerSeq = ++ltx.loadHeader().current().ledgerSeq;
+        for (auto const& ae : LedgerTestUtils::generateValidAccountEntries(10))
+        {
+            LedgerEntry le;
+            le.data.type(ACCOUNT);
+            le.data.account() = ae;
+            ltx.createOrUpdateWithoutLoading(le);
+            entries.emplace_back(le);
+        }
+        ltx.commit();
+    }
+
+    {
+        // Whether or not they are written yet, the committed entries are
+        // the ones loaded
+        LedgerTxn ltx(root);
+        ++ltx.loadHeader().current().ledgerSeq;
+        for (auto const& le : entries)
+        {
+            REQUIRE(ltx.load(LedgerEntryKey(le)).current().data == le.data);
+        }
+        ltx.erase(LedgerEntryKey(entries[0]));
+        ltx.commit();
+    }
+
+    // countObjects waits for the entries to be written
+    REQUIRE(root.countObjects(ACCOUNT) == accounts + entries.size() - 1);
+    REQUIRE(lastWritten() == std::to_string(ledgerSeq + 1));
+
+    LedgerTxnRoot sqlRoot(app->getDatabase(), 0, 0, 0, 1, false);
+    LedgerTxn ltx(sqlRoot);
+    REQUIRE(!ltx.load(LedgerEntryKey(entries[0])));
+    for (size_t i = 1; i < entries.size(); ++i)
+    {
+        auto entry = ltx.load(LedgerEntryKey(entries[i]));
+        REQUIRE(entry.current().data == entries[i].data);
+    }
+}
+#endif
+
+TEST_CASE("LedgerTxnRoot prefetch ahead", "[ledgertxn]")
+{
+    VirtualClock clock;
+    // Loading ahead needs the connection pool, which in-memory SQLite lacks
+    auto cfg = getTestConfig(0, Config::TESTDB_ON_DISK_SQLITE);
+    auto app = createTestApplication(clock, cfg);
+    app->start();
+    auto& root = app->getLedgerTxnRoot();
+
+    std::vector<LedgerEntry> entries;
+    std::unordered_set<LedgerKey> keys;
+    {
+        LedgerTxn ltx(root);
+        for (auto const& ae : LedgerTestUtils::generateValidAccountEntries(10))
+        {
+            LedgerEntry le;
+            le.data.type(ACCOUNT);
+            le.data.account() = ae;
+            ltx.createOrUpdateWithoutLoading(le);
+            entries.emplace_back(le);
+            keys.emplace(LedgerEntryKey(le));
+        }
+        ltx.commit();
+    }
+
+    REQUIRE(root.prefetchAsync(keys));
+    REQUIRE(root.waitForLoadsAhead() == 1);
+
+    // Keys on their way are not loaded again
+    REQUIRE(root.prefetchAsync(keys));
+    REQUIRE(root.waitForLoadsAhead() == 1);
+
+    // The load read entries[0] before this commit, so it must not be cached
+    auto& modified = entries[0].data.account();
+    modified.balance = modified.balance > 0 ? modified.balance - 1 : 1;
+    {
+        LedgerTxn ltx(root);
+        ltx.createOrUpdateWithoutLoading(entries[0]);
+        ltx.commit();
+    }
+
+    SECTION("modified keys are not cached")
+    {
+        LedgerTxn ltx(root);
+        REQUIRE(root.prefetch({}) == 0);
+        for (auto const& le : entries)
+        {
+            auto loaded = ltx.loadWithoutRecord(LedgerEntryKey(le));
+            REQUIRE(loaded);
+            REQUIRE(loaded.current().data.account().balance ==
+                    le.data.account().balance);
+        }
+        REQUIRE(root.getPrefetchHitRate() == Approx(0.9));
+    }
+
+    SECTION("modified keys are loaded again")
+    {
+        REQUIRE(root.prefetchAsync(keys));
+        REQUIRE(root.waitForLoadsAhead() == 2);
+        LedgerTxn ltx(root);
+        REQUIRE(root.prefetch({}) == 0);
+        for (auto const& le : entries)
+        {
+            auto loaded = ltx.loadWithoutRecord(LedgerEntryKey(le));
+            REQUIRE(loaded);
+            REQUIRE(loaded.current().data.account().balance ==
+                    le.data.account().balance);
+        }
+        REQUIRE(root.getPrefetchHitRate() == Approx(1.0));
+    }
+
+    SECTION("discarded loads are cancelled")
+    {
+        REQUIRE(root.prefetchAsync(keys));
+        root.dropOffers();
+        REQUIRE(root.waitForLoadsAhead() == 0);
+    }
+}
+
+TEST_CASE("LedgerTxnRoot writes entries in parallel", "[ledgertxn]")
+{
+    auto runTest = [](Config::TestDbMode mode) {
+        VirtualClock clock;
+        auto app = createTestApplication(clock, getTestConfig(0, mode));
+        app->start();
+        auto& root = app->getLedgerTxnRoot();
+        auto accounts = root.countObjects(ACCOUNT);
+
+        auto accountEntry = [](AccountEntry const& ae) {
+            LedgerEntry le;
+            le.data.type(ACCOUNT);
+            le.data.account() = ae;
+            return le;
+        };
+        LedgerEntryWrites writes;
+        for (auto const& ae : LedgerTestUtils::generateValidAccountEntries(100))
+        {
+            auto le = accountEntry(ae);
+            writes.emplace_back(LedgerEntryKey(le),
+                                std::make_shared<LedgerEntry const>(le));
+        }
+        root.writeInParallel(writes, 4);
+        REQUIRE(root.countObjects(ACCOUNT) == accounts + writes.size());
+
+        // The entries loaded now are cached
+        {
+            LedgerTxn ltx(root);
+            for (auto const& item : writes)
+            {
+                REQUIRE(ltx.loadWithoutRecord(item.first).current() ==
+                        *item.second);
+            }
+        }
+
+        LedgerEntryWrites updates;
+        for (size_t i = 0; i < writes.size(); ++i)
+        {
+            if (i % 2 == 0)
+            {
+                auto le = *writes[i].second;
+                ++le.lastModifiedLedgerSeq;
+                updates.emplace_back(writes[i].first,
+                                     std::make_shared<LedgerEntry const>(le));
+            }
+            else
+            {
+                updates.emplace_back(writes[i].first, nullptr);
+            }
+        }
+        // Erasing a key that is not there is not an error
+        updates.emplace_back(
+            LedgerEntryKey(
+                accountEntry(LedgerTestUtils::generateValidAccountEntry())),
+            nullptr);
+        root.writeInParallel(updates, 4);
+        REQUIRE(root.countObjects(ACCOUNT) == accounts + writes.size() / 2);
+
+        LedgerTxn ltx(root);
+        for (auto const& item : updates)
+        {
+            auto loaded = ltx.loadWithoutRecord(item.first);
+            if (item.second)
+            {
+                REQUIRE(loaded.current() == *item.second);
+            }
+            else
+            {
+                REQUIRE(!loaded);
+            }
+        }
+        REQUIRE_THROWS_AS(ltx.writeInParallel(updates, 4), std::runtime_error);
+        REQUIRE_THROWS_AS(root.writeInParallel(updates, 4), std::runtime_error);
+    };
+
+    SECTION("sqlite")
+    {
+        runTest(Config::TESTDB_ON_DISK_SQLITE);
+    }
+#ifdef USE_POSTGRES
+    SECTION("postgresql")
+    {
+        runTest(Config::TESTDB_POSTGRESQL);
+    }
+#endif
+}
+
+TEST_CASE("InMemoryLedgerTxnRoot matches LedgerTxnRoot", "[ledgertxn]")
+{
+    VirtualClock clock;
+    auto app = createTestApplication(clock, getTestConfig());
+    app->start();
+
+    auto& sqlRoot = app->getLedgerTxnRoot();
+    InMemoryLedgerTxnRoot memRoot;
+    // The genesis ledger created the root account in the database only
+    uint64_t const genesisAccounts = sqlRoot.countObjects(ACCOUNT);
+
+    std::vector<AccountID> dests;
+    for (size_t i = 0; i < 3; ++i)
+    {
+        dests.emplace_back(
+            LedgerTestUtils::generateValidAccountEntry().accountID);
+    }
+    auto randomize = [&](LedgerEntry& le) {
+        if (le.data.type() == ACCOUNT)
+        {
+            auto& ae = le.data.account();
+            ae.inflationDest.activate() = rand_element(dests);
+            ae.balance = rand_uniform<int64_t>(0, 3 * MIN_VOTES_TO_INCLUDE);
+        }
+        else if (le.data.type() == OFFER)
+        {
+            auto& oe = le.data.offer();
+            oe.price = Price{rand_uniform<int32_t>(1, 10),
+                             rand_uniform<int32_t>(1, 10)};
+        }
+    };
+
+    std::map<LedgerKey, LedgerEntry, LedgerEntryIdCmp> universe;
+    for (auto& le : LedgerTestUtils::generateValidLedgerEntries(200))
+    {
+        randomize(le);
+        universe.emplace(LedgerEntryKey(le), le);
+    }
+
+    auto check = [&]() {
+        for (auto let : {ACCOUNT, DATA, OFFER, TRUSTLINE})
+        {
+            REQUIRE(sqlRoot.countObjects(let) ==
+                    memRoot.countObjects(let) +
+                        (let == ACCOUNT ? genesisAccounts : 0));
+            for (uint32_t ledger = 2; ledger < 8; ledger += 2)
+            {
+                LedgerRange range(ledger, ledger + 1);
+                REQUIRE(sqlRoot.countObjects(let, range) ==
+                        memRoot.countObjects(let, range));
+            }
+        }
+
+        for (auto const& kv : universe)
+        {
+            auto expected = sqlRoot.getNewestVersion(kv.first);
+            auto actual = memRoot.getNewestVersion(kv.first);
+            REQUIRE(bool(expected) == bool(actual));
+            if (expected)
+            {
+                REQUIRE(*expected == *actual);
+            }
+        }
+
+        REQUIRE(sqlRoot.getAllOffers() == memRoot.getAllOffers());
+        for (auto const& kv : universe)
+        {
+            if (kv.first.type() != OFFER)
+            {
+                continue;
+            }
+            auto const& oe = kv.second.data.offer();
+            auto expected = sqlRoot.getBestOffer(oe.buying, oe.selling);
+            auto actual = memRoot.getBestOffer(oe.buying, oe.selling);
+            while (expected)
+            {
+                REQUIRE(actual);
+                REQUIRE(*actual == *expected);
+                auto const& best = expected->data.offer();
+                OfferDescriptor worseThan{best.price, best.offerID};
+                expected =
+                    sqlRoot.getBestOffer(oe.buying, oe.selling, worseThan);
+                actual = memRoot.getBestOffer(oe.buying, oe.selling, worseThan);
+            }
+            REQUIRE(!actual);
+
+            for (auto const& asset : {oe.buying, oe.selling})
+            {
+                if (asset.type() != ASSET_TYPE_NATIVE)
+                {
+                    REQUIRE(sqlRoot.getOffersByAccountAndAsset(oe.sellerID,
+                                                               asset) ==
+                            memRoot.getOffersByAccountAndAsset(oe.sellerID,
+                                                               asset));
+                }
+            }
+        }
+
+        auto expected = sqlRoot.getInflationWinners(dests.size(), 0);
+        auto actual = memRoot.getInflationWinners(dests.size(), 0);
+        REQUIRE(expected.size() == actual.size());
+        for (size_t i = 0; i < expected.size(); ++i)
+        {
+            REQUIRE(expected[i].accountID == actual[i].accountID);
+            REQUIRE(expected[i].votes == actual[i].votes);
+        }
+    };
+
+    // Each round creates, updates or erases entries at random, the same in
+    // both roots, in a ledger of its own
+    std::set<LedgerKey, LedgerEntryIdCmp> live;
+    for (uint32_t ledger = 2; ledger < 8; ++ledger)
+    {
+        std::vector<LedgerKey> created, updated, erased;
+        for (auto& kv : universe)
+        {
+            randomize(kv.second);
+            if (rand_flip())
+            {
+                continue;
+            }
+            else if (live.count(kv.first) == 0)
+            {
+                created.emplace_back(kv.first);
+                live.emplace(kv.first);
+            }
+            else if (rand_flip())
+            {
+                updated.emplace_back(kv.first);
+            }
+            else
+            {
+                erased.emplace_back(kv.first);
+                live.erase(kv.first);
+            }
+        }
+
+        for (auto* root :
+             std::vector<AbstractLedgerTxnParent*>{&sqlRoot, &memRoot})
+        {
+            LedgerTxn ltx(*root);
+            ltx.loadHeader().current().ledgerSeq = ledger;
+            for (auto const& key : created)
+            {
+                ltx.create(universe.at(key));
+            }
+            for (auto const& key : updated)
+            {
+                auto ltxe = ltx.load(key);
+                ltxe.current() = universe.at(key);
+            }
+            for (auto const& key : erased)
+            {
+                ltx.erase(key);
+            }
+            ltx.commit();
+        }
+        check();
+    }
+
+    SECTION("delete objects modified on or after ledger")
+    {
+        sqlRoot.deleteObjectsModifiedOnOrAfterLedger(5);
+        memRoot.deleteObjectsModifiedOnOrAfterLedger(5);
+        check();
+    }
+
+    SECTION("drop offers")
+    {
+        sqlRoot.dropOffers();
+        memRoot.dropOffers();
+        REQUIRE(memRoot.getFootprint(OFFER).mEntries == 0);
+        REQUIRE(memRoot.getFootprint(OFFER).mBytes == 0);
+        check();
+    }
+
+    SECTION("footprint")
+    {
+        for (auto let : {ACCOUNT, DATA, OFFER, TRUSTLINE})
+        {
+            auto footprint = memRoot.getFootprint(let);
+            REQUIRE(footprint.mEntries == memRoot.countObjects(let));
+            REQUIRE(footprint.mBytes >= footprint.mEntries *
+                                            (sizeof(LedgerKey) +
+                                             sizeof(LedgerEntry)));
+        }
+    }
+}
+
+TEST_CASE("LedgerTxn bounds the arena of long-lived LedgerTxns",
+          "[ledgertxn]")
+{
+    InMemoryLedgerTxnRoot root;
+    LedgerTxn ltxOuter(root);
+    std::unordered_map<LedgerKey, LedgerEntry> entries;
+    for (auto const& e : LedgerTestUtils::generateValidLedgerEntries(100))
+    {
+        entries[LedgerEntryKey(e)] = e;
+    }
+
+    // Every commit replaces each entry of ltxOuter by a copy of its own
+    for (size_t i = 0; i < 2000; ++i)
+    {
+        LedgerTxn ltx(ltxOuter);
+        for (auto const& kv : entries)
+        {
+            ltx.createOrUpdateWithoutLoading(kv.second);
+        }
+        ltx.commit();
+    }
+
+    // The arena stops growing within a chunk of MAX_ARENA_BYTES, 16 MB
+    REQUIRE(ltxOuter.getArenaBytesReserved() <= (16 << 20) + (1 << 20));
+    for (auto const& kv : entries)
+    {
+        auto loaded = ltxOuter.loadWithoutRecord(kv.first);
+        REQUIRE(loaded);
+        REQUIRE(loaded.current().data == kv.second.data);
+    }
+}
+
+TEST_CASE("Create performance benchmark", "[!hide][createbench]")
+{
+    auto runTest = [&](Config::TestDbMode mode, bool loading) {
+        VirtualClock clock;
+        Config cfg(getTestConfig(0, mode));
+        Application::pointer app = createTestApplication(clock, cfg);
+        app->start();
+        size_t n = 0xffff, batch = 0xfff;
+
+        std::vector<LedgerEntry> entries;
+        for (auto i = 0; i < 10; ++i)
+        {
+            // First add some bulking entries so we're not using a
+            // totally empty database.
+            entries = LedgerTestUtils::generateValidLedgerEntries(n);
+            LedgerTxn ltx(app->getLedgerTxnRoot());
+            for (auto e : entries)
+            {
+                ltx.createOrUpdateWithoutLoading(e);
+            }
+            ltx.commit();
+        }
+
+        // Then do some precise timed creates.
+        entries = LedgerTestUtils::generateValidLedgerEntries(n);
+        auto& m =
+            app->getMetrics().NewMeter({"ledger", "create", "commit"}, "entry");
+        while (!entries.empty())
+        {
+            LedgerTxn ltx(app->getLedgerTxnRoot());
+            for (size_t i = 0; !entries.empty() && i < batch; ++i)
+            {
+                if (loading)
+                {
+                    ltx.create(entries.back());
+                }
+                else
+                {
+                    ltx.createOrUpdateWithoutLoading(entries.back());
+                }
+                entries.pop_back();
+            }
+            ltx.commit();
+            m.Mark(batch);
+            CLOG(INFO, "Ledger")
+                << "benchmark create rate: " << m.mean_rate() << " entries/sec "
+                << (loading ? "(loading)" : "(non-loading)");
+        }
+    };
+
+    SECTION("sqlite")
+    {
+        runTest(Config::TESTDB_ON_DISK_SQLITE, true);
+        runTest(Config::TESTDB_ON_DISK_SQLITE, false);
+    }
+
+#ifdef USE_POSTGRES
+    SECTION("postgresql")
+    {
+        runTest(Config::TESTDB_POSTGRESQL, true);
+        runTest(Config::TESTDB_POSTGRESQL, false);
+    }
+#endif
+}
+
+#ifdef USE_POSTGRES
+TEST_CASE("Bulk upsert batch size benchmark", "[!hide][bulkupsertbench]")
+{
+    auto runTest = [&](bool copy, size_t batch) {
+        VirtualClock clock;
+        Config cfg(getTestConfig(0, Config::TESTDB_POSTGRESQL));
+        cfg.BULK_UPSERT_COPY_THRESHOLD = copy ? 0 : SIZE_MAX;
+        Application::pointer app = createTestApplication(clock, cfg);
+        app->start();
+        size_t n = 0xffff;
+
+        // Half of the upserts insert, the other half update
+        auto entries = LedgerTestUtils::generateValidLedgerEntries(n);
+        for (size_t pass = 0; pass < 2; ++pass)
+        {
+            auto& m = app->getMetrics().NewMeter(
+                {"ledger", "upsert", pass == 0 ? "insert" : "update"},
+                "entry");
+            for (size_t i = 0; i < entries.size();)
+            {
+                LedgerTxn ltx(app->getLedgerTxnRoot());
+                for (size_t j = 0; i < entries.size() && j < batch; ++i, ++j)
+                {
+                    ltx.createOrUpdateWithoutLoading(entries[i]);
+                }
+                ltx.commit();
+                m.Mark(batch);
+            }
+            CLOG(INFO, "Ledger")
+                << "benchmark " << (pass == 0 ? "insert" : "update")
+                << " rate: " << m.mean_rate() << " entries/sec, batches of "
+                << batch << " " << (copy ? "(copy)" : "(arrays)");
+        }
+    };
+
+    for (size_t batch : {16, 128, 1024, 4096})
+    {
+        runTest(false, batch);
+        runTest(true, batch);
+    }
+}
+#endif
+
+TEST_CASE("Erase performance benchmark", "[!hide][erasebench]")
+{
+    auto runTest = [&](Config::TestDbMode mode, bool loading) {
+        VirtualClock clock;
+        Config cfg(getTestConfig(0, mode));
+        Application::pointer app = createTestApplication(clock, cfg);
+        app->start();
+        size_t n = 0xffff, batch = 0xfff;
+
         std::vector<LedgerEntry> entries;
         for (auto i = 0; i < 10; ++i)
         {
@@ -2350,6 +3523,43 @@ TEST_CASE("Erase performance benchmark", "[!hide][erasebench]")
 #endif
 }
 
+TEST_CASE("Nested LedgerTxn performance benchmark", "[!hide][nestedbench]")
+{
+    VirtualClock clock;
+    Application::pointer app = createTestApplication(clock, getTestConfig());
+    app->start();
+    size_t n = 0xffff;
+
+    // The outer LedgerTxn stands in for the transaction-spanning LedgerTxn,
+    // the inner ones for the short-lived LedgerTxns opened while crossing
+    // offers.
+    auto entries = LedgerTestUtils::generateValidLedgerEntries(n);
+    InMemoryLedgerTxnRoot root;
+    LedgerTxn ltxOuter(root);
+    for (auto const& e : entries)
+    {
+        ltxOuter.createOrUpdateWithoutLoading(e);
+    }
+
+    auto& m =
+        app->getMetrics().NewMeter({"ledger", "nested", "commit"}, "entry");
+    for (size_t i = 0; i < 10; ++i)
+    {
+        for (auto const& e : entries)
+        {
+            LedgerTxn ltx(ltxOuter);
+            {
+                auto ltxe = ltx.load(LedgerEntryKey(e));
+                ++ltxe.current().lastModifiedLedgerSeq;
+            }
+            ltx.commit();
+        }
+        m.Mark(n);
+        CLOG(INFO, "Ledger") << "benchmark nested load-modify-commit rate: "
+                             << m.mean_rate() << " entries/sec";
+    }
+}
+
 TEST_CASE("Bulk load batch size benchmark", "[!hide][bulkbatchsizebench]")
 {
     size_t floor = 1000;
@@ -2678,12 +3888,13 @@ TEST_CASE("Load best offers benchmark", "[!hide][bestoffersbench]")
         }
     };
 
-    auto runTest = [&](Config::TestDbMode mode, size_t numAssets,
-                       size_t numIssuers, size_t numOffers) {
+    auto runTest = [&](Config::TestDbMode mode, bool inMemoryOrderBook,
+                       size_t numAssets, size_t numIssuers, size_t numOffers) {
         VirtualClock clock;
         Config cfg(getTestConfig(0, mode));
         cfg.ENTRY_CACHE_SIZE = 100000;
         cfg.BEST_OFFERS_CACHE_SIZE = 1000;
+        cfg.IN_MEMORY_ORDER_BOOK = inMemoryOrderBook;
         Application::pointer app = createTestApplication(clock, cfg);
 
         CLOG(WARNING, "Ledger")
@@ -2723,21 +3934,33 @@ TEST_CASE("Load best offers benchmark", "[!hide][bestoffersbench]")
             }
         }
 
-        CLOG(WARNING, "Ledger") << "Done (" << getTimeSpent(*app, "create")
-                                << ", " << getTimeSpent(*app, "write") << ", "
-                                << getTimeSpent(*app, "load") << ")";
+        CLOG(WARNING, "Ledger")
+            << "Done with" << (inMemoryOrderBook ? "" : "out")
+            << " in-memory order book (" << getTimeSpent(*app, "create")
+            << ", " << getTimeSpent(*app, "write") << ", "
+            << getTimeSpent(*app, "load") << ")";
     };
 
 #ifdef USE_POSTGRES
     SECTION("postgres")
     {
-        runTest(Config::TESTDB_POSTGRESQL, 10, 5, 25000);
+        runTest(Config::TESTDB_POSTGRESQL, false, 10, 5, 25000);
+    }
+
+    SECTION("postgres in-memory order book")
+    {
+        runTest(Config::TESTDB_POSTGRESQL, true, 10, 5, 25000);
     }
 #endif
 
     SECTION("sqlite")
     {
-        runTest(Config::TESTDB_ON_DISK_SQLITE, 10, 5, 25000);
+        runTest(Config::TESTDB_ON_DISK_SQLITE, false, 10, 5, 25000);
+    }
+
+    SECTION("sqlite in-memory order book")
+    {
+        runTest(Config::TESTDB_ON_DISK_SQLITE, true, 10, 5, 25000);
     }
 }
 
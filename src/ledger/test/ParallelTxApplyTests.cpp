@@ -0,0 +1,164 @@
+// Copyright 2020 Stellar Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "ledger/LedgerManager.h"
+#include "ledger/LedgerTxn.h"
+#include "ledger/ParallelTxApplier.h"
+#include "lib/catch.hpp"
+#include "main/Application.h"
+#include "test/TestAccount.h"
+#include "test/TestUtils.h"
+#include "test/TxTests.h"
+#include "test/test.h"
+#include "transactions/TransactionUtils.h"
+#include "util/XDROperators.h"
+
+#include "medida/counter.h"
+#include "medida/histogram.h"
+#include "medida/metrics_registry.h"
+#include "medida/timer.h"
+
+using namespace stellar;
+using namespace stellar::txtest;
+
+TEST_CASE("parallel apply scheduling", "[ledger][parallelapply]")
+{
+    VirtualClock clock;
+    auto app = createTestApplication(clock, getTestConfig());
+    app->start();
+
+    auto a = TestAccount{*app, getAccount("a"), 1};
+    auto b = TestAccount{*app, getAccount("b"), 1};
+    auto c = TestAccount{*app, getAccount("c"), 1};
+    auto d = TestAccount{*app, getAccount("d"), 1};
+    auto usd = makeAsset(getAccount("issuer"), "USD");
+
+    std::vector<TransactionFramePtr> txs = {
+        a.tx({payment(b, 10)}),
+        c.tx({payment(d, 10)}),
+        b.tx({payment(c, 10)}),
+        d.tx({manageOffer(0, makeNativeAsset(), usd, Price{1, 1}, 10)}),
+        a.tx({payment(b, 10)}),
+        c.tx({payment(d, 10)}),
+        a.tx({payment(b, usd, 10)})};
+    {
+        // binds the operations, the transactions themselves are not valid
+        LedgerTxn ltx(app->getLedgerTxnRoot());
+        for (auto const& tx : txs)
+        {
+            tx->checkValid(ltx, 0);
+        }
+    }
+
+    std::vector<std::unordered_set<LedgerKey>> footprints;
+    auto stages = ParallelTxApplier::schedule(txs, footprints);
+
+    REQUIRE(footprints.size() == txs.size());
+    REQUIRE(stages.size() == 5);
+    REQUIRE(stages[0].mTxIndexes == std::vector<size_t>{0, 1});
+    REQUIRE(!stages[0].mIsBarrier);
+    REQUIRE(stages[1].mTxIndexes == std::vector<size_t>{2});
+    REQUIRE(stages[2].mTxIndexes == std::vector<size_t>{3});
+    REQUIRE(stages[2].mIsBarrier);
+    REQUIRE(stages[3].mTxIndexes == std::vector<size_t>{4, 5});
+    REQUIRE(stages[4].mTxIndexes == std::vector<size_t>{6});
+
+    // Credit payments also touch the issuer
+    auto const& credit = footprints[6];
+    REQUIRE(credit.count(accountKey(getAccount("issuer").getPublicKey())));
+    REQUIRE(credit.count(trustlineKey(a.getPublicKey(), usd)));
+    REQUIRE(credit.count(trustlineKey(b.getPublicKey(), usd)));
+}
+
+TEST_CASE("parallel apply matches serial apply", "[ledger][parallelapply]")
+{
+    size_t const numAccounts = 20;
+
+    auto run = [&](Config cfg) {
+        VirtualClock clock;
+        auto app = createTestApplication(clock, cfg);
+        app->start();
+
+        auto root = TestAccount::createRoot(*app);
+        auto balance = app->getLedgerManager().getLastMinBalance(0) * 100;
+        std::vector<Operation> creates;
+        for (size_t i = 0; i < numAccounts; ++i)
+        {
+            auto name = "acc" + std::to_string(i);
+            creates.emplace_back(
+                createAccount(getAccount(name.c_str()).getPublicKey(),
+                              balance));
+        }
+        auto issuer = getAccount("issuer");
+        creates.emplace_back(createAccount(issuer.getPublicKey(), balance));
+        closeLedgerOn(*app, 2, 1, 1, 2020, {root.tx(creates)});
+
+        std::vector<TestAccount> accounts;
+        for (size_t i = 0; i < numAccounts; ++i)
+        {
+            auto name = "acc" + std::to_string(i);
+            accounts.emplace_back(*app, getAccount(name.c_str()));
+        }
+        auto usd = makeAsset(issuer, "USD");
+
+        // Independent pairs, a chain across the pairs, a few other
+        // operations with known footprints and one that crosses offers
+        std::vector<TransactionFramePtr> txs;
+        for (size_t i = 0; i + 1 < numAccounts; i += 2)
+        {
+            txs.emplace_back(
+                accounts[i].tx({payment(accounts[i + 1], 100 + i)}));
+        }
+        for (size_t i = 1; i + 1 < numAccounts; i += 4)
+        {
+            txs.emplace_back(
+                accounts[i].tx({payment(accounts[i + 1], 1000 + i)}));
+        }
+        DataValue value;
+        value.emplace_back('v');
+        txs.emplace_back(accounts[3].tx({manageData("key", &value)}));
+        txs.emplace_back(accounts[7].tx({changeTrust(usd, 1000)}));
+        txs.emplace_back(accounts[11].tx(
+            {manageOffer(0, makeNativeAsset(), usd, Price{1, 1}, 10)}));
+        txs.emplace_back(accounts[15].tx({accountMerge(accounts[14])}));
+        auto results = closeLedgerOn(*app, 3, 2, 1, 2020, txs);
+
+        auto& mismatch = app->getMetrics().NewCounter(
+            {"ledger", "parallel-apply", "serial-mismatch"});
+        REQUIRE(mismatch.count() == 0);
+        auto& stageSize = app->getMetrics().NewHistogram(
+            {"ledger", "parallel-apply", "stage-size"});
+        bool appliedInParallel = stageSize.count() > 0;
+        REQUIRE(appliedInParallel == (cfg.PARALLEL_TX_APPLY_THREADS > 0));
+        // Each transaction is timed once however it is applied, and only
+        // for the apply that is kept: this counts the one of ledger 2 too
+        auto& applyTimer = app->getMetrics().NewTimer(
+            {"ledger", "transaction", "apply"});
+        REQUIRE(applyTimer.count() == txs.size() + 1);
+
+        return std::make_pair(
+            app->getLedgerManager().getLastClosedLedgerHeader().hash,
+            results);
+    };
+
+    auto serial = run(getTestConfig(0));
+
+    SECTION("parallel")
+    {
+        auto cfg = getTestConfig(1);
+        cfg.PARALLEL_TX_APPLY_THREADS = 4;
+        auto parallel = run(cfg);
+        REQUIRE(parallel.first == serial.first);
+        REQUIRE(parallel.second == serial.second);
+    }
+    SECTION("parallel compared with serial")
+    {
+        auto cfg = getTestConfig(1);
+        cfg.PARALLEL_TX_APPLY_THREADS = 4;
+        cfg.PARALLEL_TX_APPLY_COMPARE_SERIAL = true;
+        auto compared = run(cfg);
+        REQUIRE(compared.first == serial.first);
+        REQUIRE(compared.second == serial.second);
+    }
+}
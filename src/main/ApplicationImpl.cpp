@@ -144,14 +144,23 @@ ApplicationImpl::initialize(bool createNewDB)
     if (getConfig().MODE_USES_IN_MEMORY_LEDGER)
     {
         mLedgerTxnRoot = std::make_unique<InMemoryLedgerTxnRoot>();
-        mNeverCommittingLedgerTxn =
-            std::make_unique<LedgerTxn>(*mLedgerTxnRoot);
     }
     else
     {
+        // On SQLite, the writer would conflict with the transaction that the
+        // main connection keeps open while closing a ledger
+        bool writeBehind =
+            mConfig.WRITE_BEHIND_LEDGER_ENTRIES && !mDatabase->isSqlite();
+        if (mConfig.WRITE_BEHIND_LEDGER_ENTRIES && !writeBehind)
+        {
+            LOG(WARNING) << "WRITE_BEHIND_LEDGER_ENTRIES is only supported on "
+                            "PostgreSQL, ignoring it";
+        }
         mLedgerTxnRoot = std::make_unique<LedgerTxnRoot>(
-            *mDatabase, mConfig.ENTRY_CACHE_SIZE,
-            mConfig.BEST_OFFERS_CACHE_SIZE, mConfig.PREFETCH_BATCH_SIZE);
+            *mDatabase, mConfig.ENTRY_CACHE_SIZE, mConfig.ENTRY_CACHE_BYTES,
+            mConfig.BEST_OFFERS_CACHE_SIZE, mConfig.PREFETCH_BATCH_SIZE,
+            mConfig.IN_MEMORY_ORDER_BOOK, writeBehind,
+            mConfig.LEDGER_KEY_FILTERS);
     }
 
     BucketListIsConsistentWithDatabase::registerInvariant(*this);
@@ -384,23 +393,17 @@ ApplicationImpl::start()
         mConfig.FORCE_SCP = true;
     }
 
-    if (mConfig.METADATA_OUTPUT_STREAM != "" && mConfig.NODE_IS_VALIDATOR)
+    if (mConfig.METADATA_OUTPUT_STREAM != "" &&
+        mConfig.METADATA_OUTPUT_STREAM.compare(0, 4, "shm:") != 0 &&
+        mConfig.METADATA_OUTPUT_BACKPRESSURE == "BLOCK" &&
+        mConfig.NODE_IS_VALIDATOR)
     {
         LOG(ERROR) << "Starting stellar-core with METADATA_OUTPUT_STREAM "
-                      "requires NODE_IS_VALIDATOR to be unset";
+                      "and METADATA_OUTPUT_BACKPRESSURE=BLOCK requires "
+                      "NODE_IS_VALIDATOR to be unset";
         throw std::invalid_argument("NODE_IS_VALIDATOR is set");
     }
 
-    if (mConfig.NODE_IS_VALIDATOR)
-    {
-        if (mConfig.MODE_USES_IN_MEMORY_LEDGER)
-        {
-            LOG(ERROR) << "Starting stellar-core with in-memory ledger mode "
-                          "requires NODE_IS_VALIDATOR to be unset";
-            throw std::invalid_argument("NODE_IS_VALIDATOR is set");
-        }
-    }
-
     if (getHistoryArchiveManager().hasAnyWritableHistoryArchive())
     {
         if (!mConfig.MODE_STORES_HISTORY)
@@ -892,7 +895,6 @@ AbstractLedgerTxnParent&
 ApplicationImpl::getLedgerTxnRoot()
 {
     assertThreadIsMain();
-    return mConfig.MODE_USES_IN_MEMORY_LEDGER ? *mNeverCommittingLedgerTxn
-                                              : *mLedgerTxnRoot;
+    return *mLedgerTxnRoot;
 }
 }
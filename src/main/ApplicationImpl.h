@@ -29,7 +29,6 @@ class HistoryManager;
 class ProcessManager;
 class CommandHandler;
 class Database;
-class LedgerTxn;
 class LedgerTxnRoot;
 class InMemoryLedgerTxnRoot;
 class LoadGenerator;
@@ -156,19 +155,6 @@ class ApplicationImpl : public Application
     std::unique_ptr<StatusManager> mStatusManager;
     std::unique_ptr<AbstractLedgerTxnParent> mLedgerTxnRoot;
 
-    // This exists for use in MODE_USES_IN_MEMORY_LEDGER only: the
-    // mLedgerTxnRoot will be an InMemoryLedgerTxnRoot which is a _stub_
-    // AbstractLedgerTxnParent that refuses all commits and answers null to all
-    // queries; then an inner "never-committing" sub-LedgerTxn is constructed
-    // beneath it that serves as the "effective" in-memory root transaction,
-    // is returned when a client requests the root.
-    //
-    // Note that using this only works when the ledger can fit in RAM -- as it
-    // is held in the never-committing LedgerTxn in its entirety -- so if it
-    // ever grows beyond RAM-size you need to use a mode with some sort of
-    // database on secondary storage.
-    std::unique_ptr<LedgerTxn> mNeverCommittingLedgerTxn;
-
 #ifdef BUILD_TESTS
     std::unique_ptr<LoadGenerator> mLoadGenerator;
 #endif
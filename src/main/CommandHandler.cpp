@@ -18,6 +18,7 @@
 #include "overlay/BanManager.h"
 #include "overlay/OverlayManager.h"
 #include "overlay/SurveyManager.h"
+#include "transactions/OperationProfiler.h"
 #include "transactions/TransactionUtils.h"
 #include "util/Logging.h"
 #include "util/StatusManager.h"
@@ -88,6 +89,7 @@ CommandHandler::CommandHandler(Application& app) : mApp(app)
     addRoute("logrotate", &CommandHandler::logRotate);
     addRoute("manualclose", &CommandHandler::manualClose);
     addRoute("metrics", &CommandHandler::metrics);
+    addRoute("opprofile", &CommandHandler::opProfile);
     addRoute("peers", &CommandHandler::peers);
     addRoute("quorum", &CommandHandler::quorum);
     addRoute("scp", &CommandHandler::scpInfo);
@@ -272,6 +274,18 @@ CommandHandler::metrics(std::string const& params, std::string& retStr)
     retStr = jr.Report();
 }
 
+void
+CommandHandler::opProfile(std::string const& params, std::string& retStr)
+{
+    auto profiler = mApp.getLedgerManager().getOperationProfiler();
+    if (!profiler)
+    {
+        throw std::invalid_argument(
+            "Operation profiling is disabled, set PROFILE_OPERATIONS");
+    }
+    retStr = profiler->getJsonInfo().toStyledString();
+}
+
 void
 CommandHandler::logRotate(std::string const& params, std::string& retStr)
 {
@@ -110,6 +110,7 @@ Config::Config() : NODE_SEED(SecretKey::random())
     CATCHUP_RECENT = 0;
     AUTOMATIC_MAINTENANCE_PERIOD = std::chrono::seconds{14400};
     AUTOMATIC_MAINTENANCE_COUNT = 50000;
+    AUTOMATIC_MAINTENANCE_STEP_BUDGET_MS = std::chrono::milliseconds{50};
     ARTIFICIALLY_GENERATE_LOAD_FOR_TESTING = false;
     ARTIFICIALLY_ACCELERATE_TIME_FOR_TESTING = false;
     ARTIFICIALLY_SET_CLOSE_TIME_FOR_TESTING = 0;
@@ -122,8 +123,12 @@ Config::Config() : NODE_SEED(SecretKey::random())
     UNSAFE_QUORUM = false;
     DISABLE_BUCKET_GC = false;
     DISABLE_XDR_FSYNC = false;
+    COMPRESS_BUCKET_FILES = false;
     MAX_SLOTS_TO_REMEMBER = 12;
     METADATA_OUTPUT_STREAM = "";
+    METADATA_OUTPUT_QUEUE_SIZE = 16;
+    METADATA_OUTPUT_BACKPRESSURE = "BLOCK";
+    METADATA_OUTPUT_SHM_SIZE_MB = 256;
 
     LOG_FILE_PATH = "stellar-core.%datetime{%Y.%M.%d-%H:%m:%s}.log";
     BUCKET_DIR_PATH = "buckets";
@@ -163,14 +168,27 @@ Config::Config() : NODE_SEED(SecretKey::random())
     //
     // Worst case = 10 concurrent merges + 1 quorum intersection calculation.
     WORKER_THREADS = 11;
+    BUCKET_MERGE_THREADS = 1;
+    BUCKET_APPLY_THREADS = 1;
     MAX_CONCURRENT_SUBPROCESSES = 16;
     NODE_IS_VALIDATOR = false;
     QUORUM_INTERSECTION_CHECKER = true;
     DATABASE = SecretValue{"sqlite3://:memory:"};
 
     ENTRY_CACHE_SIZE = 100000;
+    ENTRY_CACHE_BYTES = 128 * 1024 * 1024;
     BEST_OFFERS_CACHE_SIZE = 64;
+    IN_MEMORY_ORDER_BOOK = false;
     PREFETCH_BATCH_SIZE = 1000;
+    WRITE_BEHIND_LEDGER_ENTRIES = false;
+    BULK_UPSERT_COPY_THRESHOLD = 100;
+    LEDGER_KEY_FILTERS = true;
+
+    PARALLEL_TX_APPLY_THREADS = 0;
+    PARALLEL_TX_APPLY_COMPARE_SERIAL = false;
+
+    PROFILE_OPERATIONS = false;
+    PROFILE_SLOWEST_TRANSACTIONS = 10;
 
     SUPPORTED_META_VERSION = 1;
 
@@ -696,10 +714,36 @@ Config::processConfig(std::shared_ptr<cpptoml::table> t)
             {
                 DISABLE_XDR_FSYNC = readBool(item);
             }
+            else if (item.first == "COMPRESS_BUCKET_FILES")
+            {
+                COMPRESS_BUCKET_FILES = readBool(item);
+            }
             else if (item.first == "METADATA_OUTPUT_STREAM")
             {
                 METADATA_OUTPUT_STREAM = readString(item);
             }
+            else if (item.first == "METADATA_OUTPUT_QUEUE_SIZE")
+            {
+                METADATA_OUTPUT_QUEUE_SIZE =
+                    readInt<uint32_t>(item, 1, UINT32_MAX);
+            }
+            else if (item.first == "METADATA_OUTPUT_SHM_SIZE_MB")
+            {
+                METADATA_OUTPUT_SHM_SIZE_MB =
+                    readInt<uint32_t>(item, 1, UINT32_MAX);
+            }
+            else if (item.first == "METADATA_OUTPUT_BACKPRESSURE")
+            {
+                METADATA_OUTPUT_BACKPRESSURE = readString(item);
+                if (METADATA_OUTPUT_BACKPRESSURE != "BLOCK" &&
+                    METADATA_OUTPUT_BACKPRESSURE != "DROP" &&
+                    METADATA_OUTPUT_BACKPRESSURE != "SPILL")
+                {
+                    throw std::invalid_argument(
+                        "METADATA_OUTPUT_BACKPRESSURE must be one of BLOCK, "
+                        "DROP or SPILL");
+                }
+            }
             else if (item.first == "KNOWN_CURSORS")
             {
                 KNOWN_CURSORS = readStringArray(item);
@@ -760,6 +804,12 @@ Config::processConfig(std::shared_ptr<cpptoml::table> t)
             {
                 AUTOMATIC_MAINTENANCE_COUNT = readInt<uint32_t>(item);
             }
+            else if (item.first == "AUTOMATIC_MAINTENANCE_STEP_BUDGET_MS")
+            {
+                AUTOMATIC_MAINTENANCE_STEP_BUDGET_MS =
+                    std::chrono::milliseconds{
+                        readInt<uint32_t>(item, 1, UINT32_MAX)};
+            }
             else if (item.first == "MANUAL_CLOSE")
             {
                 MANUAL_CLOSE = readBool(item);
@@ -876,6 +926,14 @@ Config::processConfig(std::shared_ptr<cpptoml::table> t)
             {
                 WORKER_THREADS = readInt<int>(item, 1, 1000);
             }
+            else if (item.first == "BUCKET_MERGE_THREADS")
+            {
+                BUCKET_MERGE_THREADS = readInt<uint32_t>(item, 1, 64);
+            }
+            else if (item.first == "BUCKET_APPLY_THREADS")
+            {
+                BUCKET_APPLY_THREADS = readInt<uint32_t>(item, 1, 64);
+            }
             else if (item.first == "MAX_CONCURRENT_SUBPROCESSES")
             {
                 MAX_CONCURRENT_SUBPROCESSES = readInt<int>(item, 1);
@@ -951,14 +1009,55 @@ Config::processConfig(std::shared_ptr<cpptoml::table> t)
             {
                 ENTRY_CACHE_SIZE = readInt<uint32_t>(item);
             }
+            else if (item.first == "ENTRY_CACHE_BYTES")
+            {
+                ENTRY_CACHE_BYTES =
+                    static_cast<size_t>(readInt<int64_t>(item, 0));
+            }
             else if (item.first == "BEST_OFFERS_CACHE_SIZE")
             {
                 BEST_OFFERS_CACHE_SIZE = readInt<uint32_t>(item);
             }
+            else if (item.first == "IN_MEMORY_ORDER_BOOK")
+            {
+                IN_MEMORY_ORDER_BOOK = readBool(item);
+            }
             else if (item.first == "PREFETCH_BATCH_SIZE")
             {
                 PREFETCH_BATCH_SIZE = readInt<uint32_t>(item);
             }
+            else if (item.first == "WRITE_BEHIND_LEDGER_ENTRIES")
+            {
+                WRITE_BEHIND_LEDGER_ENTRIES = readBool(item);
+            }
+            else if (item.first == "BULK_UPSERT_COPY_THRESHOLD")
+            {
+                BULK_UPSERT_COPY_THRESHOLD = readInt<uint32_t>(item);
+            }
+            else if (item.first == "LEDGER_KEY_FILTERS")
+            {
+                LEDGER_KEY_FILTERS = readBool(item);
+            }
+            else if (item.first == "IN_MEMORY_LEDGER")
+            {
+                MODE_USES_IN_MEMORY_LEDGER = readBool(item);
+            }
+            else if (item.first == "PARALLEL_TX_APPLY_THREADS")
+            {
+                PARALLEL_TX_APPLY_THREADS = readInt<uint32_t>(item);
+            }
+            else if (item.first == "PARALLEL_TX_APPLY_COMPARE_SERIAL")
+            {
+                PARALLEL_TX_APPLY_COMPARE_SERIAL = readBool(item);
+            }
+            else if (item.first == "PROFILE_OPERATIONS")
+            {
+                PROFILE_OPERATIONS = readBool(item);
+            }
+            else if (item.first == "PROFILE_SLOWEST_TRANSACTIONS")
+            {
+                PROFILE_SLOWEST_TRANSACTIONS = readInt<uint32_t>(item);
+            }
             else if (item.first == "MAXIMUM_LEDGER_CLOSETIME_DRIFT")
             {
                 MAXIMUM_LEDGER_CLOSETIME_DRIFT = readInt<int64_t>(item, 0);
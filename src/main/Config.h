@@ -153,6 +153,10 @@ class Config : public std::enable_shared_from_this<Config>
     // maintenance run
     uint32_t AUTOMATIC_MAINTENANCE_COUNT;
 
+    // A maintenance run deletes rows in small batches, spending at most about
+    // this long deleting at a time before yielding to other work
+    std::chrono::milliseconds AUTOMATIC_MAINTENANCE_STEP_BUDGET_MS;
+
     // A config parameter that enables synthetic load generation on demand,
     // using the `generateload` runtime command (see CommandHandler.cpp). This
     // option only exists for stress-testing and should not be enabled in
@@ -197,10 +201,11 @@ class Config : public std::enable_shared_from_this<Config>
     // be set to `false` only for testing purposes.
     bool MODE_ENABLES_BUCKETLIST;
 
-    // A config parameter that uses a never-committing ledger. This means that
-    // all ledger entries will be kept in memory, and not persisted to DB
-    // (relevant tables won't even be created). This should not be set for
-    // production validators.
+    // A config parameter (IN_MEMORY_LEDGER in the config file) that keeps all
+    // ledger entries in an InMemoryLedgerTxnRoot instead of persisting them
+    // to DB (relevant tables won't even be created). They are loaded from the
+    // bucket list when the node starts, so this requires the bucket list and
+    // enough RAM to hold the whole ledger.
     bool MODE_USES_IN_MEMORY_LEDGER;
 
     // A config parameter that stores historical data, such as transactions,
@@ -242,6 +247,11 @@ class Config : public std::enable_shared_from_this<Config>
     // you want to make that trade.
     bool DISABLE_XDR_FSYNC;
 
+    // If set to true, bucket files are written block-compressed, see
+    // util/BlockCompression.h. Bucket hashes are those of the uncompressed
+    // files either way, and buckets are published uncompressed.
+    bool COMPRESS_BUCKET_FILES;
+
     // Number of most recent ledgers to remember. Defaults to 12, or
     // approximately ~1 min of network activity.
     uint32 MAX_SLOTS_TO_REMEMBER;
@@ -254,15 +264,42 @@ class Config : public std::enable_shared_from_this<Config>
     // POSIX or a named pipe on Windows, though plain files also work) or a
     // string of the form "fd:N" for some integer N which, on POSIX, specifies
     // the existing open file descriptor N inherited by the process (for example
-    // to write to an anonymous pipe).
+    // to write to an anonymous pipe), or "shm:NAME" for a POSIX shared memory
+    // ring buffer of METADATA_OUTPUT_SHM_SIZE_MB megabytes named NAME, see
+    // ShmRingBufferReader.
     //
     // As a further safety check, this option is mutually exclusive with
-    // NODE_IS_VALIDATOR, as its typical use writing to a pipe with a reader
-    // process on the other end introduces a potentially-unbounded synchronous
-    // delay in closing a ledger, and should not be used on a node participating
-    // in consensus, only a passive "watcher" node.
+    // NODE_IS_VALIDATOR when METADATA_OUTPUT_BACKPRESSURE is BLOCK, unless it
+    // is a shared memory ring buffer, which never waits for its readers, as its
+    // typical use writing to a pipe with a reader process on the other end
+    // introduces a potentially-unbounded delay in closing a ledger, and should
+    // not be used on a node participating in consensus, only a passive
+    // "watcher" node.
     std::string METADATA_OUTPUT_STREAM;
 
+    // METADATA_OUTPUT_BACKPRESSURE says how closing a ledger waits for the
+    // reader of METADATA_OUTPUT_STREAM:
+    // - BLOCK writes the metadata of the ledger to the stream before the
+    //   ledger is committed, waiting for the reader as needed. Metadata
+    //   lost to a crash is that of a ledger that was not committed, and is
+    //   produced again when the ledger is replayed.
+    // - DROP and SPILL leave the metadata to a dedicated thread, which
+    //   buffers up to METADATA_OUTPUT_QUEUE_SIZE ledgers of metadata that the
+    //   reader has not consumed yet. Once that buffer is full, DROP discards
+    //   the metadata of the ledger, leaving a gap in the sequence of ledgers
+    //   streamed, with no marker in its place; SPILL appends the metadata to a
+    //   temporary file, which is streamed once the buffer has been drained.
+    //   In both modes, the metadata still buffered or spilled when the
+    //   process stops without shutting down cleanly is lost for good: its
+    //   ledgers are committed, so they are not replayed, and spill files live
+    //   in a temporary directory that is wiped on restart.
+    uint32_t METADATA_OUTPUT_QUEUE_SIZE;
+    std::string METADATA_OUTPUT_BACKPRESSURE;
+
+    // Size of the ring buffer when METADATA_OUTPUT_STREAM is "shm:NAME"; a
+    // reader falling this far behind is overrun.
+    uint32_t METADATA_OUTPUT_SHM_SIZE_MB;
+
     // Set of cursors added at each startup with value '1'.
     std::vector<std::string> KNOWN_CURSORS;
 
@@ -328,6 +365,13 @@ class Config : public std::enable_shared_from_this<Config>
 
     // thread-management config
     int WORKER_THREADS;
+    // Threads each large bucket merge is split across, including the worker
+    // thread that runs it
+    uint32_t BUCKET_MERGE_THREADS;
+
+    // Database connections that catchup writes the entries of buckets
+    // through in parallel, on PostgreSQL
+    uint32_t BUCKET_APPLY_THREADS;
 
     // process-management config
     int MAX_CONCURRENT_SUBPROCESSES;
@@ -359,11 +403,21 @@ class Config : public std::enable_shared_from_this<Config>
     // Data layer cache configuration
     // - ENTRY_CACHE_SIZE controls the maximum number of LedgerEntry objects
     //   that will be stored in the cache
+    // - ENTRY_CACHE_BYTES controls the maximum memory, in bytes, used by the
+    //   LedgerEntry objects stored in the cache
     // - BEST_OFFERS_CACHE_SIZE controls the maximum number of Asset pairs that
     //   will be stored in the cache, although many LedgerEntry objects may be
     //   associated with a single Asset pair
+    // - IN_MEMORY_ORDER_BOOK keeps every offer in memory, sorted per Asset
+    //   pair, so that best offers are never loaded from the database. The
+    //   best offers cache is not used when this is set. The order book is
+    //   loaded when the last closed ledger is loaded at startup, and after
+    //   catching up from buckets, which takes memory in proportion to the
+    //   number of offers.
     size_t ENTRY_CACHE_SIZE;
+    size_t ENTRY_CACHE_BYTES;
     size_t BEST_OFFERS_CACHE_SIZE;
+    bool IN_MEMORY_ORDER_BOOK;
 
     // Data layer prefetcher configuration
     // - PREFETCH_BATCH_SIZE determines how many records we'll prefetch per
@@ -371,6 +425,46 @@ class Config : public std::enable_shared_from_this<Config>
     // the entry cache
     size_t PREFETCH_BATCH_SIZE;
 
+    // Write-behind configuration
+    // - WRITE_BEHIND_LEDGER_ENTRIES commits the ledger entries of each closed
+    //   ledger in the background, on another database connection, after the
+    //   transaction that commits its header. If the node stops before they
+    //   are written, they are restored from the bucket list on restart. Only
+    //   PostgreSQL supports it; it is ignored on SQLite.
+    bool WRITE_BEHIND_LEDGER_ENTRIES;
+
+    // - BULK_UPSERT_COPY_THRESHOLD is the number of ledger entries of one type
+    //   from which a bulk upsert streams them to PostgreSQL with a binary
+    //   COPY into a temporary table, rather than binding them as arrays. 0
+    //   always uses COPY. SQLite ignores it.
+    size_t BULK_UPSERT_COPY_THRESHOLD;
+
+    // - LEDGER_KEY_FILTERS keeps a Bloom filter of the keys in the database
+    //   for each type of ledger entry, so that most lookups of entries that
+    //   do not exist are answered without querying the database. The
+    //   filters are loaded at startup, and rebuilt on a connection of the
+    //   pool when they degrade.
+    bool LEDGER_KEY_FILTERS;
+
+    // Parallel transaction apply configuration
+    // - PARALLEL_TX_APPLY_THREADS is the number of worker threads used to
+    //   apply transactions whose ledger footprints do not overlap. 0 (the
+    //   default) applies every transaction serially on the main thread.
+    // - PARALLEL_TX_APPLY_COMPARE_SERIAL additionally applies every ledger
+    //   serially and reports any divergence from the parallel apply; the
+    //   serial outcome is the one that gets committed.
+    size_t PARALLEL_TX_APPLY_THREADS;
+    bool PARALLEL_TX_APPLY_COMPARE_SERIAL;
+
+    // Operation profiling configuration
+    // - PROFILE_OPERATIONS records the cost of applying each operation, by
+    //   operation type, in ledger.profile-<type>.* histograms, and keeps the
+    //   slowest transactions of the last ledger closed for the opprofile
+    //   command.
+    // - PROFILE_SLOWEST_TRANSACTIONS is the number of those transactions.
+    bool PROFILE_OPERATIONS;
+    size_t PROFILE_SLOWEST_TRANSACTIONS;
+
     // The version of TransactionMeta that will be generated. Acceptable values
     // are 1 (default) and 2. Set to 2 only if downstream systems have been
     // updated to handle TransactionMetaV2.
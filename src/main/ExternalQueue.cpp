@@ -152,8 +152,8 @@ ExternalQueue::deleteCursor(std::string const& resid)
     st.execute(true);
 }
 
-void
-ExternalQueue::deleteOldEntries(uint32 count)
+uint32
+ExternalQueue::getLastDeletableLedger()
 {
     auto& db = mApp.getDatabase();
     int m;
@@ -195,8 +195,14 @@ ExternalQueue::deleteOldEntries(uint32 count)
     CLOG(INFO, "History") << "Trimming history <= ledger " << cmin
                           << " (rmin=" << rmin << ", qmin=" << qmin
                           << ", lmin=" << lmin << ")";
+    return cmin;
+}
 
-    mApp.getLedgerManager().deleteOldEntries(mApp.getDatabase(), cmin, count);
+void
+ExternalQueue::deleteOldEntries(uint32 count)
+{
+    mApp.getLedgerManager().deleteOldEntries(mApp.getDatabase(),
+                                             getLastDeletableLedger(), count);
 }
 
 void
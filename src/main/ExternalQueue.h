@@ -33,6 +33,10 @@ class ExternalQueue
     // deletes the subscription for the resource
     void deleteCursor(std::string const& resid);
 
+    // the last ledger whose data is needed neither by history publication
+    // nor by any subscriber, so that it is safe to delete
+    uint32 getLastDeletableLedger();
+
     // safely delete data, maximum count entries from each table
     void deleteOldEntries(uint32 count);
 
@@ -3,6 +3,9 @@
 // of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
 
 #include "main/Maintainer.h"
+#include "ledger/LedgerHeaderUtils.h"
+#include "ledger/LedgerManager.h"
+#include "main/Application.h"
 #include "main/Config.h"
 #include "main/ExternalQueue.h"
 #include "util/GlobalChecks.h"
@@ -10,10 +13,36 @@
 #include "util/format.h"
 #include "util/numeric.h"
 
+#include "medida/counter.h"
+#include "medida/meter.h"
+#include "medida/metrics_registry.h"
+#include "medida/timer.h"
+
 namespace stellar
 {
 
-Maintainer::Maintainer(Application& app) : mApp{app}, mTimer{mApp}
+// Batches take about a quarter of the budget of a step, so that the last batch
+// of a step does not overrun it by much
+static uint32_t const BATCHES_PER_STEP = 4;
+static uint32_t const INITIAL_BATCH_SIZE = 64;
+static uint32_t const MAX_BATCH_SIZE = 16384;
+
+// Pause between steps while in sync with the network; catching up, steps run
+// back to back so that maintenance keeps up with the ledgers applied
+static std::chrono::milliseconds const SYNCED_STEP_INTERVAL{1000};
+
+Maintainer::Maintainer(Application& app)
+    : mApp{app}
+    , mTimer{mApp}
+    , mStepTimer{mApp}
+    , mBatchSize{INITIAL_BATCH_SIZE}
+    , mPruneBacklog(
+          app.getMetrics().NewCounter({"maintenance", "prune", "backlog"}))
+    , mPrunedLedgers(app.getMetrics().NewMeter(
+          {"maintenance", "prune", "ledgers"}, "ledger"))
+    , mPruneBatch(app.getMetrics().NewTimer({"maintenance", "prune", "batch"}))
+    , mPruneBatchSize(
+          app.getMetrics().NewCounter({"maintenance", "prune", "batch-size"}))
 {
 }
 
@@ -50,15 +79,97 @@ Maintainer::scheduleMaintenance()
 void
 Maintainer::tick()
 {
-    performMaintenance(mApp.getConfig().AUTOMATIC_MAINTENANCE_COUNT);
+    LOG(INFO) << "Starting maintenance";
+    // A run still in progress carries on towards the new limits
+    ExternalQueue ps{mApp};
+    mPruneLast = ps.getLastDeletableLedger();
+    mPruneRemaining = mApp.getConfig().AUTOMATIC_MAINTENANCE_COUNT;
+    if (!mPruning)
+    {
+        mPruning = true;
+        scheduleStep(std::chrono::milliseconds{0});
+    }
     scheduleMaintenance();
 }
 
+void
+Maintainer::scheduleStep(std::chrono::milliseconds delay)
+{
+    mStepTimer.expires_from_now(delay);
+    mStepTimer.async_wait([this]() { step(); }, VirtualTimer::onFailureNoop);
+}
+
+void
+Maintainer::step()
+{
+    auto budget = mApp.getConfig().AUTOMATIC_MAINTENANCE_STEP_BUDGET_MS;
+    auto batchBudget = budget / BATCHES_PER_STEP;
+    auto start = std::chrono::steady_clock::now();
+
+    bool more = true;
+    while (more && mPruneRemaining > 0 &&
+           std::chrono::steady_clock::now() - start < budget)
+    {
+        auto count = std::min(mBatchSize, mPruneRemaining);
+        auto batchStart = std::chrono::steady_clock::now();
+        more = pruneBatch(mPruneLast, count);
+        mPruneRemaining -= count;
+
+        // Deleting takes roughly as long per ledger from one batch to the next
+        auto batchTime = std::chrono::steady_clock::now() - batchStart;
+        if (batchTime > batchBudget)
+        {
+            mBatchSize = std::max<uint32_t>(1, mBatchSize / 2);
+        }
+        else if (batchTime < batchBudget / 2)
+        {
+            mBatchSize = std::min(MAX_BATCH_SIZE, mBatchSize * 2);
+        }
+        mPruneBatchSize.set_count(mBatchSize);
+    }
+
+    if (!more || mPruneRemaining == 0)
+    {
+        LOG(INFO) << "Maintenance done, " << mPruneBacklog.count()
+                  << " ledgers left to delete";
+        mPruning = false;
+        return;
+    }
+    scheduleStep(mApp.getLedgerManager().isSynced()
+                     ? SYNCED_STEP_INTERVAL
+                     : std::chrono::milliseconds{0});
+}
+
+bool
+Maintainer::pruneBatch(uint32_t last, uint32_t count)
+{
+    auto& db = mApp.getDatabase();
+    {
+        auto timer = mPruneBatch.TimeScope();
+        mApp.getLedgerManager().deleteOldEntries(db, last, count);
+    }
+    mPrunedLedgers.Mark(count);
+
+    auto oldest = LedgerHeaderUtils::getOldestLedgerSeq(db);
+    auto backlog = (oldest == 0 || oldest > last) ? 0 : last - oldest + 1;
+    mPruneBacklog.set_count(backlog);
+    return backlog > 0;
+}
+
 void
 Maintainer::performMaintenance(uint32_t count)
 {
     LOG(INFO) << "Performing maintenance";
     ExternalQueue ps{mApp};
-    ps.deleteOldEntries(count);
+    auto last = ps.getLastDeletableLedger();
+    while (count > 0)
+    {
+        auto batch = std::min(mBatchSize, count);
+        count -= batch;
+        if (!pruneBatch(last, batch))
+        {
+            break;
+        }
+    }
 }
 }
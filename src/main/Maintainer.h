@@ -8,6 +8,13 @@
 
 #include <cstdint>
 
+namespace medida
+{
+class Counter;
+class Meter;
+class Timer;
+}
+
 namespace stellar
 {
 
@@ -28,7 +35,30 @@ class Maintainer
     Application& mApp;
     VirtualTimer mTimer;
 
+    // Automatic maintenance deletes up to mPruneRemaining ledgers, none after
+    // mPruneLast, in steps of several batches of mBatchSize ledgers each.
+    // Every step stops once AUTOMATIC_MAINTENANCE_STEP_BUDGET_MS is spent and
+    // mBatchSize follows how long batches take, so that a step never holds the
+    // main thread much longer than that.
+    VirtualTimer mStepTimer;
+    bool mPruning{false};
+    uint32_t mPruneLast{0};
+    uint32_t mPruneRemaining{0};
+    uint32_t mBatchSize;
+
+    medida::Counter& mPruneBacklog;
+    medida::Meter& mPrunedLedgers;
+    medida::Timer& mPruneBatch;
+    medida::Counter& mPruneBatchSize;
+
     void scheduleMaintenance();
     void tick();
+
+    void scheduleStep(std::chrono::milliseconds delay);
+    void step();
+
+    // Deletes up to count ledgers, none after last, and returns whether some
+    // remain to delete up to last
+    bool pruneBatch(uint32_t last, uint32_t count);
 };
 }
@@ -18,7 +18,7 @@ using namespace std;
 std::string PersistentState::mapping[kLastEntry] = {
     "lastclosedledger", "historyarchivestate", "forcescponnextlaunch",
     "lastscpdata",      "databaseschema",      "networkpassphrase",
-    "ledgerupgrades"};
+    "ledgerupgrades",   "lastwrittenledger"};
 
 std::string PersistentState::kSQLCreateStatement =
     "CREATE TABLE IF NOT EXISTS storestate ("
@@ -67,6 +67,14 @@ PersistentState::setState(PersistentState::Entry entry,
     updateDb(getStoreStateName(entry), value);
 }
 
+void
+PersistentState::setState(Database& db, soci::session& session,
+                          PersistentState::Entry entry,
+                          std::string const& value)
+{
+    updateDb(db, session, getStoreStateName(entry), value);
+}
+
 std::vector<std::string>
 PersistentState::getSCPStateAllSlots()
 {
@@ -95,23 +103,32 @@ PersistentState::setSCPStateForSlot(uint64 slot, std::string const& value)
 void
 PersistentState::updateDb(std::string const& entry, std::string const& value)
 {
-    auto prep = mApp.getDatabase().getPreparedStatement(
-        "UPDATE storestate SET state = :v WHERE statename = :n;");
+    auto& db = mApp.getDatabase();
+    updateDb(db, db.getSession(), entry, value);
+}
+
+void
+PersistentState::updateDb(Database& db, soci::session& session,
+                          std::string const& entry, std::string const& value)
+{
+    auto prep = db.getPreparedStatement(
+        "UPDATE storestate SET state = :v WHERE statename = :n;", session);
 
     auto& st = prep.statement();
     st.exchange(soci::use(value));
     st.exchange(soci::use(entry));
     st.define_and_bind();
     {
-        auto timer = mApp.getDatabase().getUpdateTimer("state");
+        auto timer = db.getUpdateTimer("state");
         st.execute(true);
     }
 
-    if (st.get_affected_rows() != 1 && getFromDb(entry).empty())
+    if (st.get_affected_rows() != 1 && getFromDb(db, session, entry).empty())
     {
-        auto timer = mApp.getDatabase().getInsertTimer("state");
-        auto prep2 = mApp.getDatabase().getPreparedStatement(
-            "INSERT INTO storestate (statename, state) VALUES (:n, :v);");
+        auto timer = db.getInsertTimer("state");
+        auto prep2 = db.getPreparedStatement(
+            "INSERT INTO storestate (statename, state) VALUES (:n, :v);",
+            session);
         auto& st2 = prep2.statement();
         st2.exchange(soci::use(entry));
         st2.exchange(soci::use(value));
@@ -126,12 +143,19 @@ PersistentState::updateDb(std::string const& entry, std::string const& value)
 
 std::string
 PersistentState::getFromDb(std::string const& entry)
+{
+    auto& db = mApp.getDatabase();
+    return getFromDb(db, db.getSession(), entry);
+}
+
+std::string
+PersistentState::getFromDb(Database& db, soci::session& session,
+                           std::string const& entry)
 {
     std::string res;
 
-    auto& db = mApp.getDatabase();
     auto prep = db.getPreparedStatement(
-        "SELECT state FROM storestate WHERE statename = :n;");
+        "SELECT state FROM storestate WHERE statename = :n;", session);
     auto& st = prep.statement();
     st.exchange(soci::into(res));
     st.exchange(soci::use(entry));
@@ -7,6 +7,11 @@
 #include "main/Application.h"
 #include <string>
 
+namespace soci
+{
+class session;
+}
+
 namespace stellar
 {
 
@@ -24,6 +29,7 @@ class PersistentState
         kDatabaseSchema,
         kNetworkPassphrase,
         kLedgerUpgrades,
+        kLastWrittenLedger,
         kLastEntry,
     };
 
@@ -32,6 +38,11 @@ class PersistentState
     std::string getState(Entry stateName);
     void setState(Entry stateName, std::string const& value);
 
+    // Like setState, but on a session of db that may not be its main
+    // session, so that it can be part of a transaction on another thread.
+    static void setState(Database& db, soci::session& session,
+                         Entry stateName, std::string const& value);
+
     // Special methods for SCP state (multiple slots)
     std::vector<std::string> getSCPStateAllSlots();
     void setSCPStateForSlot(uint64 slot, std::string const& value);
@@ -42,8 +53,12 @@ class PersistentState
 
     Application& mApp;
 
-    std::string getStoreStateName(Entry n, uint32 subscript = 0);
+    static std::string getStoreStateName(Entry n, uint32 subscript = 0);
     void updateDb(std::string const& entry, std::string const& value);
     std::string getFromDb(std::string const& entry);
+    static void updateDb(Database& db, soci::session& session,
+                         std::string const& entry, std::string const& value);
+    static std::string getFromDb(Database& db, soci::session& session,
+                                 std::string const& entry);
 };
 }
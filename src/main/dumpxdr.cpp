@@ -115,9 +115,9 @@ xdr_printer(const PublicKey& pk)
     return KeyUtils::toStrKey<PublicKey>(pk);
 }
 
-template <typename T>
+template <typename T, typename Stream>
 void
-dumpstream(XDRInputFileStream& in, bool json)
+dumpstream(Stream& in, bool json)
 {
     T tmp;
     if (json)
@@ -155,7 +155,11 @@ dumpXdrStream(std::string const& filename, bool json)
         }
         else if (sm[1] == "bucket")
         {
-            dumpstream<BucketEntry>(in, json);
+            // Buckets may be block-compressed, which only the mapped stream
+            // reads
+            XDRInputMappedStream bucketIn;
+            bucketIn.open(filename);
+            dumpstream<BucketEntry>(bucketIn, json);
         }
         else if (sm[1] == "transactions")
         {
@@ -0,0 +1,75 @@
+// Copyright 2020 Stellar Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "ledger/LedgerHeaderUtils.h"
+#include "lib/catch.hpp"
+#include "main/Application.h"
+#include "main/Config.h"
+#include "main/ExternalQueue.h"
+#include "main/Maintainer.h"
+#include "test/TestUtils.h"
+#include "test/TxTests.h"
+#include "test/test.h"
+
+#include "medida/counter.h"
+#include "medida/metrics_registry.h"
+#include "medida/timer.h"
+
+using namespace stellar;
+using namespace stellar::txtest;
+
+TEST_CASE("maintenance deletes old ledgers in batches", "[maintenance]")
+{
+    VirtualClock clock;
+    auto cfg = getTestConfig();
+    cfg.AUTOMATIC_MAINTENANCE_PERIOD = std::chrono::seconds{30};
+    cfg.AUTOMATIC_MAINTENANCE_COUNT = 1000;
+    auto app = createTestApplication(clock, cfg);
+    app->start();
+
+    for (uint32_t seq = 2; seq <= 40; ++seq)
+    {
+        closeLedgerOn(*app, seq, 1, 1, 2020);
+    }
+
+    auto& db = app->getDatabase();
+    auto last = ExternalQueue(*app).getLastDeletableLedger();
+    REQUIRE(last > 1);
+    REQUIRE(LedgerHeaderUtils::getOldestLedgerSeq(db) == 1);
+
+    auto& metrics = app->getMetrics();
+    auto& batches = metrics.NewTimer({"maintenance", "prune", "batch"});
+    auto& backlog = metrics.NewCounter({"maintenance", "prune", "backlog"});
+
+    SECTION("manually")
+    {
+        SECTION("up to count ledgers")
+        {
+            app->getMaintainer().performMaintenance(5);
+            auto oldest = LedgerHeaderUtils::getOldestLedgerSeq(db);
+            REQUIRE(oldest > 1);
+            REQUIRE(oldest <= 7);
+            REQUIRE(backlog.count() == last - oldest + 1);
+        }
+        SECTION("every deletable ledger")
+        {
+            app->getMaintainer().performMaintenance(1000);
+            REQUIRE(LedgerHeaderUtils::getOldestLedgerSeq(db) == last + 1);
+            REQUIRE(backlog.count() == 0);
+        }
+    }
+
+    SECTION("automatically")
+    {
+        auto deadline = clock.now() + std::chrono::seconds{60};
+        while ((batches.count() == 0 || backlog.count() != 0) &&
+               clock.now() < deadline)
+        {
+            clock.crank(false);
+        }
+        REQUIRE(batches.count() > 0);
+        REQUIRE(backlog.count() == 0);
+        REQUIRE(LedgerHeaderUtils::getOldestLedgerSeq(db) > last);
+    }
+}
@@ -0,0 +1,96 @@
+// Copyright 2020 Stellar Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "test/AllocationCounter.h"
+
+#include <cstdlib>
+#include <new>
+
+namespace
+{
+// Plain thread_local integers, so that counting needs neither
+// synchronization nor an allocation of its own
+thread_local size_t gActiveCounters = 0;
+thread_local size_t gCount = 0;
+thread_local size_t gBytes = 0;
+
+void*
+countedAlloc(size_t size)
+{
+    if (gActiveCounters != 0)
+    {
+        ++gCount;
+        gBytes += size;
+    }
+    // malloc(0) may return nullptr, operator new must not
+    if (auto p = std::malloc(size == 0 ? 1 : size))
+    {
+        return p;
+    }
+    throw std::bad_alloc();
+}
+}
+
+void*
+operator new(size_t size)
+{
+    return countedAlloc(size);
+}
+
+void*
+operator new[](size_t size)
+{
+    return countedAlloc(size);
+}
+
+void
+operator delete(void* p) noexcept
+{
+    std::free(p);
+}
+
+void
+operator delete[](void* p) noexcept
+{
+    std::free(p);
+}
+
+void
+operator delete(void* p, size_t) noexcept
+{
+    std::free(p);
+}
+
+void
+operator delete[](void* p, size_t) noexcept
+{
+    std::free(p);
+}
+
+namespace stellar
+{
+
+AllocationCounter::AllocationCounter()
+    : mStartCount(gCount), mStartBytes(gBytes)
+{
+    ++gActiveCounters;
+}
+
+AllocationCounter::~AllocationCounter()
+{
+    --gActiveCounters;
+}
+
+size_t
+AllocationCounter::getCount() const
+{
+    return gCount - mStartCount;
+}
+
+size_t
+AllocationCounter::getBytes() const
+{
+    return gBytes - mStartBytes;
+}
+}
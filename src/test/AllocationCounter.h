@@ -0,0 +1,30 @@
+#pragma once
+
+// Copyright 2020 Stellar Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "util/NonCopyable.h"
+
+#include <cstddef>
+
+namespace stellar
+{
+
+// Counts the calls to the global operator new, and the bytes they request,
+// made on the constructing thread during the lifetime of the counter. Test
+// builds replace the global operator new to do so; counters may be nested.
+// Blocks carved out of an Arena chunk are not counted, only the chunks.
+class AllocationCounter : public NonMovableOrCopyable
+{
+    size_t const mStartCount;
+    size_t const mStartBytes;
+
+  public:
+    AllocationCounter();
+    ~AllocationCounter();
+
+    size_t getCount() const;
+    size_t getBytes() const;
+};
+}
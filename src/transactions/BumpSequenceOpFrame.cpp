@@ -7,6 +7,7 @@
 #include "database/Database.h"
 #include "main/Application.h"
 #include "transactions/TransactionFrame.h"
+#include "transactions/TransactionUtils.h"
 #include "util/XDROperators.h"
 
 namespace stellar
@@ -63,4 +64,12 @@ BumpSequenceOpFrame::doCheckValid(uint32_t ledgerVersion)
     }
     return true;
 }
+
+bool
+BumpSequenceOpFrame::insertLedgerKeysToFootprint(
+    std::unordered_set<LedgerKey>& keys) const
+{
+    keys.emplace(accountKey(getSourceID()));
+    return true;
+}
 }
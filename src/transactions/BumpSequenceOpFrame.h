@@ -29,6 +29,8 @@ class BumpSequenceOpFrame : public OperationFrame
 
     bool doApply(AbstractLedgerTxn& ltx) override;
     bool doCheckValid(uint32_t ledgerVersion) override;
+    bool insertLedgerKeysToFootprint(
+        std::unordered_set<LedgerKey>& keys) const override;
 
     static BumpSequenceResultCode
     getInnerCode(OperationResult const& res)
@@ -161,4 +161,17 @@ ChangeTrustOpFrame::doCheckValid(uint32_t ledgerVersion)
     }
     return true;
 }
+
+bool
+ChangeTrustOpFrame::insertLedgerKeysToFootprint(
+    std::unordered_set<LedgerKey>& keys) const
+{
+    keys.emplace(accountKey(getSourceID()));
+    if (mChangeTrust.line.type() != ASSET_TYPE_NATIVE)
+    {
+        keys.emplace(accountKey(getIssuer(mChangeTrust.line)));
+        keys.emplace(trustlineKey(getSourceID(), mChangeTrust.line));
+    }
+    return true;
+}
 }
@@ -23,6 +23,8 @@ class ChangeTrustOpFrame : public OperationFrame
 
     bool doApply(AbstractLedgerTxn& ltx) override;
     bool doCheckValid(uint32_t ledgerVersion) override;
+    bool insertLedgerKeysToFootprint(
+        std::unordered_set<LedgerKey>& keys) const override;
 
     static ChangeTrustResultCode
     getInnerCode(OperationResult const& res)
@@ -112,4 +112,13 @@ CreateAccountOpFrame::insertLedgerKeysToPrefetch(
 {
     keys.emplace(accountKey(mCreateAccount.destination));
 }
+
+bool
+CreateAccountOpFrame::insertLedgerKeysToFootprint(
+    std::unordered_set<LedgerKey>& keys) const
+{
+    keys.emplace(accountKey(getSourceID()));
+    keys.emplace(accountKey(mCreateAccount.destination));
+    return true;
+}
 }
@@ -28,6 +28,8 @@ class CreateAccountOpFrame : public OperationFrame
     bool doCheckValid(uint32_t ledgerVersion) override;
     void insertLedgerKeysToPrefetch(
         std::unordered_set<LedgerKey>& keys) const override;
+    bool insertLedgerKeysToFootprint(
+        std::unordered_set<LedgerKey>& keys) const override;
 
     static CreateAccountResultCode
     getInnerCode(OperationResult const& res)
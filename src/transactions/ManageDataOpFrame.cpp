@@ -112,4 +112,13 @@ ManageDataOpFrame::insertLedgerKeysToPrefetch(
 {
     keys.emplace(dataKey(getSourceID(), mManageData.dataName));
 }
+
+bool
+ManageDataOpFrame::insertLedgerKeysToFootprint(
+    std::unordered_set<LedgerKey>& keys) const
+{
+    keys.emplace(accountKey(getSourceID()));
+    keys.emplace(dataKey(getSourceID(), mManageData.dataName));
+    return true;
+}
 }
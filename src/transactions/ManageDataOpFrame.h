@@ -29,6 +29,8 @@ class ManageDataOpFrame : public OperationFrame
     bool doCheckValid(uint32_t ledgerVersion) override;
     void insertLedgerKeysToPrefetch(
         std::unordered_set<LedgerKey>& keys) const override;
+    bool insertLedgerKeysToFootprint(
+        std::unordered_set<LedgerKey>& keys) const override;
 
     static ManageDataResultCode
     getInnerCode(OperationResult const& res)
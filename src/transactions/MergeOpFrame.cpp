@@ -132,4 +132,13 @@ MergeOpFrame::doCheckValid(uint32_t ledgerVersion)
     }
     return true;
 }
+
+bool
+MergeOpFrame::insertLedgerKeysToFootprint(
+    std::unordered_set<LedgerKey>& keys) const
+{
+    keys.emplace(accountKey(getSourceID()));
+    keys.emplace(accountKey(mOperation.body.destination()));
+    return true;
+}
 }
@@ -30,6 +30,8 @@ class MergeOpFrame : public OperationFrame
 
     bool doApply(AbstractLedgerTxn& ltx) override;
     bool doCheckValid(uint32_t ledgerVersion) override;
+    bool insertLedgerKeysToFootprint(
+        std::unordered_set<LedgerKey>& keys) const override;
 
     static AccountMergeResultCode
     getInnerCode(OperationResult const& res)
@@ -229,4 +229,12 @@ OperationFrame::insertLedgerKeysToPrefetch(
     // Do nothing by default
     return;
 }
+
+bool
+OperationFrame::insertLedgerKeysToFootprint(
+    std::unordered_set<LedgerKey>& keys) const
+{
+    // Unknown by default
+    return false;
+}
 }
@@ -86,5 +86,12 @@ class OperationFrame
 
     virtual void
     insertLedgerKeysToPrefetch(std::unordered_set<LedgerKey>& keys) const;
+
+    // Inserts into keys every ledger key that applying this operation could
+    // load, create or erase, and returns true. Returns false (the default) if
+    // that set cannot be determined without applying the operation, as is the
+    // case for anything that crosses offers or touches the ledger header.
+    virtual bool
+    insertLedgerKeysToFootprint(std::unordered_set<LedgerKey>& keys) const;
 };
 }
@@ -0,0 +1,161 @@
+// Copyright 2020 Stellar Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "transactions/OperationProfiler.h"
+#include "crypto/Hex.h"
+#include "crypto/KeyUtils.h"
+#include "lib/json/json.h"
+#include "util/HashOfHash.h"
+#include "util/XDROperators.h"
+
+#include "medida/histogram.h"
+#include "medida/metrics_registry.h"
+
+#include <algorithm>
+#include <cctype>
+#include <unordered_set>
+
+namespace stellar
+{
+
+void
+OperationProfiler::Sample::start()
+{
+    mCounters = getLedgerTxnCounters();
+    mStart = std::chrono::steady_clock::now();
+}
+
+OperationProfiler::Cost
+OperationProfiler::Sample::cost() const
+{
+    auto now = std::chrono::steady_clock::now();
+    auto const& counters = getLedgerTxnCounters();
+
+    Cost res;
+    res.mTime = now - mStart;
+    res.mLoads = counters.mLoads - mCounters.mLoads;
+    res.mDatabaseLoads = counters.mDatabaseLoads - mCounters.mDatabaseLoads;
+    res.mLedgerTxns = counters.mLedgerTxns - mCounters.mLedgerTxns;
+    return res;
+}
+
+// PATH_PAYMENT_STRICT_SEND becomes path-payment-strict-send
+static std::string
+operationTypeName(OperationType type)
+{
+    std::string name = xdr::xdr_traits<OperationType>::enum_name(type);
+    for (auto& c : name)
+    {
+        c = (c == '_') ? '-' : static_cast<char>(std::tolower(c));
+    }
+    return name;
+}
+
+OperationProfiler::OperationProfiler(medida::MetricsRegistry& metrics,
+                                     size_t slowestTransactions)
+    : mSlowestTransactions(slowestTransactions)
+{
+    // Every histogram is created up front so that recordOperation only reads
+    // mHistograms, from any thread
+    for (auto type : xdr::xdr_traits<OperationType>::enum_values())
+    {
+        auto group = "profile-" +
+                     operationTypeName(static_cast<OperationType>(type));
+        mHistograms.emplace(
+            type, OperationHistograms{
+                      metrics.NewHistogram({"ledger", group, "time"}),
+                      metrics.NewHistogram({"ledger", group, "loads"}),
+                      metrics.NewHistogram({"ledger", group, "db-loads"}),
+                      metrics.NewHistogram({"ledger", group, "ledger-txns"}),
+                      metrics.NewHistogram({"ledger", group, "meta-bytes"})});
+    }
+}
+
+void
+OperationProfiler::recordOperation(OperationType type, Cost const& cost)
+{
+    auto iter = mHistograms.find(static_cast<int32_t>(type));
+    if (iter == mHistograms.end())
+    {
+        return;
+    }
+
+    auto& histograms = iter->second;
+    histograms.mTime.Update(
+        std::chrono::duration_cast<std::chrono::microseconds>(cost.mTime)
+            .count());
+    histograms.mLoads.Update(cost.mLoads);
+    histograms.mDatabaseLoads.Update(cost.mDatabaseLoads);
+    histograms.mLedgerTxns.Update(cost.mLedgerTxns);
+    histograms.mMetaBytes.Update(cost.mMetaBytes);
+}
+
+void
+OperationProfiler::recordTransaction(Hash const& hash,
+                                     AccountID const& sourceID,
+                                     size_t operations, Cost const& cost)
+{
+    std::lock_guard<std::mutex> lock(mTransactionsMutex);
+    mTransactions.push_back({hash, sourceID, operations, cost});
+}
+
+void
+OperationProfiler::ledgerClosed(uint32_t ledgerSeq)
+{
+    std::vector<TransactionCost> transactions;
+    {
+        std::lock_guard<std::mutex> lock(mTransactionsMutex);
+        transactions.swap(mTransactions);
+    }
+
+    // A transaction applied again after a failed parallel stage is reported
+    // again; only its last report describes what was committed
+    std::unordered_set<Hash> seen;
+    std::vector<TransactionCost> slowest;
+    for (auto iter = transactions.rbegin(); iter != transactions.rend();
+         ++iter)
+    {
+        if (seen.insert(iter->mHash).second)
+        {
+            slowest.emplace_back(*iter);
+        }
+    }
+
+    auto slower = [](TransactionCost const& lhs, TransactionCost const& rhs) {
+        return lhs.mCost.mTime > rhs.mCost.mTime;
+    };
+    auto n = std::min(mSlowestTransactions, slowest.size());
+    std::partial_sort(slowest.begin(), slowest.begin() + n, slowest.end(),
+                      slower);
+    slowest.resize(n);
+
+    mLastLedgerSeq = ledgerSeq;
+    mLastSlowest.swap(slowest);
+}
+
+Json::Value
+OperationProfiler::getJsonInfo() const
+{
+    Json::Value res;
+    res["ledger"] = mLastLedgerSeq;
+    auto& transactions = res["transactions"];
+    transactions = Json::arrayValue;
+    for (auto const& tx : mLastSlowest)
+    {
+        Json::Value& txJson = transactions[transactions.size()];
+        txJson["hash"] = binToHex(tx.mHash);
+        txJson["source"] = KeyUtils::toStrKey(tx.mSourceID);
+        txJson["operations"] = static_cast<Json::UInt64>(tx.mOperations);
+        txJson["time-us"] = static_cast<Json::Int64>(
+            std::chrono::duration_cast<std::chrono::microseconds>(
+                tx.mCost.mTime)
+                .count());
+        txJson["loads"] = static_cast<Json::UInt64>(tx.mCost.mLoads);
+        txJson["db-loads"] = static_cast<Json::UInt64>(tx.mCost.mDatabaseLoads);
+        txJson["ledger-txns"] = static_cast<Json::UInt64>(tx.mCost.mLedgerTxns);
+        txJson["meta-bytes"] = static_cast<Json::UInt64>(tx.mCost.mMetaBytes);
+    }
+    return res;
+}
+}
@@ -0,0 +1,107 @@
+#pragma once
+
+// Copyright 2020 Stellar Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "ledger/LedgerTxn.h"
+#include "lib/json/json-forwards.h"
+#include "xdr/Stellar-transaction.h"
+#include <chrono>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+namespace medida
+{
+class Histogram;
+class MetricsRegistry;
+}
+
+namespace stellar
+{
+
+// Breaks down the cost of closing ledgers by operation type and by
+// transaction, when PROFILE_OPERATIONS is set.
+//
+// TransactionFrame reports the cost of every operation it applies, which is
+// recorded in histograms by operation type, and the cost of every transaction,
+// of which the slowest ones of each ledger are kept until the next ledger
+// closes. Operations and transactions can be reported from several threads at
+// once, see ParallelTxApplier; those that a failed parallel stage applies
+// again serially are reported twice to the histograms, but only once in the
+// slowest transactions.
+class OperationProfiler
+{
+  public:
+    // The cost of some work, in wall time, ledger entries loaded, ledger
+    // entries queried from the database, LedgerTxns created and bytes of
+    // meta produced.
+    struct Cost
+    {
+        std::chrono::nanoseconds mTime{0};
+        uint64_t mLoads{0};
+        uint64_t mDatabaseLoads{0};
+        uint64_t mLedgerTxns{0};
+        uint64_t mMetaBytes{0};
+    };
+
+    // Measures the work done on the calling thread between start and cost,
+    // which must be called on the same thread. Constructing a Sample costs
+    // nothing, so that it can be skipped when profiling is disabled.
+    class Sample
+    {
+        std::chrono::steady_clock::time_point mStart;
+        LedgerTxnCounters mCounters;
+
+      public:
+        void start();
+
+        // The bytes of meta are left for the caller to fill in
+        Cost cost() const;
+    };
+
+  private:
+    struct OperationHistograms
+    {
+        medida::Histogram& mTime;
+        medida::Histogram& mLoads;
+        medida::Histogram& mDatabaseLoads;
+        medida::Histogram& mLedgerTxns;
+        medida::Histogram& mMetaBytes;
+    };
+
+    struct TransactionCost
+    {
+        Hash mHash;
+        AccountID mSourceID;
+        size_t mOperations;
+        Cost mCost;
+    };
+
+    size_t const mSlowestTransactions;
+    std::unordered_map<int32_t, OperationHistograms> mHistograms;
+
+    // Guards the transactions of the ledger being closed
+    std::mutex mTransactionsMutex;
+    std::vector<TransactionCost> mTransactions;
+
+    uint32_t mLastLedgerSeq{0};
+    std::vector<TransactionCost> mLastSlowest;
+
+  public:
+    OperationProfiler(medida::MetricsRegistry& metrics,
+                      size_t slowestTransactions);
+
+    void recordOperation(OperationType type, Cost const& cost);
+    void recordTransaction(Hash const& hash, AccountID const& sourceID,
+                           size_t operations, Cost const& cost);
+
+    // Keeps the slowest transactions recorded since the previous call as
+    // those of ledger ledgerSeq, and starts recording the next ledger.
+    void ledgerClosed(uint32_t ledgerSeq);
+
+    // The slowest transactions of the last ledger closed, slowest first.
+    Json::Value getJsonInfo() const;
+};
+}
@@ -141,4 +141,23 @@ PaymentOpFrame::insertLedgerKeysToPrefetch(
         keys.emplace(trustlineKey(getSourceID(), mPayment.asset));
     }
 }
+
+bool
+PaymentOpFrame::insertLedgerKeysToFootprint(
+    std::unordered_set<LedgerKey>& keys) const
+{
+    // A payment is applied as a path payment with an empty path, which never
+    // crosses offers. It touches the source and destination accounts and, for
+    // credit assets, their trust lines as well as the issuer, which path
+    // payments load before protocol 13 to check that it exists.
+    keys.emplace(accountKey(getSourceID()));
+    keys.emplace(accountKey(mPayment.destination));
+    if (mPayment.asset.type() != ASSET_TYPE_NATIVE)
+    {
+        keys.emplace(accountKey(getIssuer(mPayment.asset)));
+        keys.emplace(trustlineKey(mPayment.destination, mPayment.asset));
+        keys.emplace(trustlineKey(getSourceID(), mPayment.asset));
+    }
+    return true;
+}
 }
@@ -27,6 +27,8 @@ class PaymentOpFrame : public OperationFrame
     bool doCheckValid(uint32_t ledgerVersion) override;
     void insertLedgerKeysToPrefetch(
         std::unordered_set<LedgerKey>& keys) const override;
+    bool insertLedgerKeysToFootprint(
+        std::unordered_set<LedgerKey>& keys) const override;
 
     static PaymentResultCode
     getInnerCode(OperationResult const& res)
@@ -269,4 +269,16 @@ SetOptionsOpFrame::doCheckValid(uint32_t ledgerVersion)
 
     return true;
 }
+
+bool
+SetOptionsOpFrame::insertLedgerKeysToFootprint(
+    std::unordered_set<LedgerKey>& keys) const
+{
+    keys.emplace(accountKey(getSourceID()));
+    if (mSetOptions.inflationDest)
+    {
+        keys.emplace(accountKey(*mSetOptions.inflationDest));
+    }
+    return true;
+}
 }
@@ -26,6 +26,8 @@ class SetOptionsOpFrame : public OperationFrame
 
     bool doApply(AbstractLedgerTxn& ltx) override;
     bool doCheckValid(uint32_t ledgerVersion) override;
+    bool insertLedgerKeysToFootprint(
+        std::unordered_set<LedgerKey>& keys) const override;
 
     static SetOptionsResultCode
     getInnerCode(OperationResult const& res)
@@ -13,10 +13,12 @@
 #include "herder/TxSetFrame.h"
 #include "invariant/InvariantManager.h"
 #include "ledger/LedgerHeaderUtils.h"
+#include "ledger/LedgerManager.h"
 #include "ledger/LedgerTxn.h"
 #include "ledger/LedgerTxnEntry.h"
 #include "ledger/LedgerTxnHeader.h"
 #include "main/Application.h"
+#include "transactions/OperationProfiler.h"
 #include "transactions/SignatureChecker.h"
 #include "transactions/SignatureUtils.h"
 #include "transactions/TransactionUtils.h"
@@ -601,12 +603,19 @@ TransactionFrame::applyOperations(SignatureChecker& signatureChecker,
     auto& operationsMeta = newMeta.v2().operations;
     operationsMeta.reserve(getNumOperations());
 
+    auto profiler = app.getLedgerManager().getOperationProfiler();
+
     // shield outer scope of any side effects with LedgerTxn
     LedgerTxn ltxTx(ltx);
     auto& opTimer = app.getMetrics().NewTimer({"ledger", "operation", "apply"});
     for (auto& op : mOperations)
     {
         auto time = opTimer.TimeScope();
+        OperationProfiler::Sample opSample;
+        if (profiler)
+        {
+            opSample.start();
+        }
         LedgerTxn ltxOp(ltxTx);
         bool txRes = op->apply(signatureChecker, ltxOp);
 
@@ -622,6 +631,13 @@ TransactionFrame::applyOperations(SignatureChecker& signatureChecker,
 
         operationsMeta.emplace_back(ltxOp.getChanges());
         ltxOp.commit();
+
+        if (profiler)
+        {
+            auto cost = opSample.cost();
+            cost.mMetaBytes = xdr::xdr_size(operationsMeta.back());
+            profiler->recordOperation(op->getOperation().body.type(), cost);
+        }
     }
 
     if (success)
@@ -666,6 +682,13 @@ bool
 TransactionFrame::apply(Application& app, AbstractLedgerTxn& ltx,
                         TransactionMeta& meta)
 {
+    auto profiler = app.getLedgerManager().getOperationProfiler();
+    OperationProfiler::Sample txSample;
+    if (profiler)
+    {
+        txSample.start();
+    }
+
     mCachedAccount.reset();
     SignatureChecker signatureChecker{ltx.loadHeader().current().ledgerVersion,
                                       getContentsHash(), mEnvelope.signatures};
@@ -690,7 +713,47 @@ TransactionFrame::apply(Application& app, AbstractLedgerTxn& ltx,
         ltxTx.commit();
         valid = signaturesValid && (cv == ValidationType::kFullyValid);
     }
-    return valid && applyOperations(signatureChecker, app, ltx, meta);
+    auto res = valid && applyOperations(signatureChecker, app, ltx, meta);
+
+    if (profiler)
+    {
+        auto cost = txSample.cost();
+        cost.mMetaBytes = xdr::xdr_size(meta);
+        profiler->recordTransaction(getFullHash(), getSourceID(),
+                                    getNumOperations(), cost);
+    }
+    return res;
+}
+
+bool
+TransactionFrame::insertLedgerKeysToFootprint(
+    std::unordered_set<LedgerKey>& keys) const
+{
+    keys.emplace(accountKey(getSourceID()));
+    for (auto const& op : getOperations())
+    {
+        keys.emplace(accountKey(op->getSourceID()));
+        if (!op->insertLedgerKeysToFootprint(keys))
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+void
+TransactionFrame::restoreResult(TransactionResult const& result)
+{
+    mResult = result;
+    mCachedAccount.reset();
+
+    // bind operations to the restored results
+    mOperations.clear();
+    for (size_t i = 0; i < getNumOperations(); i++)
+    {
+        mOperations.push_back(makeOperation(
+            mEnvelope.tx.operations[i], getResult().result.results()[i], i));
+    }
 }
 
 StellarMessage
@@ -703,81 +766,245 @@ TransactionFrame::toStellarMessage() const
 }
 
 void
-TransactionFrame::storeTransaction(Database& db, uint32_t ledgerSeq,
+TransactionFrame::storeTransaction(TransactionHistoryBatch& batch,
+                                   uint32_t ledgerSeq,
                                    TransactionMeta const& tm, int txindex,
                                    TransactionResultSet const& resultSet) const
 {
     auto txBytes(xdr::xdr_to_opaque(mEnvelope));
     auto txResultBytes(xdr::xdr_to_opaque(resultSet.results.back()));
+    xdr::opaque_vec<> txMeta(xdr::xdr_to_opaque(tm));
 
-    std::string txBody;
-    txBody = decoder::encode_b64(txBytes);
+    batch.add(binToHex(getContentsHash()), ledgerSeq, txindex,
+              {decoder::encode_b64(txBytes), decoder::encode_b64(txResultBytes),
+               decoder::encode_b64(txMeta)});
+}
 
-    std::string txResult;
-    txResult = decoder::encode_b64(txResultBytes);
+void
+TransactionFrame::storeTransactionFee(TransactionHistoryBatch& batch,
+                                      uint32_t ledgerSeq,
+                                      LedgerEntryChanges const& changes,
+                                      int txindex) const
+{
+    xdr::opaque_vec<> txChanges(xdr::xdr_to_opaque(changes));
 
-    xdr::opaque_vec<> txMeta(xdr::xdr_to_opaque(tm));
+    batch.add(binToHex(getContentsHash()), ledgerSeq, txindex,
+              {decoder::encode_b64(txChanges)});
+}
 
-    std::string meta;
-    meta = decoder::encode_b64(txMeta);
+TransactionHistoryBatch::TransactionHistoryBatch(
+    std::string const& table, std::vector<std::string> const& textColumns)
+    : mTable(table), mTextColumns(textColumns), mTexts(textColumns.size())
+{
+}
 
-    string txIDString(binToHex(getContentsHash()));
+TransactionHistoryBatch
+TransactionHistoryBatch::forTransactions()
+{
+    return TransactionHistoryBatch("txhistory",
+                                   {"txbody", "txresult", "txmeta"});
+}
 
-    auto prep = db.getPreparedStatement(
-        "INSERT INTO txhistory "
-        "( txid, ledgerseq, txindex,  txbody, txresult, txmeta) VALUES "
-        "(:id,  :seq,      :txindex, :txb,   :txres,   :meta)");
+TransactionHistoryBatch
+TransactionHistoryBatch::forTransactionFees()
+{
+    return TransactionHistoryBatch("txfeehistory", {"txchanges"});
+}
 
-    auto& st = prep.statement();
-    st.exchange(soci::use(txIDString));
-    st.exchange(soci::use(ledgerSeq));
-    st.exchange(soci::use(txindex));
-    st.exchange(soci::use(txBody));
-    st.exchange(soci::use(txResult));
-    st.exchange(soci::use(meta));
-    st.define_and_bind();
+void
+TransactionHistoryBatch::add(std::string const& txID, uint32_t ledgerSeq,
+                             int txindex, std::vector<std::string> texts)
+{
+    if (texts.size() != mTexts.size())
     {
-        auto timer = db.getInsertTimer("txhistory");
-        st.execute(true);
+        throw std::runtime_error("Wrong number of columns for " + mTable);
     }
-
-    if (st.get_affected_rows() != 1)
+    mTxIDs.emplace_back(txID);
+    mLedgerSeqs.emplace_back(unsignedToSigned(ledgerSeq));
+    mTxIndexes.emplace_back(txindex);
+    for (size_t i = 0; i < texts.size(); ++i)
     {
-        throw std::runtime_error("Could not update data in SQL");
+        mTexts[i].emplace_back(std::move(texts[i]));
     }
 }
 
-void
-TransactionFrame::storeTransactionFee(Database& db, uint32_t ledgerSeq,
-                                      LedgerEntryChanges const& changes,
-                                      int txindex) const
+class BulkInsertTxHistoryOperation : public DatabaseTypeSpecificOperation<void>
 {
-    xdr::opaque_vec<> txChanges(xdr::xdr_to_opaque(changes));
+    Database& mDB;
+    std::string const& mTable;
+    std::vector<std::string> const& mTextColumns;
+    std::vector<std::string> const& mTxIDs;
+    std::vector<int32_t> const& mLedgerSeqs;
+    std::vector<int32_t> const& mTxIndexes;
+    std::vector<std::vector<std::string>> const& mTexts;
+
+    std::string
+    columns() const
+    {
+        std::string res = "txid, ledgerseq, txindex";
+        for (auto const& column : mTextColumns)
+        {
+            res += ", " + column;
+        }
+        return res;
+    }
 
-    std::string txChanges64;
-    txChanges64 = decoder::encode_b64(txChanges);
+    void
+    checkInserted(soci::statement& st) const
+    {
+        if (static_cast<size_t>(st.get_affected_rows()) != mTxIDs.size())
+        {
+            throw std::runtime_error("Could not update data in SQL");
+        }
+    }
 
-    string txIDString(binToHex(getContentsHash()));
+  public:
+    BulkInsertTxHistoryOperation(
+        Database& db, std::string const& table,
+        std::vector<std::string> const& textColumns,
+        std::vector<std::string> const& txIDs,
+        std::vector<int32_t> const& ledgerSeqs,
+        std::vector<int32_t> const& txIndexes,
+        std::vector<std::vector<std::string>> const& texts)
+        : mDB(db)
+        , mTable(table)
+        , mTextColumns(textColumns)
+        , mTxIDs(txIDs)
+        , mLedgerSeqs(ledgerSeqs)
+        , mTxIndexes(txIndexes)
+        , mTexts(texts)
+    {
+    }
 
-    auto prep = db.getPreparedStatement(
-        "INSERT INTO txfeehistory "
-        "( txid, ledgerseq, txindex,  txchanges) VALUES "
-        "(:id,  :seq,      :txindex, :txchanges)");
+    void
+    doSociGenericOperation()
+    {
+        std::string sql = "INSERT INTO " + mTable + " ( " + columns() +
+                          " ) VALUES ( :id, :seq, :txindex";
+        for (size_t i = 0; i < mTextColumns.size(); ++i)
+        {
+            sql += ", :v" + std::to_string(i);
+        }
+        sql += " )";
+
+        auto prep = mDB.getPreparedStatement(sql);
+        soci::statement& st = prep.statement();
+        st.exchange(soci::use(mTxIDs));
+        st.exchange(soci::use(mLedgerSeqs));
+        st.exchange(soci::use(mTxIndexes));
+        for (auto const& texts : mTexts)
+        {
+            st.exchange(soci::use(texts));
+        }
+        st.define_and_bind();
+        {
+            auto timer = mDB.getInsertTimer(mTable);
+            st.execute(true);
+        }
+        checkInserted(st);
+    }
 
-    auto& st = prep.statement();
-    st.exchange(soci::use(txIDString));
-    st.exchange(soci::use(ledgerSeq));
-    st.exchange(soci::use(txindex));
-    st.exchange(soci::use(txChanges64));
-    st.define_and_bind();
+    void
+    doSqliteSpecificOperation(soci::sqlite3_session_backend* sq) override
     {
-        auto timer = db.getInsertTimer("txfeehistory");
+        doSociGenericOperation();
+    }
+#ifdef USE_POSTGRES
+    void
+    doPostgresCopyOperation(PGconn* conn)
+    {
+        PGBinaryCopy copy(static_cast<uint16_t>(3 + mTextColumns.size()));
+        for (size_t i = 0; i < mTxIDs.size(); ++i)
+        {
+            copy.beginRow();
+            copy.put(mTxIDs[i]);
+            copy.put(mLedgerSeqs[i]);
+            copy.put(mTxIndexes[i]);
+            for (auto const& texts : mTexts)
+            {
+                copy.put(texts[i]);
+            }
+        }
+
+        auto timer = mDB.getInsertTimer(mTable);
+        auto tmp = copy.copyInto(mDB.getSession(), conn, mTable, columns());
+        std::string sql = "INSERT INTO " + mTable + " (" + columns() +
+                          ") SELECT " + columns() + " FROM " + tmp;
+        auto prep = mDB.getPreparedStatement(sql);
+        soci::statement& st = prep.statement();
+        st.define_and_bind();
         st.execute(true);
+        checkInserted(st);
     }
 
-    if (st.get_affected_rows() != 1)
+    void
+    doPostgresSpecificOperation(soci::postgresql_session_backend* pg) override
+    {
+        if (mDB.useBulkCopy(mTxIDs.size()))
+        {
+            doPostgresCopyOperation(pg->conn_);
+            return;
+        }
+
+        PGconn* conn = pg->conn_;
+        std::string strTxIDs, strLedgerSeqs, strTxIndexes;
+        std::vector<std::string> strTexts(mTexts.size());
+        marshalToPGArray(conn, strTxIDs, mTxIDs);
+        marshalToPGArray(conn, strLedgerSeqs, mLedgerSeqs);
+        marshalToPGArray(conn, strTxIndexes, mTxIndexes);
+        for (size_t i = 0; i < mTexts.size(); ++i)
+        {
+            marshalToPGArray(conn, strTexts[i], mTexts[i]);
+        }
+
+        std::string sql = "WITH r AS (SELECT "
+                          "unnest(:ids::TEXT[]), "
+                          "unnest(:seqs::INT[]), "
+                          "unnest(:txindexes::INT[])";
+        for (size_t i = 0; i < mTextColumns.size(); ++i)
+        {
+            sql += ", unnest(:v" + std::to_string(i) + "::TEXT[])";
+        }
+        sql += ") INSERT INTO " + mTable + " ( " + columns() +
+               " ) SELECT * FROM r";
+
+        auto prep = mDB.getPreparedStatement(sql);
+        soci::statement& st = prep.statement();
+        st.exchange(soci::use(strTxIDs));
+        st.exchange(soci::use(strLedgerSeqs));
+        st.exchange(soci::use(strTxIndexes));
+        for (auto const& strText : strTexts)
+        {
+            st.exchange(soci::use(strText));
+        }
+        st.define_and_bind();
+        {
+            auto timer = mDB.getInsertTimer(mTable);
+            st.execute(true);
+        }
+        checkInserted(st);
+    }
+#endif
+};
+
+void
+TransactionHistoryBatch::flush(Database& db)
+{
+    if (mTxIDs.empty())
+    {
+        return;
+    }
+
+    BulkInsertTxHistoryOperation op(db, mTable, mTextColumns, mTxIDs,
+                                    mLedgerSeqs, mTxIndexes, mTexts);
+    db.doDatabaseTypeSpecificOperation(op);
+
+    mTxIDs.clear();
+    mLedgerSeqs.clear();
+    mTxIndexes.clear();
+    for (auto& texts : mTexts)
     {
-        throw std::runtime_error("Could not update data in SQL");
+        texts.clear();
     }
 }
 
@@ -9,6 +9,9 @@
 
 #include <memory>
 #include <set>
+#include <string>
+#include <unordered_set>
+#include <vector>
 
 namespace soci
 {
@@ -36,6 +39,43 @@ class SHA256;
 class TransactionFrame;
 using TransactionFramePtr = std::shared_ptr<TransactionFrame>;
 
+// The rows that closing one ledger adds to the txhistory or the txfeehistory
+// table, accumulated by TransactionFrame::storeTransaction or
+// storeTransactionFee and written with a single statement by flush.
+class TransactionHistoryBatch
+{
+    std::string const mTable;
+    std::vector<std::string> const mTextColumns;
+
+    std::vector<std::string> mTxIDs;
+    std::vector<int32_t> mLedgerSeqs;
+    std::vector<int32_t> mTxIndexes;
+    // One vector of values for each of mTextColumns
+    std::vector<std::vector<std::string>> mTexts;
+
+  public:
+    TransactionHistoryBatch(std::string const& table,
+                            std::vector<std::string> const& textColumns);
+
+    // A batch of txhistory rows and one of txfeehistory rows
+    static TransactionHistoryBatch forTransactions();
+    static TransactionHistoryBatch forTransactionFees();
+
+    // texts holds the values of the text columns, in order
+    void add(std::string const& txID, uint32_t ledgerSeq, int txindex,
+             std::vector<std::string> texts);
+
+    size_t
+    size() const
+    {
+        return mTxIDs.size();
+    }
+
+    // Inserts the accumulated rows, timed by the insert timer of the table,
+    // and clears them. Throws if they are not all inserted.
+    void flush(Database& db);
+};
+
 class TransactionFrame
 {
   protected:
@@ -195,19 +235,29 @@ class TransactionFrame
     // version without meta
     bool apply(Application& app, AbstractLedgerTxn& ltx);
 
+    // Inserts into keys every ledger key that applying this transaction could
+    // access, and returns true. Returns false if some operation cannot bound
+    // its footprint ahead of time; keys is left partially filled in that case.
+    bool insertLedgerKeysToFootprint(std::unordered_set<LedgerKey>& keys) const;
+
+    // Replaces the result with one previously obtained from getResult(), so
+    // that an apply whose effects were discarded can be performed again.
+    void restoreResult(TransactionResult const& result);
+
     StellarMessage toStellarMessage() const;
 
     LedgerTxnEntry loadAccount(AbstractLedgerTxn& ltx,
                                LedgerTxnHeader const& header,
                                AccountID const& accountID);
 
-    // transaction history
-    void storeTransaction(Database& db, uint32_t ledgerSeq,
+    // transaction history, written when batch is flushed
+    void storeTransaction(TransactionHistoryBatch& batch, uint32_t ledgerSeq,
                           TransactionMeta const& tm, int txindex,
                           TransactionResultSet const& resultSet) const;
 
-    // fee history
-    void storeTransactionFee(Database& db, uint32_t ledgerSeq,
+    // fee history, written when batch is flushed
+    void storeTransactionFee(TransactionHistoryBatch& batch,
+                             uint32_t ledgerSeq,
                              LedgerEntryChanges const& changes,
                              int txindex) const;
 
@@ -0,0 +1,84 @@
+// Copyright 2020 Stellar Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "ledger/LedgerManager.h"
+#include "lib/catch.hpp"
+#include "lib/json/json.h"
+#include "main/Application.h"
+#include "test/TestAccount.h"
+#include "test/TestUtils.h"
+#include "test/TxTests.h"
+#include "test/test.h"
+#include "transactions/OperationProfiler.h"
+
+#include "medida/histogram.h"
+#include "medida/metrics_registry.h"
+
+using namespace stellar;
+using namespace stellar::txtest;
+
+TEST_CASE("operation profiler", "[tx][opprofile]")
+{
+    VirtualClock clock;
+    auto cfg = getTestConfig();
+
+    SECTION("disabled")
+    {
+        auto app = createTestApplication(clock, cfg);
+        app->start();
+        REQUIRE(!app->getLedgerManager().getOperationProfiler());
+    }
+
+    SECTION("enabled")
+    {
+        cfg.PROFILE_OPERATIONS = true;
+        cfg.PROFILE_SLOWEST_TRANSACTIONS = 2;
+        auto app = createTestApplication(clock, cfg);
+        app->start();
+        auto profiler = app->getLedgerManager().getOperationProfiler();
+        REQUIRE(profiler);
+
+        auto root = TestAccount::createRoot(*app);
+        auto balance = app->getLedgerManager().getLastMinBalance(0) * 100;
+        std::vector<Operation> creates;
+        for (auto name : {"a", "b", "c"})
+        {
+            creates.emplace_back(
+                createAccount(getAccount(name).getPublicKey(), balance));
+        }
+        closeLedgerOn(*app, 2, 1, 1, 2020, {root.tx(creates)});
+
+        auto a = TestAccount{*app, getAccount("a")};
+        auto b = TestAccount{*app, getAccount("b")};
+        auto c = TestAccount{*app, getAccount("c")};
+        closeLedgerOn(*app, 3, 2, 1, 2020,
+                      {a.tx({payment(b, 10)}), b.tx({payment(c, 10)}),
+                       c.tx({payment(a, 10)})});
+
+        auto& metrics = app->getMetrics();
+        auto histogram = [&](std::string const& type,
+                             std::string const& name) -> medida::Histogram& {
+            return metrics.NewHistogram({"ledger", "profile-" + type, name});
+        };
+        REQUIRE(histogram("create-account", "time").count() == 3);
+        REQUIRE(histogram("payment", "time").count() == 3);
+        REQUIRE(histogram("payment", "loads").min() >= 2);
+        REQUIRE(histogram("payment", "ledger-txns").min() >= 1);
+        REQUIRE(histogram("payment", "meta-bytes").min() > 0);
+        REQUIRE(histogram("manage-data", "time").count() == 0);
+
+        auto info = profiler->getJsonInfo();
+        REQUIRE(info["ledger"].asUInt() == 3);
+        auto const& transactions = info["transactions"];
+        REQUIRE(transactions.size() == 2);
+        REQUIRE(transactions[0]["time-us"].asInt64() >=
+                transactions[1]["time-us"].asInt64());
+        for (auto const& tx : transactions)
+        {
+            REQUIRE(tx["operations"].asUInt64() == 1);
+            REQUIRE(tx["loads"].asUInt64() >= 2);
+            REQUIRE(tx["meta-bytes"].asUInt64() > 0);
+        }
+    }
+}
@@ -6,6 +6,7 @@
 #include "ledger/LedgerTxnEntry.h"
 #include "ledger/LedgerTxnHeader.h"
 #include "lib/catch.hpp"
+#include "test/AllocationCounter.h"
 #include "test/TestAccount.h"
 #include "test/TestExceptions.h"
 #include "test/TestMarket.h"
@@ -4337,3 +4338,57 @@ TEST_CASE("pathpayment", "[tx][pathpayment]")
         }
     }
 }
+
+TEST_CASE("path payment allocations benchmark",
+          "[!hide][pathpaymentallocbench]")
+{
+    VirtualClock clock;
+    auto app = createTestApplication(clock, getTestConfig());
+    app->start();
+
+    auto root = TestAccount::createRoot(*app);
+    auto xlm = makeNativeAsset();
+    auto const balance = app->getLedgerManager().getLastMinBalance(10) * 100;
+    auto gateway = root.create("gate", balance);
+    auto source = root.create("source", balance);
+    auto destination = root.create("destination", balance);
+    auto usd = makeAsset(gateway, "USD");
+    auto eur = makeAsset(gateway, "EUR");
+    destination.changeTrust(eur, INT64_MAX);
+
+    // The payment crosses an offer of each market maker on each step of the
+    // path
+    for (auto name : {"maker1", "maker2"})
+    {
+        auto maker = root.create(name, balance);
+        maker.changeTrust(usd, INT64_MAX);
+        maker.changeTrust(eur, INT64_MAX);
+        gateway.pay(maker, usd, 1000);
+        gateway.pay(maker, eur, 1000);
+        maker.manageOffer(0, usd, xlm, Price{1, 1}, 1000);
+        maker.manageOffer(0, eur, usd, Price{1, 1}, 1000);
+    }
+
+    // The same payment is applied over and over to the same state, so every
+    // run but the first finds its entries in the cache of the root
+    auto tx =
+        source.tx({pathPayment(destination, xlm, 2000, eur, 1500, {usd})});
+    size_t const runs = 100;
+    size_t count = 0, bytes = 0;
+    for (size_t i = 0; i <= runs; ++i)
+    {
+        LedgerTxn ltx(app->getLedgerTxnRoot());
+        tx->processFeeSeqNum(ltx, ltx.loadHeader().current().baseFee);
+        TransactionMeta tm(2);
+        AllocationCounter counter;
+        bool res = tx->apply(*app, ltx, tm);
+        if (i != 0)
+        {
+            count += counter.getCount();
+            bytes += counter.getBytes();
+        }
+        REQUIRE(res);
+    }
+    CLOG(INFO, "Tx") << "path payment crossing 4 offers: " << count / runs
+                     << " allocations, " << bytes / runs << " bytes";
+}
@@ -0,0 +1,249 @@
+#pragma once
+
+// Copyright 2020 Stellar Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "util/NonCopyable.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <memory>
+#include <new>
+#include <vector>
+
+namespace stellar
+{
+
+// A bump allocator that carves blocks out of progressively larger chunks and
+// only returns memory to the system, all at once, when it is destroyed.
+//
+// Blocks handed back through deallocateNode are kept on per-size free lists and
+// reused by later calls to allocateNode, which absorbs the node churn of
+// node-based containers. allocateNode leaves blocks too large to be pooled,
+// such as the tables of growing hash maps, to the system, so that they are
+// freed as soon as they are returned. Blocks handed out by allocate are never
+// reused.
+//
+// An Arena is not thread-safe: it must only be allocated from, and have nodes
+// returned to it, on one thread at a time.
+class Arena : public NonMovableOrCopyable
+{
+    static size_t const ALIGNMENT = alignof(std::max_align_t);
+    static size_t const MIN_CHUNK_SIZE = 4096;
+    static size_t const MAX_CHUNK_SIZE = 1 << 20;
+    // Pooling the tables of hash maps as well does not pay: a LedgerTxn of
+    // 4095 entries makes about 17 table allocations against 4095 entry
+    // allocations, and the tables it drops are rarely of a size that another
+    // table of the same LedgerTxn needs next: pooling them doubled what
+    // the arena reserved and slowed erasing down.
+    static size_t const MAX_POOLED_SIZE = 512;
+
+    struct FreeBlock
+    {
+        FreeBlock* mNext;
+    };
+
+    std::vector<std::unique_ptr<char[]>> mChunks;
+    char* mCursor{nullptr};
+    size_t mRemaining{0};
+    size_t mNextChunkSize{MIN_CHUNK_SIZE};
+    size_t mBytesReserved{0};
+    FreeBlock* mFreeLists[MAX_POOLED_SIZE / ALIGNMENT + 1] = {};
+
+    static size_t
+    roundUp(size_t bytes)
+    {
+        bytes = std::max<size_t>(bytes, sizeof(FreeBlock));
+        return (bytes + ALIGNMENT - 1) & ~(ALIGNMENT - 1);
+    }
+
+    void
+    addChunk(size_t bytes)
+    {
+        auto size = std::max(bytes, mNextChunkSize);
+        mChunks.emplace_back(new char[size]);
+        mCursor = mChunks.back().get();
+        mRemaining = size;
+        mBytesReserved += size;
+        if (mNextChunkSize < MAX_CHUNK_SIZE)
+        {
+            mNextChunkSize *= 2;
+        }
+    }
+
+  public:
+    Arena() = default;
+
+    // Returns a block of at least bytes bytes, aligned for any scalar type.
+    void*
+    allocate(size_t bytes)
+    {
+        bytes = roundUp(bytes);
+        if (bytes > mRemaining)
+        {
+            addChunk(bytes);
+        }
+        void* res = mCursor;
+        mCursor += bytes;
+        mRemaining -= bytes;
+        return res;
+    }
+
+    // Like allocate, but prefers a block of the same size previously returned
+    // with deallocateNode.
+    void*
+    allocateNode(size_t bytes)
+    {
+        bytes = roundUp(bytes);
+        if (bytes > MAX_POOLED_SIZE)
+        {
+            return ::operator new(bytes);
+        }
+        auto& head = mFreeLists[bytes / ALIGNMENT];
+        if (head)
+        {
+            auto block = head;
+            head = block->mNext;
+            return block;
+        }
+        return allocate(bytes);
+    }
+
+    // Makes a block obtained from allocateNode available for reuse, or frees
+    // it if it is too large to be pooled.
+    void
+    deallocateNode(void* p, size_t bytes)
+    {
+        bytes = roundUp(bytes);
+        if (bytes > MAX_POOLED_SIZE)
+        {
+            ::operator delete(p);
+            return;
+        }
+        auto block = static_cast<FreeBlock*>(p);
+        auto& head = mFreeLists[bytes / ALIGNMENT];
+        block->mNext = head;
+        head = block;
+    }
+
+    // Total size of the chunks obtained from the system so far.
+    size_t
+    getBytesReserved() const
+    {
+        return mBytesReserved;
+    }
+};
+
+// Standard allocator drawing from a shared Arena and never freeing individual
+// blocks. Every copy of the allocator keeps the Arena alive, so this is the
+// allocator to use with std::allocate_shared for objects that may outlive the
+// owner of the Arena or be released on another thread.
+template <typename T> class ArenaAllocator
+{
+    std::shared_ptr<Arena> mArena;
+
+  public:
+    typedef T value_type;
+
+    explicit ArenaAllocator(std::shared_ptr<Arena> arena)
+        : mArena(std::move(arena))
+    {
+    }
+
+    template <typename U>
+    ArenaAllocator(ArenaAllocator<U> const& other) : mArena(other.getArena())
+    {
+    }
+
+    T*
+    allocate(size_t n)
+    {
+        static_assert(alignof(T) <= alignof(std::max_align_t),
+                      "over-aligned types are not supported");
+        return static_cast<T*>(mArena->allocate(n * sizeof(T)));
+    }
+
+    void
+    deallocate(T*, size_t)
+    {
+    }
+
+    std::shared_ptr<Arena> const&
+    getArena() const
+    {
+        return mArena;
+    }
+};
+
+// Standard allocator for containers that allocate and free often, such as
+// node-based containers or small hash tables: freed blocks go back to the
+// Arena's free lists. The container must only be used on one thread at a time,
+// like the Arena itself.
+template <typename T> class ArenaNodeAllocator
+{
+    std::shared_ptr<Arena> mArena;
+
+  public:
+    typedef T value_type;
+
+    explicit ArenaNodeAllocator(std::shared_ptr<Arena> arena)
+        : mArena(std::move(arena))
+    {
+    }
+
+    template <typename U>
+    ArenaNodeAllocator(ArenaNodeAllocator<U> const& other)
+        : mArena(other.getArena())
+    {
+    }
+
+    T*
+    allocate(size_t n)
+    {
+        static_assert(alignof(T) <= alignof(std::max_align_t),
+                      "over-aligned types are not supported");
+        return static_cast<T*>(mArena->allocateNode(n * sizeof(T)));
+    }
+
+    void
+    deallocate(T* p, size_t n)
+    {
+        mArena->deallocateNode(p, n * sizeof(T));
+    }
+
+    std::shared_ptr<Arena> const&
+    getArena() const
+    {
+        return mArena;
+    }
+};
+
+template <typename T, typename U>
+bool
+operator==(ArenaAllocator<T> const& lhs, ArenaAllocator<U> const& rhs)
+{
+    return lhs.getArena() == rhs.getArena();
+}
+
+template <typename T, typename U>
+bool
+operator!=(ArenaAllocator<T> const& lhs, ArenaAllocator<U> const& rhs)
+{
+    return !(lhs == rhs);
+}
+
+template <typename T, typename U>
+bool
+operator==(ArenaNodeAllocator<T> const& lhs, ArenaNodeAllocator<U> const& rhs)
+{
+    return lhs.getArena() == rhs.getArena();
+}
+
+template <typename T, typename U>
+bool
+operator!=(ArenaNodeAllocator<T> const& lhs, ArenaNodeAllocator<U> const& rhs)
+{
+    return !(lhs == rhs);
+}
+}
@@ -0,0 +1,424 @@
+// Copyright 2020 Stellar Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "util/BlockCompression.h"
+#include "util/FileSystemException.h"
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+
+namespace stellar
+{
+
+size_t const BlockCompressedWriter::BLOCK_BYTES;
+
+namespace
+{
+char const MAGIC[4] = {'X', 'D', 'R', 'Z'};
+size_t const MAGIC_BYTES = sizeof(MAGIC);
+size_t const BLOCK_HEADER_BYTES = 8;
+size_t const TABLE_ENTRY_BYTES = 16;
+size_t const TRAILER_BYTES = 8 + MAGIC_BYTES;
+
+// LZ4 block format: matches are at least MIN_MATCH bytes long, at most
+// MAX_OFFSET bytes back, and the last LAST_LITERALS bytes are literals, in a
+// last match starting at least MF_LIMIT bytes before the end.
+size_t const MIN_MATCH = 4;
+size_t const MAX_OFFSET = 65535;
+size_t const LAST_LITERALS = 5;
+size_t const MF_LIMIT = 12;
+int const HASH_LOG = 14;
+
+uint32_t
+read32(uint8_t const* p)
+{
+    uint32_t v;
+    std::memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+uint32_t
+getU32(uint8_t const* p)
+{
+    return (uint32_t(p[0]) << 24) | (uint32_t(p[1]) << 16) |
+           (uint32_t(p[2]) << 8) | uint32_t(p[3]);
+}
+
+uint64_t
+getU64(uint8_t const* p)
+{
+    return (uint64_t(getU32(p)) << 32) | getU32(p + 4);
+}
+
+void
+putU32(uint8_t* p, uint32_t v)
+{
+    p[0] = static_cast<uint8_t>(v >> 24);
+    p[1] = static_cast<uint8_t>(v >> 16);
+    p[2] = static_cast<uint8_t>(v >> 8);
+    p[3] = static_cast<uint8_t>(v);
+}
+
+void
+putU64(uint8_t* p, uint64_t v)
+{
+    putU32(p, static_cast<uint32_t>(v >> 32));
+    putU32(p + 4, static_cast<uint32_t>(v));
+}
+
+void
+putLength(std::vector<uint8_t>& dst, size_t len)
+{
+    for (; len >= 255; len -= 255)
+    {
+        dst.emplace_back(255);
+    }
+    dst.emplace_back(static_cast<uint8_t>(len));
+}
+
+void
+putLiterals(std::vector<uint8_t>& dst, uint8_t const* literals, size_t len,
+            uint8_t matchToken)
+{
+    dst.emplace_back(
+        static_cast<uint8_t>((std::min<size_t>(len, 15) << 4) | matchToken));
+    if (len >= 15)
+    {
+        putLength(dst, len - 15);
+    }
+    dst.insert(dst.end(), literals, literals + len);
+}
+
+void
+fail()
+{
+    throw std::runtime_error("malformed compressed block");
+}
+
+void
+write(FILE* out, uint8_t const* data, size_t size)
+{
+    if (size != 0 && fwrite(data, 1, size, out) != size)
+    {
+        FileSystemException::failWithErrno(
+            "BlockCompressedWriter::write() failed: ");
+    }
+}
+}
+
+void
+compressBlock(ByteSlice const& src, std::vector<uint8_t>& dst)
+{
+    auto data = src.data();
+    auto size = src.size();
+    dst.clear();
+    dst.reserve(size + size / 255 + 16);
+
+    // Positions + 1 of the last 4 bytes with every hash, 0 if none
+    std::vector<uint32_t> table(size_t(1) << HASH_LOG, 0);
+    size_t anchor = 0;
+    if (size >= MF_LIMIT)
+    {
+        size_t const matchLimit = size - LAST_LITERALS;
+        size_t i = 0;
+        while (i + MF_LIMIT <= size)
+        {
+            auto seq = read32(data + i);
+            auto h = (seq * 2654435761u) >> (32 - HASH_LOG);
+            size_t ref = table[h];
+            table[h] = static_cast<uint32_t>(i + 1);
+            if (ref == 0 || i + 1 - ref > MAX_OFFSET ||
+                read32(data + ref - 1) != seq)
+            {
+                ++i;
+                continue;
+            }
+            --ref;
+
+            size_t len = MIN_MATCH;
+            while (i + len < matchLimit && data[ref + len] == data[i + len])
+            {
+                ++len;
+            }
+            auto matchLen = len - MIN_MATCH;
+            putLiterals(dst, data + anchor, i - anchor,
+                        static_cast<uint8_t>(std::min<size_t>(matchLen, 15)));
+            auto offset = i - ref;
+            dst.emplace_back(static_cast<uint8_t>(offset));
+            dst.emplace_back(static_cast<uint8_t>(offset >> 8));
+            if (matchLen >= 15)
+            {
+                putLength(dst, matchLen - 15);
+            }
+            i += len;
+            anchor = i;
+        }
+    }
+    putLiterals(dst, data + anchor, size - anchor, 0);
+}
+
+void
+uncompressBlock(ByteSlice const& src, uint8_t* dst, size_t dstSize)
+{
+    auto data = src.data();
+    auto size = src.size();
+    size_t ip = 0;
+    size_t op = 0;
+    auto readLength = [&](size_t len) {
+        if (len == 15)
+        {
+            uint8_t b;
+            do
+            {
+                if (ip >= size)
+                {
+                    fail();
+                }
+                b = data[ip++];
+                len += b;
+            } while (b == 255);
+        }
+        return len;
+    };
+
+    for (;;)
+    {
+        if (ip >= size)
+        {
+            fail();
+        }
+        uint8_t token = data[ip++];
+        auto literals = readLength(token >> 4);
+        if (literals > size - ip || literals > dstSize - op)
+        {
+            fail();
+        }
+        if (literals > 0)
+        {
+            std::memcpy(dst + op, data + ip, literals);
+        }
+        ip += literals;
+        op += literals;
+        if (ip == size)
+        {
+            break;
+        }
+
+        if (size - ip < 2)
+        {
+            fail();
+        }
+        size_t offset = data[ip] | (size_t(data[ip + 1]) << 8);
+        ip += 2;
+        auto len = readLength(token & 15) + MIN_MATCH;
+        if (offset == 0 || offset > op || len > dstSize - op)
+        {
+            fail();
+        }
+        auto from = dst + op - offset;
+        if (offset >= len)
+        {
+            std::memcpy(dst + op, from, len);
+        }
+        else
+        {
+            // The match repeats bytes it copies
+            for (size_t i = 0; i < len; ++i)
+            {
+                dst[op + i] = from[i];
+            }
+        }
+        op += len;
+    }
+    if (op != dstSize)
+    {
+        fail();
+    }
+}
+
+bool
+isBlockCompressed(ByteSlice const& fileStart)
+{
+    return fileStart.size() >= MAGIC_BYTES &&
+           std::memcmp(fileStart.data(), MAGIC, MAGIC_BYTES) == 0;
+}
+
+bool
+isBlockCompressedFile(std::string const& filename)
+{
+    char start[MAGIC_BYTES];
+    std::ifstream in(filename, std::ios::binary);
+    return in.read(start, MAGIC_BYTES) &&
+           isBlockCompressed(ByteSlice(start, MAGIC_BYTES));
+}
+
+void
+BlockCompressedWriter::start(FILE* out)
+{
+    mBlock.clear();
+    mTable.clear();
+    mFramesPos = 0;
+    write(out, reinterpret_cast<uint8_t const*>(MAGIC), MAGIC_BYTES);
+    mFilePos = MAGIC_BYTES;
+}
+
+void
+BlockCompressedWriter::writeBlock(FILE* out)
+{
+    if (mBlock.empty())
+    {
+        return;
+    }
+    compressBlock(mBlock, mCompressed);
+    auto const& stored =
+        mCompressed.size() < mBlock.size() ? mCompressed : mBlock;
+
+    uint8_t header[BLOCK_HEADER_BYTES];
+    putU32(header, static_cast<uint32_t>(stored.size()));
+    putU32(header + 4, static_cast<uint32_t>(mBlock.size()));
+    write(out, header, sizeof(header));
+    write(out, stored.data(), stored.size());
+
+    mTable.emplace_back(mFramesPos);
+    mTable.emplace_back(mFilePos);
+    mFramesPos += mBlock.size();
+    mFilePos += sizeof(header) + stored.size();
+    mBlock.clear();
+}
+
+void
+BlockCompressedWriter::add(FILE* out, uint8_t const* frames, size_t size)
+{
+    while (size > 0)
+    {
+        if (size < 4)
+        {
+            throw std::runtime_error("partial XDR frame");
+        }
+        size_t frame = 4 + (getU32(frames) & 0x7fffffff);
+        if (frame > size)
+        {
+            throw std::runtime_error("partial XDR frame");
+        }
+        if (!mBlock.empty() && mBlock.size() + frame > BLOCK_BYTES)
+        {
+            writeBlock(out);
+        }
+        mBlock.insert(mBlock.end(), frames, frames + frame);
+        frames += frame;
+        size -= frame;
+    }
+}
+
+void
+BlockCompressedWriter::finish(FILE* out)
+{
+    writeBlock(out);
+    std::vector<uint8_t> trailer(mTable.size() * 8 + TRAILER_BYTES);
+    auto p = trailer.data();
+    for (auto v : mTable)
+    {
+        putU64(p, v);
+        p += 8;
+    }
+    putU64(p, mTable.size() / 2);
+    std::memcpy(p + 8, MAGIC, MAGIC_BYTES);
+    write(out, trailer.data(), trailer.size());
+}
+
+BlockCompressedReader::BlockCompressedReader(uint8_t const* data, size_t size)
+    : mData(data), mLoaded(UINT64_MAX)
+{
+    if (!isBlockCompressed(ByteSlice(data, size)) ||
+        size < MAGIC_BYTES + TRAILER_BYTES ||
+        std::memcmp(data + size - MAGIC_BYTES, MAGIC, MAGIC_BYTES) != 0)
+    {
+        throw std::runtime_error("malformed block-compressed file");
+    }
+    mBlocks = getU64(data + size - TRAILER_BYTES);
+    if (mBlocks > (size - MAGIC_BYTES - TRAILER_BYTES) / TABLE_ENTRY_BYTES)
+    {
+        throw std::runtime_error("malformed block-compressed file");
+    }
+    mTable = data + size - TRAILER_BYTES - mBlocks * TABLE_ENTRY_BYTES;
+    if (mBlocks > 0)
+    {
+        auto last = fileOffset(mBlocks - 1);
+        if (last < MAGIC_BYTES ||
+            last + BLOCK_HEADER_BYTES > uint64_t(mTable - mData))
+        {
+            throw std::runtime_error("malformed block-compressed file");
+        }
+        mSize = framesOffset(mBlocks - 1) + getU32(mData + last + 4);
+    }
+}
+
+uint64_t
+BlockCompressedReader::framesOffset(uint64_t block) const
+{
+    return getU64(mTable + block * TABLE_ENTRY_BYTES);
+}
+
+uint64_t
+BlockCompressedReader::fileOffset(uint64_t block) const
+{
+    return getU64(mTable + block * TABLE_ENTRY_BYTES + 8);
+}
+
+void
+BlockCompressedReader::load(uint64_t pos, uint8_t const*& block,
+                            uint64_t& begin, uint64_t& end)
+{
+    // The last block starting at or before pos
+    uint64_t lo = 0;
+    uint64_t hi = mBlocks;
+    while (hi - lo > 1)
+    {
+        auto mid = lo + (hi - lo) / 2;
+        if (framesOffset(mid) <= pos)
+        {
+            lo = mid;
+        }
+        else
+        {
+            hi = mid;
+        }
+    }
+
+    auto blockBytes = uint64_t(mTable - mData);
+    auto offset = mBlocks > 0 ? fileOffset(lo) : 0;
+    if (mBlocks == 0 || offset < MAGIC_BYTES ||
+        offset + BLOCK_HEADER_BYTES > blockBytes)
+    {
+        fail();
+    }
+    auto header = mData + offset;
+    uint32_t storedSize = getU32(header);
+    uint32_t blockSize = getU32(header + 4);
+    begin = framesOffset(lo);
+    end = lo + 1 < mBlocks ? framesOffset(lo + 1) : mSize;
+    if (storedSize > blockBytes - offset - BLOCK_HEADER_BYTES ||
+        end < begin || blockSize != end - begin || pos < begin || pos >= end)
+    {
+        fail();
+    }
+
+    ByteSlice stored(header + BLOCK_HEADER_BYTES, storedSize);
+    if (storedSize == blockSize)
+    {
+        block = stored.data();
+        return;
+    }
+    if (mLoaded != lo)
+    {
+        mLoaded = UINT64_MAX;
+        mBuf.resize(blockSize);
+        uncompressBlock(stored, mBuf.data(), blockSize);
+        mLoaded = lo;
+    }
+    block = mBuf.data();
+}
+}
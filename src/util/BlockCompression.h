@@ -0,0 +1,102 @@
+#pragma once
+
+// Copyright 2020 Stellar Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "crypto/ByteSlice.h"
+#include "util/NonCopyable.h"
+
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+namespace stellar
+{
+
+// Compresses src into dst, replacing its contents, in the LZ4 block format.
+// Matches are found greedily in a 64KiB window, favoring speed over ratio.
+void compressBlock(ByteSlice const& src, std::vector<uint8_t>& dst);
+
+// Uncompresses a block written by compressBlock into the dstSize bytes at dst.
+// Throws std::runtime_error if the block is malformed or does not uncompress
+// to exactly dstSize bytes.
+void uncompressBlock(ByteSlice const& src, uint8_t* dst, size_t dstSize);
+
+// Block-compressed XDR files hold the same frames as the files that
+// XDROutputFileStream writes by default, cut into blocks of whole frames of
+// about BLOCK_BYTES bytes that are compressed independently:
+//
+//   magic
+//   for every block: uint32 compressed size, uint32 size, compressed bytes
+//   for every block: uint64 offset in the frames, uint64 offset in the file
+//   uint64 number of blocks
+//   magic
+//
+// with big-endian integers. Blocks that do not compress are stored as they
+// are, with equal sizes. Unlike that of an XDR frame, the first byte of the
+// magic does not have its high bit set, so that either kind of file is told
+// from its first byte.
+//
+// Positions in block-compressed files are offsets in their frames, as they
+// would be in the uncompressed file, and reading from any position only
+// uncompresses the block holding it.
+bool isBlockCompressed(ByteSlice const& fileStart);
+bool isBlockCompressedFile(std::string const& filename);
+
+// Writes a block-compressed XDR file to a FILE*.
+class BlockCompressedWriter : public NonMovableOrCopyable
+{
+    std::vector<uint8_t> mBlock;
+    std::vector<uint8_t> mCompressed;
+    std::vector<uint64_t> mTable;
+    uint64_t mFramesPos{0};
+    uint64_t mFilePos{0};
+
+    void writeBlock(FILE* out);
+
+  public:
+    static size_t const BLOCK_BYTES = 64 * 1024;
+
+    void start(FILE* out);
+
+    // Adds size bytes of whole frames
+    void add(FILE* out, uint8_t const* frames, size_t size);
+
+    // Writes the last block and the table of blocks
+    void finish(FILE* out);
+};
+
+// Reads the frames of a block-compressed XDR file mapped in memory, one
+// uncompressed block at a time.
+class BlockCompressedReader : public NonMovableOrCopyable
+{
+    uint8_t const* mData;
+    uint8_t const* mTable;
+    uint64_t mBlocks;
+    uint64_t mSize{0};
+    uint64_t mLoaded;
+    std::vector<uint8_t> mBuf;
+
+    uint64_t framesOffset(uint64_t block) const;
+    uint64_t fileOffset(uint64_t block) const;
+
+  public:
+    // Throws std::runtime_error if data is not a block-compressed file
+    BlockCompressedReader(uint8_t const* data, size_t size);
+
+    // Size of the frames
+    uint64_t
+    size() const
+    {
+        return mSize;
+    }
+
+    // Sets block to the frames of the block holding the frames at pos, from
+    // begin to end, which stay valid until the next call. Throws
+    // std::runtime_error if that block is malformed.
+    void load(uint64_t pos, uint8_t const*& block, uint64_t& begin,
+              uint64_t& end);
+};
+}
@@ -0,0 +1,147 @@
+#pragma once
+
+// Copyright 2020 Stellar Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include <cmath>
+#include <cstdint>
+#include <functional>
+#include <stdexcept>
+#include <vector>
+
+namespace stellar
+{
+
+// A Bloom filter over keys of type K: mayContain is true for every key that
+// was added, and false for most of the others. The false positive rate grows
+// with the number of keys added past the capacity the filter was sized for,
+// and falsePositiveRate estimates it from the fraction of bits set, so that
+// the owner can rebuild the filter bigger when it degrades.
+//
+// Keys cannot be removed. Hash should mix all of the key, as the positions
+// of the key are derived from a single hash by double hashing.
+template <typename K, typename Hash = std::hash<K>> class BloomFilter
+{
+    static size_t const BITS_PER_KEY = 10;
+    static size_t const NUM_HASHES = 7;
+    static size_t const MIN_BITS = 1024;
+
+    std::vector<uint64_t> mWords;
+    size_t mBitMask;
+    size_t mBitsSet{0};
+    size_t mAdditions{0};
+    Hash mHash;
+
+    static uint64_t
+    mix(uint64_t h)
+    {
+        // splitmix64 finalizer
+        h += 0x9e3779b97f4a7c15ULL;
+        h = (h ^ (h >> 30)) * 0xbf58476d1ce4e5b9ULL;
+        h = (h ^ (h >> 27)) * 0x94d049bb133111ebULL;
+        return h ^ (h >> 31);
+    }
+
+    template <typename F>
+    void
+    forEachBit(K const& key, F f) const
+    {
+        uint64_t h1 = mix(static_cast<uint64_t>(mHash(key)));
+        // Odd, so that it visits distinct bits of the power of 2 sized array
+        uint64_t h2 = mix(h1) | 1;
+        for (size_t i = 0; i < NUM_HASHES; ++i)
+        {
+            f(static_cast<size_t>(h1 + i * h2) & mBitMask);
+        }
+    }
+
+  public:
+    explicit BloomFilter(size_t capacity, Hash const& hash = Hash())
+        : mHash(hash)
+    {
+        size_t bits = MIN_BITS;
+        while (bits < capacity * BITS_PER_KEY)
+        {
+            bits <<= 1;
+        }
+        mWords.resize(bits / 64);
+        mBitMask = bits - 1;
+    }
+
+    // Recreates a filter from the words and additions of another one, to
+    // load it from where it was persisted. Throws std::invalid_argument if
+    // words cannot be the words of a filter.
+    BloomFilter(std::vector<uint64_t> words, size_t additions,
+                Hash const& hash = Hash())
+        : mWords(std::move(words)), mAdditions(additions), mHash(hash)
+    {
+        size_t bits = mWords.size() * 64;
+        if (bits < MIN_BITS || (bits & (bits - 1)) != 0)
+        {
+            throw std::invalid_argument("invalid bloom filter size");
+        }
+        mBitMask = bits - 1;
+        for (auto word : mWords)
+        {
+            for (; word != 0; word &= word - 1)
+            {
+                ++mBitsSet;
+            }
+        }
+    }
+
+    // add does not throw
+    void
+    add(K const& key)
+    {
+        forEachBit(key, [this](size_t bit) {
+            uint64_t mask = uint64_t(1) << (bit % 64);
+            auto& word = mWords[bit / 64];
+            if (!(word & mask))
+            {
+                word |= mask;
+                ++mBitsSet;
+            }
+        });
+        ++mAdditions;
+    }
+
+    bool
+    mayContain(K const& key) const
+    {
+        bool res = true;
+        forEachBit(key, [&](size_t bit) {
+            res = res && (mWords[bit / 64] & (uint64_t(1) << (bit % 64)));
+        });
+        return res;
+    }
+
+    // Number of calls to add, including those of keys already added.
+    size_t
+    additions() const
+    {
+        return mAdditions;
+    }
+
+    size_t
+    bitCount() const
+    {
+        return mBitMask + 1;
+    }
+
+    std::vector<uint64_t> const&
+    words() const
+    {
+        return mWords;
+    }
+
+    // Probability that mayContain is true for a key that was never added.
+    double
+    falsePositiveRate() const
+    {
+        return std::pow(static_cast<double>(mBitsSet) / bitCount(),
+                        static_cast<double>(NUM_HASHES));
+    }
+};
+}
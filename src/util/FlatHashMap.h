@@ -0,0 +1,607 @@
+#pragma once
+
+// Copyright 2020 Stellar Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include <algorithm>
+#include <cstdint>
+#include <functional>
+#include <initializer_list>
+#include <memory>
+#include <stdexcept>
+#include <tuple>
+#include <utility>
+#include <vector>
+
+#if defined(__SSE2__) || defined(_M_X64) ||                                    \
+    (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define STELLAR_FLAT_HASH_MAP_SSE2
+#include <emmintrin.h>
+#endif
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+namespace stellar
+{
+
+// An open-addressing hash map for keys that are expensive to hash and compare,
+// such as LedgerKey.
+//
+// Elements are stored densely, in insertion order until something is erased,
+// and are located through a separate table of one-byte control words probed
+// 16 at a time (with SSE2 where available). Each element's full hash is
+// computed once, on insertion, and kept alongside it: growing the table never
+// hashes a key again, and a key is only compared with elements whose full hash
+// matches. find(key, hash) lets a caller that already has the hash of a key
+// skip hashing altogether.
+//
+// Unlike std::unordered_map:
+//  - value_type is std::pair<K, V>; the key must not be modified in place.
+//  - Any insertion may invalidate all iterators, pointers and references.
+//  - erase moves the last element into the erased position; erase(iter)
+//    returns an iterator to that position, so erasing while iterating visits
+//    every element once.
+// emplace and operator[] provide the strong exception safety guarantee, erase,
+// clear and swap do not throw provided that moving a value_type does not.
+template <typename K, typename V, typename Hash = std::hash<K>,
+          typename KeyEqual = std::equal_to<K>,
+          typename Alloc = std::allocator<std::pair<K, V>>>
+class FlatHashMap
+{
+  public:
+    typedef K key_type;
+    typedef V mapped_type;
+    typedef std::pair<K, V> value_type;
+    typedef Alloc allocator_type;
+    typedef Hash hasher;
+    typedef KeyEqual key_equal;
+    typedef size_t size_type;
+    typedef typename std::vector<value_type, Alloc>::iterator iterator;
+    typedef
+        typename std::vector<value_type, Alloc>::const_iterator const_iterator;
+
+  private:
+    template <typename T>
+    using RebindAlloc =
+        typename std::allocator_traits<Alloc>::template rebind_alloc<T>;
+
+    static constexpr size_t GROUP_SIZE = 16;
+    static constexpr size_t MIN_CAPACITY = GROUP_SIZE;
+    static constexpr size_t NOT_FOUND = ~size_t(0);
+    // A control byte is either EMPTY, DELETED, or the top 7 bits of the
+    // mixed hash of the element in that slot (so the sign bit is only set
+    // for free slots)
+    static constexpr int8_t EMPTY = -128;
+    static constexpr int8_t DELETED = -2;
+
+    // Dense storage, mHashes[i] is the hash of mValues[i].first
+    std::vector<value_type, Alloc> mValues;
+    std::vector<size_t, RebindAlloc<size_t>> mHashes;
+    // Probing table, mSlots[s] is the index in mValues of the element in slot
+    // s if mCtrl[s] is not EMPTY or DELETED
+    std::vector<int8_t, RebindAlloc<int8_t>> mCtrl;
+    std::vector<uint32_t, RebindAlloc<uint32_t>> mSlots;
+    size_t mDeleted{0};
+    Hash mHash;
+    KeyEqual mEqual;
+
+    static uint64_t
+    mix(size_t hash)
+    {
+        return static_cast<uint64_t>(hash) * 0x9E3779B97F4A7C15ULL;
+    }
+
+    static int8_t
+    ctrlByte(size_t hash)
+    {
+        return static_cast<int8_t>(mix(hash) >> 57);
+    }
+
+    static size_t
+    maxLoad(size_t capacity)
+    {
+        return capacity - capacity / 8;
+    }
+
+    // Bit i of the result is set if ctrl[i] == b
+    static uint32_t
+    matchByte(int8_t const* ctrl, int8_t b)
+    {
+#ifdef STELLAR_FLAT_HASH_MAP_SSE2
+        auto group = _mm_loadu_si128(reinterpret_cast<__m128i const*>(ctrl));
+        return static_cast<uint32_t>(
+            _mm_movemask_epi8(_mm_cmpeq_epi8(group, _mm_set1_epi8(b))));
+#else
+        uint32_t res = 0;
+        for (size_t i = 0; i < GROUP_SIZE; ++i)
+        {
+            if (ctrl[i] == b)
+            {
+                res |= uint32_t(1) << i;
+            }
+        }
+        return res;
+#endif
+    }
+
+    // Bit i of the result is set if ctrl[i] is EMPTY or DELETED
+    static uint32_t
+    matchFree(int8_t const* ctrl)
+    {
+#ifdef STELLAR_FLAT_HASH_MAP_SSE2
+        auto group = _mm_loadu_si128(reinterpret_cast<__m128i const*>(ctrl));
+        return static_cast<uint32_t>(_mm_movemask_epi8(group));
+#else
+        uint32_t res = 0;
+        for (size_t i = 0; i < GROUP_SIZE; ++i)
+        {
+            if (ctrl[i] < 0)
+            {
+                res |= uint32_t(1) << i;
+            }
+        }
+        return res;
+#endif
+    }
+
+    static size_t
+    lowestBit(uint32_t mask)
+    {
+#if defined(_MSC_VER)
+        unsigned long res;
+        _BitScanForward(&res, mask);
+        return res;
+#else
+        return static_cast<size_t>(__builtin_ctz(mask));
+#endif
+    }
+
+    // Visits the groups of a table of numGroups groups in triangular order,
+    // which reaches every group when numGroups is a power of 2
+    class ProbeSequence
+    {
+        size_t mMask;
+        size_t mGroup;
+        size_t mStep{0};
+
+      public:
+        ProbeSequence(size_t hash, size_t numGroups)
+            : mMask(numGroups - 1)
+            , mGroup(static_cast<size_t>(mix(hash)) & mMask)
+        {
+        }
+
+        size_t
+        offset() const
+        {
+            return mGroup * GROUP_SIZE;
+        }
+
+        void
+        next()
+        {
+            mGroup = (mGroup + ++mStep) & mMask;
+        }
+    };
+
+    size_t
+    findSlot(K const& key, size_t hash) const
+    {
+        if (mValues.empty())
+        {
+            return NOT_FOUND;
+        }
+        auto b = ctrlByte(hash);
+        ProbeSequence seq(hash, mCtrl.size() / GROUP_SIZE);
+        while (true)
+        {
+            auto ctrl = mCtrl.data() + seq.offset();
+            for (auto m = matchByte(ctrl, b); m != 0; m &= m - 1)
+            {
+                auto slot = seq.offset() + lowestBit(m);
+                auto index = mSlots[slot];
+                if (mHashes[index] == hash && mEqual(mValues[index].first, key))
+                {
+                    return slot;
+                }
+            }
+            if (matchByte(ctrl, EMPTY) != 0)
+            {
+                return NOT_FOUND;
+            }
+            seq.next();
+        }
+    }
+
+    // Slot in the probing table that refers to mValues[index]
+    size_t
+    findSlotOfIndex(size_t index) const
+    {
+        auto hash = mHashes[index];
+        auto b = ctrlByte(hash);
+        ProbeSequence seq(hash, mCtrl.size() / GROUP_SIZE);
+        while (true)
+        {
+            auto ctrl = mCtrl.data() + seq.offset();
+            for (auto m = matchByte(ctrl, b); m != 0; m &= m - 1)
+            {
+                auto slot = seq.offset() + lowestBit(m);
+                if (mSlots[slot] == index)
+                {
+                    return slot;
+                }
+            }
+            seq.next();
+        }
+    }
+
+    // First free slot on the probe sequence of hash, the table must not be
+    // full
+    static size_t
+    findFreeSlot(std::vector<int8_t, RebindAlloc<int8_t>> const& ctrl,
+                 size_t hash)
+    {
+        ProbeSequence seq(hash, ctrl.size() / GROUP_SIZE);
+        while (true)
+        {
+            auto m = matchFree(ctrl.data() + seq.offset());
+            if (m != 0)
+            {
+                return seq.offset() + lowestBit(m);
+            }
+            seq.next();
+        }
+    }
+
+    // Rebuilds the probing table with the given capacity from the cached
+    // hashes, dropping every DELETED slot. Only the probing table is
+    // replaced, so this has the strong exception safety guarantee.
+    void
+    rehash(size_t capacity)
+    {
+        std::vector<int8_t, RebindAlloc<int8_t>> ctrl(
+            capacity, int8_t(EMPTY), mCtrl.get_allocator());
+        std::vector<uint32_t, RebindAlloc<uint32_t>> slots(
+            capacity, 0, mSlots.get_allocator());
+        for (size_t i = 0; i < mHashes.size(); ++i)
+        {
+            auto slot = findFreeSlot(ctrl, mHashes[i]);
+            ctrl[slot] = ctrlByte(mHashes[i]);
+            slots[slot] = static_cast<uint32_t>(i);
+        }
+        mCtrl.swap(ctrl);
+        mSlots.swap(slots);
+        mDeleted = 0;
+    }
+
+    static size_t
+    capacityFor(size_t size)
+    {
+        size_t capacity = MIN_CAPACITY;
+        while (maxLoad(capacity) < size)
+        {
+            capacity *= 2;
+        }
+        return capacity;
+    }
+
+    // Makes room for one more element without invalidating anything if this
+    // throws
+    void
+    prepareInsert()
+    {
+        auto size = mValues.size();
+        if (mCtrl.empty())
+        {
+            rehash(MIN_CAPACITY);
+        }
+        else if (size + mDeleted + 1 > maxLoad(mCtrl.size()))
+        {
+            // Mostly tombstones: clean up in place rather than grow
+            rehash(size + 1 <= maxLoad(mCtrl.size()) / 2 ? mCtrl.size()
+                                                          : mCtrl.size() * 2);
+        }
+        if (mHashes.size() == mHashes.capacity())
+        {
+            mHashes.reserve(mHashes.empty() ? GROUP_SIZE
+                                            : 2 * mHashes.capacity());
+        }
+    }
+
+    template <typename KK, typename... Args>
+    std::pair<iterator, bool>
+    tryEmplaceImpl(KK&& key, Args&&... args)
+    {
+        auto hash = mHash(key);
+        auto slot = findSlot(key, hash);
+        if (slot != NOT_FOUND)
+        {
+            return std::make_pair(mValues.begin() + mSlots[slot], false);
+        }
+
+        prepareInsert();
+        mValues.emplace_back(
+            std::piecewise_construct,
+            std::forward_as_tuple(std::forward<KK>(key)),
+            std::forward_as_tuple(std::forward<Args>(args)...));
+        // Nothing below throws
+        mHashes.push_back(hash);
+        slot = findFreeSlot(mCtrl, hash);
+        if (mCtrl[slot] == DELETED)
+        {
+            --mDeleted;
+        }
+        mCtrl[slot] = ctrlByte(hash);
+        mSlots[slot] = static_cast<uint32_t>(mValues.size() - 1);
+        return std::make_pair(mValues.end() - 1, true);
+    }
+
+    void
+    eraseSlot(size_t slot)
+    {
+        size_t index = mSlots[slot];
+        mCtrl[slot] = DELETED;
+        ++mDeleted;
+
+        size_t last = mValues.size() - 1;
+        if (index != last)
+        {
+            mSlots[findSlotOfIndex(last)] = static_cast<uint32_t>(index);
+            mValues[index] = std::move(mValues[last]);
+            mHashes[index] = mHashes[last];
+        }
+        mValues.pop_back();
+        mHashes.pop_back();
+    }
+
+  public:
+    FlatHashMap() = default;
+
+    explicit FlatHashMap(Alloc const& alloc)
+        : mValues(alloc)
+        , mHashes(RebindAlloc<size_t>(alloc))
+        , mCtrl(RebindAlloc<int8_t>(alloc))
+        , mSlots(RebindAlloc<uint32_t>(alloc))
+    {
+    }
+
+    FlatHashMap(std::initializer_list<value_type> values)
+    {
+        reserve(values.size());
+        for (auto const& kv : values)
+        {
+            emplace(kv.first, kv.second);
+        }
+    }
+
+    allocator_type
+    get_allocator() const
+    {
+        return mValues.get_allocator();
+    }
+
+    hasher
+    hash_function() const
+    {
+        return mHash;
+    }
+
+    iterator
+    begin()
+    {
+        return mValues.begin();
+    }
+
+    iterator
+    end()
+    {
+        return mValues.end();
+    }
+
+    const_iterator
+    begin() const
+    {
+        return mValues.begin();
+    }
+
+    const_iterator
+    end() const
+    {
+        return mValues.end();
+    }
+
+    const_iterator
+    cbegin() const
+    {
+        return mValues.cbegin();
+    }
+
+    const_iterator
+    cend() const
+    {
+        return mValues.cend();
+    }
+
+    bool
+    empty() const
+    {
+        return mValues.empty();
+    }
+
+    size_t
+    size() const
+    {
+        return mValues.size();
+    }
+
+    // Number of elements that can be held without growing the probing table
+    size_t
+    capacity() const
+    {
+        return maxLoad(mCtrl.size());
+    }
+
+    void
+    reserve(size_t size)
+    {
+        if (size > capacity())
+        {
+            rehash(capacityFor(size));
+        }
+        mValues.reserve(size);
+        mHashes.reserve(size);
+    }
+
+    void
+    clear()
+    {
+        mValues.clear();
+        mHashes.clear();
+        std::fill(mCtrl.begin(), mCtrl.end(), int8_t(EMPTY));
+        mDeleted = 0;
+    }
+
+    void
+    swap(FlatHashMap& other)
+    {
+        using std::swap;
+        mValues.swap(other.mValues);
+        mHashes.swap(other.mHashes);
+        mCtrl.swap(other.mCtrl);
+        mSlots.swap(other.mSlots);
+        swap(mDeleted, other.mDeleted);
+        swap(mHash, other.mHash);
+        swap(mEqual, other.mEqual);
+    }
+
+    // hash must be hash_function()(key)
+    iterator
+    find(K const& key, size_t hash)
+    {
+        auto slot = findSlot(key, hash);
+        return slot == NOT_FOUND ? mValues.end()
+                                 : mValues.begin() + mSlots[slot];
+    }
+
+    const_iterator
+    find(K const& key, size_t hash) const
+    {
+        auto slot = findSlot(key, hash);
+        return slot == NOT_FOUND ? mValues.end()
+                                 : mValues.begin() + mSlots[slot];
+    }
+
+    iterator
+    find(K const& key)
+    {
+        return find(key, mHash(key));
+    }
+
+    const_iterator
+    find(K const& key) const
+    {
+        return find(key, mHash(key));
+    }
+
+    size_t
+    count(K const& key) const
+    {
+        return findSlot(key, mHash(key)) == NOT_FOUND ? 0 : 1;
+    }
+
+    V&
+    at(K const& key)
+    {
+        auto iter = find(key);
+        if (iter == end())
+        {
+            throw std::out_of_range("FlatHashMap::at");
+        }
+        return iter->second;
+    }
+
+    V const&
+    at(K const& key) const
+    {
+        auto iter = find(key);
+        if (iter == end())
+        {
+            throw std::out_of_range("FlatHashMap::at");
+        }
+        return iter->second;
+    }
+
+    template <typename... Args>
+    std::pair<iterator, bool>
+    try_emplace(K const& key, Args&&... args)
+    {
+        return tryEmplaceImpl(key, std::forward<Args>(args)...);
+    }
+
+    template <typename... Args>
+    std::pair<iterator, bool>
+    try_emplace(K&& key, Args&&... args)
+    {
+        return tryEmplaceImpl(std::move(key), std::forward<Args>(args)...);
+    }
+
+    template <typename VV>
+    std::pair<iterator, bool>
+    emplace(K const& key, VV&& value)
+    {
+        return tryEmplaceImpl(key, std::forward<VV>(value));
+    }
+
+    template <typename VV>
+    std::pair<iterator, bool>
+    emplace(K&& key, VV&& value)
+    {
+        return tryEmplaceImpl(std::move(key), std::forward<VV>(value));
+    }
+
+    std::pair<iterator, bool>
+    insert(value_type const& kv)
+    {
+        return tryEmplaceImpl(kv.first, kv.second);
+    }
+
+    V&
+    operator[](K const& key)
+    {
+        return tryEmplaceImpl(key).first->second;
+    }
+
+    size_t
+    erase(K const& key)
+    {
+        auto slot = findSlot(key, mHash(key));
+        if (slot == NOT_FOUND)
+        {
+            return 0;
+        }
+        eraseSlot(slot);
+        return 1;
+    }
+
+    // Returns an iterator to the element moved into the erased position, or
+    // end() if the last element was erased
+    iterator
+    erase(const_iterator iter)
+    {
+        auto index = static_cast<size_t>(iter - mValues.cbegin());
+        eraseSlot(findSlotOfIndex(index));
+        return mValues.begin() + index;
+    }
+};
+
+template <typename K, typename V, typename Hash, typename KeyEqual,
+          typename Alloc>
+void
+swap(FlatHashMap<K, V, Hash, KeyEqual, Alloc>& lhs,
+     FlatHashMap<K, V, Hash, KeyEqual, Alloc>& rhs)
+{
+    lhs.swap(rhs);
+}
+}
@@ -0,0 +1,148 @@
+// Copyright 2020 Stellar Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "util/MappedFile.h"
+#include "util/FileSystemException.h"
+#include "util/Logging.h"
+
+#ifdef _WIN32
+#include <Windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace stellar
+{
+
+#ifdef _WIN32
+
+MappedFile::MappedFile(std::string const& filename)
+{
+    HANDLE file = ::CreateFile(filename.c_str(), GENERIC_READ,
+                               FILE_SHARE_READ | FILE_SHARE_DELETE,
+                               NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL,
+                               NULL);
+    if (file == INVALID_HANDLE_VALUE)
+    {
+        FileSystemException::failWithGetLastError("failed to open file " +
+                                                  filename);
+    }
+    LARGE_INTEGER size;
+    if (!::GetFileSizeEx(file, &size))
+    {
+        auto err = FileSystemException::getLastErrorString();
+        ::CloseHandle(file);
+        FileSystemException::failWith("failed to get size of file " +
+                                      filename + ": " + err);
+    }
+    mFile = file;
+    mSize = static_cast<size_t>(size.QuadPart);
+    if (mSize == 0)
+    {
+        // Empty files cannot be mapped, and need not be
+        return;
+    }
+
+    HANDLE mapping =
+        ::CreateFileMapping(file, NULL, PAGE_READONLY, 0, 0, NULL);
+    if (mapping == NULL)
+    {
+        auto err = FileSystemException::getLastErrorString();
+        ::CloseHandle(file);
+        FileSystemException::failWith("failed to map file " + filename +
+                                      ": " + err);
+    }
+    mMapping = mapping;
+    mData = static_cast<uint8_t const*>(
+        ::MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+    if (mData == nullptr)
+    {
+        auto err = FileSystemException::getLastErrorString();
+        ::CloseHandle(mapping);
+        ::CloseHandle(file);
+        FileSystemException::failWith("failed to map file " + filename +
+                                      ": " + err);
+    }
+}
+
+MappedFile::~MappedFile()
+{
+    if (mData)
+    {
+        ::UnmapViewOfFile(mData);
+    }
+    if (mMapping)
+    {
+        ::CloseHandle(mMapping);
+    }
+    if (mFile)
+    {
+        ::CloseHandle(mFile);
+    }
+}
+
+void
+MappedFile::adviseSequential()
+{
+}
+
+#else
+
+MappedFile::MappedFile(std::string const& filename)
+{
+    int fd = ::open(filename.c_str(), O_RDONLY);
+    if (fd == -1)
+    {
+        FileSystemException::failWithErrno("failed to open file " + filename +
+                                           ": ");
+    }
+    struct stat st;
+    if (::fstat(fd, &st) != 0)
+    {
+        std::string err = std::strerror(errno);
+        ::close(fd);
+        FileSystemException::failWith("failed to stat file " + filename +
+                                      ": " + err);
+    }
+    mSize = static_cast<size_t>(st.st_size);
+    if (mSize != 0)
+    {
+        // Empty files cannot be mapped, and need not be
+        void* data = ::mmap(nullptr, mSize, PROT_READ, MAP_SHARED, fd, 0);
+        if (data == MAP_FAILED)
+        {
+            std::string err = std::strerror(errno);
+            ::close(fd);
+            FileSystemException::failWith("failed to map file " + filename +
+                                          ": " + err);
+        }
+        mData = static_cast<uint8_t const*>(data);
+    }
+    // The mapping keeps the file open
+    ::close(fd);
+}
+
+MappedFile::~MappedFile()
+{
+    if (mData)
+    {
+        ::munmap(const_cast<uint8_t*>(mData), mSize);
+    }
+}
+
+void
+MappedFile::adviseSequential()
+{
+    if (mData &&
+        ::madvise(const_cast<uint8_t*>(mData), mSize, MADV_SEQUENTIAL) != 0)
+    {
+        CLOG(DEBUG, "Fs") << "madvise failed: " << strerror(errno);
+    }
+}
+
+#endif
+}
@@ -0,0 +1,47 @@
+#pragma once
+
+// Copyright 2020 Stellar Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "util/NonCopyable.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace stellar
+{
+
+// A file mapped read-only into memory, for the lifetime of the object. Throws
+// FileSystemException if the file cannot be opened or mapped.
+class MappedFile : public NonMovableOrCopyable
+{
+    uint8_t const* mData{nullptr};
+    size_t mSize{0};
+#ifdef _WIN32
+    void* mFile{nullptr};
+    void* mMapping{nullptr};
+#endif
+
+  public:
+    explicit MappedFile(std::string const& filename);
+    ~MappedFile();
+
+    // Tells the kernel that the file will be read once, front to back, so
+    // that it reads ahead aggressively and drops pages behind the reader.
+    void adviseSequential();
+
+    uint8_t const*
+    data() const
+    {
+        return mData;
+    }
+
+    size_t
+    size() const
+    {
+        return mSize;
+    }
+};
+}
@@ -0,0 +1,287 @@
+// Copyright 2020 Stellar Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "util/ShmRingBuffer.h"
+#include "util/FileSystemException.h"
+#include "util/Logging.h"
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include <cstring>
+#include <new>
+
+namespace stellar
+{
+
+static size_t const FRAME_ALIGNMENT = sizeof(ShmRingBufferFrame);
+
+static uint64_t
+alignFrame(uint64_t size)
+{
+    return (size + FRAME_ALIGNMENT - 1) / FRAME_ALIGNMENT * FRAME_ALIGNMENT;
+}
+
+// shm_open wants a name starting with a single slash
+static std::string
+shmName(std::string const& name)
+{
+    return (!name.empty() && name[0] == '/') ? name : "/" + name;
+}
+
+#ifdef _WIN32
+
+ShmRingBufferWriter::ShmRingBufferWriter(std::string const& name,
+                                         size_t capacity)
+{
+    throw std::runtime_error("shared memory streams are not supported on "
+                             "Windows");
+}
+
+ShmRingBufferWriter::~ShmRingBufferWriter()
+{
+}
+
+ShmRingBufferReader::ShmRingBufferReader(std::string const& name)
+{
+    throw std::runtime_error("shared memory streams are not supported on "
+                             "Windows");
+}
+
+ShmRingBufferReader::~ShmRingBufferReader()
+{
+}
+
+#else
+
+ShmRingBufferWriter::ShmRingBufferWriter(std::string const& name,
+                                         size_t capacity)
+    : mName(shmName(name))
+{
+    capacity = alignFrame(capacity);
+    if (capacity == 0)
+    {
+        throw std::invalid_argument("empty shared memory ring buffer");
+    }
+    mMappingSize = alignFrame(sizeof(ShmRingBufferHeader)) + capacity;
+
+    // A reader still mapping a previous object keeps it, and sees it closed
+    shm_unlink(mName.c_str());
+    int fd = shm_open(mName.c_str(), O_CREAT | O_EXCL | O_RDWR, 0644);
+    if (fd == -1)
+    {
+        FileSystemException::failWithErrno(
+            std::string("shm_open(\"") + mName + "\") failed: ");
+    }
+    if (ftruncate(fd, static_cast<off_t>(mMappingSize)) != 0)
+    {
+        ::close(fd);
+        shm_unlink(mName.c_str());
+        FileSystemException::failWithErrno(
+            std::string("ftruncate(\"") + mName + "\") failed: ");
+    }
+    mMapping = mmap(nullptr, mMappingSize, PROT_READ | PROT_WRITE,
+                    MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (mMapping == MAP_FAILED)
+    {
+        mMapping = nullptr;
+        shm_unlink(mName.c_str());
+        FileSystemException::failWithErrno(
+            std::string("mmap(\"") + mName + "\") failed: ");
+    }
+
+    mHeader = new (mMapping) ShmRingBufferHeader();
+    mHeader->mMagic = ShmRingBufferHeader::MAGIC;
+    mHeader->mVersion = ShmRingBufferHeader::VERSION;
+    mHeader->mCapacity = capacity;
+    mHeader->mReserved.store(0, std::memory_order_relaxed);
+    mHeader->mCommitted.store(0, std::memory_order_relaxed);
+    mHeader->mClosed.store(0, std::memory_order_release);
+    mBuffer = static_cast<unsigned char*>(mMapping) +
+              alignFrame(sizeof(ShmRingBufferHeader));
+}
+
+ShmRingBufferWriter::~ShmRingBufferWriter()
+{
+    if (mMapping)
+    {
+        mHeader->mClosed.store(1, std::memory_order_release);
+        munmap(mMapping, mMappingSize);
+        shm_unlink(mName.c_str());
+    }
+}
+
+ShmRingBufferReader::ShmRingBufferReader(std::string const& name)
+{
+    auto shm = shmName(name);
+    int fd = shm_open(shm.c_str(), O_RDONLY, 0);
+    if (fd == -1)
+    {
+        FileSystemException::failWithErrno(std::string("shm_open(\"") + shm +
+                                           "\") failed: ");
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0)
+    {
+        ::close(fd);
+        FileSystemException::failWithErrno(std::string("fstat(\"") + shm +
+                                           "\") failed: ");
+    }
+    mMappingSize = static_cast<size_t>(st.st_size);
+    mMapping = mmap(nullptr, mMappingSize, PROT_READ, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (mMapping == MAP_FAILED)
+    {
+        mMapping = nullptr;
+        FileSystemException::failWithErrno(std::string("mmap(\"") + shm +
+                                           "\") failed: ");
+    }
+
+    mHeader = static_cast<ShmRingBufferHeader const*>(mMapping);
+    mCapacity = mHeader->mCapacity;
+    if (mMappingSize < alignFrame(sizeof(ShmRingBufferHeader)) ||
+        mHeader->mMagic != ShmRingBufferHeader::MAGIC ||
+        mHeader->mVersion != ShmRingBufferHeader::VERSION ||
+        mMappingSize != alignFrame(sizeof(ShmRingBufferHeader)) + mCapacity)
+    {
+        munmap(mMapping, mMappingSize);
+        mMapping = nullptr;
+        throw std::runtime_error(shm + " is not a shared memory ring buffer");
+    }
+    mBuffer = static_cast<unsigned char const*>(mMapping) +
+              alignFrame(sizeof(ShmRingBufferHeader));
+
+    if (mHeader->mReserved.load(std::memory_order_acquire) > mCapacity)
+    {
+        resync();
+    }
+}
+
+ShmRingBufferReader::~ShmRingBufferReader()
+{
+    if (mMapping)
+    {
+        munmap(mMapping, mMappingSize);
+    }
+}
+
+#endif
+
+unsigned char*
+ShmRingBufferWriter::reserve(size_t size)
+{
+    auto frameSize = sizeof(ShmRingBufferFrame) + alignFrame(size);
+    auto capacity = mHeader->mCapacity;
+    if (frameSize > capacity || size > UINT32_MAX)
+    {
+        throw std::runtime_error("frame of " + std::to_string(size) +
+                                 " bytes does not fit in " + mName);
+    }
+
+    auto offset = mPosition % capacity;
+    auto start = mPosition;
+    if (capacity - offset < frameSize)
+    {
+        start += capacity - offset;
+    }
+    mReservedEnd = start + frameSize;
+
+    // Readers check mReserved after reading a frame, so it must be updated
+    // before anything is overwritten
+    mHeader->mReserved.store(mReservedEnd, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    if (start != mPosition)
+    {
+        ShmRingBufferFrame wrap{0, ShmRingBufferFrame::WRAP, 0};
+        std::memcpy(mBuffer + offset, &wrap, sizeof(wrap));
+    }
+    ShmRingBufferFrame frame{static_cast<uint32_t>(size),
+                             ShmRingBufferFrame::FRAME, ++mSequence};
+    auto dest = mBuffer + start % capacity;
+    std::memcpy(dest, &frame, sizeof(frame));
+    return dest + sizeof(frame);
+}
+
+void
+ShmRingBufferWriter::commit()
+{
+    mPosition = mReservedEnd;
+    mHeader->mCommitted.store(mPosition, std::memory_order_release);
+}
+
+bool
+ShmRingBufferReader::notOverwritten(uint64_t position) const
+{
+    std::atomic_thread_fence(std::memory_order_acquire);
+    return mHeader->mReserved.load(std::memory_order_relaxed) <=
+           position + mCapacity;
+}
+
+void
+ShmRingBufferReader::resync()
+{
+    mPosition = mHeader->mCommitted.load(std::memory_order_acquire);
+    mNextSequence = 0;
+}
+
+ShmRingBufferReader::Result
+ShmRingBufferReader::next(Frame& frame)
+{
+    while (true)
+    {
+        auto committed = mHeader->mCommitted.load(std::memory_order_acquire);
+        if (mPosition == committed)
+        {
+            // The writer commits its last frame before closing
+            if (mHeader->mClosed.load(std::memory_order_acquire) &&
+                mHeader->mCommitted.load(std::memory_order_acquire) ==
+                    mPosition)
+            {
+                return Result::CLOSED;
+            }
+            return Result::EMPTY;
+        }
+
+        ShmRingBufferFrame header;
+        std::memcpy(&header, mBuffer + mPosition % mCapacity, sizeof(header));
+        if (!notOverwritten(mPosition))
+        {
+            resync();
+            return Result::OVERRUN;
+        }
+
+        if (header.mType == ShmRingBufferFrame::WRAP)
+        {
+            mPosition += mCapacity - mPosition % mCapacity;
+            continue;
+        }
+        if (header.mType != ShmRingBufferFrame::FRAME ||
+            (mNextSequence != 0 && header.mSequence != mNextSequence))
+        {
+            throw std::runtime_error("corrupt shared memory ring buffer");
+        }
+
+        frame.mSequence = header.mSequence;
+        frame.mData =
+            mBuffer + mPosition % mCapacity + sizeof(ShmRingBufferFrame);
+        frame.mSize = header.mSize;
+        mFramePosition = mPosition;
+        mPosition += sizeof(ShmRingBufferFrame) + alignFrame(header.mSize);
+        mNextSequence = header.mSequence + 1;
+        return Result::FRAME;
+    }
+}
+
+bool
+ShmRingBufferReader::stillValid() const
+{
+    return notOverwritten(mFramePosition);
+}
+}
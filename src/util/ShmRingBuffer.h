@@ -0,0 +1,177 @@
+#pragma once
+
+// Copyright 2020 Stellar Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "util/NonCopyable.h"
+#include "xdrpp/marshal.h"
+#include <atomic>
+#include <cstdint>
+#include <string>
+
+namespace stellar
+{
+
+// A ring buffer of XDR frames in a named POSIX shared memory object, written
+// by a single ShmRingBufferWriter and read by any number of
+// ShmRingBufferReaders, possibly in other processes on the same host.
+//
+// The writer never waits for readers: a reader that falls more than the
+// capacity of the buffer behind is overrun, which it detects and reports.
+// Frames are contiguous in the buffer, so that readers can decode them in
+// place; a frame that would not fit before the end of the buffer starts at
+// its beginning instead.
+//
+// The object holds a ShmRingBufferHeader followed by the buffer. Every frame
+// is a ShmRingBufferFrame followed by its payload, padded to a multiple of
+// sizeof(ShmRingBufferFrame). Integers are in host byte order. Positions
+// count the bytes written since the buffer was created, so that a frame at
+// position p is at offset p % capacity of the buffer.
+struct ShmRingBufferHeader
+{
+    static uint32_t const MAGIC = 0x53484d52; // "SHMR"
+    static uint32_t const VERSION = 1;
+
+    uint32_t mMagic;
+    uint32_t mVersion;
+    uint64_t mCapacity;
+
+    // The writer may be overwriting anything before mReserved - mCapacity
+    std::atomic<uint64_t> mReserved;
+    // Every frame before mCommitted is complete
+    std::atomic<uint64_t> mCommitted;
+    // Set once the writer has written its last frame
+    std::atomic<uint32_t> mClosed;
+};
+
+struct ShmRingBufferFrame
+{
+    static uint32_t const FRAME = 0;
+    // The rest of the buffer is unused, the next frame is at its beginning
+    static uint32_t const WRAP = 1;
+
+    uint32_t mSize;
+    uint32_t mType;
+    // Frames are numbered from 1
+    uint64_t mSequence;
+};
+
+class ShmRingBufferWriter : NonMovableOrCopyable
+{
+    std::string const mName;
+    size_t mMappingSize{0};
+    void* mMapping{nullptr};
+    ShmRingBufferHeader* mHeader{nullptr};
+    unsigned char* mBuffer{nullptr};
+
+    uint64_t mPosition{0};
+    uint64_t mReservedEnd{0};
+    uint64_t mSequence{0};
+
+    // Returns where to write the payload of the next frame, of size bytes
+    unsigned char* reserve(size_t size);
+    void commit();
+
+  public:
+    // Creates the shared memory object name, replacing any existing one, with
+    // a buffer of capacity bytes
+    ShmRingBufferWriter(std::string const& name, size_t capacity);
+
+    // Marks the buffer closed and unlinks the shared memory object; readers
+    // that have it open can still read what was written
+    ~ShmRingBufferWriter();
+
+    template <typename T>
+    void
+    writeOne(T const& t)
+    {
+        auto size = xdr::xdr_size(t);
+        auto payload = reserve(size);
+        xdr::xdr_put p(payload, payload + size);
+        xdr::xdr_argpack_archive(p, t);
+        commit();
+    }
+};
+
+class ShmRingBufferReader : NonMovableOrCopyable
+{
+  public:
+    enum class Result
+    {
+        FRAME,
+        // Nothing to read yet
+        EMPTY,
+        // The writer overwrote frames before they were read; reading resumes
+        // at the next frame written
+        OVERRUN,
+        // Everything was read and the writer is gone
+        CLOSED
+    };
+
+    // Points into the shared memory object, see stillValid
+    struct Frame
+    {
+        uint64_t mSequence;
+        unsigned char const* mData;
+        size_t mSize;
+    };
+
+  private:
+    size_t mMappingSize{0};
+    void* mMapping{nullptr};
+    ShmRingBufferHeader const* mHeader{nullptr};
+    unsigned char const* mBuffer{nullptr};
+    uint64_t mCapacity{0};
+
+    uint64_t mPosition{0};
+    uint64_t mFramePosition{0};
+    uint64_t mNextSequence{0};
+
+    bool notOverwritten(uint64_t position) const;
+    void resync();
+
+  public:
+    // Opens the shared memory object name created by a ShmRingBufferWriter.
+    // Reading starts at the first frame if the writer has not wrapped around
+    // the buffer yet, and at the next frame written otherwise.
+    explicit ShmRingBufferReader(std::string const& name);
+    ~ShmRingBufferReader();
+
+    Result next(Frame& frame);
+
+    // Whether the last frame returned by next is still intact; its data must
+    // only be trusted if this holds once the caller is done reading it
+    bool stillValid() const;
+
+    template <typename T>
+    Result
+    readOne(T& out)
+    {
+        Frame frame;
+        auto res = next(frame);
+        if (res != Result::FRAME)
+        {
+            return res;
+        }
+        try
+        {
+            xdr::xdr_get g(frame.mData, frame.mData + frame.mSize);
+            xdr::xdr_argpack_archive(g, out);
+        }
+        catch (xdr::xdr_runtime_error&)
+        {
+            if (stillValid())
+            {
+                throw;
+            }
+        }
+        if (!stillValid())
+        {
+            resync();
+            return Result::OVERRUN;
+        }
+        return Result::FRAME;
+    }
+};
+}
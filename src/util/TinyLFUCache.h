@@ -0,0 +1,502 @@
+#pragma once
+
+// Copyright 2020 Stellar Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "util/NonCopyable.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <functional>
+#include <limits>
+#include <list>
+#include <stdexcept>
+#include <unordered_map>
+#include <vector>
+
+namespace stellar
+{
+
+// A cache bounded both by its number of entries and by their total size in
+// bytes, as reported by the caller of put, that follows the W-TinyLFU policy:
+//
+//  - New entries enter a small LRU "window" that absorbs bursts of recent
+//    entries.
+//
+//  - An entry pushed out of the window is only admitted to the main part of
+//    the cache if it is estimated to be used more often than each entry it
+//    would displace, so a scan over many entries used once does not flush
+//    out a frequently used working set.
+//
+//  - The main part is a segmented LRU: entries hit while on probation are
+//    promoted to a protected segment and only go back on probation, rather
+//    than out of the cache, when the protected segment overflows.
+//
+// Use frequencies are estimated by a count-min sketch of small saturating
+// counters that are all halved periodically, so that the estimates follow
+// changes in the workload. The sketch survives clear() and erase(), so the
+// cache keeps favoring popular keys across those.
+template <typename K, typename V, typename Hash = std::hash<K>>
+class TinyLFUCache : public NonMovableOrCopyable
+{
+  public:
+    struct Counters
+    {
+        uint64_t mHits{0};
+        uint64_t mMisses{0};
+        uint64_t mInserts{0};
+        uint64_t mUpdates{0};
+        // Entries that left the cache to make room, including those rejected
+        // on their way from the window to the main part (also counted in
+        // mRejects).
+        uint64_t mEvicts{0};
+        uint64_t mRejects{0};
+    };
+
+    typedef std::function<void(K const&, V const&)> EvictionCallback;
+
+  private:
+    class FrequencySketch
+    {
+        static size_t const DEPTH = 4;
+        static uint8_t const MAX_COUNT = 15;
+        static size_t const MIN_WIDTH = 16;
+        static size_t const MAX_WIDTH = size_t(1) << 24;
+
+        std::vector<uint8_t> mCounts;
+        size_t mWidth{MIN_WIDTH};
+        size_t mAdditions{0};
+        size_t mSampleSize;
+
+        size_t
+        index(size_t hash, size_t row) const
+        {
+            // splitmix64 finalizer, seeded differently for each row
+            uint64_t h = static_cast<uint64_t>(hash) +
+                         0x9e3779b97f4a7c15ULL * (row + 1);
+            h = (h ^ (h >> 30)) * 0xbf58476d1ce4e5b9ULL;
+            h = (h ^ (h >> 27)) * 0x94d049bb133111ebULL;
+            h ^= h >> 31;
+            return row * mWidth + (static_cast<size_t>(h) & (mWidth - 1));
+        }
+
+      public:
+        explicit FrequencySketch(size_t expectedEntries)
+        {
+            while (mWidth < expectedEntries && mWidth < MAX_WIDTH)
+            {
+                mWidth <<= 1;
+            }
+            mCounts.assign(DEPTH * mWidth, 0);
+            mSampleSize = 10 * mWidth;
+        }
+
+        void
+        increment(size_t hash)
+        {
+            bool added = false;
+            for (size_t row = 0; row < DEPTH; ++row)
+            {
+                auto& count = mCounts[index(hash, row)];
+                if (count < MAX_COUNT)
+                {
+                    ++count;
+                    added = true;
+                }
+            }
+            if (added && ++mAdditions == mSampleSize)
+            {
+                for (auto& count : mCounts)
+                {
+                    count >>= 1;
+                }
+                mAdditions /= 2;
+            }
+        }
+
+        uint8_t
+        estimate(size_t hash) const
+        {
+            uint8_t res = MAX_COUNT;
+            for (size_t row = 0; row < DEPTH; ++row)
+            {
+                res = std::min(res, mCounts[index(hash, row)]);
+            }
+            return res;
+        }
+    };
+
+    enum class Segment
+    {
+        WINDOW,
+        PROBATION,
+        PROTECTED
+    };
+
+    struct Node
+    {
+        K mKey;
+        V mValue;
+        size_t mBytes;
+        Segment mSegment;
+    };
+
+    typedef std::list<Node> List;
+    typedef typename List::iterator NodeIter;
+
+    // Each segment is kept in LRU order, most recently used first. Nodes move
+    // between segments with splice, which keeps the iterators in mNodes valid.
+    struct SegmentList
+    {
+        List mList;
+        size_t mBytes{0};
+        size_t mMaxSize{0};
+        size_t mMaxBytes{0};
+
+        bool
+        overBudget() const
+        {
+            return mList.size() > mMaxSize || mBytes > mMaxBytes;
+        }
+    };
+
+    size_t const mMaxSize;
+    size_t const mMaxBytes;
+    size_t mBytes{0};
+
+    SegmentList mWindow;
+    SegmentList mProbation;
+    SegmentList mProtected;
+
+    Hash mHash;
+    std::unordered_map<K, NodeIter, Hash> mNodes;
+    FrequencySketch mSketch;
+    EvictionCallback mOnEvict;
+
+    Counters mCounters;
+
+    SegmentList&
+    segment(Segment s)
+    {
+        switch (s)
+        {
+        case Segment::WINDOW:
+            return mWindow;
+        case Segment::PROBATION:
+            return mProbation;
+        default:
+            return mProtected;
+        }
+    }
+
+    bool
+    overBudget() const
+    {
+        return mNodes.size() > mMaxSize || mBytes > mMaxBytes;
+    }
+
+    // Moves node to the front of segment `to`.
+    void
+    moveTo(NodeIter node, Segment to)
+    {
+        auto& from = segment(node->mSegment);
+        auto& dest = segment(to);
+        dest.mList.splice(dest.mList.begin(), from.mList, node);
+        from.mBytes -= node->mBytes;
+        dest.mBytes += node->mBytes;
+        node->mSegment = to;
+    }
+
+    void
+    remove(NodeIter node, bool rejected)
+    {
+        auto& seg = segment(node->mSegment);
+        seg.mBytes -= node->mBytes;
+        mBytes -= node->mBytes;
+        ++mCounters.mEvicts;
+        if (rejected)
+        {
+            ++mCounters.mRejects;
+        }
+        if (mOnEvict)
+        {
+            mOnEvict(node->mKey, node->mValue);
+        }
+        mNodes.erase(node->mKey);
+        seg.mList.erase(node);
+    }
+
+    void
+    touch(NodeIter node)
+    {
+        switch (node->mSegment)
+        {
+        case Segment::WINDOW:
+            moveTo(node, Segment::WINDOW);
+            break;
+        case Segment::PROBATION:
+            moveTo(node, Segment::PROTECTED);
+            while (mProtected.mList.size() > 1 && mProtected.overBudget())
+            {
+                moveTo(std::prev(mProtected.mList.end()), Segment::PROBATION);
+            }
+            break;
+        case Segment::PROTECTED:
+            moveTo(node, Segment::PROTECTED);
+            break;
+        }
+    }
+
+    // Lets candidate, just moved from the window to the front of probation,
+    // displace the least recently used main entries for as long as the cache
+    // is over budget and it is used more often than each of them.
+    void
+    admit(NodeIter candidate)
+    {
+        auto candidateFreq = mSketch.estimate(mHash(candidate->mKey));
+        while (overBudget())
+        {
+            NodeIter victim;
+            if (std::prev(mProbation.mList.end()) != candidate)
+            {
+                victim = std::prev(mProbation.mList.end());
+            }
+            else if (!mProtected.mList.empty())
+            {
+                victim = std::prev(mProtected.mList.end());
+            }
+            else
+            {
+                remove(candidate, true);
+                return;
+            }
+
+            if (candidateFreq > mSketch.estimate(mHash(victim->mKey)))
+            {
+                remove(victim, false);
+            }
+            else
+            {
+                remove(candidate, true);
+                return;
+            }
+        }
+    }
+
+    void
+    evict()
+    {
+        while (mWindow.mList.size() > 1 && mWindow.overBudget())
+        {
+            auto candidate = std::prev(mWindow.mList.end());
+            moveTo(candidate, Segment::PROBATION);
+            admit(candidate);
+        }
+        // Updates that grew an entry can leave the cache over budget with
+        // nothing to admit
+        while (overBudget())
+        {
+            auto& seg = !mProbation.mList.empty()
+                            ? mProbation
+                            : !mProtected.mList.empty() ? mProtected : mWindow;
+            remove(std::prev(seg.mList.end()), false);
+        }
+    }
+
+    // 80% of n, rounded down but at least 1 so that small caches still
+    // protect an entry, computed without overflowing for n near SIZE_MAX
+    static size_t
+    protectedShare(size_t n)
+    {
+        return std::max<size_t>(1, n - n / 5 - (n % 5 != 0 ? 1 : 0));
+    }
+
+  public:
+    // maxBytes bounds the sum of the sizes passed to put for the entries in
+    // the cache. onEvict, if set, is called with every entry that leaves the
+    // cache to make room for others, but not with erased or cleared entries.
+    explicit TinyLFUCache(
+        size_t maxSize,
+        size_t maxBytes = std::numeric_limits<size_t>::max(),
+        EvictionCallback onEvict = nullptr)
+        : mMaxSize(maxSize)
+        , mMaxBytes(maxBytes)
+        , mSketch(maxSize)
+        , mOnEvict(std::move(onEvict))
+    {
+        // 1% of the cache for the window and 80% of the rest for protected
+        // entries, as recommended for W-TinyLFU
+        mWindow.mMaxSize = std::max<size_t>(1, maxSize / 100);
+        mWindow.mMaxBytes = std::max<size_t>(1, maxBytes / 100);
+        auto mainSize = maxSize - std::min(maxSize, mWindow.mMaxSize);
+        mProtected.mMaxSize = protectedShare(mainSize);
+        mProtected.mMaxBytes = protectedShare(maxBytes - mWindow.mMaxBytes);
+        mProbation.mMaxSize = std::numeric_limits<size_t>::max();
+        mProbation.mMaxBytes = std::numeric_limits<size_t>::max();
+    }
+
+    size_t
+    maxSize() const
+    {
+        return mMaxSize;
+    }
+
+    size_t
+    maxBytes() const
+    {
+        return mMaxBytes;
+    }
+
+    size_t
+    size() const
+    {
+        return mNodes.size();
+    }
+
+    size_t
+    bytes() const
+    {
+        return mBytes;
+    }
+
+    Counters const&
+    getCounters() const
+    {
+        return mCounters;
+    }
+
+#ifdef BUILD_TESTS
+    size_t
+    protectedSize() const
+    {
+        return mProtected.mList.size();
+    }
+#endif
+
+    // `put` does not offer exception safety. If it throws an exception,
+    // cache may be in an inconsistent state. It is, therefore,
+    // client's responsibility to handle failures correctly. The entry may
+    // not be admitted, or be evicted right away, if it is larger than the
+    // cache or used less often than the entries it would displace.
+    void
+    put(K const& k, V const& v, size_t bytes = 1)
+    {
+        mSketch.increment(mHash(k));
+        auto iter = mNodes.find(k);
+        if (iter != mNodes.end())
+        {
+            auto node = iter->second;
+            auto& seg = segment(node->mSegment);
+            seg.mBytes = seg.mBytes - node->mBytes + bytes;
+            mBytes = mBytes - node->mBytes + bytes;
+            node->mBytes = bytes;
+            node->mValue = v;
+            ++mCounters.mUpdates;
+            touch(node);
+        }
+        else
+        {
+            if (mMaxSize == 0 || bytes > mMaxBytes)
+            {
+                return;
+            }
+            mWindow.mList.emplace_front(Node{k, v, bytes, Segment::WINDOW});
+            mWindow.mBytes += bytes;
+            mBytes += bytes;
+            mNodes.emplace(k, mWindow.mList.begin());
+            ++mCounters.mInserts;
+        }
+        evict();
+    }
+
+    // `exists` offers strong exception safety guarantee.
+    bool
+    exists(K const& k, bool countMisses = true)
+    {
+        bool miss = (mNodes.find(k) == mNodes.end());
+        // As with RandomEvictionCache, misses are counted here since exists()
+        // is typically used as a guard followed by a get().
+        if (miss && countMisses)
+        {
+            ++mCounters.mMisses;
+        }
+        return !miss;
+    }
+
+    // `get` offers strong exception safety guarantee.
+    V&
+    get(K const& k)
+    {
+        auto iter = mNodes.find(k);
+        if (iter == mNodes.end())
+        {
+            throw std::range_error("There is no such key in cache");
+        }
+        auto node = iter->second;
+        mSketch.increment(mHash(k));
+        ++mCounters.mHits;
+        touch(node);
+        return node->mValue;
+    }
+
+    // `maybeGet` offers strong exception safety guarantee.
+    V*
+    maybeGet(K const& k)
+    {
+        if (exists(k))
+        {
+            return &get(k);
+        }
+        return nullptr;
+    }
+
+    // `erase` does not throw unless Hash does.
+    void
+    erase(K const& k)
+    {
+        auto iter = mNodes.find(k);
+        if (iter != mNodes.end())
+        {
+            auto node = iter->second;
+            auto& seg = segment(node->mSegment);
+            seg.mBytes -= node->mBytes;
+            mBytes -= node->mBytes;
+            mNodes.erase(iter);
+            seg.mList.erase(node);
+        }
+    }
+
+    // `erase_if` offers basic exception safety guarantee. If it throws an
+    // exception, then the cache may or may not be modified.
+    void
+    erase_if(std::function<bool(V const&)> const& f)
+    {
+        for (auto seg : {&mWindow, &mProbation, &mProtected})
+        {
+            for (auto node = seg->mList.begin(); node != seg->mList.end();)
+            {
+                auto next = std::next(node);
+                if (f(node->mValue))
+                {
+                    erase(node->mKey);
+                }
+                node = next;
+            }
+        }
+    }
+
+    // `clear` does not throw
+    void
+    clear()
+    {
+        mNodes.clear();
+        for (auto seg : {&mWindow, &mProbation, &mProtected})
+        {
+            seg->mList.clear();
+            seg->mBytes = 0;
+        }
+        mBytes = 0;
+    }
+};
+}
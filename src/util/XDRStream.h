@@ -6,12 +6,15 @@
 
 #include "crypto/ByteSlice.h"
 #include "crypto/SHA.h"
+#include "util/BlockCompression.h"
 #include "util/FileSystemException.h"
 #include "util/Fs.h"
 #include "util/Logging.h"
+#include "util/MappedFile.h"
 #include "xdrpp/marshal.h"
 
 #include <fstream>
+#include <memory>
 #include <string>
 #include <vector>
 #ifdef _WIN32
@@ -80,6 +83,13 @@ class XDRInputFileStream
         return mIn.tellg();
     }
 
+    void
+    seek(size_t pos)
+    {
+        mIn.clear();
+        mIn.seekg(pos);
+    }
+
     template <typename T>
     bool
     readOne(T& out)
@@ -119,6 +129,157 @@ class XDRInputFileStream
     }
 };
 
+/**
+ * Like XDRInputFileStream, but reading from a read-only mapping of the file,
+ * which the kernel is told will be read sequentially: objects are decoded
+ * straight from the mapped pages, without first copying them out of the file,
+ * and readOneXdr gives the bytes of an object without decoding it at all.
+ *
+ * Block-compressed files (see util/BlockCompression.h) are read the same way,
+ * uncompressing one block at a time; positions and sizes are then those of
+ * the uncompressed file.
+ */
+class XDRInputMappedStream
+{
+    std::unique_ptr<MappedFile> mFile;
+    std::unique_ptr<BlockCompressedReader> mBlocks;
+    // The bytes of the file from mWindowBegin to mWindowEnd: all of them, or
+    // the current block of a block-compressed file
+    uint8_t const* mWindow{nullptr};
+    uint64_t mWindowBegin{0};
+    uint64_t mWindowEnd{0};
+    size_t mPos{0};
+    size_t mSizeLimit;
+
+  public:
+    XDRInputMappedStream(unsigned int sizeLimit = 0) : mSizeLimit{sizeLimit}
+    {
+    }
+
+    void
+    close()
+    {
+        mBlocks.reset();
+        mFile.reset();
+        mWindow = nullptr;
+        mWindowBegin = mWindowEnd = 0;
+        mPos = 0;
+    }
+
+    void
+    open(std::string const& filename)
+    {
+        close();
+        mFile = std::make_unique<MappedFile>(filename);
+        mFile->adviseSequential();
+        if (isBlockCompressed(ByteSlice(mFile->data(), mFile->size())))
+        {
+            mBlocks = std::make_unique<BlockCompressedReader>(mFile->data(),
+                                                              mFile->size());
+        }
+        else
+        {
+            mWindow = mFile->data();
+            mWindowEnd = mFile->size();
+        }
+    }
+
+    operator bool() const
+    {
+        return mFile && mPos < size();
+    }
+
+    size_t
+    size() const
+    {
+        if (mBlocks)
+        {
+            return mBlocks->size();
+        }
+        return mFile ? mFile->size() : 0;
+    }
+
+    size_t
+    pos() const
+    {
+        return mPos;
+    }
+
+    void
+    seek(size_t pos)
+    {
+        mPos = pos;
+    }
+
+    // Sets data and size to the XDR of the next object, which stays valid
+    // until the next read.
+    bool
+    readOneXdr(uint8_t const*& data, size_t& size)
+    {
+        if (!mFile)
+        {
+            return false;
+        }
+        if (mPos < mWindowBegin || mPos >= mWindowEnd)
+        {
+            if (!mBlocks || mPos >= mBlocks->size())
+            {
+                return false;
+            }
+            mBlocks->load(mPos, mWindow, mWindowBegin, mWindowEnd);
+        }
+        if (mPos + 4 > mWindowEnd)
+        {
+            // Blocks hold whole objects
+            if (mBlocks)
+            {
+                throw xdr::xdr_runtime_error("malformed XDR file");
+            }
+            return false;
+        }
+        auto szBuf = mWindow + (mPos - mWindowBegin);
+
+        // Read 4 bytes of size, big-endian, with XDR 'continuation' bit cleared
+        // (high bit of high byte).
+        uint32_t sz = 0;
+        sz |= static_cast<uint8_t>(szBuf[0] & 0x7f);
+        sz <<= 8;
+        sz |= szBuf[1];
+        sz <<= 8;
+        sz |= szBuf[2];
+        sz <<= 8;
+        sz |= szBuf[3];
+
+        if (mSizeLimit != 0 && sz > mSizeLimit)
+        {
+            return false;
+        }
+        if (sz > mWindowEnd - mPos - 4)
+        {
+            throw xdr::xdr_runtime_error("malformed XDR file");
+        }
+        data = szBuf + 4;
+        size = sz;
+        mPos += sz + 4;
+        return true;
+    }
+
+    template <typename T>
+    bool
+    readOne(T& out)
+    {
+        uint8_t const* data;
+        size_t size;
+        if (!readOneXdr(data, size))
+        {
+            return false;
+        }
+        xdr::xdr_get g(data, data + size);
+        xdr::xdr_argpack_archive(g, out);
+        return true;
+    }
+};
+
 // XDROutputStream needs access to a file descriptor to do
 // fsync, so we use cstdio here rather than fstreams.
 class XDROutputFileStream
@@ -126,9 +287,65 @@ class XDROutputFileStream
     FILE* mOut{nullptr};
     std::vector<char> mBuf;
     const bool mFsyncOnClose;
+    // Set to write a block-compressed file
+    std::unique_ptr<BlockCompressedWriter> mBlocks;
+
+    // Makes room in mBuf for an object of sz bytes after its size
+    void
+    prepareBuf(uint32_t sz)
+    {
+        if (!mOut)
+        {
+            FileSystemException::failWith(
+                "XDROutputFileStream::writeOne() on non-open FILE*");
+        }
+
+        assert(sz < 0x80000000);
+
+        if (mBuf.size() < sz + 4)
+        {
+            mBuf.resize(sz + 4);
+        }
+
+        // Write 4 bytes of size, big-endian, with XDR 'continuation' bit set on
+        // high bit of high byte.
+        mBuf[0] = static_cast<char>((sz >> 24) & 0xFF) | '\x80';
+        mBuf[1] = static_cast<char>((sz >> 16) & 0xFF);
+        mBuf[2] = static_cast<char>((sz >> 8) & 0xFF);
+        mBuf[3] = static_cast<char>(sz & 0xFF);
+    }
+
+    void
+    writeBuf(uint32_t sz, SHA256* hasher, size_t* bytesPut)
+    {
+        if (mBlocks)
+        {
+            mBlocks->add(mOut, reinterpret_cast<uint8_t const*>(mBuf.data()),
+                         sz + 4);
+        }
+        else if (fwrite(mBuf.data(), 1, sz + 4, mOut) != sz + 4)
+        {
+            FileSystemException::failWithErrno(
+                "XDROutputFileStream::writeOne() failed:");
+        }
+
+        if (hasher)
+        {
+            hasher->add(ByteSlice(mBuf.data(), sz + 4));
+        }
+        if (bytesPut)
+        {
+            *bytesPut += (sz + 4);
+        }
+    }
 
   public:
-    XDROutputFileStream(bool fsyncOnClose) : mFsyncOnClose(fsyncOnClose)
+    // Hashers and byte counts passed to writes are given the objects as they
+    // would be written to an uncompressed file, even with compressBlocks.
+    XDROutputFileStream(bool fsyncOnClose, bool compressBlocks = false)
+        : mFsyncOnClose(fsyncOnClose)
+        , mBlocks(compressBlocks ? std::make_unique<BlockCompressedWriter>()
+                                 : nullptr)
     {
     }
 
@@ -148,6 +365,10 @@ class XDROutputFileStream
             FileSystemException::failWith(
                 "XDROutputFileStream::close() on non-open FILE*");
         }
+        if (mBlocks)
+        {
+            mBlocks->finish(mOut);
+        }
         if (fflush(mOut) != 0)
         {
             FileSystemException::failWithErrno(
@@ -179,6 +400,10 @@ class XDROutputFileStream
             FileSystemException::failWithErrno(
                 "XDROutputFileStream::fdopen() failed");
         }
+        if (mBlocks)
+        {
+            mBlocks->start(mOut);
+        }
     }
 
     void
@@ -211,6 +436,10 @@ class XDROutputFileStream
                 std::string("XDROutputFileStream::open(\"") + filename +
                 "\") failed: ");
         }
+        if (mBlocks)
+        {
+            mBlocks->start(mOut);
+        }
     }
 
     operator bool() const
@@ -222,44 +451,60 @@ class XDROutputFileStream
     template <typename T>
     void
     writeOne(T const& t, SHA256* hasher = nullptr, size_t* bytesPut = nullptr)
+    {
+        uint32_t sz = (uint32_t)xdr::xdr_size(t);
+        prepareBuf(sz);
+
+        xdr::xdr_put p(mBuf.data() + 4, mBuf.data() + 4 + sz);
+        xdr_argpack_archive(p, t);
+
+        writeBuf(sz, hasher, bytesPut);
+    }
+
+    // Like writeOne, given the XDR of the object rather than the object, as
+    // XDRInputMappedStream::readOneXdr returns it.
+    void
+    writeOneXdr(ByteSlice const& xdr, SHA256* hasher = nullptr,
+                size_t* bytesPut = nullptr)
+    {
+        uint32_t sz = (uint32_t)xdr.size();
+        prepareBuf(sz);
+        std::copy(xdr.begin(), xdr.end(), mBuf.begin() + 4);
+        writeBuf(sz, hasher, bytesPut);
+    }
+
+    // Writes objects already framed the way writeOne frames them, such as
+    // the contents of another file that writeOne wrote.
+    void
+    writeFrames(ByteSlice const& frames, SHA256* hasher = nullptr,
+                size_t* bytesPut = nullptr)
     {
         if (!mOut)
         {
             FileSystemException::failWith(
-                "XDROutputFileStream::writeOne() on non-open FILE*");
+                "XDROutputFileStream::writeFrames() on non-open FILE*");
         }
-
-        uint32_t sz = (uint32_t)xdr::xdr_size(t);
-        assert(sz < 0x80000000);
-
-        if (mBuf.size() < sz + 4)
+        if (frames.empty())
         {
-            mBuf.resize(sz + 4);
+            return;
         }
-
-        // Write 4 bytes of size, big-endian, with XDR 'continuation' bit set on
-        // high bit of high byte.
-        mBuf[0] = static_cast<char>((sz >> 24) & 0xFF) | '\x80';
-        mBuf[1] = static_cast<char>((sz >> 16) & 0xFF);
-        mBuf[2] = static_cast<char>((sz >> 8) & 0xFF);
-        mBuf[3] = static_cast<char>(sz & 0xFF);
-
-        xdr::xdr_put p(mBuf.data() + 4, mBuf.data() + 4 + sz);
-        xdr_argpack_archive(p, t);
-
-        if (fwrite(mBuf.data(), 1, sz + 4, mOut) != sz + 4)
+        if (mBlocks)
+        {
+            mBlocks->add(mOut, frames.data(), frames.size());
+        }
+        else if (fwrite(frames.data(), 1, frames.size(), mOut) !=
+                 frames.size())
         {
             FileSystemException::failWithErrno(
-                "XDROutputFileStream::writeOne() failed:");
+                "XDROutputFileStream::writeFrames() failed:");
         }
-
         if (hasher)
         {
-            hasher->add(ByteSlice(mBuf.data(), sz + 4));
+            hasher->add(frames);
         }
         if (bytesPut)
         {
-            *bytesPut += (sz + 4);
+            *bytesPut += frames.size();
         }
     }
 };
@@ -0,0 +1,99 @@
+// Copyright 2020 Stellar Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "lib/catch.hpp"
+#include "util/Arena.h"
+#include <algorithm>
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+using namespace stellar;
+
+TEST_CASE("arena hands out aligned, disjoint blocks", "[arena]")
+{
+    Arena arena;
+    std::vector<char*> blocks;
+    for (size_t i = 1; i < 1000; i += 7)
+    {
+        auto p = static_cast<char*>(arena.allocate(i));
+        REQUIRE(reinterpret_cast<uintptr_t>(p) % alignof(std::max_align_t) ==
+                0);
+        std::fill(p, p + i, static_cast<char>(i));
+        blocks.emplace_back(p);
+    }
+    size_t j = 0;
+    for (size_t i = 1; i < 1000; i += 7, ++j)
+    {
+        REQUIRE(std::all_of(blocks[j], blocks[j] + i, [&](char c) {
+            return c == static_cast<char>(i);
+        }));
+    }
+
+    // Blocks larger than a chunk get a chunk of their own
+    auto before = arena.getBytesReserved();
+    arena.allocate(1 << 22);
+    REQUIRE(arena.getBytesReserved() >= before + (1 << 22));
+}
+
+TEST_CASE("arena reuses returned nodes", "[arena]")
+{
+    Arena arena;
+    auto a = arena.allocateNode(48);
+    auto b = arena.allocateNode(48);
+    REQUIRE(a != b);
+    arena.deallocateNode(a, 48);
+    REQUIRE(arena.allocateNode(48) == a);
+    REQUIRE(arena.allocateNode(48) != a);
+}
+
+TEST_CASE("arena leaves large nodes to the system", "[arena]")
+{
+    Arena arena;
+    for (size_t i = 0; i < 100; ++i)
+    {
+        auto p = arena.allocateNode(1 << 16);
+        arena.deallocateNode(p, 1 << 16);
+    }
+    REQUIRE(arena.getBytesReserved() == 0);
+}
+
+TEST_CASE("arena allocators back standard containers", "[arena]")
+{
+    auto arena = std::make_shared<Arena>();
+    std::weak_ptr<Arena> weak = arena;
+
+    std::shared_ptr<std::string> escaped;
+    {
+        typedef std::unordered_map<
+            int, std::shared_ptr<std::string>, std::hash<int>,
+            std::equal_to<int>,
+            ArenaNodeAllocator<
+                std::pair<int const, std::shared_ptr<std::string>>>>
+            Map;
+        Map map{Map::allocator_type(arena)};
+        for (int i = 0; i < 1000; ++i)
+        {
+            map.emplace(i, std::allocate_shared<std::string>(
+                               ArenaAllocator<std::string>(arena),
+                               std::to_string(i)));
+        }
+        for (int i = 0; i < 1000; i += 2)
+        {
+            map.erase(i);
+        }
+        REQUIRE(map.size() == 500);
+        REQUIRE(*map.at(1) == "1");
+        escaped = map.at(999);
+    }
+
+    // The arena outlives its owner for as long as anything allocated from it
+    // is still referenced
+    arena.reset();
+    REQUIRE(!weak.expired());
+    REQUIRE(*escaped == "999");
+    escaped.reset();
+    REQUIRE(weak.expired());
+}
@@ -0,0 +1,197 @@
+// Copyright 2020 Stellar Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "lib/catch.hpp"
+#include "util/BlockCompression.h"
+#include "util/Math.h"
+
+#include <cstdio>
+#include <cstring>
+#include <stdexcept>
+
+using namespace stellar;
+
+namespace
+{
+std::vector<uint8_t>
+randomBytes(size_t size, uint8_t maxByte)
+{
+    std::vector<uint8_t> res(size);
+    for (auto& b : res)
+    {
+        b = static_cast<uint8_t>(rand_uniform<uint32_t>(0, maxByte));
+    }
+    return res;
+}
+
+std::vector<uint8_t>
+roundTrip(std::vector<uint8_t> const& data, size_t& compressedSize)
+{
+    std::vector<uint8_t> compressed;
+    compressBlock(ByteSlice(data.data(), data.size()), compressed);
+    compressedSize = compressed.size();
+    std::vector<uint8_t> res(data.size());
+    uncompressBlock(ByteSlice(compressed.data(), compressed.size()),
+                    res.data(), res.size());
+    return res;
+}
+
+// Frames of random sizes, with the XDR size marks
+std::vector<uint8_t>
+randomFrames(size_t count, std::vector<uint64_t>& offsets)
+{
+    std::vector<uint8_t> res;
+    for (size_t i = 0; i < count; ++i)
+    {
+        offsets.emplace_back(res.size());
+        auto sz = 4 * rand_uniform<uint32_t>(1, 512);
+        uint32_t mark = sz | 0x80000000;
+        res.emplace_back(static_cast<uint8_t>(mark >> 24));
+        res.emplace_back(static_cast<uint8_t>(mark >> 16));
+        res.emplace_back(static_cast<uint8_t>(mark >> 8));
+        res.emplace_back(static_cast<uint8_t>(mark));
+        auto body = randomBytes(sz, 3);
+        res.insert(res.end(), body.begin(), body.end());
+    }
+    return res;
+}
+}
+
+TEST_CASE("compressed blocks round trip", "[blockcompression]")
+{
+    size_t compressedSize = 0;
+    SECTION("repetitive data")
+    {
+        std::vector<uint8_t> data;
+        auto pattern = randomBytes(100, 255);
+        for (size_t i = 0; i < 1000; ++i)
+        {
+            data.insert(data.end(), pattern.begin(), pattern.end());
+        }
+        REQUIRE(roundTrip(data, compressedSize) == data);
+        REQUIRE(compressedSize < data.size() / 10);
+    }
+    SECTION("data with few distinct bytes")
+    {
+        auto data = randomBytes(100000, 3);
+        REQUIRE(roundTrip(data, compressedSize) == data);
+        REQUIRE(compressedSize < data.size());
+    }
+    SECTION("random data")
+    {
+        auto data = randomBytes(100000, 255);
+        REQUIRE(roundTrip(data, compressedSize) == data);
+    }
+    SECTION("short data")
+    {
+        for (size_t size = 0; size < 32; ++size)
+        {
+            auto data = randomBytes(size, 1);
+            REQUIRE(roundTrip(data, compressedSize) == data);
+        }
+    }
+}
+
+TEST_CASE("malformed compressed blocks are rejected", "[blockcompression]")
+{
+    auto data = randomBytes(10000, 3);
+    std::vector<uint8_t> compressed;
+    compressBlock(ByteSlice(data.data(), data.size()), compressed);
+    std::vector<uint8_t> out(data.size() + 1);
+
+    SECTION("wrong size")
+    {
+        REQUIRE_THROWS_AS(
+            uncompressBlock(ByteSlice(compressed.data(), compressed.size()),
+                            out.data(), data.size() - 1),
+            std::runtime_error);
+        REQUIRE_THROWS_AS(
+            uncompressBlock(ByteSlice(compressed.data(), compressed.size()),
+                            out.data(), data.size() + 1),
+            std::runtime_error);
+    }
+    SECTION("truncated")
+    {
+        for (size_t size = 0; size < compressed.size(); ++size)
+        {
+            REQUIRE_THROWS_AS(
+                uncompressBlock(ByteSlice(compressed.data(), size),
+                                out.data(), data.size()),
+                std::runtime_error);
+        }
+    }
+    SECTION("corrupted")
+    {
+        // Must not read or write out of bounds, whether it throws or not
+        for (size_t i = 0; i < 1000; ++i)
+        {
+            auto corrupted = compressed;
+            corrupted[rand_uniform<size_t>(0, corrupted.size() - 1)] ^=
+                static_cast<uint8_t>(rand_uniform<uint32_t>(1, 255));
+            try
+            {
+                uncompressBlock(ByteSlice(corrupted.data(), corrupted.size()),
+                                out.data(), data.size());
+            }
+            catch (std::runtime_error&)
+            {
+            }
+        }
+    }
+}
+
+TEST_CASE("block-compressed files are read at any position",
+          "[blockcompression]")
+{
+    std::vector<uint64_t> offsets;
+    auto frames = randomFrames(2000, offsets);
+
+    std::vector<uint8_t> file;
+    {
+        auto out = std::tmpfile();
+        REQUIRE(out);
+        BlockCompressedWriter writer;
+        writer.start(out);
+        // Written in pieces of whole frames
+        for (size_t i = 0; i < offsets.size(); i += 7)
+        {
+            auto end = i + 7 < offsets.size() ? offsets[i + 7] : frames.size();
+            writer.add(out, frames.data() + offsets[i], end - offsets[i]);
+        }
+        REQUIRE_THROWS_AS(writer.add(out, frames.data(), 3),
+                          std::runtime_error);
+        REQUIRE_THROWS_AS(writer.add(out, frames.data(), offsets[1] - 1),
+                          std::runtime_error);
+        writer.finish(out);
+        file.resize(static_cast<size_t>(std::ftell(out)));
+        std::rewind(out);
+        REQUIRE(std::fread(file.data(), 1, file.size(), out) == file.size());
+        std::fclose(out);
+    }
+    REQUIRE(isBlockCompressed(ByteSlice(file.data(), file.size())));
+    REQUIRE(!isBlockCompressed(ByteSlice(frames.data(), frames.size())));
+    REQUIRE(file.size() < frames.size());
+
+    BlockCompressedReader reader(file.data(), file.size());
+    REQUIRE(reader.size() == frames.size());
+    for (size_t i = 0; i < 1000; ++i)
+    {
+        auto frame = offsets[rand_uniform<size_t>(0, offsets.size() - 1)];
+        uint8_t const* block;
+        uint64_t begin, end;
+        reader.load(frame, block, begin, end);
+        REQUIRE(begin <= frame);
+        REQUIRE(frame < end);
+        REQUIRE(end - begin <= BlockCompressedWriter::BLOCK_BYTES);
+        REQUIRE(std::memcmp(block, frames.data() + begin, end - begin) == 0);
+    }
+
+    SECTION("truncated files are rejected")
+    {
+        REQUIRE_THROWS_AS(BlockCompressedReader(file.data(), file.size() - 1),
+                          std::runtime_error);
+        REQUIRE_THROWS_AS(BlockCompressedReader(file.data(), 4),
+                          std::runtime_error);
+    }
+}
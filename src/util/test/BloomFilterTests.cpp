@@ -0,0 +1,93 @@
+// Copyright 2020 Stellar Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "lib/catch.hpp"
+#include "util/BloomFilter.h"
+#include "util/Math.h"
+#include <unordered_set>
+
+using namespace stellar;
+
+TEST_CASE("bloom filter has no false negatives", "[bloomfilter]")
+{
+    size_t const capacity = 10000;
+    BloomFilter<uint64_t> filter(capacity);
+    std::unordered_set<uint64_t> added;
+
+    // Past its capacity, the filter gets worse but must not forget any key
+    for (size_t i = 0; i < 4 * capacity; ++i)
+    {
+        auto key = rand_uniform<uint64_t>(0, UINT64_MAX);
+        filter.add(key);
+        added.insert(key);
+    }
+    REQUIRE(filter.additions() == 4 * capacity);
+    for (auto key : added)
+    {
+        REQUIRE(filter.mayContain(key));
+    }
+}
+
+TEST_CASE("bloom filter false positive rate", "[bloomfilter]")
+{
+    size_t const capacity = 10000;
+    BloomFilter<uint64_t> filter(capacity);
+    REQUIRE(filter.falsePositiveRate() == 0.0);
+
+    // Even keys are added, odd ones never are
+    for (uint64_t i = 0; i < capacity; ++i)
+    {
+        filter.add(2 * i);
+    }
+
+    size_t const probes = 100000;
+    size_t falsePositives = 0;
+    for (uint64_t i = 0; i < probes; ++i)
+    {
+        if (filter.mayContain(2 * i + 1))
+        {
+            ++falsePositives;
+        }
+    }
+    auto measured = static_cast<double>(falsePositives) / probes;
+    auto estimated = filter.falsePositiveRate();
+
+    // With at least 10 bits per key the rate is below 1%, and the estimate
+    // follows the measured rate
+    REQUIRE(estimated < 0.01);
+    REQUIRE(measured < 0.01);
+    REQUIRE(measured < 2 * estimated + 0.001);
+    REQUIRE(estimated < 2 * measured + 0.001);
+
+    // Overfilling the filter shows up in the estimate
+    for (uint64_t i = capacity; i < 4 * capacity; ++i)
+    {
+        filter.add(2 * i);
+    }
+    REQUIRE(filter.falsePositiveRate() > 0.1);
+}
+
+TEST_CASE("bloom filter recreated from its words", "[bloomfilter]")
+{
+    BloomFilter<uint64_t> filter(1000);
+    for (uint64_t i = 0; i < 1000; ++i)
+    {
+        filter.add(rand_uniform<uint64_t>(0, UINT64_MAX));
+    }
+
+    BloomFilter<uint64_t> copy(filter.words(), filter.additions());
+    REQUIRE(copy.bitCount() == filter.bitCount());
+    REQUIRE(copy.additions() == filter.additions());
+    REQUIRE(copy.falsePositiveRate() == filter.falsePositiveRate());
+    for (size_t i = 0; i < 10000; ++i)
+    {
+        auto key = rand_uniform<uint64_t>(0, UINT64_MAX);
+        REQUIRE(copy.mayContain(key) == filter.mayContain(key));
+    }
+
+    REQUIRE_THROWS_AS(BloomFilter<uint64_t>(std::vector<uint64_t>(3), 0),
+                      std::invalid_argument);
+    REQUIRE_THROWS_AS(BloomFilter<uint64_t>(std::vector<uint64_t>(), 0),
+                      std::invalid_argument);
+}
@@ -5,6 +5,7 @@
 #include "lib/catch.hpp"
 #include "lib/util/lrucache.hpp"
 #include "util/RandomEvictionCache.h"
+#include "util/TinyLFUCache.h"
 #include <ctime>
 #include <map>
 
@@ -112,10 +113,122 @@ TEST_CASE("cachetable does not thrash", "[randomevictioncachethrash][!hide]")
     REQUIRE(ctrs.mEvicts < 11);
 }
 
+TEST_CASE("tinylfu cache respects its byte budget", "[tinylfucache]")
+{
+    size_t evicted = 0;
+    TinyLFUCache<int, int> cache(1000, 100,
+                                 [&](int const&, int const&) { ++evicted; });
+    auto const& ctrs = cache.getCounters();
+
+    for (int i = 0; i < 100; ++i)
+    {
+        cache.put(i, i, 10);
+        REQUIRE(cache.bytes() <= 100);
+        REQUIRE(cache.size() <= 10);
+    }
+    REQUIRE(ctrs.mInserts == 100);
+    REQUIRE(cache.size() + ctrs.mEvicts == 100);
+    REQUIRE(evicted == ctrs.mEvicts);
+
+    // An entry larger than the whole cache is never cached
+    cache.put(1000, 1000, 101);
+    REQUIRE(!cache.exists(1000));
+
+    // Growing an entry makes room for it
+    for (int i = 0; i < 100; ++i)
+    {
+        if (cache.exists(i, false))
+        {
+            cache.put(i, i, 60);
+            REQUIRE(cache.exists(i, false));
+            break;
+        }
+    }
+    REQUIRE(cache.bytes() <= 100);
+    REQUIRE(evicted == ctrs.mEvicts);
+
+    // Erasing and clearing are not evictions
+    auto evicts = ctrs.mEvicts;
+    cache.erase_if([](int) { return true; });
+    REQUIRE(cache.size() == 0);
+    REQUIRE(cache.bytes() == 0);
+    cache.put(1, 1, 10);
+    cache.clear();
+    REQUIRE(cache.bytes() == 0);
+    REQUIRE(ctrs.mEvicts == evicts);
+}
+
+TEST_CASE("tinylfu cache resists scans", "[tinylfucache]")
+{
+    // A working set of 80 keys, reused every 160 accesses because of a scan
+    // over keys used once, is evicted over and over by an LRU cache of 100
+    // entries but should mostly stay in a TinyLFU cache
+    size_t const sz = 100;
+    int const hot = 80;
+    TinyLFUCache<int, int> cache(sz);
+    auto access = [&](int k) {
+        if (cache.exists(k))
+        {
+            return cache.get(k) == k;
+        }
+        cache.put(k, k);
+        return false;
+    };
+
+    int scan = 1000;
+    for (int round = 0; round < 10; ++round)
+    {
+        for (int k = 0; k < hot; ++k)
+        {
+            access(k);
+            access(scan++);
+        }
+    }
+
+    size_t hits = 0;
+    for (int round = 0; round < 10; ++round)
+    {
+        for (int k = 0; k < hot; ++k)
+        {
+            hits += access(k);
+            access(scan++);
+        }
+    }
+    REQUIRE(hits >= 0.9 * 10 * hot);
+    REQUIRE(cache.size() <= sz);
+    REQUIRE(cache.getCounters().mRejects > 0);
+}
+
+TEST_CASE("tinylfu cache protects entries of small caches", "[tinylfucache]")
+{
+    // A cache of 5 entries has a window of 1 and protects 80% of the other 4
+    TinyLFUCache<int, int> cache(5);
+    for (int i = 1; i <= 5; ++i)
+    {
+        cache.put(i, i);
+    }
+    REQUIRE(cache.size() == 5);
+    REQUIRE(cache.protectedSize() == 0);
+
+    // Reading an entry on probation promotes it
+    for (int i = 2; i <= 4; ++i)
+    {
+        REQUIRE(cache.get(i) == i);
+        REQUIRE(cache.protectedSize() == static_cast<size_t>(i - 1));
+    }
+
+    // Promoting one more demotes the least recently used protected entry
+    REQUIRE(cache.get(1) == 1);
+    REQUIRE(cache.protectedSize() == 3);
+    REQUIRE(cache.size() == 5);
+}
+
 using RandCache = RandomEvictionCache<int, int>;
 using LruCache = cache::lru_cache<int, int>;
+using TinyLFU = TinyLFUCache<int, int>;
 
-TEMPLATE_TEST_CASE("cache empty", "[cache][template]", RandCache, LruCache)
+TEMPLATE_TEST_CASE("cache empty", "[cache][template]", RandCache, LruCache,
+                   TinyLFU)
 {
     TestType c{5};
 
@@ -123,7 +236,7 @@ TEMPLATE_TEST_CASE("cache empty", "[cache][template]", RandCache, LruCache)
 }
 
 TEMPLATE_TEST_CASE("cache keeps most added items", "[cache][template]",
-                   RandCache, LruCache)
+                   RandCache, LruCache, TinyLFU)
 {
     TestType c{5};
     c.put(0, 0);
@@ -151,7 +264,7 @@ TEMPLATE_TEST_CASE("cache keeps most added items", "[cache][template]",
 }
 
 TEMPLATE_TEST_CASE("cache keeps last read items", "[cache][template]",
-                   RandCache, LruCache)
+                   RandCache, LruCache, TinyLFU)
 {
     TestType c{5};
     c.put(0, 0);
@@ -175,7 +288,7 @@ TEMPLATE_TEST_CASE("cache keeps last read items", "[cache][template]",
 }
 
 TEMPLATE_TEST_CASE("cache replace element", "[cache][template]", RandCache,
-                   LruCache)
+                   LruCache, TinyLFU)
 {
     TestType c{5};
     c.put(0, 0);
@@ -191,7 +304,7 @@ TEMPLATE_TEST_CASE("cache replace element", "[cache][template]", RandCache,
 }
 
 TEMPLATE_TEST_CASE("cache erase_if removes some nodes", "[cache][template]",
-                   RandCache, LruCache)
+                   RandCache, LruCache, TinyLFU)
 {
     TestType c{5};
     c.put(0, 0);
@@ -210,7 +323,7 @@ TEMPLATE_TEST_CASE("cache erase_if removes some nodes", "[cache][template]",
 }
 
 TEMPLATE_TEST_CASE("cache erase_if removes no nodes", "[cache][template]",
-                   RandCache, LruCache)
+                   RandCache, LruCache, TinyLFU)
 {
     TestType c{5};
     c.put(0, 0);
@@ -229,7 +342,7 @@ TEMPLATE_TEST_CASE("cache erase_if removes no nodes", "[cache][template]",
 }
 
 TEMPLATE_TEST_CASE("cache erase_if removes all nodes", "[cache][template]",
-                   RandCache, LruCache)
+                   RandCache, LruCache, TinyLFU)
 {
     TestType c{5};
     c.put(0, 0);
@@ -0,0 +1,173 @@
+// Copyright 2020 Stellar Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "ledger/LedgerHashUtils.h"
+#include "ledger/test/LedgerTestUtils.h"
+#include "lib/catch.hpp"
+#include "util/Arena.h"
+#include "util/FlatHashMap.h"
+#include "util/Logging.h"
+#include "util/Math.h"
+#include "util/XDROperators.h"
+#include <chrono>
+#include <string>
+#include <unordered_map>
+
+using namespace stellar;
+
+TEST_CASE("flat hash map agrees with unordered_map", "[flathashmap]")
+{
+    FlatHashMap<uint32_t, uint32_t> flat;
+    std::unordered_map<uint32_t, uint32_t> reference;
+
+    // A small key space so that inserts, overwrites and erases of present and
+    // absent keys all happen often, and tombstones pile up
+    for (size_t i = 0; i < 100000; ++i)
+    {
+        auto key = rand_uniform<uint32_t>(0, 2000);
+        switch (rand_uniform<int>(0, 3))
+        {
+        case 0:
+        {
+            auto res = flat.emplace(key, static_cast<uint32_t>(i));
+            auto expected = reference.emplace(key, static_cast<uint32_t>(i));
+            REQUIRE(res.second == expected.second);
+            REQUIRE(res.first->second == expected.first->second);
+            break;
+        }
+        case 1:
+            flat[key] = static_cast<uint32_t>(i);
+            reference[key] = static_cast<uint32_t>(i);
+            break;
+        case 2:
+            REQUIRE(flat.erase(key) == reference.erase(key));
+            break;
+        default:
+        {
+            auto iter = flat.find(key);
+            auto expected = reference.find(key);
+            REQUIRE((iter == flat.end()) == (expected == reference.end()));
+            if (iter != flat.end())
+            {
+                REQUIRE(iter->second == expected->second);
+            }
+        }
+        }
+        REQUIRE(flat.size() == reference.size());
+    }
+
+    for (auto const& kv : flat)
+    {
+        REQUIRE(reference.at(kv.first) == kv.second);
+    }
+
+    flat.clear();
+    REQUIRE(flat.empty());
+    REQUIRE(flat.begin() == flat.end());
+    REQUIRE(flat.find(0) == flat.end());
+}
+
+TEST_CASE("flat hash map erase while iterating", "[flathashmap]")
+{
+    FlatHashMap<std::string, int> map;
+    for (int i = 0; i < 1000; ++i)
+    {
+        map.emplace(std::to_string(i), i);
+    }
+
+    size_t visited = 0;
+    for (auto iter = map.begin(); iter != map.end();)
+    {
+        ++visited;
+        if (iter->second % 3 == 0)
+        {
+            iter = map.erase(iter);
+        }
+        else
+        {
+            ++iter;
+        }
+    }
+    REQUIRE(visited == 1000);
+    REQUIRE(map.size() == 666);
+    for (int i = 0; i < 1000; ++i)
+    {
+        REQUIRE(map.count(std::to_string(i)) == (i % 3 == 0 ? 0 : 1));
+    }
+}
+
+TEST_CASE("flat hash map finds by precomputed hash", "[flathashmap]")
+{
+    auto arena = std::make_shared<Arena>();
+    typedef FlatHashMap<std::string, int, std::hash<std::string>,
+                        std::equal_to<std::string>,
+                        ArenaNodeAllocator<std::pair<std::string, int>>>
+        Map;
+    Map map{Map::allocator_type(arena)};
+    map.reserve(100);
+    auto capacity = map.capacity();
+    for (int i = 0; i < 100; ++i)
+    {
+        map.emplace(std::to_string(i), i);
+    }
+    REQUIRE(map.capacity() == capacity);
+
+    auto hasher = map.hash_function();
+    for (int i = 0; i < 100; ++i)
+    {
+        auto key = std::to_string(i);
+        auto iter = map.find(key, hasher(key));
+        REQUIRE(iter != map.end());
+        REQUIRE(iter->second == i);
+    }
+
+    Map copy(map);
+    copy.erase("7");
+    REQUIRE(map.count("7") == 1);
+    REQUIRE(copy.count("7") == 0);
+    copy.swap(map);
+    REQUIRE(map.size() == 99);
+    REQUIRE(copy.size() == 100);
+}
+
+TEST_CASE("flat hash map LedgerKey lookup benchmark",
+          "[!hide][flathashmapbench]")
+{
+    size_t const n = 100000;
+    size_t const rounds = 20;
+
+    std::vector<LedgerKey> keys;
+    keys.reserve(n);
+    for (auto const& le : LedgerTestUtils::generateValidLedgerEntries(n))
+    {
+        keys.emplace_back(LedgerEntryKey(le));
+    }
+
+    auto run = [&](auto& map, std::string const& name) {
+        auto start = std::chrono::steady_clock::now();
+        for (auto const& key : keys)
+        {
+            map[key] = nullptr;
+        }
+        size_t found = 0;
+        for (size_t r = 0; r < rounds; ++r)
+        {
+            for (auto const& key : keys)
+            {
+                found += map.find(key) != map.end();
+            }
+        }
+        auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(
+            std::chrono::steady_clock::now() - start);
+        REQUIRE(found == map.size() * rounds);
+        CLOG(INFO, "Ledger") << name << ": " << map.size() << " keys, "
+                             << rounds << " lookup rounds in "
+                             << elapsed.count() << "ms";
+    };
+
+    std::unordered_map<LedgerKey, std::shared_ptr<LedgerEntry const>> node;
+    run(node, "std::unordered_map");
+    FlatHashMap<LedgerKey, std::shared_ptr<LedgerEntry const>> flat;
+    run(flat, "FlatHashMap");
+}
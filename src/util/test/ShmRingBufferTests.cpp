@@ -0,0 +1,225 @@
+// Copyright 2020 Stellar Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#ifndef _WIN32
+
+#include "crypto/Hex.h"
+#include "crypto/Random.h"
+#include "ledger/test/LedgerTestUtils.h"
+#include "lib/catch.hpp"
+#include "util/Logging.h"
+#include "util/ShmRingBuffer.h"
+#include "util/XDRStream.h"
+#include "xdr/Stellar-ledger.h"
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <unistd.h>
+
+using namespace stellar;
+
+static std::string
+randomShmName()
+{
+    return "stellar-test-" + binToHex(randomBytes(8));
+}
+
+static LedgerCloseMeta
+makeMeta(uint32_t ledgerSeq, std::vector<LedgerEntry> const& entries)
+{
+    LedgerCloseMeta lcm;
+    lcm.v0().ledgerHeader.header.ledgerSeq = ledgerSeq;
+    if (!entries.empty())
+    {
+        lcm.v0().txProcessing.emplace_back();
+        auto& changes = lcm.v0().txProcessing.back().feeProcessing;
+        for (auto const& e : entries)
+        {
+            changes.emplace_back(LEDGER_ENTRY_CREATED);
+            changes.back().created() = e;
+        }
+    }
+    return lcm;
+}
+
+TEST_CASE("shared memory ring buffer", "[shm]")
+{
+    auto name = randomShmName();
+
+    SECTION("frames are read in order")
+    {
+        auto writer = std::make_unique<ShmRingBufferWriter>(name, 1 << 20);
+        ShmRingBufferReader reader(name);
+
+        LedgerCloseMeta lcm;
+        REQUIRE(reader.readOne(lcm) == ShmRingBufferReader::Result::EMPTY);
+        for (uint32_t seq = 1; seq <= 10; ++seq)
+        {
+            writer->writeOne(makeMeta(seq, {}));
+        }
+        for (uint32_t seq = 1; seq <= 10; ++seq)
+        {
+            REQUIRE(reader.readOne(lcm) == ShmRingBufferReader::Result::FRAME);
+            REQUIRE(lcm.v0().ledgerHeader.header.ledgerSeq == seq);
+        }
+        REQUIRE(reader.readOne(lcm) == ShmRingBufferReader::Result::EMPTY);
+
+        writer.reset();
+        REQUIRE(reader.readOne(lcm) == ShmRingBufferReader::Result::CLOSED);
+    }
+
+    SECTION("frames wrap around the buffer")
+    {
+        auto entries = LedgerTestUtils::generateValidLedgerEntries(10);
+        auto size = xdr::xdr_size(makeMeta(1, entries));
+        // Room for a bit more than 3 frames, so that they start at different
+        // offsets every time around
+        ShmRingBufferWriter writer(name, size * 3 + size / 2 + 64);
+        ShmRingBufferReader reader(name);
+
+        LedgerCloseMeta lcm;
+        for (uint32_t seq = 1; seq <= 100; ++seq)
+        {
+            writer.writeOne(makeMeta(seq, entries));
+            if (seq % 2 == 0)
+            {
+                for (auto expected : {seq - 1, seq})
+                {
+                    ShmRingBufferReader::Frame frame;
+                    REQUIRE(reader.next(frame) ==
+                            ShmRingBufferReader::Result::FRAME);
+                    REQUIRE(frame.mSequence == expected);
+                    REQUIRE(frame.mSize == size);
+                    REQUIRE(reader.stillValid());
+                }
+            }
+        }
+    }
+
+    SECTION("slow readers are overrun")
+    {
+        ShmRingBufferWriter writer(name, 4096);
+        ShmRingBufferReader reader(name);
+
+        for (uint32_t seq = 1; seq <= 1000; ++seq)
+        {
+            writer.writeOne(makeMeta(seq, {}));
+        }
+        LedgerCloseMeta lcm;
+        REQUIRE(reader.readOne(lcm) == ShmRingBufferReader::Result::OVERRUN);
+        REQUIRE(reader.readOne(lcm) == ShmRingBufferReader::Result::EMPTY);
+
+        writer.writeOne(makeMeta(1001, {}));
+        REQUIRE(reader.readOne(lcm) == ShmRingBufferReader::Result::FRAME);
+        REQUIRE(lcm.v0().ledgerHeader.header.ledgerSeq == 1001);
+    }
+
+    SECTION("frames larger than the buffer are rejected")
+    {
+        auto entries = LedgerTestUtils::generateValidLedgerEntries(100);
+        ShmRingBufferWriter writer(name, 1024);
+        REQUIRE_THROWS_AS(writer.writeOne(makeMeta(1, entries)),
+                          std::runtime_error);
+    }
+}
+
+TEST_CASE("shared memory ring buffer throughput", "[!hide][shm][bench]")
+{
+    size_t const nLedgers = 1000;
+    auto entries = LedgerTestUtils::generateValidLedgerEntries(1000);
+    std::vector<LedgerCloseMeta> metas;
+    for (uint32_t seq = 1; seq <= nLedgers; ++seq)
+    {
+        metas.emplace_back(makeMeta(seq, entries));
+    }
+    auto bytes = xdr::xdr_size(metas[0]) * nLedgers;
+
+    auto report = [&](std::string const& mode,
+                      std::chrono::steady_clock::time_point start) {
+        auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(
+            std::chrono::steady_clock::now() - start);
+        CLOG(INFO, "Fs") << "streamed " << nLedgers << " ledgers, " << bytes
+                         << " bytes over " << mode << " in "
+                         << elapsed.count() << "ms";
+    };
+
+    SECTION("fd")
+    {
+        int fds[2];
+        REQUIRE(::pipe(fds) == 0);
+        auto start = std::chrono::steady_clock::now();
+        size_t n = 0;
+        std::thread readerThread([&]() {
+            XDRInputFileStream in;
+            in.open("/dev/fd/" + std::to_string(fds[0]));
+            LedgerCloseMeta lcm;
+            while (in.readOne(lcm))
+            {
+                ++n;
+            }
+        });
+        {
+            XDROutputFileStream out(/*fsyncOnClose=*/false);
+            out.fdopen(fds[1]);
+            for (auto const& lcm : metas)
+            {
+                out.writeOne(lcm);
+                out.flush();
+            }
+        }
+        readerThread.join();
+        ::close(fds[0]);
+        report("fd", start);
+        REQUIRE(n == nLedgers);
+    }
+
+    SECTION("shm")
+    {
+        auto name = randomShmName();
+        auto writer = std::make_unique<ShmRingBufferWriter>(
+            name, xdr::xdr_size(metas[0]) * 16);
+        ShmRingBufferReader reader(name);
+        auto start = std::chrono::steady_clock::now();
+        std::atomic<size_t> n{0};
+        bool overrun = false;
+        std::thread readerThread([&]() {
+            LedgerCloseMeta lcm;
+            while (true)
+            {
+                auto res = reader.readOne(lcm);
+                if (res == ShmRingBufferReader::Result::FRAME)
+                {
+                    ++n;
+                }
+                else if (res == ShmRingBufferReader::Result::OVERRUN)
+                {
+                    overrun = true;
+                }
+                else if (res == ShmRingBufferReader::Result::CLOSED)
+                {
+                    break;
+                }
+            }
+        });
+        for (size_t i = 0; i < metas.size(); ++i)
+        {
+            // The writer never waits for readers, keep this one from being
+            // overrun so that both modes stream the same ledgers, as a pipe
+            // would
+            while (i >= n + 8)
+            {
+                std::this_thread::yield();
+            }
+            writer->writeOne(metas[i]);
+        }
+        writer.reset();
+        readerThread.join();
+        report("shm", start);
+        REQUIRE(!overrun);
+        REQUIRE(n == nLedgers);
+    }
+}
+
+#endif
@@ -11,6 +11,8 @@
 #include "util/XDRStream.h"
 
 #include <chrono>
+#include <fstream>
+#include <iterator>
 
 using namespace stellar;
 
@@ -43,6 +45,149 @@ TEST_CASE("XDROutputFileStream fail modes", "[xdrstream]")
     }
 }
 
+TEST_CASE("XDRInputMappedStream", "[xdrstream]")
+{
+    Config const& cfg = getTestConfig(0);
+    fs::mkpath(cfg.BUCKET_DIR_PATH);
+    auto filename = cfg.BUCKET_DIR_PATH + "/mapped.xdr";
+    auto copyFilename = cfg.BUCKET_DIR_PATH + "/mapped-copy.xdr";
+
+    auto ledgerEntries = LedgerTestUtils::generateValidLedgerEntries(100);
+    auto bucketEntries =
+        Bucket::convertToBucketEntry(false, {}, ledgerEntries, {});
+    auto hasher = SHA256::create();
+    size_t bytes = 0;
+    {
+        XDROutputFileStream out(/*doFsync=*/false);
+        out.open(filename);
+        for (auto const& e : bucketEntries)
+        {
+            out.writeOne(e, hasher.get(), &bytes);
+        }
+        out.close();
+    }
+
+    SECTION("objects are decoded from the mapping")
+    {
+        XDRInputMappedStream in;
+        in.open(filename);
+        REQUIRE(in.size() == bytes);
+        BucketEntry e;
+        for (auto const& expected : bucketEntries)
+        {
+            REQUIRE(in);
+            REQUIRE(in.readOne(e));
+            REQUIRE(e == expected);
+        }
+        REQUIRE(!in);
+        REQUIRE(!in.readOne(e));
+        REQUIRE(in.pos() == bytes);
+    }
+
+    SECTION("the XDR of objects is copied as is")
+    {
+        XDRInputMappedStream in;
+        in.open(filename);
+        XDROutputFileStream out(/*doFsync=*/false);
+        out.open(copyFilename);
+        auto copyHasher = SHA256::create();
+        size_t copyBytes = 0;
+        uint8_t const* data;
+        size_t size;
+        while (in.readOneXdr(data, size))
+        {
+            out.writeOneXdr(ByteSlice(data, size), copyHasher.get(),
+                            &copyBytes);
+        }
+        out.close();
+        REQUIRE(copyBytes == bytes);
+        REQUIRE(copyHasher->finish() == hasher->finish());
+        std::remove(copyFilename.c_str());
+    }
+
+    SECTION("block-compressed files hold the same objects")
+    {
+        auto compressedFilename = cfg.BUCKET_DIR_PATH + "/mapped.xdrz";
+        auto compressedHasher = SHA256::create();
+        size_t compressedBytes = 0;
+        std::vector<size_t> offsets;
+        {
+            XDROutputFileStream out(/*doFsync=*/false,
+                                    /*compressBlocks=*/true);
+            out.open(compressedFilename);
+            for (auto const& e : bucketEntries)
+            {
+                offsets.emplace_back(compressedBytes);
+                out.writeOne(e, compressedHasher.get(), &compressedBytes);
+            }
+            out.close();
+        }
+        REQUIRE(compressedBytes == bytes);
+        REQUIRE(compressedHasher->finish() == hasher->finish());
+        REQUIRE(isBlockCompressedFile(compressedFilename));
+        REQUIRE(!isBlockCompressedFile(filename));
+
+        XDRInputMappedStream in;
+        in.open(compressedFilename);
+        REQUIRE(in.size() == bytes);
+        BucketEntry e;
+        for (auto const& expected : bucketEntries)
+        {
+            REQUIRE(in.readOne(e));
+            REQUIRE(e == expected);
+        }
+        REQUIRE(!in.readOne(e));
+        REQUIRE(in.pos() == bytes);
+
+        // Positions are those of the uncompressed file
+        for (size_t i = bucketEntries.size(); i-- > 0;)
+        {
+            in.seek(offsets[i]);
+            REQUIRE(in.readOne(e));
+            REQUIRE(e == bucketEntries[i]);
+        }
+        std::remove(compressedFilename.c_str());
+    }
+
+    auto truncate = [&](size_t size) {
+        std::string contents;
+        {
+            std::ifstream in(filename, std::ios::binary);
+            contents.assign(std::istreambuf_iterator<char>(in),
+                            std::istreambuf_iterator<char>());
+        }
+        std::ofstream out(filename, std::ios::binary | std::ios::trunc);
+        out.write(contents.data(), size);
+    };
+
+    SECTION("truncated files are malformed")
+    {
+        truncate(bytes - 1);
+        XDRInputMappedStream in;
+        in.open(filename);
+        BucketEntry e;
+        REQUIRE_THROWS_AS(
+            [&]() {
+                while (in.readOne(e))
+                {
+                }
+            }(),
+            xdr::xdr_runtime_error);
+    }
+
+    SECTION("empty files have no objects")
+    {
+        truncate(0);
+        XDRInputMappedStream in;
+        in.open(filename);
+        BucketEntry e;
+        REQUIRE(!in);
+        REQUIRE(!in.readOne(e));
+    }
+
+    std::remove(filename.c_str());
+}
+
 TEST_CASE("XDROutputFileStream fsync bench", "[!hide][xdrstream][bench]")
 {
     Config const& cfg = getTestConfig(0);
@@ -91,3 +236,74 @@ TEST_CASE("XDROutputFileStream fsync bench", "[!hide][xdrstream][bench]")
                          << elapsed.count() << "ms";
     }
 }
+
+TEST_CASE("XDRInputMappedStream bench", "[!hide][xdrstream][bench]")
+{
+    Config const& cfg = getTestConfig(0);
+    fs::mkpath(cfg.BUCKET_DIR_PATH);
+    auto filename = cfg.BUCKET_DIR_PATH + "/read-bench.xdr";
+
+    auto ledgerEntries = LedgerTestUtils::generateValidLedgerEntries(1000000);
+    auto bucketEntries =
+        Bucket::convertToBucketEntry(false, {}, ledgerEntries, {});
+    size_t bytes = 0;
+    {
+        XDROutputFileStream out(/*doFsync=*/false);
+        out.open(filename);
+        for (auto const& e : bucketEntries)
+        {
+            out.writeOne(e, nullptr, &bytes);
+        }
+        out.close();
+    }
+
+    auto report = [&](std::string const& mode,
+                      std::chrono::steady_clock::time_point start) {
+        auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(
+            std::chrono::steady_clock::now() - start);
+        CLOG(INFO, "Fs") << "read " << bytes << " bytes with " << mode
+                         << " in " << elapsed.count() << "ms";
+    };
+
+    for (int i = 0; i < 5; ++i)
+    {
+        BucketEntry e;
+        size_t n = 0;
+        auto start = std::chrono::steady_clock::now();
+        {
+            XDRInputFileStream in;
+            in.open(filename);
+            while (in.readOne(e))
+            {
+                ++n;
+            }
+        }
+        report("ifstream", start);
+
+        start = std::chrono::steady_clock::now();
+        {
+            XDRInputMappedStream in;
+            in.open(filename);
+            while (in.readOne(e))
+            {
+                ++n;
+            }
+        }
+        report("mmap", start);
+
+        start = std::chrono::steady_clock::now();
+        {
+            XDRInputMappedStream in;
+            in.open(filename);
+            uint8_t const* data;
+            size_t size;
+            while (in.readOneXdr(data, size))
+            {
+                ++n;
+            }
+        }
+        report("mmap without decoding", start);
+        REQUIRE(n == 3 * bucketEntries.size());
+    }
+    std::remove(filename.c_str());
+}